@@ -0,0 +1,503 @@
+/**
+ * cachefs Implementation
+ * Persistent cache of CD-ROM file pages on an ATA disk partition
+ *
+ * The cache lives in an MBR partition of type CACHEFS_PART_TYPE:
+ *
+ *   sector 0           superblock (layout and the cached volumes)
+ *   index_start ...    index, 16 entries of 32 bytes per sector
+ *   data_start ...     one FS_PAGE_SIZE slot per index entry
+ *
+ * A page is identified by its volume (volume ID and creation date from
+ * the PVD), the extent LBA of its file and its page index. It may sit in
+ * any of CACHEFS_WAYS entries of the set its key hashes to; the entry
+ * stored longest ago is replaced. Stores write the data before the index
+ * entry, and every read is checked against the entry's CRC-32, so a torn
+ * write or a foreign disk is detected and the page is read from the
+ * CD-ROM again.
+ *
+ * Pages read by device interrupts are only copied into a small queue
+ * there; the disk writes happen in cachefs_flush(), outside the handler.
+ */
+
+#include <cachefs.h>
+#include <ide.h>
+#include <kernel.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Index entries per sector */
+#define CACHEFS_ENTRIES_PER_SECTOR  (CACHEFS_SECTOR_SIZE / sizeof(cachefs_entry_t))
+
+/* Sectors per index transfer (one page) */
+#define CACHEFS_INDEX_CHUNK         CACHEFS_PAGE_SECTORS
+
+/* Cache partition */
+static bool cachefs_present = false;
+static uint8_t cachefs_drive = 0;
+static uint32_t cachefs_base = 0;       /* First sector of the partition */
+
+/* Superblock and index (kept in memory, written through) */
+static cachefs_super_t cachefs_super;
+static cachefs_entry_t cachefs_index[CACHEFS_MAX_ENTRIES];
+static uint32_t cachefs_clock = 0;
+
+/* Pages read in interrupt context, waiting to be stored */
+typedef struct {
+    int volume;
+    uint32_t extent;
+    uint32_t page;
+    uint32_t bytes;
+    uint8_t data[FS_PAGE_SIZE];
+} cachefs_queued_t;
+
+static cachefs_queued_t cachefs_queue[CACHEFS_MAX_QUEUED];
+static uint32_t cachefs_queued = 0;
+
+/* Statistics since boot */
+static uint32_t cachefs_hits = 0;
+static uint32_t cachefs_misses = 0;
+static uint32_t cachefs_stores = 0;
+
+/* CRC-32 (IEEE 802.3) lookup table */
+static uint32_t cachefs_crc_table[256];
+
+/* Sector buffer for the MBR */
+static uint8_t cachefs_sector_buf[CACHEFS_SECTOR_SIZE];
+
+/**
+ * Build the CRC-32 lookup table
+ */
+static void cachefs_crc_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        }
+        cachefs_crc_table[i] = crc;
+    }
+}
+
+/**
+ * Compute the CRC-32 of a buffer
+ */
+static uint32_t cachefs_crc32(const uint8_t *data, uint32_t size) {
+    uint32_t crc = 0xFFFFFFFFu;
+
+    for (uint32_t i = 0; i < size; i++) {
+        crc = cachefs_crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc ^ 0xFFFFFFFFu;
+}
+
+/**
+ * Write the superblock with a fresh checksum
+ */
+static int cachefs_write_super(void) {
+    cachefs_super.checksum = cachefs_crc32((const uint8_t *)&cachefs_super,
+                                           offsetof(cachefs_super_t, checksum));
+
+    if (ide_write_sectors(cachefs_drive, cachefs_base, 1, &cachefs_super) != IDE_OK) {
+        return CACHEFS_ERR_IO;
+    }
+    return CACHEFS_OK;
+}
+
+/**
+ * Write the index sector holding an entry
+ */
+static int cachefs_write_entry(uint32_t index) {
+    uint32_t sector = index / CACHEFS_ENTRIES_PER_SECTOR;
+    cachefs_entry_t *first = &cachefs_index[sector * CACHEFS_ENTRIES_PER_SECTOR];
+
+    if (ide_write_sectors(cachefs_drive, cachefs_base + cachefs_super.index_start + sector,
+                          1, first) != IDE_OK) {
+        return CACHEFS_ERR_IO;
+    }
+    return CACHEFS_OK;
+}
+
+/**
+ * Write the whole index
+ */
+static int cachefs_write_index(void) {
+    uint32_t sectors = cachefs_super.entries / CACHEFS_ENTRIES_PER_SECTOR;
+    uint8_t *data = (uint8_t *)cachefs_index;
+
+    for (uint32_t done = 0; done < sectors; done += CACHEFS_INDEX_CHUNK) {
+        uint32_t count = sectors - done;
+        if (count > CACHEFS_INDEX_CHUNK) {
+            count = CACHEFS_INDEX_CHUNK;
+        }
+        if (ide_write_sectors(cachefs_drive, cachefs_base + cachefs_super.index_start + done,
+                              count, data + done * CACHEFS_SECTOR_SIZE) != IDE_OK) {
+            return CACHEFS_ERR_IO;
+        }
+    }
+
+    return CACHEFS_OK;
+}
+
+/**
+ * Read the whole index
+ */
+static int cachefs_read_index(void) {
+    uint32_t sectors = cachefs_super.entries / CACHEFS_ENTRIES_PER_SECTOR;
+    uint8_t *data = (uint8_t *)cachefs_index;
+
+    for (uint32_t done = 0; done < sectors; done += CACHEFS_INDEX_CHUNK) {
+        uint32_t count = sectors - done;
+        if (count > CACHEFS_INDEX_CHUNK) {
+            count = CACHEFS_INDEX_CHUNK;
+        }
+        if (ide_read_sectors(cachefs_drive, cachefs_base + cachefs_super.index_start + done,
+                             count, data + done * CACHEFS_SECTOR_SIZE) != IDE_OK) {
+            return CACHEFS_ERR_IO;
+        }
+    }
+
+    return CACHEFS_OK;
+}
+
+/**
+ * Lay out an empty cache on a partition
+ */
+static int cachefs_format(uint32_t sectors) {
+    /* Every entry costs one data slot plus 1/16 of an index sector;
+     * keep whole index sectors (which are also whole sets) */
+    uint32_t entries = (sectors - 1) / (CACHEFS_PAGE_SECTORS * CACHEFS_ENTRIES_PER_SECTOR + 1) *
+                       CACHEFS_ENTRIES_PER_SECTOR;
+    if (entries > CACHEFS_MAX_ENTRIES) {
+        entries = CACHEFS_MAX_ENTRIES;
+    }
+    if (entries < CACHEFS_ENTRIES_PER_SECTOR) {
+        return CACHEFS_ERR_NODEV;
+    }
+
+    memset(&cachefs_super, 0, sizeof(cachefs_super));
+    memcpy(cachefs_super.magic, CACHEFS_MAGIC, sizeof(cachefs_super.magic));
+    cachefs_super.version = CACHEFS_VERSION;
+    cachefs_super.entries = entries;
+    cachefs_super.index_start = 1;
+    cachefs_super.data_start = 1 + entries / CACHEFS_ENTRIES_PER_SECTOR;
+
+    memset(cachefs_index, 0, sizeof(cachefs_index));
+    if (cachefs_write_index() != CACHEFS_OK) {
+        return CACHEFS_ERR_IO;
+    }
+
+    return cachefs_write_super();
+}
+
+/**
+ * Open the cache on a partition, formatting it if it holds no valid cache
+ */
+static int cachefs_open(uint32_t sectors) {
+    if (ide_read_sectors(cachefs_drive, cachefs_base, 1, &cachefs_super) != IDE_OK) {
+        return CACHEFS_ERR_IO;
+    }
+
+    uint32_t checksum = cachefs_crc32((const uint8_t *)&cachefs_super,
+                                      offsetof(cachefs_super_t, checksum));
+    cachefs_super_t *sb = &cachefs_super;
+    bool valid = memcmp(sb->magic, CACHEFS_MAGIC, sizeof(sb->magic)) == 0 &&
+                 sb->version == CACHEFS_VERSION &&
+                 sb->checksum == checksum &&
+                 sb->entries >= CACHEFS_ENTRIES_PER_SECTOR &&
+                 sb->entries <= CACHEFS_MAX_ENTRIES &&
+                 sb->entries % CACHEFS_ENTRIES_PER_SECTOR == 0 &&
+                 sb->index_start >= 1 &&
+                 sb->data_start >= sb->index_start + sb->entries / CACHEFS_ENTRIES_PER_SECTOR &&
+                 sb->data_start + sb->entries * CACHEFS_PAGE_SECTORS <= sectors;
+
+    if (!valid || cachefs_read_index() != CACHEFS_OK) {
+        return cachefs_format(sectors);
+    }
+
+    /* Continue the store order where the last boot left it */
+    cachefs_clock = 0;
+    for (uint32_t i = 0; i < sb->entries; i++) {
+        cachefs_entry_t *entry = &cachefs_index[i];
+        if (entry->volume >= CACHEFS_MAX_VOLUMES) {
+            entry->valid = 0;
+        }
+        if (entry->valid && entry->stamp > cachefs_clock) {
+            cachefs_clock = entry->stamp;
+        }
+    }
+
+    return CACHEFS_OK;
+}
+
+/**
+ * First entry of the set a page key belongs to (FNV-1a)
+ */
+static uint32_t cachefs_set(int volume, uint32_t extent, uint32_t page) {
+    uint32_t key[3] = { (uint32_t)volume, extent, page };
+    const uint8_t *bytes = (const uint8_t *)key;
+    uint32_t hash = 2166136261u;
+
+    for (uint32_t i = 0; i < sizeof(key); i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+
+    return (hash % (cachefs_super.entries / CACHEFS_WAYS)) * CACHEFS_WAYS;
+}
+
+/**
+ * Find the entry holding a page
+ * @return Entry index, or -1 if the page is not cached
+ */
+static int cachefs_find(int volume, uint32_t extent, uint32_t page) {
+    uint32_t set = cachefs_set(volume, extent, page);
+
+    for (uint32_t i = set; i < set + CACHEFS_WAYS; i++) {
+        cachefs_entry_t *entry = &cachefs_index[i];
+        if (entry->valid && entry->volume == volume && entry->extent == extent &&
+            entry->page == page) {
+            return (int)i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Find the cache partition and load its index
+ */
+int cachefs_init(void) {
+    cachefs_crc_init();
+    cachefs_present = false;
+    cachefs_hits = 0;
+    cachefs_misses = 0;
+    cachefs_stores = 0;
+
+    for (uint8_t drive = 0; drive < IDE_MAX_DRIVES; drive++) {
+        ide_device_t *dev = ide_get_device(drive);
+        if (!dev || dev->type != IDE_TYPE_ATA) {
+            continue;
+        }
+
+        if (ide_read_sectors(drive, 0, 1, cachefs_sector_buf) != IDE_OK ||
+            !mbr_valid(cachefs_sector_buf)) {
+            continue;
+        }
+
+        const mbr_part_t *parts = mbr_partitions(cachefs_sector_buf);
+        for (int i = 0; i < MBR_PARTITIONS; i++) {
+            if (parts[i].type != CACHEFS_PART_TYPE || parts[i].sectors == 0) {
+                continue;
+            }
+
+            cachefs_drive = drive;
+            cachefs_base = parts[i].lba_first;
+            if (cachefs_open(parts[i].sectors) == CACHEFS_OK) {
+                cachefs_present = true;
+                return CACHEFS_OK;
+            }
+        }
+    }
+
+    return CACHEFS_ERR_NODEV;
+}
+
+/**
+ * Get the volume slot for a CD-ROM
+ */
+int cachefs_attach(const char *key) {
+    if (!cachefs_present || !key) {
+        return -1;
+    }
+
+    int slot = -1;
+    for (int i = 0; i < CACHEFS_MAX_VOLUMES; i++) {
+        cachefs_volume_t *volume = &cachefs_super.volumes[i];
+        if (memcmp(volume->key, key, CACHEFS_KEY_SIZE) == 0) {
+            return i;
+        }
+        if (slot < 0 && volume->key[0] == '\0') {
+            slot = i;
+        }
+    }
+
+    /* No free slot: drop the volume whose newest page is oldest */
+    if (slot < 0) {
+        uint32_t newest[CACHEFS_MAX_VOLUMES] = { 0 };
+
+        for (uint32_t i = 0; i < cachefs_super.entries; i++) {
+            cachefs_entry_t *entry = &cachefs_index[i];
+            if (entry->valid && entry->stamp > newest[entry->volume]) {
+                newest[entry->volume] = entry->stamp;
+            }
+        }
+
+        slot = 0;
+        for (int i = 1; i < CACHEFS_MAX_VOLUMES; i++) {
+            if (newest[i] < newest[slot]) {
+                slot = i;
+            }
+        }
+
+        for (uint32_t i = 0; i < cachefs_super.entries; i++) {
+            if (cachefs_index[i].volume == slot) {
+                cachefs_index[i].valid = 0;
+            }
+        }
+        if (cachefs_write_index() != CACHEFS_OK) {
+            return -1;
+        }
+    }
+
+    memcpy(cachefs_super.volumes[slot].key, key, CACHEFS_KEY_SIZE);
+    if (cachefs_write_super() != CACHEFS_OK) {
+        return -1;
+    }
+
+    return slot;
+}
+
+/**
+ * Read a cached file page
+ */
+int cachefs_read(int volume, uint32_t extent, uint32_t page, uint8_t *buffer, uint32_t bytes) {
+    if (!cachefs_present || volume < 0 || volume >= CACHEFS_MAX_VOLUMES ||
+        !buffer || bytes == 0 || bytes > FS_PAGE_SIZE) {
+        return CACHEFS_ERR_MISS;
+    }
+
+    int index = cachefs_find(volume, extent, page);
+    if (index < 0 || cachefs_index[index].bytes != bytes) {
+        cachefs_misses++;
+        return CACHEFS_ERR_MISS;
+    }
+
+    cachefs_entry_t *entry = &cachefs_index[index];
+    uint32_t lba = cachefs_base + cachefs_super.data_start + index * CACHEFS_PAGE_SECTORS;
+    uint8_t count = (bytes + CACHEFS_SECTOR_SIZE - 1) / CACHEFS_SECTOR_SIZE;
+
+    if (ide_read_sectors(cachefs_drive, lba, count, buffer) != IDE_OK ||
+        cachefs_crc32(buffer, bytes) != entry->checksum) {
+        /* Bad copy: forget it and go to the CD-ROM */
+        entry->valid = 0;
+        cachefs_write_entry(index);
+        cachefs_misses++;
+        return CACHEFS_ERR_MISS;
+    }
+
+    cachefs_hits++;
+    return CACHEFS_OK;
+}
+
+/**
+ * Store a file page read from the CD-ROM
+ */
+int cachefs_store(int volume, uint32_t extent, uint32_t page, const uint8_t *buffer, uint32_t bytes) {
+    if (!cachefs_present || volume < 0 || volume >= CACHEFS_MAX_VOLUMES) {
+        return CACHEFS_ERR_NODEV;
+    }
+
+    if (!buffer || bytes == 0 || bytes > FS_PAGE_SIZE) {
+        return CACHEFS_ERR_MISS;
+    }
+
+    /* Reuse the page's entry, else a free way, else the oldest one */
+    int index = cachefs_find(volume, extent, page);
+    if (index < 0) {
+        uint32_t set = cachefs_set(volume, extent, page);
+        index = (int)set;
+        for (uint32_t i = set; i < set + CACHEFS_WAYS; i++) {
+            if (!cachefs_index[i].valid) {
+                index = (int)i;
+                break;
+            }
+            if (cachefs_index[i].stamp < cachefs_index[index].stamp) {
+                index = (int)i;
+            }
+        }
+    }
+
+    /* Data first: until the entry is rewritten, the old checksum no
+     * longer matches and the slot reads as a miss */
+    uint32_t lba = cachefs_base + cachefs_super.data_start + index * CACHEFS_PAGE_SECTORS;
+    uint8_t count = (bytes + CACHEFS_SECTOR_SIZE - 1) / CACHEFS_SECTOR_SIZE;
+    if (ide_write_sectors(cachefs_drive, lba, count, buffer) != IDE_OK) {
+        return CACHEFS_ERR_IO;
+    }
+
+    cachefs_entry_t *entry = &cachefs_index[index];
+    memset(entry, 0, sizeof(cachefs_entry_t));
+    entry->extent = extent;
+    entry->page = page;
+    entry->bytes = bytes;
+    entry->checksum = cachefs_crc32(buffer, bytes);
+    entry->stamp = ++cachefs_clock;
+    entry->volume = (uint8_t)volume;
+    entry->valid = 1;
+
+    cachefs_stores++;
+    return cachefs_write_entry(index);
+}
+
+/**
+ * Queue a file page for storing later
+ */
+int cachefs_queue_store(int volume, uint32_t extent, uint32_t page, const uint8_t *buffer,
+                        uint32_t bytes) {
+    if (!cachefs_present || volume < 0 || volume >= CACHEFS_MAX_VOLUMES) {
+        return CACHEFS_ERR_NODEV;
+    }
+
+    if (!buffer || bytes == 0 || bytes > FS_PAGE_SIZE || cachefs_queued >= CACHEFS_MAX_QUEUED) {
+        return CACHEFS_ERR_MISS;
+    }
+
+    cachefs_queued_t *slot = &cachefs_queue[cachefs_queued++];
+    slot->volume = volume;
+    slot->extent = extent;
+    slot->page = page;
+    slot->bytes = bytes;
+    memcpy(slot->data, buffer, bytes);
+    return CACHEFS_OK;
+}
+
+/**
+ * Write the queued pages to the disk
+ */
+void cachefs_flush(void) {
+    /* Interrupts stay disabled in the kernel, so the queue cannot grow
+     * while it is written */
+    for (uint32_t i = 0; i < cachefs_queued; i++) {
+        cachefs_queued_t *slot = &cachefs_queue[i];
+        cachefs_store(slot->volume, slot->extent, slot->page, slot->data, slot->bytes);
+    }
+    cachefs_queued = 0;
+}
+
+/**
+ * Get cache status
+ */
+void cachefs_get_info(cachefs_info_t *info) {
+    if (!info) {
+        return;
+    }
+
+    memset(info, 0, sizeof(cachefs_info_t));
+    info->present = cachefs_present;
+    info->hits = cachefs_hits;
+    info->misses = cachefs_misses;
+    info->stores = cachefs_stores;
+
+    if (!cachefs_present) {
+        return;
+    }
+
+    info->drive = cachefs_drive;
+    info->entries = cachefs_super.entries;
+    for (uint32_t i = 0; i < cachefs_super.entries; i++) {
+        if (cachefs_index[i].valid) {
+            info->used++;
+        }
+    }
+}
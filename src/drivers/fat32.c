@@ -0,0 +1,1979 @@
+/**
+ * FAT32 Filesystem Driver
+ * Read/write FAT32 volumes on ATA disks
+ *
+ * Metadata is kept in memory so that file I/O goes to the disk for file
+ * data only:
+ *
+ *   - FAT and directory sectors live in a write-back sector cache. Dirty
+ *     sectors are written when a file is closed, after a directory has
+ *     changed, or when they are evicted; FAT sectors go to every FAT copy.
+ *   - A free-cluster bitmap is built from the FAT at mount time, so
+ *     allocation never scans the FAT.
+ *   - A file that is read or written gets a map of its cluster runs. A
+ *     file offset becomes a disk sector through a binary search over the
+ *     runs, and each run is transferred with multi-sector commands.
+ *   - Size and first cluster changes are kept with the run map and copied
+ *     to the directory entry on sync, so many writes cost one entry update.
+ *
+ * Nodes are identified by the position of their short directory entry
+ * (sector relative to the volume * 16 + slot); the root directory is 0.
+ */
+
+#include <fat32.h>
+#include <ide.h>
+#include <mbr.h>
+#include <string.h>
+
+/* Position in a directory */
+typedef struct {
+    uint32_t cluster;           /* Cluster holding the slot */
+    uint32_t slot;              /* Slot index within the directory */
+    bool end;                   /* Past the last cluster */
+} fat32_dirpos_t;
+
+/* Directory entry found by fat32_dir_next() */
+typedef struct {
+    char name[FS_MAX_NAME];     /* Long name, or the 8.3 name */
+    fat32_dirent_t entry;       /* Copy of the short entry */
+    uint32_t inode;             /* Position of the short entry */
+    fat32_dirpos_t first;       /* First slot (long name entries included) */
+    fat32_dirpos_t last;        /* Slot of the short entry */
+} fat32_found_t;
+
+/* Sector cache entry (FAT, directory and FSInfo sectors) */
+typedef struct {
+    fat32_volume_t *vol;        /* Volume, NULL if the slot is free */
+    uint32_t lba;               /* Sector */
+    uint32_t lru;               /* Last use stamp (higher is more recent) */
+    bool dirty;                 /* Modified since read */
+} fat32_cache_t;
+
+/* Per-volume state, one slot per IDE drive (nodes point to theirs) */
+static fat32_volume_t fat32_volumes[IDE_MAX_DRIVES];
+
+/* Free-cluster bitmaps, handed to volumes at mount time */
+static uint32_t fat32_bitmaps[FAT32_MAX_VOLUMES][FAT32_MAX_CLUSTERS / 32];
+
+/* Sector cache */
+static fat32_cache_t fat32_cache[FAT32_CACHE_SECTORS];
+static uint8_t fat32_cache_data[FAT32_CACHE_SECTORS][FAT32_SECTOR_SIZE];
+static uint32_t fat32_cache_clock = 0;
+
+/* Files with cluster-run maps */
+static fat32_file_t fat32_files[FAT32_MAX_FILES];
+static uint32_t fat32_file_clock = 0;
+
+/* Sector buffer for partial sector transfers and boot sectors */
+static uint8_t fat32_sector_buf[FAT32_SECTOR_SIZE];
+
+/* Multi-sector buffer for FAT scans and zero fills */
+static uint8_t fat32_io_buf[8 * FAT32_SECTOR_SIZE];
+
+/* Scratch entries for directory scans (too large for the stack) */
+static fat32_found_t fat32_found;
+static char fat32_lfn_buf[FAT32_MAX_LFN_ENTRIES * FAT32_LFN_CHARS + 1];
+
+/* readdir position, so listing a directory in order is linear */
+static struct {
+    fat32_volume_t *vol;        /* Volume, NULL if invalid */
+    uint32_t dir;               /* First cluster of the directory */
+    uint32_t index;             /* Index of the next visible entry */
+    fat32_dirpos_t pos;         /* Slot of the next visible entry */
+} fat32_cursor;
+
+/* Node for finddir/create results (the VFS path cache keeps its own copy) */
+static fs_node_t fat32_found_node;
+
+/* Static directory entry for readdir */
+static dirent_t fat32_dirent;
+
+/* Filesystem type for registration */
+static filesystem_t fat32_fstype = {
+    .name = "fat32",
+    .mount = fat32_mount,
+    .unmount = fat32_unmount,
+    .usage = fat32_usage
+};
+
+/* Forward declarations */
+static int fat32_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
+static int fat32_write(fs_node_t *node, uint32_t offset, uint32_t size, const uint8_t *buffer);
+static int fat32_truncate(fs_node_t *node, uint32_t length);
+static void fat32_close(fs_node_t *node);
+static dirent_t *fat32_readdir(fs_node_t *node, uint32_t index);
+static fs_node_t *fat32_finddir(fs_node_t *node, const char *name);
+static fs_node_t *fat32_create(fs_node_t *node, const char *name, uint32_t type);
+static int fat32_unlink(fs_node_t *node, const char *name);
+static int fat32_sync_volume(fat32_volume_t *vol);
+
+/**
+ * Read sectors in FAT32_IO_SECTORS transfers
+ */
+static int fat32_disk_read(fat32_volume_t *vol, uint32_t lba, uint32_t count, uint8_t *buffer) {
+    while (count > 0) {
+        uint32_t chunk = (count > FAT32_IO_SECTORS) ? FAT32_IO_SECTORS : count;
+        if (ide_read_sectors(vol->drive, lba, chunk, buffer) != IDE_OK) {
+            return FS_ERR_IO;
+        }
+        fs_account_sectors(chunk);
+
+        lba += chunk;
+        buffer += chunk * FAT32_SECTOR_SIZE;
+        count -= chunk;
+    }
+
+    return FS_OK;
+}
+
+/**
+ * Write sectors in FAT32_IO_SECTORS transfers
+ */
+static int fat32_disk_write(fat32_volume_t *vol, uint32_t lba, uint32_t count, const uint8_t *buffer) {
+    while (count > 0) {
+        uint32_t chunk = (count > FAT32_IO_SECTORS) ? FAT32_IO_SECTORS : count;
+        if (ide_write_sectors(vol->drive, lba, chunk, buffer) != IDE_OK) {
+            return FS_ERR_IO;
+        }
+
+        lba += chunk;
+        buffer += chunk * FAT32_SECTOR_SIZE;
+        count -= chunk;
+    }
+
+    return FS_OK;
+}
+
+/**
+ * Fill sectors with zeros
+ */
+static int fat32_disk_zero(fat32_volume_t *vol, uint32_t lba, uint32_t count) {
+    uint32_t per_write = sizeof(fat32_io_buf) / FAT32_SECTOR_SIZE;
+
+    memset(fat32_io_buf, 0, sizeof(fat32_io_buf));
+    while (count > 0) {
+        uint32_t chunk = (count > per_write) ? per_write : count;
+        if (fat32_disk_write(vol, lba, chunk, fat32_io_buf) != FS_OK) {
+            return FS_ERR_IO;
+        }
+        lba += chunk;
+        count -= chunk;
+    }
+
+    return FS_OK;
+}
+
+/**
+ * Write a cached sector back (FAT sectors to every FAT copy)
+ */
+static int fat32_cache_write_back(fat32_cache_t *entry) {
+    fat32_volume_t *vol = entry->vol;
+    const uint8_t *data = fat32_cache_data[entry - fat32_cache];
+
+    if (fat32_disk_write(vol, entry->lba, 1, data) != FS_OK) {
+        return FS_ERR_IO;
+    }
+
+    if (entry->lba >= vol->fat_start && entry->lba < vol->fat_start + vol->fat_size) {
+        for (uint32_t i = 1; i < vol->fat_count; i++) {
+            if (fat32_disk_write(vol, entry->lba + i * vol->fat_size, 1, data) != FS_OK) {
+                return FS_ERR_IO;
+            }
+        }
+    }
+
+    entry->dirty = false;
+    return FS_OK;
+}
+
+/**
+ * Get a sector through the cache
+ * @param dirty: The caller modifies the sector
+ * @return Sector data, or NULL on a disk error
+ */
+static uint8_t *fat32_cache_get(fat32_volume_t *vol, uint32_t lba, bool dirty) {
+    fat32_cache_t *victim = NULL;
+
+    for (int i = 0; i < FAT32_CACHE_SECTORS; i++) {
+        fat32_cache_t *entry = &fat32_cache[i];
+        if (entry->vol == vol && entry->lba == lba) {
+            entry->lru = ++fat32_cache_clock;
+            entry->dirty |= dirty;
+            return fat32_cache_data[i];
+        }
+
+        /* Free slots first, then the least recently used */
+        if (!victim || (victim->vol && (!entry->vol || entry->lru < victim->lru))) {
+            victim = entry;
+        }
+    }
+
+    if (victim->vol && victim->dirty && fat32_cache_write_back(victim) != FS_OK) {
+        return NULL;
+    }
+
+    uint8_t *data = fat32_cache_data[victim - fat32_cache];
+    victim->vol = NULL;
+    if (fat32_disk_read(vol, lba, 1, data) != FS_OK) {
+        return NULL;
+    }
+
+    victim->vol = vol;
+    victim->lba = lba;
+    victim->lru = ++fat32_cache_clock;
+    victim->dirty = dirty;
+    return data;
+}
+
+/**
+ * Write back all dirty sectors of a volume, FAT sectors first so that
+ * directory entries never point at clusters the FAT does not hold yet
+ */
+static int fat32_cache_flush(fat32_volume_t *vol) {
+    int result = FS_OK;
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < FAT32_CACHE_SECTORS; i++) {
+            fat32_cache_t *entry = &fat32_cache[i];
+            if (entry->vol != vol || !entry->dirty) {
+                continue;
+            }
+
+            bool fat = entry->lba >= vol->fat_start && entry->lba < vol->fat_start + vol->fat_size;
+            if (fat == (pass == 0) && fat32_cache_write_back(entry) != FS_OK) {
+                result = FS_ERR_IO;
+            }
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Drop cached sectors of a range without writing them
+ * Used for clusters of freed directories, which may be reused for data.
+ */
+static void fat32_cache_discard(fat32_volume_t *vol, uint32_t lba, uint32_t count) {
+    for (int i = 0; i < FAT32_CACHE_SECTORS; i++) {
+        fat32_cache_t *entry = &fat32_cache[i];
+        if (entry->vol == vol && entry->lba >= lba && entry->lba < lba + count) {
+            entry->vol = NULL;
+            entry->dirty = false;
+        }
+    }
+}
+
+/**
+ * First sector of a cluster
+ */
+static inline uint32_t fat32_cluster_lba(fat32_volume_t *vol, uint32_t cluster) {
+    return vol->data_start + (cluster - FAT32_FIRST_CLUSTER) * vol->cluster_sectors;
+}
+
+/**
+ * Bytes per cluster
+ */
+static inline uint32_t fat32_cluster_bytes(fat32_volume_t *vol) {
+    return vol->cluster_sectors * FAT32_SECTOR_SIZE;
+}
+
+/**
+ * Check whether a FAT value ends a chain (end marker, bad or free cluster)
+ */
+static inline bool fat32_chain_end(fat32_volume_t *vol, uint32_t value) {
+    return value < FAT32_FIRST_CLUSTER || value >= vol->cluster_count + FAT32_FIRST_CLUSTER;
+}
+
+/**
+ * Read the FAT entry of a cluster
+ */
+static int fat32_fat_get(fat32_volume_t *vol, uint32_t cluster, uint32_t *value) {
+    uint32_t offset = cluster * 4;
+    uint8_t *data = fat32_cache_get(vol, vol->fat_start + offset / FAT32_SECTOR_SIZE, false);
+    if (!data) {
+        return FS_ERR_IO;
+    }
+
+    *value = *(uint32_t *)(data + offset % FAT32_SECTOR_SIZE) & FAT32_CLUSTER_MASK;
+    return FS_OK;
+}
+
+/**
+ * Write the FAT entry of a cluster (the reserved top bits are kept)
+ */
+static int fat32_fat_set(fat32_volume_t *vol, uint32_t cluster, uint32_t value) {
+    uint32_t offset = cluster * 4;
+    uint8_t *data = fat32_cache_get(vol, vol->fat_start + offset / FAT32_SECTOR_SIZE, true);
+    if (!data) {
+        return FS_ERR_IO;
+    }
+
+    uint32_t *entry = (uint32_t *)(data + offset % FAT32_SECTOR_SIZE);
+    *entry = (*entry & ~FAT32_CLUSTER_MASK) | (value & FAT32_CLUSTER_MASK);
+    return FS_OK;
+}
+
+/**
+ * Check whether a cluster is allocated (clusters past the bitmap count
+ * as allocated, so they are never handed out)
+ */
+static inline bool fat32_cluster_used(fat32_volume_t *vol, uint32_t cluster) {
+    uint32_t bit = cluster - FAT32_FIRST_CLUSTER;
+
+    if (cluster < FAT32_FIRST_CLUSTER || bit >= vol->tracked) {
+        return true;
+    }
+    return (vol->bitmap[bit / 32] & (1u << (bit % 32))) != 0;
+}
+
+/**
+ * Mark a run of clusters allocated or free in the bitmap
+ */
+static void fat32_mark(fat32_volume_t *vol, uint32_t start, uint32_t count, bool used) {
+    for (uint32_t cluster = start; cluster < start + count; cluster++) {
+        uint32_t bit = cluster - FAT32_FIRST_CLUSTER;
+        if (cluster < FAT32_FIRST_CLUSTER || bit >= vol->tracked) {
+            continue;
+        }
+
+        if (used) {
+            vol->bitmap[bit / 32] |= 1u << (bit % 32);
+            vol->free_count--;
+        } else {
+            vol->bitmap[bit / 32] &= ~(1u << (bit % 32));
+            vol->free_count++;
+        }
+    }
+
+    vol->fsinfo_dirty = true;
+}
+
+/**
+ * Search part of the bitmap for free clusters
+ * @return Length of the first run of want clusters, else of the longest
+ *         run found (at most want), with its first cluster in *start
+ */
+static uint32_t fat32_scan_run(fat32_volume_t *vol, uint32_t from, uint32_t to,
+                               uint32_t want, uint32_t *start) {
+    uint32_t best_len = 0;
+    uint32_t bit = from;
+
+    while (bit < to) {
+        /* Skip fully allocated bitmap words */
+        if (bit % 32 == 0 && vol->bitmap[bit / 32] == 0xFFFFFFFF) {
+            bit += 32;
+            continue;
+        }
+
+        if (vol->bitmap[bit / 32] & (1u << (bit % 32))) {
+            bit++;
+            continue;
+        }
+
+        uint32_t run_start = bit;
+        while (bit < to && !(vol->bitmap[bit / 32] & (1u << (bit % 32))) &&
+               bit - run_start < want) {
+            bit++;
+        }
+
+        uint32_t len = bit - run_start;
+        if (len > best_len) {
+            best_len = len;
+            *start = run_start + FAT32_FIRST_CLUSTER;
+            if (len == want) {
+                break;
+            }
+        }
+    }
+
+    return best_len;
+}
+
+/**
+ * Find free clusters for a new run, starting at the allocation hint
+ * Takes the first run of want clusters, otherwise the longest free run.
+ * @return Run length (at most want), 0 if the volume is full
+ */
+static uint32_t fat32_find_run(fat32_volume_t *vol, uint32_t want, uint32_t *start) {
+    uint32_t hint = vol->next_free - FAT32_FIRST_CLUSTER;
+    if (vol->next_free < FAT32_FIRST_CLUSTER || hint >= vol->tracked) {
+        hint = 0;
+    }
+
+    uint32_t len = fat32_scan_run(vol, hint, vol->tracked, want, start);
+    if (len < want && hint > 0) {
+        uint32_t wrap_start;
+        uint32_t wrap_len = fat32_scan_run(vol, 0, hint, want, &wrap_start);
+        if (wrap_len > len) {
+            len = wrap_len;
+            *start = wrap_start;
+        }
+    }
+
+    return len;
+}
+
+/**
+ * Free a cluster chain
+ * @param dir: The chain held a directory (its cached sectors are dropped)
+ */
+static int fat32_free_chain(fat32_volume_t *vol, uint32_t cluster, bool dir) {
+    uint32_t limit = vol->cluster_count;
+
+    while (!fat32_chain_end(vol, cluster) && limit-- > 0) {
+        uint32_t next;
+        if (fat32_fat_get(vol, cluster, &next) != FS_OK ||
+            fat32_fat_set(vol, cluster, 0) != FS_OK) {
+            return FS_ERR_IO;
+        }
+
+        fat32_mark(vol, cluster, 1, false);
+        if (dir) {
+            fat32_cache_discard(vol, fat32_cluster_lba(vol, cluster), vol->cluster_sectors);
+        }
+        cluster = next;
+    }
+
+    return FS_OK;
+}
+
+/**
+ * Chain a run of newly allocated clusters and append it after last
+ * The run is linked internally before it is attached.
+ * @param last: Last cluster of the chain, 0 to start a new chain
+ */
+static int fat32_link_run(fat32_volume_t *vol, uint32_t last, uint32_t start, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t value = (i + 1 < count) ? start + i + 1 : FAT32_CLUSTER_LAST;
+        if (fat32_fat_set(vol, start + i, value) != FS_OK) {
+            return FS_ERR_IO;
+        }
+    }
+
+    if (last && fat32_fat_set(vol, last, start) != FS_OK) {
+        return FS_ERR_IO;
+    }
+
+    return FS_OK;
+}
+
+/**
+ * Allocate one zeroed cluster for a directory
+ * @return Cluster number, or 0 if the volume is full or a write failed
+ */
+static uint32_t fat32_alloc_dir_cluster(fat32_volume_t *vol) {
+    uint32_t cluster;
+
+    if (fat32_find_run(vol, 1, &cluster) == 0) {
+        return 0;
+    }
+
+    fat32_mark(vol, cluster, 1, true);
+    if (fat32_disk_zero(vol, fat32_cluster_lba(vol, cluster), vol->cluster_sectors) != FS_OK ||
+        fat32_link_run(vol, 0, cluster, 1) != FS_OK) {
+        fat32_mark(vol, cluster, 1, false);
+        return 0;
+    }
+
+    vol->next_free = cluster + 1;
+    return cluster;
+}
+
+/**
+ * Get the short directory entry at a node position through the cache
+ */
+static fat32_dirent_t *fat32_entry_at(fat32_volume_t *vol, uint32_t inode, bool dirty) {
+    uint8_t *data = fat32_cache_get(vol, vol->lba_start + inode / FAT32_ENTRIES_PER_SECTOR, dirty);
+    if (!data) {
+        return NULL;
+    }
+
+    return (fat32_dirent_t *)data + inode % FAT32_ENTRIES_PER_SECTOR;
+}
+
+/**
+ * First cluster recorded in a short entry
+ */
+static inline uint32_t fat32_entry_cluster(const fat32_dirent_t *entry) {
+    return ((uint32_t)entry->cluster_high << 16) | entry->cluster_low;
+}
+
+/**
+ * Record the first cluster in a short entry
+ */
+static inline void fat32_entry_set_cluster(fat32_dirent_t *entry, uint32_t cluster) {
+    entry->cluster_high = (uint16_t)(cluster >> 16);
+    entry->cluster_low = (uint16_t)cluster;
+}
+
+/**
+ * Find the file with a run map for a node position
+ */
+static fat32_file_t *fat32_file_find(fat32_volume_t *vol, uint32_t inode) {
+    for (int i = 0; i < FAT32_MAX_FILES; i++) {
+        fat32_file_t *file = &fat32_files[i];
+        if (file->used && file->vol == vol && file->inode == inode) {
+            return file;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Copy a file's size and first cluster to its directory entry (cached)
+ */
+static int fat32_file_store(fat32_file_t *file) {
+    fat32_dirent_t *entry = fat32_entry_at(file->vol, file->inode, true);
+    if (!entry) {
+        return FS_ERR_IO;
+    }
+
+    entry->size = file->size;
+    fat32_entry_set_cluster(entry, file->first_cluster);
+    entry->attr |= FAT32_ATTR_ARCHIVE;
+    file->dirty = false;
+    return FS_OK;
+}
+
+/**
+ * Append clusters to a file's run map
+ * Runs only describe a prefix of the chain: once the map is full, later
+ * clusters are found by walking the FAT.
+ */
+static void fat32_file_add_run(fat32_file_t *file, uint32_t file_cluster,
+                               uint32_t disk_cluster, uint32_t count) {
+    if (file->run_count > 0) {
+        fat32_run_t *last = &file->runs[file->run_count - 1];
+        if (last->file_cluster + last->count != file_cluster) {
+            return;
+        }
+        if (last->disk_cluster + last->count == disk_cluster) {
+            last->count += count;
+            return;
+        }
+    } else if (file_cluster != 0) {
+        return;
+    }
+
+    if (file->run_count < FAT32_MAX_RUNS) {
+        fat32_run_t *run = &file->runs[file->run_count++];
+        run->file_cluster = file_cluster;
+        run->disk_cluster = disk_cluster;
+        run->count = count;
+    }
+}
+
+/**
+ * Build the run map of a file by walking its chain once
+ */
+static int fat32_file_map(fat32_file_t *file) {
+    fat32_volume_t *vol = file->vol;
+    uint32_t cluster = file->first_cluster;
+
+    file->run_count = 0;
+    file->clusters = 0;
+    file->last_cluster = 0;
+    file->walk_index = 0;
+    file->walk_cluster = 0;
+
+    while (!fat32_chain_end(vol, cluster)) {
+        if (file->clusters >= vol->cluster_count) {
+            return FS_ERR_IO;       /* Chain loops */
+        }
+
+        fat32_file_add_run(file, file->clusters, cluster, 1);
+        file->clusters++;
+        file->last_cluster = cluster;
+
+        if (fat32_fat_get(vol, cluster, &cluster) != FS_OK) {
+            return FS_ERR_IO;
+        }
+    }
+
+    return FS_OK;
+}
+
+/**
+ * Get the file state of a node, mapping the file on first use
+ * @return File, or NULL if the node is not a FAT32 file or on a disk error
+ */
+static fat32_file_t *fat32_file_open(fs_node_t *node) {
+    fat32_volume_t *vol = (fat32_volume_t *)node->private_data;
+    if (!vol || !vol->mounted || (node->flags & 0x07) != FS_FILE) {
+        return NULL;
+    }
+
+    fat32_file_t *file = fat32_file_find(vol, node->inode);
+    if (file) {
+        file->lru = ++fat32_file_clock;
+        return file;
+    }
+
+    /* Free slot, else the least recently used file */
+    for (int i = 0; i < FAT32_MAX_FILES; i++) {
+        fat32_file_t *slot = &fat32_files[i];
+        if (!file || (file->used && (!slot->used || slot->lru < file->lru))) {
+            file = slot;
+        }
+    }
+
+    if (file->used && file->dirty && fat32_file_store(file) != FS_OK) {
+        return NULL;
+    }
+
+    memset(file, 0, sizeof(fat32_file_t));
+    file->vol = vol;
+    file->inode = node->inode;
+    file->first_cluster = node->impl;
+    file->size = node->length;
+    if (fat32_file_map(file) != FS_OK) {
+        return NULL;
+    }
+
+    file->lru = ++fat32_file_clock;
+    file->used = true;
+    return file;
+}
+
+/**
+ * Find the disk cluster holding a cluster of a file
+ * @param index: Cluster index within the file
+ * @param contig: Set to the number of clusters contiguous from there
+ * @return Disk cluster, or 0 past the end of the chain or on a disk error
+ */
+static uint32_t fat32_file_cluster(fat32_file_t *file, uint32_t index, uint32_t *contig) {
+    uint32_t low = 0;
+    uint32_t high = file->run_count;
+
+    /* Binary search for the first run ending past index */
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+        if (file->runs[mid].file_cluster + file->runs[mid].count <= index) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    if (low < file->run_count) {
+        fat32_run_t *run = &file->runs[low];
+        *contig = run->count - (index - run->file_cluster);
+        return run->disk_cluster + (index - run->file_cluster);
+    }
+
+    if (file->run_count == 0 || index >= file->clusters) {
+        return 0;
+    }
+
+    /* Past the map: walk the FAT from the end of the last run, or from
+     * the previous walk if that is closer */
+    fat32_run_t *last = &file->runs[file->run_count - 1];
+    uint32_t at = last->file_cluster + last->count - 1;
+    uint32_t cluster = last->disk_cluster + last->count - 1;
+    if (file->walk_cluster && file->walk_index > at && file->walk_index <= index) {
+        at = file->walk_index;
+        cluster = file->walk_cluster;
+    }
+
+    while (at < index) {
+        if (fat32_fat_get(file->vol, cluster, &cluster) != FS_OK ||
+            fat32_chain_end(file->vol, cluster)) {
+            return 0;
+        }
+        at++;
+    }
+
+    file->walk_index = at;
+    file->walk_cluster = cluster;
+    *contig = 1;
+    return cluster;
+}
+
+/**
+ * Free clusters from the end of a file until it holds keep clusters
+ */
+static int fat32_file_shrink(fat32_file_t *file, uint32_t keep) {
+    fat32_volume_t *vol = file->vol;
+    uint32_t cut;
+
+    if (keep >= file->clusters) {
+        return FS_OK;
+    }
+
+    if (keep == 0) {
+        cut = file->first_cluster;
+        file->first_cluster = 0;
+        file->last_cluster = 0;
+        file->dirty = true;
+    } else {
+        uint32_t contig;
+        uint32_t last = fat32_file_cluster(file, keep - 1, &contig);
+        if (!last || fat32_fat_get(vol, last, &cut) != FS_OK ||
+            fat32_fat_set(vol, last, FAT32_CLUSTER_LAST) != FS_OK) {
+            return FS_ERR_IO;
+        }
+        file->last_cluster = last;
+    }
+
+    /* Trim the run map */
+    while (file->run_count > 0 && file->runs[file->run_count - 1].file_cluster >= keep) {
+        file->run_count--;
+    }
+    if (file->run_count > 0) {
+        fat32_run_t *run = &file->runs[file->run_count - 1];
+        if (run->file_cluster + run->count > keep) {
+            run->count = keep - run->file_cluster;
+        }
+    }
+    file->clusters = keep;
+    file->walk_index = 0;
+    file->walk_cluster = 0;
+
+    return fat32_free_chain(vol, cut, false);
+}
+
+/**
+ * Allocate clusters at the end of a file until it holds need clusters
+ * The chain is extended in place while the following clusters are free;
+ * otherwise the next free run of the missing length is taken.
+ * @return FS_OK, FS_ERR_NOSPACE or FS_ERR_IO (the file keeps its old clusters)
+ */
+static int fat32_file_grow(fat32_file_t *file, uint32_t need) {
+    fat32_volume_t *vol = file->vol;
+    uint32_t had = file->clusters;
+    int result = FS_OK;
+
+    while (file->clusters < need) {
+        uint32_t want = need - file->clusters;
+        uint32_t start = 0;
+        uint32_t count = 0;
+
+        if (file->last_cluster) {
+            start = file->last_cluster + 1;
+            while (count < want && !fat32_cluster_used(vol, start + count)) {
+                count++;
+            }
+        }
+
+        if (count == 0) {
+            count = fat32_find_run(vol, want, &start);
+            if (count == 0) {
+                result = FS_ERR_NOSPACE;
+                break;
+            }
+        }
+
+        fat32_mark(vol, start, count, true);
+        if (fat32_link_run(vol, file->last_cluster, start, count) != FS_OK) {
+            fat32_mark(vol, start, count, false);
+            result = FS_ERR_IO;
+            break;
+        }
+
+        if (!file->first_cluster) {
+            file->first_cluster = start;
+            file->dirty = true;
+        }
+        fat32_file_add_run(file, file->clusters, start, count);
+        file->clusters += count;
+        file->last_cluster = start + count - 1;
+        vol->next_free = start + count;
+    }
+
+    if (result != FS_OK) {
+        fat32_file_shrink(file, had);
+    }
+
+    return result;
+}
+
+/**
+ * Copy a byte range of a file, one cluster run at a time
+ * The range must lie within the allocated clusters. Whole sectors move
+ * straight between the disk and the buffer; partial sectors go through
+ * fat32_sector_buf.
+ * @param out: Buffer to read into, or NULL
+ * @param in: Data to write, or NULL (with out also NULL: fill with zeros)
+ */
+static int fat32_file_io(fat32_file_t *file, uint32_t offset, uint32_t size,
+                         uint8_t *out, const uint8_t *in) {
+    fat32_volume_t *vol = file->vol;
+    uint32_t cluster_bytes = fat32_cluster_bytes(vol);
+
+    while (size > 0) {
+        uint32_t contig;
+        uint32_t cluster = fat32_file_cluster(file, offset / cluster_bytes, &contig);
+        if (!cluster) {
+            return FS_ERR_IO;
+        }
+
+        /* Bytes of the run from offset on, limited to the request */
+        uint32_t skip = offset % cluster_bytes;
+        uint32_t chunk = size;
+        if (contig <= size / cluster_bytes && contig * cluster_bytes - skip < chunk) {
+            chunk = contig * cluster_bytes - skip;
+        }
+
+        uint32_t lba = fat32_cluster_lba(vol, cluster) + skip / FAT32_SECTOR_SIZE;
+        uint32_t sector_offset = offset % FAT32_SECTOR_SIZE;
+
+        if (sector_offset != 0 || chunk < FAT32_SECTOR_SIZE) {
+            /* Partial sector */
+            chunk = FAT32_SECTOR_SIZE - sector_offset;
+            if (chunk > size) {
+                chunk = size;
+            }
+
+            if (fat32_disk_read(vol, lba, 1, fat32_sector_buf) != FS_OK) {
+                return FS_ERR_IO;
+            }
+            if (out) {
+                memcpy(out, fat32_sector_buf + sector_offset, chunk);
+            } else {
+                if (in) {
+                    memcpy(fat32_sector_buf + sector_offset, in, chunk);
+                } else {
+                    memset(fat32_sector_buf + sector_offset, 0, chunk);
+                }
+                if (fat32_disk_write(vol, lba, 1, fat32_sector_buf) != FS_OK) {
+                    return FS_ERR_IO;
+                }
+            }
+        } else {
+            /* Whole sectors */
+            uint32_t sectors = chunk / FAT32_SECTOR_SIZE;
+            chunk = sectors * FAT32_SECTOR_SIZE;
+
+            int err;
+            if (out) {
+                err = fat32_disk_read(vol, lba, sectors, out);
+            } else if (in) {
+                err = fat32_disk_write(vol, lba, sectors, in);
+            } else {
+                err = fat32_disk_zero(vol, lba, sectors);
+            }
+            if (err != FS_OK) {
+                return err;
+            }
+        }
+
+        if (out) {
+            out += chunk;
+        } else if (in) {
+            in += chunk;
+        }
+        offset += chunk;
+        size -= chunk;
+    }
+
+    return FS_OK;
+}
+
+/**
+ * Get the directory slot at a position through the cache
+ * @param inode: Set to the node position of the slot (may be NULL)
+ */
+static fat32_dirent_t *fat32_dir_slot(fat32_volume_t *vol, fat32_dirpos_t *pos,
+                                      bool dirty, uint32_t *inode) {
+    uint32_t in_cluster = pos->slot % (vol->cluster_sectors * FAT32_ENTRIES_PER_SECTOR);
+    uint32_t lba = fat32_cluster_lba(vol, pos->cluster) + in_cluster / FAT32_ENTRIES_PER_SECTOR;
+
+    uint8_t *data = fat32_cache_get(vol, lba, dirty);
+    if (!data) {
+        return NULL;
+    }
+
+    if (inode) {
+        *inode = (lba - vol->lba_start) * FAT32_ENTRIES_PER_SECTOR +
+                 in_cluster % FAT32_ENTRIES_PER_SECTOR;
+    }
+    return (fat32_dirent_t *)data + in_cluster % FAT32_ENTRIES_PER_SECTOR;
+}
+
+/**
+ * Move to the next directory slot, following the cluster chain
+ * At the end of the chain pos->end is set and pos->cluster stays on the
+ * last cluster.
+ */
+static void fat32_dir_advance(fat32_volume_t *vol, fat32_dirpos_t *pos) {
+    pos->slot++;
+    if (pos->slot % (vol->cluster_sectors * FAT32_ENTRIES_PER_SECTOR) != 0) {
+        return;
+    }
+
+    uint32_t next;
+    if (fat32_fat_get(vol, pos->cluster, &next) != FS_OK || fat32_chain_end(vol, next)) {
+        pos->end = true;
+        return;
+    }
+    pos->cluster = next;
+}
+
+/**
+ * Long name checksum of an 8.3 name
+ */
+static uint8_t fat32_lfn_checksum(const char *name) {
+    uint8_t sum = 0;
+
+    for (int i = 0; i < 11; i++) {
+        sum = (uint8_t)(((sum & 1) << 7) + (sum >> 1) + (uint8_t)name[i]);
+    }
+
+    return sum;
+}
+
+/**
+ * Copy the characters of a long name entry (non-ASCII becomes '?')
+ */
+static void fat32_lfn_get(const fat32_lfn_t *lfn, char *out) {
+    uint16_t chars[FAT32_LFN_CHARS];
+
+    memcpy(chars, lfn->name1, sizeof(lfn->name1));
+    memcpy(chars + 5, lfn->name2, sizeof(lfn->name2));
+    memcpy(chars + 11, lfn->name3, sizeof(lfn->name3));
+
+    for (int i = 0; i < FAT32_LFN_CHARS; i++) {
+        if (chars[i] == 0) {
+            out[i] = '\0';
+            return;
+        }
+        out[i] = (chars[i] < 0x80) ? (char)chars[i] : '?';
+    }
+}
+
+/**
+ * Fill a long name entry with its part of a name
+ */
+static void fat32_lfn_set(fat32_lfn_t *lfn, const char *name, uint32_t len, uint32_t part) {
+    uint16_t chars[FAT32_LFN_CHARS];
+
+    for (uint32_t i = 0; i < FAT32_LFN_CHARS; i++) {
+        uint32_t at = part * FAT32_LFN_CHARS + i;
+        if (at < len) {
+            chars[i] = (uint8_t)name[at];
+        } else {
+            chars[i] = (at == len) ? 0x0000 : 0xFFFF;   /* Terminator, then padding */
+        }
+    }
+
+    memcpy(lfn->name1, chars, sizeof(lfn->name1));
+    memcpy(lfn->name2, chars + 5, sizeof(lfn->name2));
+    memcpy(lfn->name3, chars + 11, sizeof(lfn->name3));
+}
+
+/**
+ * Upper-case an ASCII character
+ */
+static inline char fat32_upper(char c) {
+    return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+}
+
+/**
+ * Format the 8.3 name of a short entry ("NAME.EXT", lower case where the
+ * nt_case flags say so)
+ */
+static void fat32_short_name(const fat32_dirent_t *entry, char *out) {
+    int len = 0;
+
+    for (int i = 0; i < 8 && entry->name[i] != ' '; i++) {
+        char c = (i == 0 && (uint8_t)entry->name[0] == 0x05) ? (char)0xE5 : entry->name[i];
+        if ((entry->nt_case & FAT32_CASE_LOWER_BASE) && c >= 'A' && c <= 'Z') {
+            c = (char)(c - 'A' + 'a');
+        }
+        out[len++] = c;
+    }
+
+    if (entry->name[8] != ' ') {
+        out[len++] = '.';
+        for (int i = 8; i < 11 && entry->name[i] != ' '; i++) {
+            char c = entry->name[i];
+            if ((entry->nt_case & FAT32_CASE_LOWER_EXT) && c >= 'A' && c <= 'Z') {
+                c = (char)(c - 'A' + 'a');
+            }
+            out[len++] = c;
+        }
+    }
+
+    out[len] = '\0';
+}
+
+/**
+ * Compare two names ignoring ASCII case
+ */
+static bool fat32_name_equal(const char *a, const char *b) {
+    while (*a && fat32_upper(*a) == fat32_upper(*b)) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+/**
+ * Read the next visible entry at or after pos, leaving pos after it
+ * Long names are assembled from the entries before the short entry;
+ * deleted entries, volume labels, "." and ".." are skipped.
+ * @return FS_OK, FS_ERR_NOENT at the end of the directory, or FS_ERR_IO
+ */
+static int fat32_dir_next(fat32_volume_t *vol, fat32_dirpos_t *pos, fat32_found_t *found) {
+    uint32_t expect = 0;        /* Order of the next long name entry */
+    uint8_t checksum = 0;
+    bool have_lfn = false;
+
+    while (!pos->end) {
+        uint32_t inode;
+        fat32_dirent_t *entry = fat32_dir_slot(vol, pos, false, &inode);
+        if (!entry) {
+            return FS_ERR_IO;
+        }
+
+        uint8_t first = (uint8_t)entry->name[0];
+        if (first == FAT32_ENTRY_END) {
+            pos->end = true;
+            break;
+        }
+
+        fat32_dirpos_t here = *pos;
+        fat32_dir_advance(vol, pos);
+
+        if (first == FAT32_ENTRY_DELETED) {
+            have_lfn = false;
+            continue;
+        }
+
+        if ((entry->attr & 0x3F) == FAT32_ATTR_LFN) {
+            fat32_lfn_t *lfn = (fat32_lfn_t *)entry;
+            uint32_t order = lfn->order & FAT32_LFN_ORDER_MASK;
+
+            if (lfn->order & FAT32_LFN_LAST) {
+                if (order == 0 || order > FAT32_MAX_LFN_ENTRIES) {
+                    have_lfn = false;
+                    continue;
+                }
+                have_lfn = true;
+                checksum = lfn->checksum;
+                found->first = here;
+                fat32_lfn_buf[order * FAT32_LFN_CHARS] = '\0';
+            } else if (!have_lfn || order != expect || lfn->checksum != checksum) {
+                have_lfn = false;
+                continue;
+            }
+
+            fat32_lfn_get(lfn, fat32_lfn_buf + (order - 1) * FAT32_LFN_CHARS);
+            expect = order - 1;
+            continue;
+        }
+
+        if (entry->attr & FAT32_ATTR_VOLUME_ID) {
+            have_lfn = false;
+            continue;
+        }
+
+        /* Short entry: use the long name if it is complete and belongs here */
+        if (have_lfn && expect == 0 && fat32_lfn_checksum(entry->name) == checksum) {
+            strncpy(found->name, fat32_lfn_buf, FS_MAX_NAME - 1);
+            found->name[FS_MAX_NAME - 1] = '\0';
+        } else {
+            fat32_short_name(entry, found->name);
+            found->first = here;
+        }
+        have_lfn = false;
+
+        if (strcmp(found->name, ".") == 0 || strcmp(found->name, "..") == 0) {
+            continue;
+        }
+
+        memcpy(&found->entry, entry, sizeof(fat32_dirent_t));
+        found->inode = inode;
+        found->last = here;
+        return FS_OK;
+    }
+
+    return FS_ERR_NOENT;
+}
+
+/**
+ * Find an entry in a directory by long or 8.3 name, ignoring case
+ * @return FS_OK, FS_ERR_NOENT or FS_ERR_IO
+ */
+static int fat32_dir_find(fat32_volume_t *vol, uint32_t dir, const char *name, fat32_found_t *found) {
+    fat32_dirpos_t pos = { dir, 0, false };
+    char short_name[13];
+    int err;
+
+    while ((err = fat32_dir_next(vol, &pos, found)) == FS_OK) {
+        if (fat32_name_equal(found->name, name)) {
+            return FS_OK;
+        }
+
+        fat32_short_name(&found->entry, short_name);
+        if (fat32_name_equal(short_name, name)) {
+            return FS_OK;
+        }
+    }
+
+    return err;
+}
+
+/**
+ * Check whether a directory holds anything besides "." and ".."
+ */
+static bool fat32_dir_empty(fat32_volume_t *vol, uint32_t dir) {
+    fat32_dirpos_t pos = { dir, 0, false };
+
+    while (!pos.end) {
+        fat32_dirent_t *entry = fat32_dir_slot(vol, &pos, false, NULL);
+        if (!entry) {
+            return false;
+        }
+
+        uint8_t first = (uint8_t)entry->name[0];
+        if (first == FAT32_ENTRY_END) {
+            break;
+        }
+        if (first != FAT32_ENTRY_DELETED && first != '.' &&
+            (entry->attr & 0x3F) != FAT32_ATTR_LFN && !(entry->attr & FAT32_ATTR_VOLUME_ID)) {
+            return false;
+        }
+
+        fat32_dir_advance(vol, &pos);
+    }
+
+    return true;
+}
+
+/**
+ * Check whether a directory has a short entry with this raw 8.3 name
+ */
+static bool fat32_short_exists(fat32_volume_t *vol, uint32_t dir, const char *name) {
+    fat32_dirpos_t pos = { dir, 0, false };
+
+    while (!pos.end) {
+        fat32_dirent_t *entry = fat32_dir_slot(vol, &pos, false, NULL);
+        if (!entry || (uint8_t)entry->name[0] == FAT32_ENTRY_END) {
+            break;
+        }
+        if ((entry->attr & 0x3F) != FAT32_ATTR_LFN && memcmp(entry->name, name, 11) == 0) {
+            return true;
+        }
+
+        fat32_dir_advance(vol, &pos);
+    }
+
+    return false;
+}
+
+/**
+ * Check whether a character may appear in an 8.3 name
+ */
+static bool fat32_short_char(char c) {
+    if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+        return true;
+    }
+    return c != '\0' && strchr("!#$%&'()-@^_`{}~", c) != NULL;
+}
+
+/**
+ * Check whether a name can be created (long name rules)
+ */
+static bool fat32_valid_name(const char *name) {
+    uint32_t len = strlen(name);
+
+    if (len == 0 || len >= FS_MAX_NAME || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < len; i++) {
+        if ((uint8_t)name[i] < 0x20 || (uint8_t)name[i] >= 0x80 || strchr("\"*/:<>?\\|", name[i])) {
+            return false;
+        }
+    }
+
+    /* Trailing dots and spaces are dropped by other systems */
+    return name[len - 1] != '.' && name[len - 1] != ' ';
+}
+
+/**
+ * Store a name as 8.3 if it fits in one case per part
+ * @return true if entry->name and entry->nt_case now hold the whole name
+ */
+static bool fat32_fit_short(const char *name, fat32_dirent_t *entry) {
+    const char *dot = strrchr(name, '.');
+    uint32_t base_len = dot ? (uint32_t)(dot - name) : strlen(name);
+    uint32_t ext_len = dot ? strlen(dot + 1) : 0;
+
+    if (base_len == 0 || base_len > 8 || ext_len > 3 || (dot && ext_len == 0)) {
+        return false;
+    }
+
+    uint8_t lower[2] = { 0, 0 };
+    uint8_t upper[2] = { 0, 0 };
+
+    memset(entry->name, ' ', 11);
+    for (uint32_t i = 0; name[i]; i++) {
+        if (name + i == dot) {
+            continue;
+        }
+
+        int part = (dot && name + i > dot) ? 1 : 0;
+        char c = name[i];
+        if (!fat32_short_char(c)) {
+            return false;
+        }
+        if (c >= 'a' && c <= 'z') {
+            lower[part] = 1;
+        } else if (c >= 'A' && c <= 'Z') {
+            upper[part] = 1;
+        }
+
+        uint32_t at = part ? 8 + (uint32_t)(name + i - dot - 1) : i;
+        entry->name[at] = fat32_upper(c);
+    }
+
+    if ((lower[0] && upper[0]) || (lower[1] && upper[1])) {
+        return false;
+    }
+
+    entry->nt_case = (lower[0] ? FAT32_CASE_LOWER_BASE : 0) | (lower[1] ? FAT32_CASE_LOWER_EXT : 0);
+    return true;
+}
+
+/**
+ * Build a unique "BASIS~N.EXT" short name for a long name
+ * @return true if one was found
+ */
+static bool fat32_make_short(fat32_volume_t *vol, uint32_t dir, const char *name, fat32_dirent_t *entry) {
+    const char *dot = strrchr(name, '.');
+    char basis[8];
+    uint32_t basis_len = 0;
+
+    memset(entry->name, ' ', 11);
+    entry->nt_case = 0;
+
+    /* Basis: characters before the last dot, without dots and spaces */
+    for (const char *p = name; *p && p != dot && basis_len < 6; p++) {
+        if (*p != '.' && *p != ' ') {
+            basis[basis_len++] = fat32_short_char(*p) ? fat32_upper(*p) : '_';
+        }
+    }
+    if (basis_len == 0) {
+        basis[basis_len++] = '_';
+    }
+
+    /* Extension: up to three characters after the last dot */
+    if (dot && dot != name) {
+        uint32_t ext_len = 0;
+        for (const char *p = dot + 1; *p && ext_len < 3; p++) {
+            if (*p != ' ') {
+                entry->name[8 + ext_len++] = fat32_short_char(*p) ? fat32_upper(*p) : '_';
+            }
+        }
+    }
+
+    for (uint32_t n = 1; n <= 999999; n++) {
+        char tail[8];
+        uint32_t tail_len = 0;
+        for (uint32_t v = n; v > 0; v /= 10) {
+            tail[tail_len++] = (char)('0' + v % 10);
+        }
+
+        /* BASIS~N must fit in eight characters */
+        uint32_t keep = 8 - (tail_len + 1);
+        if (keep > basis_len) {
+            keep = basis_len;
+        }
+
+        memset(entry->name, ' ', 8);
+        memcpy(entry->name, basis, keep);
+        entry->name[keep] = '~';
+        for (uint32_t i = 0; i < tail_len; i++) {
+            entry->name[keep + 1 + i] = tail[tail_len - 1 - i];
+        }
+
+        if (!fat32_short_exists(vol, dir, entry->name)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Find count consecutive free slots in a directory, adding a cluster at
+ * the end when there is no room
+ */
+static int fat32_dir_reserve(fat32_volume_t *vol, uint32_t dir, uint32_t count, fat32_dirpos_t *start) {
+    fat32_dirpos_t pos = { dir, 0, false };
+    uint32_t run = 0;
+
+    while (true) {
+        if (pos.end) {
+            uint32_t cluster = fat32_alloc_dir_cluster(vol);
+            if (!cluster) {
+                return FS_ERR_NOSPACE;
+            }
+            if (fat32_fat_set(vol, pos.cluster, cluster) != FS_OK) {
+                return FS_ERR_IO;
+            }
+            pos.cluster = cluster;
+            pos.end = false;
+        }
+
+        fat32_dirent_t *entry = fat32_dir_slot(vol, &pos, false, NULL);
+        if (!entry) {
+            return FS_ERR_IO;
+        }
+
+        uint8_t first = (uint8_t)entry->name[0];
+        if (first == FAT32_ENTRY_END || first == FAT32_ENTRY_DELETED) {
+            if (run == 0) {
+                *start = pos;
+            }
+            if (++run == count) {
+                return FS_OK;
+            }
+        } else {
+            run = 0;
+        }
+
+        fat32_dir_advance(vol, &pos);
+    }
+}
+
+/**
+ * Set the directory operations of a node
+ */
+static void fat32_dir_ops(fs_node_t *node) {
+    node->readdir = fat32_readdir;
+    node->finddir = fat32_finddir;
+    node->create = fat32_create;
+    node->unlink = fat32_unlink;
+}
+
+/**
+ * Fill a VFS node from a directory entry
+ */
+static void fat32_fill_node(fs_node_t *node, fat32_volume_t *vol, const fat32_found_t *found) {
+    memset(node, 0, sizeof(fs_node_t));
+    strcpy(node->name, found->name);
+    node->inode = found->inode;
+    node->impl = fat32_entry_cluster(&found->entry);
+    node->dev = FAT32_DEV + vol->drive;
+    node->private_data = vol;
+
+    if (found->entry.attr & FAT32_ATTR_DIRECTORY) {
+        node->flags = FS_DIRECTORY;
+        fat32_dir_ops(node);
+        return;
+    }
+
+    node->flags = FS_FILE;
+    node->length = found->entry.size;
+    node->read = fat32_read;
+    node->write = fat32_write;
+    node->truncate = fat32_truncate;
+    node->close = fat32_close;
+
+    /* A file being written may be ahead of its directory entry */
+    fat32_file_t *file = fat32_file_find(vol, found->inode);
+    if (file) {
+        node->length = file->size;
+        node->impl = file->first_cluster;
+    }
+}
+
+/**
+ * Read file data
+ */
+static int fat32_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
+    fat32_file_t *file = fat32_file_open(node);
+    if (!file) {
+        return FS_ERR_IO;
+    }
+
+    if (offset >= file->size) {
+        return 0;
+    }
+    if (size > file->size - offset) {
+        size = file->size - offset;
+    }
+
+    int err = fat32_file_io(file, offset, size, buffer, NULL);
+    return (err == FS_OK) ? (int)size : err;
+}
+
+/**
+ * Write file data, growing the file as needed
+ */
+static int fat32_write(fs_node_t *node, uint32_t offset, uint32_t size, const uint8_t *buffer) {
+    fat32_file_t *file = fat32_file_open(node);
+    if (!file) {
+        return FS_ERR_IO;
+    }
+
+    if (size == 0) {
+        return 0;
+    }
+
+    uint32_t end = offset + size;
+    if (end < offset) {
+        return FS_ERR_INVALID;
+    }
+
+    uint32_t cluster_bytes = fat32_cluster_bytes(file->vol);
+    int err = fat32_file_grow(file, end / cluster_bytes + (end % cluster_bytes != 0));
+    if (err != FS_OK) {
+        return err;
+    }
+
+    /* Writing past the end leaves a hole that reads back as zeros */
+    if (offset > file->size) {
+        err = fat32_file_io(file, file->size, offset - file->size, NULL, NULL);
+    }
+    if (err == FS_OK) {
+        err = fat32_file_io(file, offset, size, NULL, buffer);
+    }
+    if (err != FS_OK) {
+        return err;
+    }
+
+    if (end > file->size) {
+        file->size = end;
+        file->dirty = true;
+    }
+    node->length = file->size;
+    node->impl = file->first_cluster;
+
+    return size;
+}
+
+/**
+ * Change the size of a file
+ */
+static int fat32_truncate(fs_node_t *node, uint32_t length) {
+    fat32_file_t *file = fat32_file_open(node);
+    if (!file) {
+        return FS_ERR_INVALID;
+    }
+
+    uint32_t cluster_bytes = fat32_cluster_bytes(file->vol);
+    uint32_t need = length / cluster_bytes + (length % cluster_bytes != 0);
+    int err;
+
+    if (length > file->size) {
+        err = fat32_file_grow(file, need);
+        if (err == FS_OK) {
+            err = fat32_file_io(file, file->size, length - file->size, NULL, NULL);
+        }
+    } else {
+        err = fat32_file_shrink(file, need);
+    }
+    if (err != FS_OK) {
+        return err;
+    }
+
+    if (file->size != length) {
+        file->size = length;
+        file->dirty = true;
+    }
+    node->length = length;
+    node->impl = file->first_cluster;
+
+    return FS_OK;
+}
+
+/**
+ * Close a file: write back its directory entry and the FAT
+ */
+static void fat32_close(fs_node_t *node) {
+    fat32_volume_t *vol = (fat32_volume_t *)node->private_data;
+    if (vol && vol->mounted) {
+        fat32_sync_volume(vol);
+    }
+}
+
+/**
+ * Read directory entry by index
+ */
+static dirent_t *fat32_readdir(fs_node_t *node, uint32_t index) {
+    fat32_volume_t *vol = (fat32_volume_t *)node->private_data;
+    if (!vol || !vol->mounted) {
+        return NULL;
+    }
+
+    /* Continue from the previous call when listing in order */
+    if (fat32_cursor.vol != vol || fat32_cursor.dir != node->impl || fat32_cursor.index > index) {
+        fat32_cursor.vol = vol;
+        fat32_cursor.dir = node->impl;
+        fat32_cursor.index = 0;
+        fat32_cursor.pos.cluster = node->impl;
+        fat32_cursor.pos.slot = 0;
+        fat32_cursor.pos.end = false;
+    }
+
+    while (true) {
+        if (fat32_dir_next(vol, &fat32_cursor.pos, &fat32_found) != FS_OK) {
+            fat32_cursor.vol = NULL;
+            return NULL;
+        }
+        if (fat32_cursor.index++ == index) {
+            break;
+        }
+    }
+
+    strcpy(fat32_dirent.name, fat32_found.name);
+    fat32_dirent.inode = fat32_found.inode;
+    return &fat32_dirent;
+}
+
+/**
+ * Find a file in a directory
+ */
+static fs_node_t *fat32_finddir(fs_node_t *node, const char *name) {
+    fat32_volume_t *vol = (fat32_volume_t *)node->private_data;
+    if (!vol || !vol->mounted) {
+        return NULL;
+    }
+
+    if (fat32_dir_find(vol, node->impl, name, &fat32_found) != FS_OK) {
+        return NULL;
+    }
+
+    fat32_fill_node(&fat32_found_node, vol, &fat32_found);
+    return &fat32_found_node;
+}
+
+/**
+ * Create a file or directory
+ */
+static fs_node_t *fat32_create(fs_node_t *node, const char *name, uint32_t type) {
+    fat32_volume_t *vol = (fat32_volume_t *)node->private_data;
+    uint32_t dir = node->impl;
+
+    if (!vol || !vol->mounted || !fat32_valid_name(name) ||
+        fat32_dir_find(vol, dir, name, &fat32_found) != FS_ERR_NOENT) {
+        return NULL;
+    }
+
+    /* Short entry, with long name entries unless the name fits 8.3 */
+    fat32_dirent_t entry;
+    memset(&entry, 0, sizeof(entry));
+    uint32_t len = strlen(name);
+    uint32_t lfn_count = 0;
+    if (!fat32_fit_short(name, &entry)) {
+        if (!fat32_make_short(vol, dir, name, &entry)) {
+            return NULL;
+        }
+        lfn_count = (len + FAT32_LFN_CHARS - 1) / FAT32_LFN_CHARS;
+    }
+    entry.attr = (type == FS_DIRECTORY) ? FAT32_ATTR_DIRECTORY : FAT32_ATTR_ARCHIVE;
+    entry.create_date = FAT32_DEFAULT_DATE;
+    entry.access_date = FAT32_DEFAULT_DATE;
+    entry.write_date = FAT32_DEFAULT_DATE;
+
+    /* A directory starts with one cluster holding "." and ".." */
+    uint32_t cluster = 0;
+    if (type == FS_DIRECTORY) {
+        cluster = fat32_alloc_dir_cluster(vol);
+        if (!cluster) {
+            return NULL;
+        }
+
+        fat32_dirent_t *dots = (fat32_dirent_t *)fat32_cache_get(vol, fat32_cluster_lba(vol, cluster), true);
+        if (!dots) {
+            fat32_free_chain(vol, cluster, true);
+            return NULL;
+        }
+        memcpy(&dots[0], &entry, sizeof(fat32_dirent_t));
+        memcpy(dots[0].name, ".          ", 11);
+        dots[0].nt_case = 0;
+        fat32_entry_set_cluster(&dots[0], cluster);
+        memcpy(&dots[1], &dots[0], sizeof(fat32_dirent_t));
+        memcpy(dots[1].name, "..         ", 11);
+        fat32_entry_set_cluster(&dots[1], (dir == vol->root_cluster) ? 0 : dir);
+
+        fat32_entry_set_cluster(&entry, cluster);
+    }
+
+    fat32_dirpos_t pos;
+    if (fat32_dir_reserve(vol, dir, lfn_count + 1, &pos) != FS_OK) {
+        if (cluster) {
+            fat32_free_chain(vol, cluster, true);
+        }
+        return NULL;
+    }
+
+    /* Long name entries go first, last part first */
+    uint8_t checksum = fat32_lfn_checksum(entry.name);
+    fat32_found.first = pos;
+    for (uint32_t part = lfn_count; part > 0; part--) {
+        fat32_lfn_t *lfn = (fat32_lfn_t *)fat32_dir_slot(vol, &pos, true, NULL);
+        if (!lfn) {
+            return NULL;
+        }
+
+        memset(lfn, 0, sizeof(fat32_lfn_t));
+        lfn->order = (uint8_t)part | ((part == lfn_count) ? FAT32_LFN_LAST : 0);
+        lfn->attr = FAT32_ATTR_LFN;
+        lfn->checksum = checksum;
+        fat32_lfn_set(lfn, name, len, part - 1);
+        fat32_dir_advance(vol, &pos);
+    }
+
+    fat32_dirent_t *slot = fat32_dir_slot(vol, &pos, true, &fat32_found.inode);
+    if (!slot) {
+        return NULL;
+    }
+    memcpy(slot, &entry, sizeof(fat32_dirent_t));
+
+    fat32_cursor.vol = NULL;
+    fat32_sync_volume(vol);
+
+    strcpy(fat32_found.name, name);
+    memcpy(&fat32_found.entry, &entry, sizeof(fat32_dirent_t));
+    fat32_found.last = pos;
+    fat32_fill_node(&fat32_found_node, vol, &fat32_found);
+    return &fat32_found_node;
+}
+
+/**
+ * Remove a file or empty directory
+ */
+static int fat32_unlink(fs_node_t *node, const char *name) {
+    fat32_volume_t *vol = (fat32_volume_t *)node->private_data;
+    if (!vol || !vol->mounted) {
+        return FS_ERR_NOTDIR;
+    }
+
+    int err = fat32_dir_find(vol, node->impl, name, &fat32_found);
+    if (err != FS_OK) {
+        return (err == FS_ERR_NOENT) ? FS_ERR_NOENT : FS_ERR_IO;
+    }
+
+    uint32_t cluster = fat32_entry_cluster(&fat32_found.entry);
+    bool is_dir = (fat32_found.entry.attr & FAT32_ATTR_DIRECTORY) != 0;
+    if (is_dir && !fat32_dir_empty(vol, cluster)) {
+        return FS_ERR_NOTEMPTY;
+    }
+
+    /* Mark the short entry and its long name entries deleted */
+    fat32_dirpos_t pos = fat32_found.first;
+    while (true) {
+        fat32_dirent_t *entry = fat32_dir_slot(vol, &pos, true, NULL);
+        if (!entry) {
+            return FS_ERR_IO;
+        }
+        entry->name[0] = (char)FAT32_ENTRY_DELETED;
+
+        if (pos.slot == fat32_found.last.slot) {
+            break;
+        }
+        fat32_dir_advance(vol, &pos);
+    }
+
+    /* A file with a run map may be ahead of its entry */
+    fat32_file_t *file = fat32_file_find(vol, fat32_found.inode);
+    if (file) {
+        cluster = file->first_cluster;
+        file->used = false;
+    }
+
+    fat32_cursor.vol = NULL;
+    err = fat32_free_chain(vol, cluster, is_dir);
+    if (fat32_sync_volume(vol) != FS_OK) {
+        err = FS_ERR_IO;
+    }
+
+    return err;
+}
+
+/**
+ * Write back pending changes of one volume
+ */
+static int fat32_sync_volume(fat32_volume_t *vol) {
+    int result = FS_OK;
+
+    for (int i = 0; i < FAT32_MAX_FILES; i++) {
+        fat32_file_t *file = &fat32_files[i];
+        if (file->used && file->vol == vol && file->dirty && fat32_file_store(file) != FS_OK) {
+            result = FS_ERR_IO;
+        }
+    }
+
+    if (vol->fsinfo_dirty && vol->fsinfo_lba) {
+        fat32_fsinfo_t *info = (fat32_fsinfo_t *)fat32_cache_get(vol, vol->fsinfo_lba, true);
+        if (info && info->lead_signature == FAT32_FSINFO_LEAD &&
+            info->struct_signature == FAT32_FSINFO_STRUCT) {
+            info->free_count = (vol->tracked == vol->cluster_count) ? vol->free_count : FAT32_FREE_UNKNOWN;
+            info->next_free = vol->next_free;
+        }
+    }
+    vol->fsinfo_dirty = false;
+
+    if (fat32_cache_flush(vol) != FS_OK) {
+        result = FS_ERR_IO;
+    }
+
+    return result;
+}
+
+/**
+ * Check whether a sector holds a FAT32 boot sector
+ */
+static bool fat32_bpb_valid(const uint8_t *sector) {
+    const fat32_bpb_t *bpb = (const fat32_bpb_t *)sector;
+    uint8_t spc = bpb->sectors_per_cluster;
+
+    return mbr_valid(sector) &&
+           bpb->bytes_per_sector == FAT32_SECTOR_SIZE &&
+           spc != 0 && (spc & (spc - 1)) == 0 &&
+           bpb->reserved_sectors != 0 &&
+           bpb->fat_count != 0 &&
+           bpb->root_entries == 0 &&
+           bpb->fat_size_16 == 0 &&
+           bpb->fat_size_32 != 0 &&
+           bpb->total_sectors_32 != 0 &&
+           bpb->root_cluster >= FAT32_FIRST_CLUSTER;
+}
+
+/**
+ * Find the FAT32 volume of a drive: the whole disk, or the first FAT32
+ * partition of its MBR. Leaves the boot sector in fat32_sector_buf.
+ * @param lba_start: Set to the first sector of the volume
+ */
+static int fat32_locate(uint8_t drive, uint32_t *lba_start) {
+    ide_device_t *dev = ide_get_device(drive);
+    if (drive >= IDE_MAX_DRIVES || !dev || dev->type != IDE_TYPE_ATA) {
+        return FS_ERR_NOTFOUND;
+    }
+
+    if (ide_read_sectors(drive, 0, 1, fat32_sector_buf) != IDE_OK) {
+        return FS_ERR_IO;
+    }
+
+    if (fat32_bpb_valid(fat32_sector_buf)) {
+        *lba_start = 0;
+        return FS_OK;
+    }
+
+    if (!mbr_valid(fat32_sector_buf)) {
+        return FS_ERR_NOTFOUND;
+    }
+
+    mbr_part_t parts[MBR_PARTITIONS];
+    memcpy(parts, mbr_partitions(fat32_sector_buf), sizeof(parts));
+
+    for (int i = 0; i < MBR_PARTITIONS; i++) {
+        if (parts[i].type != MBR_TYPE_FAT32_CHS && parts[i].type != MBR_TYPE_FAT32_LBA) {
+            continue;
+        }
+
+        if (ide_read_sectors(drive, parts[i].lba_first, 1, fat32_sector_buf) == IDE_OK &&
+            fat32_bpb_valid(fat32_sector_buf)) {
+            *lba_start = parts[i].lba_first;
+            return FS_OK;
+        }
+    }
+
+    return FS_ERR_NOTFOUND;
+}
+
+/**
+ * Build the free-cluster bitmap from the FAT
+ */
+static int fat32_build_bitmap(fat32_volume_t *vol) {
+    uint32_t per_read = sizeof(fat32_io_buf) / FAT32_SECTOR_SIZE;
+    uint32_t entries_per_read = sizeof(fat32_io_buf) / 4;
+    uint32_t end = vol->tracked + FAT32_FIRST_CLUSTER;
+
+    memset(vol->bitmap, 0, FAT32_MAX_CLUSTERS / 8);
+    vol->free_count = vol->tracked;
+
+    for (uint32_t base = 0; base < end; base += entries_per_read) {
+        if (fat32_disk_read(vol, vol->fat_start + base / (FAT32_SECTOR_SIZE / 4),
+                            per_read, fat32_io_buf) != FS_OK) {
+            return FS_ERR_IO;
+        }
+
+        const uint32_t *fat = (const uint32_t *)fat32_io_buf;
+        for (uint32_t i = 0; i < entries_per_read && base + i < end; i++) {
+            uint32_t cluster = base + i;
+            if (cluster >= FAT32_FIRST_CLUSTER && (fat[i] & FAT32_CLUSTER_MASK) != 0) {
+                uint32_t bit = cluster - FAT32_FIRST_CLUSTER;
+                vol->bitmap[bit / 32] |= 1u << (bit % 32);
+                vol->free_count--;
+            }
+        }
+    }
+
+    return FS_OK;
+}
+
+/**
+ * Initialize the FAT32 driver
+ */
+void fat32_init(void) {
+    memset(fat32_volumes, 0, sizeof(fat32_volumes));
+    memset(fat32_cache, 0, sizeof(fat32_cache));
+    memset(fat32_files, 0, sizeof(fat32_files));
+    fat32_cursor.vol = NULL;
+
+    /* Register filesystem type */
+    fs_register(&fat32_fstype);
+}
+
+/**
+ * Check whether a drive holds a FAT32 volume
+ */
+bool fat32_probe(uint8_t drive) {
+    uint32_t lba_start;
+    return fat32_locate(drive, &lba_start) == FS_OK;
+}
+
+/**
+ * Mount the FAT32 volume of a drive
+ */
+fs_node_t *fat32_mount(uint8_t drive) {
+    if (drive >= IDE_MAX_DRIVES) {
+        return NULL;
+    }
+
+    fat32_volume_t *vol = &fat32_volumes[drive];
+    if (vol->mounted) {
+        return &vol->root;
+    }
+
+    /* Take a free bitmap */
+    uint32_t *bitmap = NULL;
+    for (int i = 0; i < FAT32_MAX_VOLUMES && !bitmap; i++) {
+        bitmap = fat32_bitmaps[i];
+        for (int d = 0; d < IDE_MAX_DRIVES; d++) {
+            if (fat32_volumes[d].mounted && fat32_volumes[d].bitmap == bitmap) {
+                bitmap = NULL;
+                break;
+            }
+        }
+    }
+    if (!bitmap) {
+        return NULL;
+    }
+
+    uint32_t lba_start;
+    if (fat32_locate(drive, &lba_start) != FS_OK) {
+        return NULL;
+    }
+
+    const fat32_bpb_t *bpb = (const fat32_bpb_t *)fat32_sector_buf;
+    uint32_t meta = bpb->reserved_sectors + bpb->fat_count * bpb->fat_size_32;
+    if (bpb->total_sectors_32 <= meta) {
+        return NULL;
+    }
+
+    memset(vol, 0, sizeof(fat32_volume_t));
+    vol->drive = drive;
+    vol->lba_start = lba_start;
+    vol->fat_start = lba_start + bpb->reserved_sectors;
+    vol->fat_size = bpb->fat_size_32;
+    vol->fat_count = bpb->fat_count;
+    vol->data_start = lba_start + meta;
+    vol->cluster_sectors = bpb->sectors_per_cluster;
+    vol->root_cluster = bpb->root_cluster;
+
+    /* Clusters are limited by the data area and by what the FAT can describe */
+    vol->cluster_count = (bpb->total_sectors_32 - meta) / vol->cluster_sectors;
+    if (vol->cluster_count > vol->fat_size * (FAT32_SECTOR_SIZE / 4) - FAT32_FIRST_CLUSTER) {
+        vol->cluster_count = vol->fat_size * (FAT32_SECTOR_SIZE / 4) - FAT32_FIRST_CLUSTER;
+    }
+    if (vol->root_cluster >= vol->cluster_count + FAT32_FIRST_CLUSTER) {
+        return NULL;
+    }
+
+    if (bpb->fsinfo_sector != 0 && bpb->fsinfo_sector != 0xFFFF) {
+        vol->fsinfo_lba = lba_start + bpb->fsinfo_sector;
+    }
+
+    vol->bitmap = bitmap;
+    vol->tracked = (vol->cluster_count < FAT32_MAX_CLUSTERS) ? vol->cluster_count : FAT32_MAX_CLUSTERS;
+    vol->next_free = FAT32_FIRST_CLUSTER;
+    if (fat32_build_bitmap(vol) != FS_OK) {
+        return NULL;
+    }
+
+    /* Root directory */
+    fs_node_t *root = &vol->root;
+    root->flags = FS_DIRECTORY;
+    root->inode = 0;
+    root->impl = vol->root_cluster;
+    root->dev = FAT32_DEV + drive;
+    root->private_data = vol;
+    fat32_dir_ops(root);
+
+    vol->mounted = true;
+    return root;
+}
+
+/**
+ * Unmount a FAT32 volume
+ */
+int fat32_unmount(fs_node_t *root) {
+    fat32_volume_t *vol = root ? (fat32_volume_t *)root->private_data : NULL;
+    if (!vol || root != &vol->root || !vol->mounted) {
+        return FS_ERR_INVALID;
+    }
+
+    int result = fat32_sync_volume(vol);
+
+    for (int i = 0; i < FAT32_MAX_FILES; i++) {
+        if (fat32_files[i].vol == vol) {
+            fat32_files[i].used = false;
+        }
+    }
+    for (int i = 0; i < FAT32_CACHE_SECTORS; i++) {
+        if (fat32_cache[i].vol == vol) {
+            fat32_cache[i].vol = NULL;
+        }
+    }
+    if (fat32_cursor.vol == vol) {
+        fat32_cursor.vol = NULL;
+    }
+
+    vol->mounted = false;
+    vol->bitmap = NULL;
+    return result;
+}
+
+/**
+ * Write back pending changes of all volumes
+ */
+int fat32_sync(void) {
+    int result = FS_OK;
+
+    for (int i = 0; i < IDE_MAX_DRIVES; i++) {
+        if (fat32_volumes[i].mounted && fat32_sync_volume(&fat32_volumes[i]) != FS_OK) {
+            result = FS_ERR_IO;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Get the free space of a mounted volume
+ */
+int fat32_usage(uint8_t drive, uint32_t *free, uint32_t *total, uint32_t *cluster_size) {
+    if (drive >= IDE_MAX_DRIVES || !fat32_volumes[drive].mounted) {
+        return FS_ERR_NOTMOUNT;
+    }
+
+    fat32_volume_t *vol = &fat32_volumes[drive];
+    if (free) {
+        *free = vol->free_count;
+    }
+    if (total) {
+        *total = vol->cluster_count;
+    }
+    if (cluster_size) {
+        *cluster_size = fat32_cluster_bytes(vol);
+    }
+
+    return FS_OK;
+}
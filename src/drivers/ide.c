@@ -27,8 +27,8 @@ static uint8_t ide_drive_count = 0;
 /* Identification buffer */
 static uint16_t ide_buf[256];
 
-/* IRQ flags for waiting */
-static volatile uint8_t ide_irq_invoked = 0;
+/* Asynchronous ATAPI reads, one per channel */
+static ide_async_t ide_async[2];
 
 /**
  * Wait for ~400ns by reading alternate status port 4 times
@@ -293,12 +293,95 @@ static void ide_extract_string(uint16_t *src, char *dst, int words) {
     }
 }
 
+/**
+ * Finish the asynchronous read on a channel and report the result
+ * Interrupts are disabled on the channel again for synchronous requests.
+ */
+static void ide_async_finish(uint8_t channel, int status) {
+    ide_async_t *req = &ide_async[channel];
+    
+    outb(ide_channels[channel].ctrl, ATA_CTRL_NIEN);
+    ide_channels[channel].nien = 1;
+    req->active = false;
+    
+    if (req->done) {
+        req->done(req->ctx, status);
+    }
+}
+
+/**
+ * Advance the asynchronous read on a channel
+ * Called for every channel interrupt, and in a loop by ide_async_wait().
+ * @return true if a sector was transferred or the request finished
+ */
+static bool ide_async_service(uint8_t channel) {
+    ide_async_t *req = &ide_async[channel];
+    uint16_t base = ide_channels[channel].base;
+    
+    /* Reading the status register also acknowledges the interrupt */
+    uint8_t status = inb(base + 7);
+    
+    if (!req->active || (status & ATA_SR_BSY)) {
+        return false;
+    }
+    
+    if (status & (ATA_SR_ERR | ATA_SR_DF)) {
+        ide_async_finish(channel, (status & ATA_SR_DF) ? IDE_ERR_DRIVE_FAULT : IDE_ERR_READ);
+        return true;
+    }
+    
+    if (status & ATA_SR_DRQ) {
+        /* Data phase: one sector per interrupt (byte count limit) */
+        if (req->remaining == 0) {
+            ide_async_finish(channel, IDE_ERR_READ);
+            return true;
+        }
+        
+        for (int i = 0; i < 1024; i++) {
+            *req->buffer++ = inw(base);
+        }
+        req->remaining--;
+        return true;
+    }
+    
+    /* Status phase: the command has completed */
+    ide_async_finish(channel, req->remaining == 0 ? IDE_OK : IDE_ERR_READ);
+    return true;
+}
+
+/**
+ * Wait for the asynchronous read on a channel to finish
+ * Drives the transfer by polling, since synchronous callers usually run
+ * with interrupts disabled.
+ */
+static void ide_async_wait(uint8_t channel) {
+    uint32_t flags;
+    uint32_t timeout = ATA_TIMEOUT;
+    
+    if (!ide_async[channel].active) {
+        return;
+    }
+    
+    /* Keep the interrupt handler out while polling */
+    __asm__ volatile ("pushf; pop %0; cli" : "=r"(flags));
+    
+    while (ide_async[channel].active) {
+        if (ide_async_service(channel)) {
+            timeout = ATA_TIMEOUT;
+        } else if (--timeout == 0) {
+            ide_async_finish(channel, IDE_ERR_TIMEOUT);
+        }
+    }
+    
+    __asm__ volatile ("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
+
 /**
  * Primary IDE interrupt handler (IRQ14)
  */
 static void ide_primary_handler(interrupt_frame_t *frame) {
     UNUSED(frame);
-    ide_irq_invoked = 1;
+    ide_async_service(IDE_PRIMARY);
 }
 
 /**
@@ -306,7 +389,7 @@ static void ide_primary_handler(interrupt_frame_t *frame) {
  */
 static void ide_secondary_handler(interrupt_frame_t *frame) {
     UNUSED(frame);
-    ide_irq_invoked = 1;
+    ide_async_service(IDE_SECONDARY);
 }
 
 /**
@@ -318,15 +401,19 @@ void ide_init(void) {
     
     /* Clear device array */
     memset(ide_devices, 0, sizeof(ide_devices));
+    memset(ide_async, 0, sizeof(ide_async));
     ide_drive_count = 0;
     
     /* Install IRQ handlers */
     irq_install_handler(14, ide_primary_handler);
     irq_install_handler(15, ide_secondary_handler);
     
-    /* Disable interrupts on both channels */
+    /* Disable interrupts on both channels (asynchronous reads enable
+     * them for the duration of the transfer) */
     outb(ATA_PRIMARY_CONTROL, ATA_CTRL_NIEN);
     outb(ATA_SECONDARY_CONTROL, ATA_CTRL_NIEN);
+    ide_channels[IDE_PRIMARY].nien = 1;
+    ide_channels[IDE_SECONDARY].nien = 1;
     
     /* Scan for devices */
     for (channel = 0; channel < 2; channel++) {
@@ -414,6 +501,9 @@ int ide_read_sectors(uint8_t drive, uint32_t lba, uint8_t sectors, void *buffer)
     
     base = ide_channels[dev->channel].base;
     
+    /* Let a background read on this channel finish */
+    ide_async_wait(dev->channel);
+    
     /* Wait for drive to be ready */
     err = ide_wait_bsy(dev->channel);
     if (err != IDE_OK) {
@@ -480,6 +570,9 @@ int ide_write_sectors(uint8_t drive, uint32_t lba, uint8_t sectors, const void *
     
     base = ide_channels[dev->channel].base;
     
+    /* Let a background read on this channel finish */
+    ide_async_wait(dev->channel);
+    
     /* Wait for drive to be ready */
     err = ide_wait_bsy(dev->channel);
     if (err != IDE_OK) {
@@ -557,6 +650,9 @@ int ide_atapi_read(uint8_t drive, uint32_t lba, uint8_t sectors, void *buffer) {
     
     base = ide_channels[dev->channel].base;
     
+    /* Let a background read on this channel finish */
+    ide_async_wait(dev->channel);
+    
     /* Wait for drive to be ready */
     err = ide_wait_bsy(dev->channel);
     if (err != IDE_OK) {
@@ -616,6 +712,91 @@ int ide_atapi_read(uint8_t drive, uint32_t lba, uint8_t sectors, void *buffer) {
     return IDE_OK;
 }
 
+/**
+ * Start an interrupt-driven read from an ATAPI device
+ */
+int ide_atapi_read_async(uint8_t drive, uint32_t lba, uint8_t sectors, void *buffer,
+                         ide_done_fn done, void *ctx) {
+    ide_device_t *dev;
+    ide_async_t *req;
+    uint16_t base;
+    uint8_t select;
+    int err;
+    uint8_t packet[12];
+    
+    /* Validate parameters */
+    if (drive >= IDE_MAX_DRIVES || sectors == 0 || !buffer) {
+        return IDE_ERR_INVALID;
+    }
+    
+    dev = &ide_devices[drive];
+    if (!dev->present) {
+        return IDE_ERR_NO_DEVICE;
+    }
+    
+    if (dev->type != IDE_TYPE_ATAPI) {
+        return IDE_ERR_INVALID;
+    }
+    
+    req = &ide_async[dev->channel];
+    if (req->active) {
+        return IDE_ERR_BUSY;
+    }
+    
+    base = ide_channels[dev->channel].base;
+    
+    /* Wait for drive to be ready */
+    err = ide_wait_bsy(dev->channel);
+    if (err != IDE_OK) {
+        return err;
+    }
+    
+    /* Select drive */
+    select = (dev->drive == IDE_SLAVE) ? ATA_DRIVE_SLAVE : ATA_DRIVE_MASTER;
+    outb(base + 6, select);
+    ide_400ns_delay(dev->channel);
+    
+    /* Set up ATAPI command */
+    outb(base + 1, 0);                          /* Features = 0 (PIO) */
+    outb(base + 4, ATAPI_SECTOR_SIZE & 0xFF);   /* Byte count low */
+    outb(base + 5, ATAPI_SECTOR_SIZE >> 8);     /* Byte count high */
+    
+    /* Send PACKET command */
+    outb(base + 7, ATA_CMD_PACKET);
+    
+    /* Wait for DRQ */
+    err = ide_wait_drq(dev->channel);
+    if (err != IDE_OK) {
+        return err;
+    }
+    
+    /* Enable interrupts on the channel; the request is set up before the
+     * packet goes out so the first interrupt finds it */
+    req->buffer = (uint16_t *)buffer;
+    req->remaining = sectors;
+    req->done = done;
+    req->ctx = ctx;
+    req->active = true;
+    outb(ide_channels[dev->channel].ctrl, 0);
+    ide_channels[dev->channel].nien = 0;
+    
+    /* Build SCSI READ(12) command packet */
+    memset(packet, 0, sizeof(packet));
+    packet[0] = ATAPI_CMD_READ;         /* READ command */
+    packet[2] = (lba >> 24) & 0xFF;     /* LBA byte 3 */
+    packet[3] = (lba >> 16) & 0xFF;     /* LBA byte 2 */
+    packet[4] = (lba >> 8) & 0xFF;      /* LBA byte 1 */
+    packet[5] = lba & 0xFF;             /* LBA byte 0 */
+    packet[9] = sectors;                /* Transfer length (LSB) */
+    
+    /* Send packet; the data arrives through ide_async_service() */
+    for (int i = 0; i < 6; i++) {
+        outw(base, ((uint16_t *)packet)[i]);
+    }
+    
+    return IDE_OK;
+}
+
 /**
  * Eject ATAPI device media
  */
@@ -642,6 +823,9 @@ int ide_atapi_eject(uint8_t drive) {
     
     base = ide_channels[dev->channel].base;
     
+    /* Let a background read on this channel finish */
+    ide_async_wait(dev->channel);
+    
     /* Wait for drive to be ready */
     err = ide_wait_bsy(dev->channel);
     if (err != IDE_OK) {
@@ -0,0 +1,405 @@
+/**
+ * initramfs Implementation
+ * Read-only root filesystem from a cpio "newc" archive in memory
+ *
+ * The archive is indexed once at mount time into a table of entries with
+ * a (parent, name) lookup hash, and file reads copy straight out of the
+ * archive. Directories that only appear as path prefixes are created
+ * implicitly.
+ */
+
+#include <initramfs.h>
+#include <kernel.h>
+#include <string.h>
+
+/* Archive */
+static const uint8_t *initramfs_image = NULL;
+static uint32_t initramfs_size = 0;
+
+/* Entries (index 0 is the root directory; node inode numbers are index + 1) */
+static initramfs_entry_t initramfs_entries[INITRAMFS_MAX_ENTRIES];
+static int16_t initramfs_entry_count = 0;
+
+/* Lookup hash: first entry of each chain, -1 for empty */
+static int16_t initramfs_hash[INITRAMFS_HASH_SIZE];
+
+/* Root node and mount state */
+static fs_node_t initramfs_root_node;
+static bool initramfs_mounted = false;
+
+/* Node for finddir results (the VFS path cache keeps its own copy) */
+static fs_node_t initramfs_found_node;
+
+/* Static directory entry for readdir */
+static dirent_t initramfs_dirent;
+
+/* Filesystem type for registration */
+static filesystem_t initramfs_fstype = {
+    .name = "initramfs",
+    .mount = initramfs_mount,
+    .unmount = initramfs_unmount
+};
+
+/* Forward declarations */
+static int initramfs_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
+static dirent_t *initramfs_readdir(fs_node_t *node, uint32_t index);
+static fs_node_t *initramfs_finddir(fs_node_t *node, const char *name);
+
+/**
+ * Parse an 8-digit ASCII hex field of a cpio header
+ */
+static uint32_t initramfs_hex(const char *field) {
+    uint32_t value = 0;
+
+    for (int i = 0; i < 8; i++) {
+        char c = field[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        }
+    }
+
+    return value;
+}
+
+/**
+ * Round up to the 4-byte alignment of the newc format
+ */
+static inline uint32_t initramfs_align4(uint32_t value) {
+    return (value + 3) & ~3u;
+}
+
+/**
+ * Hash a directory entry key into a bucket index (FNV-1a)
+ */
+static uint32_t initramfs_hash_name(int16_t parent, const char *name, uint32_t len) {
+    uint32_t hash = 2166136261u ^ (uint32_t)parent;
+
+    for (uint32_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+
+    return hash % INITRAMFS_HASH_SIZE;
+}
+
+/**
+ * Find a child of a directory by name
+ * @param len: Name length (name need not be terminated)
+ * @return Entry index, or -1 if not found
+ */
+static int16_t initramfs_lookup(int16_t dir, const char *name, uint32_t len) {
+    if (len >= INITRAMFS_MAX_NAME) {
+        return -1;
+    }
+
+    int16_t index = initramfs_hash[initramfs_hash_name(dir, name, len)];
+
+    while (index >= 0) {
+        initramfs_entry_t *entry = &initramfs_entries[index];
+        if (entry->parent == dir && strncmp(entry->name, name, len) == 0 &&
+            entry->name[len] == '\0') {
+            return index;
+        }
+        index = entry->hash_next;
+    }
+
+    return -1;
+}
+
+/**
+ * Add an entry to a directory
+ * @return Entry index, or -1 if the table is full or the name too long
+ */
+static int16_t initramfs_add(int16_t dir, const char *name, uint32_t len, uint32_t type) {
+    if (initramfs_entry_count >= INITRAMFS_MAX_ENTRIES || len >= INITRAMFS_MAX_NAME) {
+        return -1;
+    }
+
+    int16_t index = initramfs_entry_count++;
+    initramfs_entry_t *entry = &initramfs_entries[index];
+    initramfs_entry_t *parent = &initramfs_entries[dir];
+
+    memset(entry, 0, sizeof(initramfs_entry_t));
+    memcpy(entry->name, name, len);
+    entry->name[len] = '\0';
+    entry->type = type;
+    entry->parent = dir;
+    entry->next = -1;
+    entry->first_child = -1;
+    entry->last_child = -1;
+
+    /* Append to the directory listing (keeps archive order) */
+    if (parent->last_child >= 0) {
+        initramfs_entries[parent->last_child].next = index;
+    } else {
+        parent->first_child = index;
+    }
+    parent->last_child = index;
+
+    /* Add to the lookup hash */
+    uint32_t bucket = initramfs_hash_name(dir, name, len);
+    entry->hash_next = initramfs_hash[bucket];
+    initramfs_hash[bucket] = index;
+
+    return index;
+}
+
+/**
+ * Enter one archive member into the index
+ * Missing parent directories are created along the way.
+ * @param path: Member path ("./" and "/" prefixes are ignored)
+ */
+static void initramfs_insert(const char *path, uint32_t type, const uint8_t *data, uint32_t size) {
+    int16_t dir = 0;
+
+    while (*path) {
+        /* Skip separators and "." components */
+        while (*path == '/' || (path[0] == '.' && (path[1] == '/' || path[1] == '\0'))) {
+            path++;
+        }
+        if (!*path) {
+            return;
+        }
+
+        uint32_t len = 0;
+        while (path[len] && path[len] != '/') {
+            len++;
+        }
+        bool last = (path[len] == '\0');
+
+        int16_t index = initramfs_lookup(dir, path, len);
+        if (index < 0) {
+            index = initramfs_add(dir, path, len, last ? type : FS_DIRECTORY);
+            if (index < 0) {
+                return;
+            }
+        }
+
+        if (last) {
+            initramfs_entries[index].type = type;
+            initramfs_entries[index].data = data;
+            initramfs_entries[index].size = size;
+            return;
+        }
+
+        if (initramfs_entries[index].type != FS_DIRECTORY) {
+            return;     /* Path goes through a file */
+        }
+
+        dir = index;
+        path += len;
+    }
+}
+
+/**
+ * Index the archive
+ * @return 0 on success, -1 if the archive is malformed
+ */
+static int initramfs_parse(void) {
+    uint32_t offset = 0;
+
+    while (offset + sizeof(cpio_newc_header_t) <= initramfs_size) {
+        const cpio_newc_header_t *header = (const cpio_newc_header_t *)(initramfs_image + offset);
+        if (memcmp(header->magic, CPIO_NEWC_MAGIC, 6) != 0) {
+            return -1;
+        }
+
+        uint32_t mode = initramfs_hex(header->mode);
+        uint32_t filesize = initramfs_hex(header->filesize);
+        uint32_t namesize = initramfs_hex(header->namesize);
+
+        /* Name, then data, each padded to 4 bytes */
+        uint32_t name_offset = offset + sizeof(cpio_newc_header_t);
+        if (namesize == 0 || namesize > initramfs_size - name_offset) {
+            return -1;
+        }
+
+        const char *name = (const char *)(initramfs_image + name_offset);
+        if (name[namesize - 1] != '\0') {
+            return -1;
+        }
+
+        uint32_t data_offset = initramfs_align4(name_offset + namesize);
+        if (data_offset > initramfs_size || filesize > initramfs_size - data_offset) {
+            return -1;
+        }
+
+        if (strcmp(name, CPIO_TRAILER) == 0) {
+            return 0;
+        }
+
+        /* Only regular files and directories; devices, links etc. are skipped */
+        if ((mode & CPIO_MODE_TYPE) == CPIO_MODE_DIR) {
+            initramfs_insert(name, FS_DIRECTORY, NULL, 0);
+        } else if ((mode & CPIO_MODE_TYPE) == CPIO_MODE_FILE) {
+            initramfs_insert(name, FS_FILE, initramfs_image + data_offset, filesize);
+        }
+
+        offset = initramfs_align4(data_offset + filesize);
+    }
+
+    /* Archives end with a trailer record */
+    return -1;
+}
+
+/**
+ * Get the entry behind a node
+ * @return Entry index, or -1 if the node is not an initramfs node
+ */
+static int16_t initramfs_index_of(fs_node_t *node) {
+    if (!node || !initramfs_mounted || node->dev != INITRAMFS_DEV ||
+        node->inode == 0 || node->inode > (uint32_t)initramfs_entry_count) {
+        return -1;
+    }
+
+    return (int16_t)(node->inode - 1);
+}
+
+/**
+ * Fill a VFS node from an entry
+ */
+static void initramfs_fill_node(fs_node_t *node, int16_t index) {
+    initramfs_entry_t *entry = &initramfs_entries[index];
+
+    memset(node, 0, sizeof(fs_node_t));
+    strcpy(node->name, entry->name);
+    node->flags = entry->type;
+    node->inode = index + 1;
+    node->length = entry->size;
+    node->dev = INITRAMFS_DEV;
+
+    if (entry->type == FS_DIRECTORY) {
+        node->readdir = initramfs_readdir;
+        node->finddir = initramfs_finddir;
+    } else {
+        node->read = initramfs_read;
+    }
+}
+
+/**
+ * Read file data
+ */
+static int initramfs_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
+    int16_t index = initramfs_index_of(node);
+    if (index < 0 || initramfs_entries[index].type != FS_FILE) {
+        return FS_ERR_INVALID;
+    }
+
+    initramfs_entry_t *entry = &initramfs_entries[index];
+    if (offset >= entry->size) {
+        return 0;
+    }
+    if (size > entry->size - offset) {
+        size = entry->size - offset;
+    }
+
+    memcpy(buffer, entry->data + offset, size);
+    return size;
+}
+
+/**
+ * Read directory entry by index
+ */
+static dirent_t *initramfs_readdir(fs_node_t *node, uint32_t index) {
+    int16_t dir = initramfs_index_of(node);
+    if (dir < 0 || initramfs_entries[dir].type != FS_DIRECTORY) {
+        return NULL;
+    }
+
+    int16_t child = initramfs_entries[dir].first_child;
+    while (child >= 0 && index > 0) {
+        child = initramfs_entries[child].next;
+        index--;
+    }
+
+    if (child < 0) {
+        return NULL;
+    }
+
+    strcpy(initramfs_dirent.name, initramfs_entries[child].name);
+    initramfs_dirent.inode = child + 1;
+    return &initramfs_dirent;
+}
+
+/**
+ * Find a file in a directory
+ */
+static fs_node_t *initramfs_finddir(fs_node_t *node, const char *name) {
+    int16_t dir = initramfs_index_of(node);
+    if (dir < 0 || initramfs_entries[dir].type != FS_DIRECTORY) {
+        return NULL;
+    }
+
+    int16_t index = initramfs_lookup(dir, name, strlen(name));
+    if (index < 0) {
+        return NULL;
+    }
+
+    initramfs_fill_node(&initramfs_found_node, index);
+    return &initramfs_found_node;
+}
+
+/**
+ * Initialize the initramfs driver
+ */
+void initramfs_init(const uint8_t *image, uint32_t size) {
+    initramfs_image = image;
+    initramfs_size = size;
+    initramfs_mounted = false;
+
+    /* Register filesystem type */
+    fs_register(&initramfs_fstype);
+}
+
+/**
+ * Mount the initramfs
+ */
+fs_node_t *initramfs_mount(uint8_t drive) {
+    (void)drive;
+
+    if (initramfs_mounted) {
+        return &initramfs_root_node;
+    }
+
+    if (!initramfs_image || initramfs_size == 0) {
+        return NULL;
+    }
+
+    memset(initramfs_entries, 0, sizeof(initramfs_entries));
+    memset(initramfs_hash, 0xFF, sizeof(initramfs_hash));   /* All chains empty (-1) */
+
+    /* Root directory */
+    initramfs_entry_t *root = &initramfs_entries[0];
+    root->type = FS_DIRECTORY;
+    root->parent = -1;
+    root->hash_next = -1;
+    root->next = -1;
+    root->first_child = -1;
+    root->last_child = -1;
+    initramfs_entry_count = 1;
+
+    if (initramfs_parse() != 0) {
+        return NULL;
+    }
+
+    initramfs_mounted = true;
+    initramfs_fill_node(&initramfs_root_node, 0);
+    return &initramfs_root_node;
+}
+
+/**
+ * Unmount the initramfs
+ */
+int initramfs_unmount(fs_node_t *root) {
+    if (root != &initramfs_root_node || !initramfs_mounted) {
+        return FS_ERR_INVALID;
+    }
+
+    initramfs_mounted = false;
+    return FS_OK;
+}
@@ -4,14 +4,12 @@
  */
 
 #include <iso9660.h>
+#include <cachefs.h>
 #include <ide.h>
 #include <kernel.h>
 #include <string.h>
 #include <vga.h>
 
-/* Maximum cached directory entries */
-#define ISO9660_MAX_CACHED_ENTRIES 64
-
 /* Maximum long filename length */
 #define ISO9660_MAX_LONGNAME 256
 
@@ -24,13 +22,23 @@ static uint8_t iso9660_cont_buf[ISO9660_SECTOR_SIZE];
 /* Static directory entry for readdir */
 static dirent_t iso9660_dirent;
 
-/* Node cache for finddir results */
-static fs_node_t iso9660_node_cache[ISO9660_MAX_CACHED_ENTRIES];
-static iso9660_file_t iso9660_file_cache[ISO9660_MAX_CACHED_ENTRIES];
-static int iso9660_cache_index = 0;
+/* Per-volume private data, one slot per IDE drive (nodes point to theirs) */
+static iso9660_fs_t iso9660_volumes[IDE_MAX_DRIVES];
+
+/* Asynchronous page read in flight, one per IDE drive */
+typedef struct {
+    iso9660_fs_t *fs;           /* Volume */
+    uint32_t extent;            /* Extent LBA of the file */
+    uint32_t page;              /* Page index within the file */
+    uint8_t *buffer;            /* Page being filled */
+    uint32_t bytes;             /* File bytes in the page */
+    uint8_t count;              /* Sectors requested */
+    fs_io_done_fn done;         /* VFS completion callback */
+    void *ctx;                  /* Callback argument */
+    bool active;                /* Slot in use */
+} iso9660_async_t;
 
-/* Filesystem private data */
-static iso9660_fs_t iso9660_fs_data;
+static iso9660_async_t iso9660_pending[IDE_MAX_DRIVES];
 
 /* Filesystem type for registration */
 static filesystem_t iso9660_fstype = {
@@ -41,6 +49,9 @@ static filesystem_t iso9660_fstype = {
 
 /* Forward declarations */
 static int iso9660_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
+static int iso9660_readpage(fs_node_t *node, uint32_t index, uint8_t *buffer);
+static int iso9660_readpage_async(fs_node_t *node, uint32_t index, uint8_t *buffer,
+                                  fs_io_done_fn done, void *ctx);
 static dirent_t *iso9660_readdir(fs_node_t *node, uint32_t index);
 static fs_node_t *iso9660_finddir(fs_node_t *node, const char *name);
 
@@ -48,7 +59,11 @@ static fs_node_t *iso9660_finddir(fs_node_t *node, const char *name);
  * Read sectors from CD-ROM
  */
 static int iso9660_read_sectors(uint8_t drive, uint32_t lba, uint8_t count, void *buffer) {
-    return ide_atapi_read(drive, lba, count, buffer);
+    int err = ide_atapi_read(drive, lba, count, buffer);
+    if (err == IDE_OK) {
+        fs_account_sectors(count);
+    }
+    return err;
 }
 
 /**
@@ -138,8 +153,8 @@ static uint16_t susp_get_signature(const uint8_t *sig) {
  * Parse Rock Ridge NM (Name) entries from System Use area
  * Returns 1 if a Rock Ridge name was found, 0 otherwise
  */
-static int iso9660_parse_rock_ridge_name(iso9660_dirent_t *entry, char *dst) {
-    if (!iso9660_fs_data.has_rock_ridge) {
+static int iso9660_parse_rock_ridge_name(iso9660_fs_t *fs, iso9660_dirent_t *entry, char *dst) {
+    if (!fs->has_rock_ridge) {
         return 0;
     }
     
@@ -152,7 +167,7 @@ static int iso9660_parse_rock_ridge_name(iso9660_dirent_t *entry, char *dst) {
     }
     
     /* Skip SUSP skip bytes (from SP entry) */
-    su_offset += iso9660_fs_data.susp_skip;
+    su_offset += fs->susp_skip;
     
     if (su_offset >= entry->length) {
         return 0;  /* No System Use area */
@@ -210,7 +225,7 @@ static int iso9660_parse_rock_ridge_name(iso9660_dirent_t *entry, char *dst) {
             rrip_ce_t *ce = (rrip_ce_t *)su_area;
             
             /* Read continuation area */
-            if (iso9660_read_sectors(iso9660_fs_data.drive, ce->block_le, 1, iso9660_cont_buf) == IDE_OK) {
+            if (iso9660_read_sectors(fs->drive, ce->block_le, 1, iso9660_cont_buf) == IDE_OK) {
                 uint8_t *cont_area = iso9660_cont_buf + ce->offset_le;
                 uint32_t cont_remaining = ce->cont_length_le;
                 
@@ -255,12 +270,12 @@ static int iso9660_parse_rock_ridge_name(iso9660_dirent_t *entry, char *dst) {
 /**
  * Check for SUSP SP entry in root directory to detect Rock Ridge
  */
-static void iso9660_detect_rock_ridge(void) {
-    iso9660_fs_data.has_rock_ridge = 0;
-    iso9660_fs_data.susp_skip = 0;
+static void iso9660_detect_rock_ridge(iso9660_fs_t *fs) {
+    fs->has_rock_ridge = 0;
+    fs->susp_skip = 0;
     
     /* Read first sector of root directory */
-    if (iso9660_read_sectors(iso9660_fs_data.drive, iso9660_fs_data.root_lba, 1, iso9660_sector_buf) != IDE_OK) {
+    if (iso9660_read_sectors(fs->drive, fs->root_lba, 1, iso9660_sector_buf) != IDE_OK) {
         return;
     }
     
@@ -296,14 +311,14 @@ static void iso9660_detect_rock_ridge(void) {
             if (su->length >= 7) {
                 uint8_t *sp_data = su_area + 4;
                 if (sp_data[0] == 0xBE && sp_data[1] == 0xEF) {
-                    iso9660_fs_data.has_rock_ridge = 1;
-                    iso9660_fs_data.susp_skip = sp_data[2];
+                    fs->has_rock_ridge = 1;
+                    fs->susp_skip = sp_data[2];
                     return;
                 }
             }
         } else if (sig == RRIP_SIG_RR) {
             /* Found Rock Ridge extension marker */
-            iso9660_fs_data.has_rock_ridge = 1;
+            fs->has_rock_ridge = 1;
             return;
         }
         
@@ -313,18 +328,17 @@ static void iso9660_detect_rock_ridge(void) {
 }
 
 /**
- * Allocate a node from cache
+ * Allocate a node for the VFS
+ * Nodes are self-contained (extent LBA in inode, size in length), so the
+ * VFS path cache can keep its own copies and free the node.
+ * @return Node, or NULL if out of memory
  */
-static fs_node_t *iso9660_alloc_node(void) {
-    fs_node_t *node = &iso9660_node_cache[iso9660_cache_index];
-    iso9660_file_t *file = &iso9660_file_cache[iso9660_cache_index];
-    
-    iso9660_cache_index = (iso9660_cache_index + 1) % ISO9660_MAX_CACHED_ENTRIES;
+static fs_node_t *iso9660_alloc_node(iso9660_fs_t *fs) {
+    fs_node_t *node = fs_node_alloc();
     
-    memset(node, 0, sizeof(fs_node_t));
-    memset(file, 0, sizeof(iso9660_file_t));
-    
-    node->private_data = file;
+    if (node) {
+        node->private_data = fs;
+    }
     
     return node;
 }
@@ -333,29 +347,29 @@ static fs_node_t *iso9660_alloc_node(void) {
  * Read file data
  */
 static int iso9660_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
-    if (!node || !buffer || !node->private_data) {
+    if (!node || !buffer) {
         return FS_ERR_INVALID;
     }
     
-    iso9660_file_t *file = (iso9660_file_t *)node->private_data;
+    iso9660_fs_t *fs = (iso9660_fs_t *)node->private_data;
     
     /* Check bounds */
-    if (offset >= file->size) {
+    if (offset >= node->length) {
         return 0;
     }
     
-    if (offset + size > file->size) {
-        size = file->size - offset;
+    if (offset + size > node->length) {
+        size = node->length - offset;
     }
     
     /* Calculate starting sector and offset within sector */
-    uint32_t start_sector = file->lba + (offset / ISO9660_SECTOR_SIZE);
+    uint32_t start_sector = node->inode + (offset / ISO9660_SECTOR_SIZE);
     uint32_t sector_offset = offset % ISO9660_SECTOR_SIZE;
     uint32_t bytes_read = 0;
     
     while (bytes_read < size) {
         /* Read sector */
-        if (iso9660_read_sectors(iso9660_fs_data.drive, start_sector, 1, iso9660_sector_buf) != IDE_OK) {
+        if (iso9660_read_sectors(fs->drive, start_sector, 1, iso9660_sector_buf) != IDE_OK) {
             return FS_ERR_IO;
         }
         
@@ -376,25 +390,146 @@ static int iso9660_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t
     return bytes_read;
 }
 
+/**
+ * Read one page of file data for the VFS page cache
+ * Reads the whole page in a single device request
+ */
+static int iso9660_readpage(fs_node_t *node, uint32_t index, uint8_t *buffer) {
+    if (!node || !buffer) {
+        return FS_ERR_INVALID;
+    }
+    
+    iso9660_fs_t *fs = (iso9660_fs_t *)node->private_data;
+    uint32_t offset = index * FS_PAGE_SIZE;
+    uint32_t bytes = 0;
+    
+    if (offset < node->length) {
+        bytes = node->length - offset;
+        if (bytes > FS_PAGE_SIZE) {
+            bytes = FS_PAGE_SIZE;
+        }
+        
+        /* Store pages read in the background, then try the disk cache
+         * before the CD-ROM */
+        cachefs_flush();
+        if (cachefs_read(fs->cache_volume, node->inode, index, buffer, bytes) != CACHEFS_OK) {
+            uint8_t count = (bytes + ISO9660_SECTOR_SIZE - 1) / ISO9660_SECTOR_SIZE;
+            uint32_t lba = node->inode + offset / ISO9660_SECTOR_SIZE;
+            if (iso9660_read_sectors(fs->drive, lba, count, buffer) != IDE_OK) {
+                return FS_ERR_IO;
+            }
+            cachefs_store(fs->cache_volume, node->inode, index, buffer, bytes);
+        }
+    }
+    
+    /* Zero the tail past end of file */
+    if (bytes < FS_PAGE_SIZE) {
+        memset(buffer + bytes, 0, FS_PAGE_SIZE - bytes);
+    }
+    
+    return FS_OK;
+}
+
+/**
+ * Device completion for iso9660_readpage_async() (interrupt context)
+ */
+static void iso9660_readpage_done(void *ctx, int status) {
+    iso9660_async_t *req = (iso9660_async_t *)ctx;
+    
+    req->active = false;
+    
+    if (status == IDE_OK) {
+        fs_account_sectors(req->count);
+        
+        /* Disk writes wait until the kernel is out of the interrupt */
+        cachefs_queue_store(req->fs->cache_volume, req->extent, req->page, req->buffer,
+                            req->bytes);
+        
+        /* Zero the tail past end of file */
+        if (req->bytes < FS_PAGE_SIZE) {
+            memset(req->buffer + req->bytes, 0, FS_PAGE_SIZE - req->bytes);
+        }
+    }
+    
+    req->done(req->ctx, status == IDE_OK ? FS_OK : FS_ERR_IO);
+}
+
+/**
+ * Start reading one page of file data in the background
+ * Extents are contiguous, so a page is a single interrupt-driven request.
+ */
+static int iso9660_readpage_async(fs_node_t *node, uint32_t index, uint8_t *buffer,
+                                  fs_io_done_fn done, void *ctx) {
+    if (!node || !buffer || !done) {
+        return FS_ERR_INVALID;
+    }
+    
+    iso9660_fs_t *fs = (iso9660_fs_t *)node->private_data;
+    uint32_t offset = index * FS_PAGE_SIZE;
+    
+    if (offset >= node->length) {
+        return FS_ERR_INVALID;
+    }
+    
+    uint32_t bytes = node->length - offset;
+    if (bytes > FS_PAGE_SIZE) {
+        bytes = FS_PAGE_SIZE;
+    }
+    
+    /* Pages in the disk cache complete at once */
+    if (cachefs_read(fs->cache_volume, node->inode, index, buffer, bytes) == CACHEFS_OK) {
+        if (bytes < FS_PAGE_SIZE) {
+            memset(buffer + bytes, 0, FS_PAGE_SIZE - bytes);
+        }
+        done(ctx, FS_OK);
+        return FS_OK;
+    }
+    
+    iso9660_async_t *req = &iso9660_pending[fs->drive];
+    if (req->active) {
+        return FS_ERR_BUSY;
+    }
+    
+    req->fs = fs;
+    req->extent = node->inode;
+    req->page = index;
+    req->buffer = buffer;
+    req->bytes = bytes;
+    req->count = (req->bytes + ISO9660_SECTOR_SIZE - 1) / ISO9660_SECTOR_SIZE;
+    req->done = done;
+    req->ctx = ctx;
+    req->active = true;
+    
+    uint32_t lba = node->inode + offset / ISO9660_SECTOR_SIZE;
+    int err = ide_atapi_read_async(fs->drive, lba, req->count, buffer, iso9660_readpage_done, req);
+    if (err != IDE_OK) {
+        req->active = false;
+    }
+    if (err == IDE_ERR_BUSY) {
+        return FS_ERR_BUSY;
+    }
+    
+    return (err == IDE_OK) ? FS_OK : FS_ERR_IO;
+}
+
 /**
  * Read directory entry by index
  */
 static dirent_t *iso9660_readdir(fs_node_t *node, uint32_t index) {
-    if (!node || !node->private_data) {
+    if (!node) {
         return NULL;
     }
     
-    iso9660_file_t *dir = (iso9660_file_t *)node->private_data;
-    
-    uint32_t current_sector = dir->lba;
-    uint32_t bytes_remaining = dir->size;
+    iso9660_fs_t *fs = (iso9660_fs_t *)node->private_data;
+    uint32_t current_sector = node->inode;
+    uint32_t bytes_remaining = node->length;
     uint32_t entry_index = 0;
     uint32_t sector_offset = 0;
     
     while (bytes_remaining > 0) {
         /* Read sector if needed */
         if (sector_offset == 0 || sector_offset >= ISO9660_SECTOR_SIZE) {
-            if (iso9660_read_sectors(iso9660_fs_data.drive, current_sector, 1, iso9660_sector_buf) != IDE_OK) {
+            if (iso9660_read_sectors(fs->drive, current_sector, 1, iso9660_sector_buf) != IDE_OK) {
                 return NULL;
             }
             sector_offset = 0;
@@ -426,9 +561,9 @@ static dirent_t *iso9660_readdir(fs_node_t *node, uint32_t index) {
         /* Check if this is the entry we want */
         if (entry_index == index) {
             /* Try Rock Ridge name first */
-            if (!iso9660_parse_rock_ridge_name(entry, iso9660_dirent.name)) {
+            if (!iso9660_parse_rock_ridge_name(fs, entry, iso9660_dirent.name)) {
                 /* Try Joliet (UCS-2) if available */
-                if (iso9660_fs_data.has_joliet) {
+                if (fs->has_joliet) {
                     iso9660_ucs2_to_ascii((const uint8_t *)entry->name, entry->name_length, 
                                           iso9660_dirent.name, FS_MAX_NAME);
                 } else {
@@ -449,108 +584,370 @@ static dirent_t *iso9660_readdir(fs_node_t *node, uint32_t index) {
 }
 
 /**
- * Find a file in a directory
+ * Get the display name of a directory entry
+ * Prefers Rock Ridge, then Joliet, then the primary identifier
  */
-static fs_node_t *iso9660_finddir(fs_node_t *node, const char *name) {
-    if (!node || !name || !node->private_data) {
+static void iso9660_entry_name(iso9660_fs_t *fs, iso9660_dirent_t *entry, char *dst) {
+    /* Handle "." and ".." */
+    if (entry->name_length == 1 && entry->name[0] == 0) {
+        dst[0] = '.';
+        dst[1] = '\0';
+    } else if (entry->name_length == 1 && entry->name[0] == 1) {
+        dst[0] = '.';
+        dst[1] = '.';
+        dst[2] = '\0';
+    } else if (!iso9660_parse_rock_ridge_name(fs, entry, dst)) {
+        /* Try Joliet (UCS-2) if available */
+        if (fs->has_joliet) {
+            iso9660_ucs2_to_ascii((const uint8_t *)entry->name, entry->name_length,
+                                  dst, ISO9660_MAX_LONGNAME);
+        } else {
+            /* Fall back to standard ISO9660 name */
+            iso9660_parse_filename(entry->name, entry->name_length, dst);
+        }
+    }
+}
+
+/**
+ * Create a node for a directory entry
+ */
+static fs_node_t *iso9660_make_node(iso9660_fs_t *fs, iso9660_dirent_t *entry, const char *name) {
+    fs_node_t *found = iso9660_alloc_node(fs);
+    if (!found) {
         return NULL;
     }
     
-    iso9660_file_t *dir = (iso9660_file_t *)node->private_data;
+    strcpy(found->name, name);
+    found->inode = entry->extent_lba_le;
+    found->length = entry->data_length_le;
+    found->dev = fs->drive;
     
-    uint32_t current_sector = dir->lba;
-    uint32_t bytes_remaining = dir->size;
-    uint32_t sector_offset = 0;
+    if (entry->flags & ISO9660_FLAG_DIRECTORY) {
+        found->flags = FS_DIRECTORY;
+        found->readdir = iso9660_readdir;
+        found->finddir = iso9660_finddir;
+    } else {
+        found->flags = FS_FILE;
+        found->read = iso9660_read;
+        found->readpage = iso9660_readpage;
+        found->readpage_async = iso9660_readpage_async;
+    }
     
-    while (bytes_remaining > 0) {
-        /* Read sector if needed */
-        if (sector_offset == 0 || sector_offset >= ISO9660_SECTOR_SIZE) {
-            if (iso9660_read_sectors(iso9660_fs_data.drive, current_sector, 1, iso9660_sector_buf) != IDE_OK) {
-                return NULL;
-            }
-            sector_offset = 0;
-            current_sector++;
+    return found;
+}
+
+/**
+ * Compare two identifier parts padded with spaces (ECMA-119 9.3)
+ */
+static int iso9660_compare_padded(const char *a, int a_len, const char *b, int b_len) {
+    int len = (a_len > b_len) ? a_len : b_len;
+    
+    for (int i = 0; i < len; i++) {
+        uint8_t ca = (i < a_len) ? (uint8_t)a[i] : ' ';
+        uint8_t cb = (i < b_len) ? (uint8_t)b[i] : ' ';
+        if (ca != cb) {
+            return ca - cb;
+        }
+    }
+    
+    return 0;
+}
+
+/**
+ * Compare a lookup name against the identifier of a directory entry
+ * Uses the ECMA-119 ordering directories are sorted by: file name part
+ * first, then extension, each padded with spaces. Primary identifiers
+ * are upper case, so the lookup name is folded before comparing.
+ * @return <0 if name sorts before the entry, 0 if equal, >0 if after
+ */
+static int iso9660_compare_ident(iso9660_fs_t *fs, const char *name, iso9660_dirent_t *entry) {
+    char ident[ISO9660_MAX_LONGNAME];
+    char target[ISO9660_MAX_LONGNAME];
+    int i;
+    
+    /* Get raw identifier without version number */
+    if (fs->has_joliet) {
+        iso9660_ucs2_to_ascii((const uint8_t *)entry->name, entry->name_length,
+                              ident, ISO9660_MAX_LONGNAME);
+    } else {
+        for (i = 0; i < entry->name_length && entry->name[i] != ';' &&
+                    i < ISO9660_MAX_LONGNAME - 1; i++) {
+            ident[i] = entry->name[i];
+        }
+        ident[i] = '\0';
+    }
+    
+    /* Primary identifiers only use upper case d-characters */
+    for (i = 0; name[i] && i < ISO9660_MAX_LONGNAME - 1; i++) {
+        char c = name[i];
+        if (!fs->has_joliet && c >= 'a' && c <= 'z') {
+            c = c - 'a' + 'A';
+        }
+        target[i] = c;
+    }
+    target[i] = '\0';
+    
+    /* Split both at the first dot into name and extension */
+    const char *ident_dot = strchr(ident, '.');
+    const char *target_dot = strchr(target, '.');
+    int ident_name_len = ident_dot ? (int)(ident_dot - ident) : (int)strlen(ident);
+    int target_name_len = target_dot ? (int)(target_dot - target) : (int)strlen(target);
+    
+    int cmp = iso9660_compare_padded(target, target_name_len, ident, ident_name_len);
+    if (cmp != 0) {
+        return cmp;
+    }
+    
+    const char *ident_ext = ident_dot ? ident_dot + 1 : "";
+    const char *target_ext = target_dot ? target_dot + 1 : "";
+    return iso9660_compare_padded(target_ext, (int)strlen(target_ext),
+                                  ident_ext, (int)strlen(ident_ext));
+}
+
+/**
+ * Get the first record of the directory sector in the sector buffer
+ * Skips "." and ".." so sector 0 samples its first real entry.
+ * @return First record, or NULL if the sector holds no records
+ */
+static iso9660_dirent_t *iso9660_first_record(uint32_t limit) {
+    uint32_t offset = 0;
+    
+    while (offset < limit) {
+        iso9660_dirent_t *entry = (iso9660_dirent_t *)(iso9660_sector_buf + offset);
+        
+        if (entry->length == 0) {
+            return NULL;
         }
         
-        /* Get directory entry */
-        iso9660_dirent_t *entry = (iso9660_dirent_t *)(iso9660_sector_buf + sector_offset);
+        if (!(entry->name_length == 1 && (entry->name[0] == 0 || entry->name[0] == 1))) {
+            return entry;
+        }
         
-        /* Check for end of sector */
+        offset += entry->length;
+    }
+    
+    return NULL;
+}
+
+/**
+ * Scan the directory sector in the sector buffer for a name
+ * @param limit: Number of valid directory bytes in the sector
+ * @return Node for the entry, or NULL if not in this sector
+ */
+static fs_node_t *iso9660_scan_sector(iso9660_fs_t *fs, uint32_t limit, const char *name) {
+    char parsed_name[ISO9660_MAX_LONGNAME];
+    uint32_t offset = 0;
+    
+    while (offset < limit) {
+        iso9660_dirent_t *entry = (iso9660_dirent_t *)(iso9660_sector_buf + offset);
+        
+        /* Rest of the sector is padding */
         if (entry->length == 0) {
-            uint32_t skip = ISO9660_SECTOR_SIZE - sector_offset;
-            if (skip > bytes_remaining) {
-                break;
-            }
-            bytes_remaining -= skip;
-            sector_offset = ISO9660_SECTOR_SIZE;
-            continue;
+            break;
+        }
+        
+        iso9660_entry_name(fs, entry, parsed_name);
+        
+        if (iso9660_compare_name(parsed_name, name) == 0) {
+            return iso9660_make_node(fs, entry, parsed_name);
+        }
+        
+        offset += entry->length;
+    }
+    
+    return NULL;
+}
+
+/**
+ * Check whether a record has a Rock Ridge name other than its identifier
+ * @return 1 if the Rock Ridge name differs from the primary identifier
+ */
+static int iso9660_rr_renamed(iso9660_fs_t *fs, iso9660_dirent_t *entry) {
+    char rr_name[ISO9660_MAX_LONGNAME];
+    char primary_name[ISO9660_MAX_LONGNAME];
+    
+    if (!fs->has_rock_ridge || !iso9660_parse_rock_ridge_name(fs, entry, rr_name)) {
+        return 0;
+    }
+    if (entry->name_length == 1 && (entry->name[0] == 0 || entry->name[0] == 1)) {
+        return 0;
+    }
+    
+    iso9660_parse_filename(entry->name, entry->name_length, primary_name);
+    return iso9660_compare_name(rr_name, primary_name) != 0;
+}
+
+/**
+ * Find a file by binary search over the sectors of a directory
+ * ECMA-119 keeps directory records sorted by identifier and records never
+ * cross sector boundaries, so the first record of each sector bounds the
+ * names it can hold. Only O(log n) sectors are read for a lookup.
+ * @param usable: Set to 0 if a sector could not be read and the caller
+ *                must scan linearly
+ * @return Node, or NULL if not found in the candidate sector
+ */
+static fs_node_t *iso9660_finddir_sorted(fs_node_t *dir, const char *name, int *usable) {
+    iso9660_fs_t *fs = (iso9660_fs_t *)dir->private_data;
+    uint32_t sector_count = (dir->length + ISO9660_SECTOR_SIZE - 1) / ISO9660_SECTOR_SIZE;
+    uint32_t lo = 0;
+    uint32_t hi = sector_count - 1;
+    int32_t loaded = -1;
+    
+    *usable = 1;
+    
+    /* Find the last sector whose first record sorts at or before name */
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo + 1) / 2;
+        
+        if (iso9660_read_sectors(fs->drive, dir->inode + mid, 1, iso9660_sector_buf) != IDE_OK) {
+            *usable = 0;
+            return NULL;
         }
+        loaded = (int32_t)mid;
         
-        /* Parse filename */
-        char parsed_name[ISO9660_MAX_LONGNAME];
+        iso9660_dirent_t *first = iso9660_first_record(ISO9660_SECTOR_SIZE);
+        if (!first) {
+            /* Empty trailing sector */
+            hi = mid - 1;
+            continue;
+        }
         
-        /* Handle "." and ".." */
-        if (entry->name_length == 1 && entry->name[0] == 0) {
-            parsed_name[0] = '.';
-            parsed_name[1] = '\0';
-        } else if (entry->name_length == 1 && entry->name[0] == 1) {
-            parsed_name[0] = '.';
-            parsed_name[1] = '.';
-            parsed_name[2] = '\0';
+        if (iso9660_compare_ident(fs, name, first) < 0) {
+            hi = mid - 1;
         } else {
-            /* Try Rock Ridge name first */
-            if (!iso9660_parse_rock_ridge_name(entry, parsed_name)) {
-                /* Try Joliet (UCS-2) if available */
-                if (iso9660_fs_data.has_joliet) {
-                    iso9660_ucs2_to_ascii((const uint8_t *)entry->name, entry->name_length,
-                                          parsed_name, ISO9660_MAX_LONGNAME);
-                } else {
-                    /* Fall back to standard ISO9660 name */
-                    iso9660_parse_filename(entry->name, entry->name_length, parsed_name);
-                }
-            }
+            lo = mid;
+        }
+    }
+    
+    /* Scan only the candidate sector */
+    if (loaded != (int32_t)lo) {
+        if (iso9660_read_sectors(fs->drive, dir->inode + lo, 1, iso9660_sector_buf) != IDE_OK) {
+            *usable = 0;
+            return NULL;
+        }
+    }
+    
+    uint32_t limit = dir->length - lo * ISO9660_SECTOR_SIZE;
+    if (limit > ISO9660_SECTOR_SIZE) {
+        limit = ISO9660_SECTOR_SIZE;
+    }
+    
+    return iso9660_scan_sector(fs, limit, name);
+}
+
+/**
+ * Check whether the names of a directory follow its sorted identifiers
+ * A Rock Ridge name that differs from its primary identifier (mangled to
+ * 8.3, truncated, made unique) sorts under the identifier, possibly in
+ * another sector than the name leads to. Every record is checked once per
+ * directory and the result kept.
+ * @return 1 if a binary search miss is final, 0 if misses must scan
+ */
+static int iso9660_dir_sorted(fs_node_t *dir) {
+    iso9660_fs_t *fs = (iso9660_fs_t *)dir->private_data;
+    
+    if (!fs->has_rock_ridge) {
+        return 1;
+    }
+    for (int i = 0; i < ISO9660_ORDER_CACHE; i++) {
+        if (fs->order[i].extent == dir->inode) {
+            return fs->order[i].sorted;
+        }
+    }
+    
+    int sorted = 1;
+    uint32_t bytes_remaining = dir->length;
+    for (uint32_t sector = dir->inode; sorted && bytes_remaining > 0; sector++) {
+        if (iso9660_read_sectors(fs->drive, sector, 1, iso9660_sector_buf) != IDE_OK) {
+            return 0;
         }
         
-        /* Compare names */
-        if (iso9660_compare_name(parsed_name, name) == 0) {
-            /* Found it! Create a node */
-            fs_node_t *found = iso9660_alloc_node();
-            iso9660_file_t *file = (iso9660_file_t *)found->private_data;
-            
-            strcpy(found->name, parsed_name);
-            found->inode = entry->extent_lba_le;
-            found->length = entry->data_length_le;
-            
-            file->lba = entry->extent_lba_le;
-            file->size = entry->data_length_le;
-            file->flags = entry->flags;
-            
-            if (entry->flags & ISO9660_FLAG_DIRECTORY) {
-                found->flags = FS_DIRECTORY;
-                found->readdir = iso9660_readdir;
-                found->finddir = iso9660_finddir;
-            } else {
-                found->flags = FS_FILE;
-                found->read = iso9660_read;
+        uint32_t limit = (bytes_remaining > ISO9660_SECTOR_SIZE) ? ISO9660_SECTOR_SIZE : bytes_remaining;
+        uint32_t offset = 0;
+        while (offset < limit) {
+            iso9660_dirent_t *entry = (iso9660_dirent_t *)(iso9660_sector_buf + offset);
+            if (entry->length == 0) {
+                break;
             }
-            
+            if (iso9660_rr_renamed(fs, entry)) {
+                sorted = 0;
+                break;
+            }
+            offset += entry->length;
+        }
+        bytes_remaining -= limit;
+    }
+    
+    iso9660_order_t *slot = &fs->order[fs->order_next];
+    fs->order_next = (fs->order_next + 1) % ISO9660_ORDER_CACHE;
+    slot->extent = dir->inode;
+    slot->sorted = (uint8_t)sorted;
+    return sorted;
+}
+
+/**
+ * Find a file by scanning every sector of a directory
+ */
+static fs_node_t *iso9660_finddir_linear(fs_node_t *dir, const char *name) {
+    iso9660_fs_t *fs = (iso9660_fs_t *)dir->private_data;
+    uint32_t current_sector = dir->inode;
+    uint32_t bytes_remaining = dir->length;
+    
+    while (bytes_remaining > 0) {
+        if (iso9660_read_sectors(fs->drive, current_sector, 1, iso9660_sector_buf) != IDE_OK) {
+            return NULL;
+        }
+        
+        uint32_t limit = (bytes_remaining > ISO9660_SECTOR_SIZE) ? ISO9660_SECTOR_SIZE : bytes_remaining;
+        
+        fs_node_t *found = iso9660_scan_sector(fs, limit, name);
+        if (found) {
             return found;
         }
         
-        sector_offset += entry->length;
-        bytes_remaining -= entry->length;
+        bytes_remaining -= limit;
+        current_sector++;
     }
     
     return NULL;
 }
 
+/**
+ * Find a file in a directory
+ */
+static fs_node_t *iso9660_finddir(fs_node_t *node, const char *name) {
+    if (!node || !name) {
+        return NULL;
+    }
+    
+    iso9660_fs_t *fs = (iso9660_fs_t *)node->private_data;
+    
+    /* "." and ".." live at the start of the first sector */
+    int is_dot = (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')));
+    
+    if (!is_dot && node->length > ISO9660_SECTOR_SIZE) {
+        int usable;
+        fs_node_t *found = iso9660_finddir_sorted(node, name, &usable);
+        if (found) {
+            return found;
+        }
+        
+        /* A miss is final when every name follows the sorted identifiers.
+         * Joliet identifiers are sorted by case-sensitive UCS-2 code while
+         * lookups ignore case, so Joliet misses still scan. */
+        if (usable && !fs->has_joliet && iso9660_dir_sorted(node)) {
+            return NULL;
+        }
+    }
+    
+    return iso9660_finddir_linear(node, name);
+}
+
 /**
  * Initialize ISO9660 filesystem driver
  */
 void iso9660_init(void) {
-    iso9660_cache_index = 0;
-    memset(iso9660_node_cache, 0, sizeof(iso9660_node_cache));
-    memset(iso9660_file_cache, 0, sizeof(iso9660_file_cache));
+    memset(iso9660_volumes, 0, sizeof(iso9660_volumes));
     
     /* Register filesystem type */
     fs_register(&iso9660_fstype);
@@ -563,10 +960,12 @@ fs_node_t *iso9660_mount(uint8_t drive) {
     ide_device_t *dev = ide_get_device(drive);
     
     /* Check if device exists and is ATAPI */
-    if (!dev || dev->type != IDE_TYPE_ATAPI) {
+    if (drive >= IDE_MAX_DRIVES || !dev || dev->type != IDE_TYPE_ATAPI) {
         return NULL;
     }
     
+    iso9660_fs_t *fs = &iso9660_volumes[drive];
+    
     /* Read Primary Volume Descriptor (sector 16) */
     if (iso9660_read_sectors(drive, ISO9660_SYSTEM_AREA, 1, iso9660_sector_buf) != IDE_OK) {
         return NULL;
@@ -585,24 +984,35 @@ fs_node_t *iso9660_mount(uint8_t drive) {
     iso9660_dirent_t *root_entry = (iso9660_dirent_t *)pvd->root_dir;
     
     /* Store filesystem info */
-    iso9660_fs_data.drive = drive;
-    iso9660_fs_data.root_lba = root_entry->extent_lba_le;
-    iso9660_fs_data.root_size = root_entry->data_length_le;
-    iso9660_fs_data.block_size = pvd->logical_block_le;
+    fs->drive = drive;
+    fs->root_lba = root_entry->extent_lba_le;
+    fs->root_size = root_entry->data_length_le;
+    fs->block_size = pvd->logical_block_le;
     
     /* Copy volume ID */
-    memcpy(iso9660_fs_data.volume_id, pvd->volume_id, 32);
-    iso9660_fs_data.volume_id[32] = '\0';
+    memcpy(fs->volume_id, pvd->volume_id, 32);
+    fs->volume_id[32] = '\0';
     
     /* Trim trailing spaces from volume ID */
-    for (int i = 31; i >= 0 && iso9660_fs_data.volume_id[i] == ' '; i--) {
-        iso9660_fs_data.volume_id[i] = '\0';
+    for (int i = 31; i >= 0 && fs->volume_id[i] == ' '; i--) {
+        fs->volume_id[i] = '\0';
     }
     
+    /* File pages are cached on disk under the volume ID and creation
+     * date, which together tell discs with the same label apart */
+    char cache_key[CACHEFS_KEY_SIZE];
+    memcpy(cache_key, pvd->volume_id, 32);
+    memcpy(cache_key + 32, pvd->creation_date, 16);
+    fs->cache_volume = cachefs_attach(cache_key);
+    
+    /* Directories of the previous disc */
+    memset(fs->order, 0, sizeof(fs->order));
+    fs->order_next = 0;
+    
     /* Initialize Joliet fields */
-    iso9660_fs_data.has_joliet = 0;
-    iso9660_fs_data.joliet_root_lba = 0;
-    iso9660_fs_data.joliet_root_size = 0;
+    fs->has_joliet = 0;
+    fs->joliet_root_lba = 0;
+    fs->joliet_root_size = 0;
     
     /* Scan for Supplementary Volume Descriptor (Joliet) */
     uint32_t vd_sector = ISO9660_SYSTEM_AREA;
@@ -630,13 +1040,13 @@ fs_node_t *iso9660_mount(uint8_t drive) {
                 (vd->unused3[2] == 0x40 || vd->unused3[2] == 0x43 || vd->unused3[2] == 0x45)) {
                 /* Found Joliet! Use its root directory */
                 iso9660_dirent_t *joliet_root = (iso9660_dirent_t *)vd->root_dir;
-                iso9660_fs_data.has_joliet = 1;
-                iso9660_fs_data.joliet_root_lba = joliet_root->extent_lba_le;
-                iso9660_fs_data.joliet_root_size = joliet_root->data_length_le;
+                fs->has_joliet = 1;
+                fs->joliet_root_lba = joliet_root->extent_lba_le;
+                fs->joliet_root_size = joliet_root->data_length_le;
                 
                 /* Use Joliet root directory instead of primary */
-                iso9660_fs_data.root_lba = iso9660_fs_data.joliet_root_lba;
-                iso9660_fs_data.root_size = iso9660_fs_data.joliet_root_size;
+                fs->root_lba = fs->joliet_root_lba;
+                fs->root_size = fs->joliet_root_size;
                 break;
             }
         }
@@ -649,23 +1059,22 @@ fs_node_t *iso9660_mount(uint8_t drive) {
     }
     
     /* Detect Rock Ridge extensions for long filename support */
-    iso9660_detect_rock_ridge();
+    iso9660_detect_rock_ridge(fs);
     
     /* Create root node */
-    fs_node_t *root = iso9660_alloc_node();
-    iso9660_file_t *root_file = (iso9660_file_t *)root->private_data;
+    fs_node_t *root = iso9660_alloc_node(fs);
+    if (!root) {
+        return NULL;
+    }
     
     strcpy(root->name, "/");
     root->flags = FS_DIRECTORY;
-    root->inode = iso9660_fs_data.root_lba;
-    root->length = iso9660_fs_data.root_size;
+    root->inode = fs->root_lba;
+    root->length = fs->root_size;
+    root->dev = drive;
     root->readdir = iso9660_readdir;
     root->finddir = iso9660_finddir;
     
-    root_file->lba = iso9660_fs_data.root_lba;
-    root_file->size = iso9660_fs_data.root_size;
-    root_file->flags = ISO9660_FLAG_DIRECTORY;
-    
     return root;
 }
 
@@ -679,16 +1088,22 @@ int iso9660_unmount(fs_node_t *root) {
 }
 
 /**
- * Get mounted volume ID
+ * Get the volume ID of the filesystem mounted from a drive
  */
-const char *iso9660_get_volume_id(void) {
-    return iso9660_fs_data.volume_id;
+const char *iso9660_get_volume_id(uint8_t drive) {
+    if (drive >= IDE_MAX_DRIVES) {
+        return "";
+    }
+    return iso9660_volumes[drive].volume_id;
 }
 
 /**
  * Check if Rock Ridge extensions are available
  * @return 1 if Rock Ridge is supported, 0 otherwise
  */
-int iso9660_has_rock_ridge(void) {
-    return iso9660_fs_data.has_rock_ridge;
+int iso9660_has_rock_ridge(uint8_t drive) {
+    if (drive >= IDE_MAX_DRIVES) {
+        return 0;
+    }
+    return iso9660_volumes[drive].has_rock_ridge;
 }
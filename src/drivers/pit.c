@@ -14,6 +14,9 @@ static volatile uint32_t pit_ticks = 0;
 /* Current timer frequency */
 static uint32_t pit_frequency = 0;
 
+/* Current channel 0 divisor */
+static uint32_t pit_divisor = 0;
+
 /**
  * Timer interrupt handler (IRQ0)
  */
@@ -53,6 +56,7 @@ void pit_set_frequency(uint32_t frequency) {
 
     /* Calculate divisor */
     divisor = PIT_BASE_FREQUENCY / frequency;
+    pit_divisor = divisor;
 
     /* Send command byte: Channel 0, lobyte/hibyte, rate generator, binary */
     outb(PIT_COMMAND, PIT_CHANNEL0 | PIT_LOHI | PIT_MODE2 | PIT_BINARY);
@@ -93,6 +97,38 @@ uint16_t pit_read_count(void) {
     return count;
 }
 
+/**
+ * Get time since PIT initialization in microseconds
+ * Combines the tick count with the progress of channel 0 through the
+ * current tick, so the resolution is about 1us instead of one tick.
+ * Wraps after about 71 minutes.
+ */
+uint32_t pit_get_micros(void) {
+    uint32_t ticks;
+    uint32_t count;
+
+    if (pit_frequency == 0) {
+        return 0;
+    }
+
+    /* Retry if the timer interrupt fired between the two reads */
+    do {
+        ticks = pit_ticks;
+        count = pit_read_count();
+    } while (ticks != pit_ticks);
+
+    /* With interrupts disabled (e.g. inside a syscall) the counter may
+     * have reloaded while IRQ0 is still pending: account for that tick */
+    outb(PIC1_COMMAND, 0x0A);  /* OCW3: read IRR */
+    if ((inb(PIC1_COMMAND) & 0x01) && count > pit_divisor / 2) {
+        ticks++;
+    }
+
+    uint32_t elapsed = (pit_divisor > count) ? pit_divisor - count : 0;
+    uint32_t tick_us = 1000000 / pit_frequency;
+    return ticks * tick_us + (elapsed * tick_us) / pit_divisor;
+}
+
 /**
  * Busy-wait sleep using timer interrupts
  * @param ms: Milliseconds to sleep
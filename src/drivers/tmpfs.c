@@ -0,0 +1,665 @@
+/**
+ * tmpfs Implementation
+ * Writable RAM-backed filesystem for scratch files
+ *
+ * File data lives in a fixed pool of TMPFS_BLOCK_SIZE blocks, and every
+ * file is a short list of extents (runs of contiguous blocks), so reads
+ * and writes copy whole runs at a time. Directory lookups hash the
+ * (parent, name) pair into one table instead of scanning entries.
+ */
+
+#include <tmpfs.h>
+#include <frame.h>
+#include <kernel.h>
+#include <paging.h>
+#include <string.h>
+
+/* Inodes (index 0 is the root directory; node inode numbers are index + 1) */
+static tmpfs_inode_t tmpfs_inodes[TMPFS_MAX_INODES];
+
+/* Lookup hash: first inode of each chain, -1 for empty */
+static int16_t tmpfs_hash[TMPFS_HASH_SIZE];
+
+/* Block allocation bitmap (bit set = block in use) */
+static uint32_t tmpfs_bitmap[TMPFS_MAX_BLOCKS / 32];
+
+/* Storage pool (NULL while not mounted) */
+static uint8_t *tmpfs_pool = NULL;
+static uint32_t tmpfs_block_count = 0;
+static uint32_t tmpfs_blocks_used = 0;
+
+/* Root node */
+static fs_node_t tmpfs_root_node;
+
+/* Node for finddir/create results (the VFS path cache keeps its own copy) */
+static fs_node_t tmpfs_found_node;
+
+/* Static directory entry for readdir */
+static dirent_t tmpfs_dirent;
+
+/* Filesystem type for registration */
+static filesystem_t tmpfs_fstype = {
+    .name = "tmpfs",
+    .mount = tmpfs_mount,
+    .unmount = tmpfs_unmount
+};
+
+/* Forward declarations */
+static int tmpfs_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
+static int tmpfs_write(fs_node_t *node, uint32_t offset, uint32_t size, const uint8_t *buffer);
+static int tmpfs_truncate(fs_node_t *node, uint32_t length);
+static void tmpfs_close(fs_node_t *node);
+static dirent_t *tmpfs_readdir(fs_node_t *node, uint32_t index);
+static fs_node_t *tmpfs_finddir(fs_node_t *node, const char *name);
+static fs_node_t *tmpfs_create(fs_node_t *node, const char *name, uint32_t type);
+static int tmpfs_unlink(fs_node_t *node, const char *name);
+
+/**
+ * Check whether a block is allocated
+ */
+static inline bool tmpfs_block_used(uint32_t block) {
+    return (tmpfs_bitmap[block / 32] & (1u << (block % 32))) != 0;
+}
+
+/**
+ * Mark a run of blocks allocated or free
+ */
+static void tmpfs_mark(uint32_t start, uint32_t count, bool used) {
+    for (uint32_t block = start; block < start + count; block++) {
+        if (used) {
+            tmpfs_bitmap[block / 32] |= 1u << (block % 32);
+        } else {
+            tmpfs_bitmap[block / 32] &= ~(1u << (block % 32));
+        }
+    }
+
+    if (used) {
+        tmpfs_blocks_used += count;
+    } else {
+        tmpfs_blocks_used -= count;
+    }
+}
+
+/**
+ * Number of blocks needed to hold a byte count
+ */
+static inline uint32_t tmpfs_blocks_for(uint32_t bytes) {
+    return (bytes + TMPFS_BLOCK_SIZE - 1) / TMPFS_BLOCK_SIZE;
+}
+
+/**
+ * Find free blocks for a new extent
+ * Takes the first run of want blocks, otherwise the longest free run.
+ * @param want: Blocks wanted
+ * @param start: Set to the first block of the run
+ * @return Run length (at most want), 0 if the pool is full
+ */
+static uint32_t tmpfs_find_run(uint32_t want, uint32_t *start) {
+    uint32_t best_start = 0;
+    uint32_t best_len = 0;
+    uint32_t block = 0;
+
+    while (block < tmpfs_block_count) {
+        /* Skip fully allocated bitmap words */
+        if (block % 32 == 0 && tmpfs_bitmap[block / 32] == 0xFFFFFFFF) {
+            block += 32;
+            continue;
+        }
+
+        if (tmpfs_block_used(block)) {
+            block++;
+            continue;
+        }
+
+        uint32_t run_start = block;
+        while (block < tmpfs_block_count && !tmpfs_block_used(block) &&
+               block - run_start < want) {
+            block++;
+        }
+
+        uint32_t len = block - run_start;
+        if (len == want) {
+            *start = run_start;
+            return len;
+        }
+        if (len > best_len) {
+            best_start = run_start;
+            best_len = len;
+        }
+    }
+
+    *start = best_start;
+    return best_len;
+}
+
+/**
+ * Free blocks from the end of a file until it holds keep blocks
+ */
+static void tmpfs_shrink(tmpfs_inode_t *inode, uint32_t keep) {
+    while (inode->blocks > keep) {
+        tmpfs_extent_t *ext = &inode->extents[inode->extent_count - 1];
+        uint32_t drop = inode->blocks - keep;
+        if (drop > ext->count) {
+            drop = ext->count;
+        }
+
+        tmpfs_mark(ext->start + ext->count - drop, drop, false);
+        ext->count -= drop;
+        inode->blocks -= drop;
+
+        if (ext->count == 0) {
+            inode->extent_count--;
+        }
+    }
+}
+
+/**
+ * Allocate blocks at the end of a file until it holds need blocks
+ * Grows the last extent in place when the following blocks are free.
+ * New extents ask for at least as many blocks as the file already has,
+ * so a file written in small pieces next to another growing file still
+ * ends up in few extents. The slack is given back on close.
+ * @return FS_OK, or FS_ERR_NOSPACE (the file keeps its old blocks)
+ */
+static int tmpfs_grow(tmpfs_inode_t *inode, uint32_t need) {
+    uint32_t had = inode->blocks;
+
+    while (inode->blocks < need) {
+        uint32_t want = need - inode->blocks;
+
+        /* Extend the last extent in place */
+        if (inode->extent_count > 0) {
+            tmpfs_extent_t *ext = &inode->extents[inode->extent_count - 1];
+            uint32_t next = ext->start + ext->count;
+            uint32_t count = 0;
+
+            while (count < want && next + count < tmpfs_block_count &&
+                   !tmpfs_block_used(next + count)) {
+                count++;
+            }
+
+            if (count > 0) {
+                tmpfs_mark(next, count, true);
+                ext->count += count;
+                inode->blocks += count;
+                continue;
+            }
+        }
+
+        /* Start a new extent */
+        if (inode->extent_count == TMPFS_MAX_EXTENTS) {
+            break;
+        }
+
+        uint32_t start;
+        uint32_t ask = (want > inode->blocks) ? want : inode->blocks;
+        uint32_t count = tmpfs_find_run(ask, &start);
+        if (count == 0) {
+            break;
+        }
+
+        tmpfs_mark(start, count, true);
+        inode->extents[inode->extent_count].start = start;
+        inode->extents[inode->extent_count].count = count;
+        inode->extent_count++;
+        inode->blocks += count;
+    }
+
+    if (inode->blocks < need) {
+        tmpfs_shrink(inode, had);
+        return FS_ERR_NOSPACE;
+    }
+
+    return FS_OK;
+}
+
+/**
+ * Copy a byte range of a file, one extent run at a time
+ * The range must lie within the allocated blocks.
+ * @param out: Buffer to read into, or NULL
+ * @param in: Data to write, or NULL (with out also NULL: fill with zeros)
+ */
+static void tmpfs_copy(tmpfs_inode_t *inode, uint32_t offset, uint32_t size,
+                       uint8_t *out, const uint8_t *in) {
+    uint32_t ext_offset = 0;    /* File offset of the current extent */
+
+    for (uint32_t i = 0; i < inode->extent_count && size > 0; i++) {
+        tmpfs_extent_t *ext = &inode->extents[i];
+        uint32_t ext_bytes = ext->count * TMPFS_BLOCK_SIZE;
+
+        if (offset < ext_offset + ext_bytes) {
+            uint32_t skip = offset - ext_offset;
+            uint32_t chunk = ext_bytes - skip;
+            if (chunk > size) {
+                chunk = size;
+            }
+
+            uint8_t *data = tmpfs_pool + ext->start * TMPFS_BLOCK_SIZE + skip;
+            if (out) {
+                memcpy(out, data, chunk);
+                out += chunk;
+            } else if (in) {
+                memcpy(data, in, chunk);
+                in += chunk;
+            } else {
+                memset(data, 0, chunk);
+            }
+
+            offset += chunk;
+            size -= chunk;
+        }
+
+        ext_offset += ext_bytes;
+    }
+}
+
+/**
+ * Hash a directory entry key into a bucket index (FNV-1a)
+ */
+static uint32_t tmpfs_hash_name(int16_t parent, const char *name) {
+    uint32_t hash = 2166136261u ^ (uint32_t)parent;
+
+    while (*name) {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+
+    return hash % TMPFS_HASH_SIZE;
+}
+
+/**
+ * Find a child of a directory by name
+ * @return Inode index, or -1 if not found
+ */
+static int16_t tmpfs_lookup(int16_t dir, const char *name) {
+    int16_t index = tmpfs_hash[tmpfs_hash_name(dir, name)];
+
+    while (index >= 0) {
+        tmpfs_inode_t *inode = &tmpfs_inodes[index];
+        if (inode->parent == dir && strcmp(inode->name, name) == 0) {
+            return index;
+        }
+        index = inode->hash_next;
+    }
+
+    return -1;
+}
+
+/**
+ * Get the inode behind a node
+ * @return Inode index, or -1 if the node is not a live tmpfs node
+ */
+static int16_t tmpfs_index_of(fs_node_t *node) {
+    if (!node || !tmpfs_pool || node->dev != TMPFS_DEV ||
+        node->inode == 0 || node->inode > TMPFS_MAX_INODES) {
+        return -1;
+    }
+
+    int16_t index = (int16_t)(node->inode - 1);
+    return tmpfs_inodes[index].used ? index : -1;
+}
+
+/**
+ * Fill a VFS node from an inode
+ */
+static void tmpfs_fill_node(fs_node_t *node, int16_t index) {
+    tmpfs_inode_t *inode = &tmpfs_inodes[index];
+
+    memset(node, 0, sizeof(fs_node_t));
+    strcpy(node->name, inode->name);
+    node->flags = inode->type;
+    node->inode = index + 1;
+    node->length = inode->size;
+    node->dev = TMPFS_DEV;
+
+    if (inode->type == FS_DIRECTORY) {
+        node->readdir = tmpfs_readdir;
+        node->finddir = tmpfs_finddir;
+        node->create = tmpfs_create;
+        node->unlink = tmpfs_unlink;
+    } else {
+        node->read = tmpfs_read;
+        node->write = tmpfs_write;
+        node->truncate = tmpfs_truncate;
+        node->close = tmpfs_close;
+    }
+}
+
+/**
+ * Read file data
+ */
+static int tmpfs_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
+    int16_t index = tmpfs_index_of(node);
+    if (index < 0 || tmpfs_inodes[index].type != FS_FILE) {
+        return FS_ERR_INVALID;
+    }
+
+    tmpfs_inode_t *inode = &tmpfs_inodes[index];
+    if (offset >= inode->size) {
+        return 0;
+    }
+    if (size > inode->size - offset) {
+        size = inode->size - offset;
+    }
+
+    tmpfs_copy(inode, offset, size, buffer, NULL);
+    return size;
+}
+
+/**
+ * Write file data, growing the file as needed
+ */
+static int tmpfs_write(fs_node_t *node, uint32_t offset, uint32_t size, const uint8_t *buffer) {
+    int16_t index = tmpfs_index_of(node);
+    if (index < 0 || tmpfs_inodes[index].type != FS_FILE) {
+        return FS_ERR_INVALID;
+    }
+
+    if (size == 0) {
+        return 0;
+    }
+
+    uint32_t end = offset + size;
+    if (end < offset) {
+        return FS_ERR_INVALID;
+    }
+
+    tmpfs_inode_t *inode = &tmpfs_inodes[index];
+    if (tmpfs_grow(inode, tmpfs_blocks_for(end)) != FS_OK) {
+        return FS_ERR_NOSPACE;
+    }
+
+    /* Writing past the end leaves a hole that reads back as zeros */
+    if (offset > inode->size) {
+        tmpfs_copy(inode, inode->size, offset - inode->size, NULL, NULL);
+    }
+
+    tmpfs_copy(inode, offset, size, NULL, buffer);
+
+    if (end > inode->size) {
+        inode->size = end;
+    }
+    node->length = inode->size;
+
+    return size;
+}
+
+/**
+ * Change the size of a file
+ */
+static int tmpfs_truncate(fs_node_t *node, uint32_t length) {
+    int16_t index = tmpfs_index_of(node);
+    if (index < 0 || tmpfs_inodes[index].type != FS_FILE) {
+        return FS_ERR_INVALID;
+    }
+
+    tmpfs_inode_t *inode = &tmpfs_inodes[index];
+    if (length > inode->size) {
+        if (tmpfs_grow(inode, tmpfs_blocks_for(length)) != FS_OK) {
+            return FS_ERR_NOSPACE;
+        }
+        tmpfs_copy(inode, inode->size, length - inode->size, NULL, NULL);
+    } else {
+        tmpfs_shrink(inode, tmpfs_blocks_for(length));
+    }
+
+    inode->size = length;
+    node->length = length;
+
+    return FS_OK;
+}
+
+/**
+ * Close a file: free blocks reserved past the end of the file
+ */
+static void tmpfs_close(fs_node_t *node) {
+    int16_t index = tmpfs_index_of(node);
+    if (index >= 0 && tmpfs_inodes[index].type == FS_FILE) {
+        tmpfs_shrink(&tmpfs_inodes[index], tmpfs_blocks_for(tmpfs_inodes[index].size));
+    }
+}
+
+/**
+ * Read directory entry by index
+ */
+static dirent_t *tmpfs_readdir(fs_node_t *node, uint32_t index) {
+    int16_t dir = tmpfs_index_of(node);
+    if (dir < 0 || tmpfs_inodes[dir].type != FS_DIRECTORY) {
+        return NULL;
+    }
+
+    int16_t child = tmpfs_inodes[dir].first_child;
+    while (child >= 0 && index > 0) {
+        child = tmpfs_inodes[child].next;
+        index--;
+    }
+
+    if (child < 0) {
+        return NULL;
+    }
+
+    strcpy(tmpfs_dirent.name, tmpfs_inodes[child].name);
+    tmpfs_dirent.inode = child + 1;
+    return &tmpfs_dirent;
+}
+
+/**
+ * Find a file in a directory
+ */
+static fs_node_t *tmpfs_finddir(fs_node_t *node, const char *name) {
+    int16_t dir = tmpfs_index_of(node);
+    if (dir < 0 || tmpfs_inodes[dir].type != FS_DIRECTORY) {
+        return NULL;
+    }
+
+    int16_t index = tmpfs_lookup(dir, name);
+    if (index < 0) {
+        return NULL;
+    }
+
+    tmpfs_fill_node(&tmpfs_found_node, index);
+    return &tmpfs_found_node;
+}
+
+/**
+ * Create a file or directory
+ */
+static fs_node_t *tmpfs_create(fs_node_t *node, const char *name, uint32_t type) {
+    int16_t dir = tmpfs_index_of(node);
+    if (dir < 0 || tmpfs_inodes[dir].type != FS_DIRECTORY) {
+        return NULL;
+    }
+
+    uint32_t len = strlen(name);
+    if (len == 0 || len >= TMPFS_MAX_NAME || strchr(name, '/')) {
+        return NULL;
+    }
+
+    if (tmpfs_lookup(dir, name) >= 0) {
+        return NULL;
+    }
+
+    /* Find a free inode (slot 0 is the root) */
+    int16_t index = -1;
+    for (int16_t i = 1; i < TMPFS_MAX_INODES; i++) {
+        if (!tmpfs_inodes[i].used) {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0) {
+        return NULL;
+    }
+
+    tmpfs_inode_t *inode = &tmpfs_inodes[index];
+    tmpfs_inode_t *parent = &tmpfs_inodes[dir];
+
+    memset(inode, 0, sizeof(tmpfs_inode_t));
+    strcpy(inode->name, name);
+    inode->type = type;
+    inode->parent = dir;
+    inode->first_child = -1;
+    inode->last_child = -1;
+    inode->used = true;
+
+    /* Append to the directory listing */
+    inode->prev = parent->last_child;
+    inode->next = -1;
+    if (parent->last_child >= 0) {
+        tmpfs_inodes[parent->last_child].next = index;
+    } else {
+        parent->first_child = index;
+    }
+    parent->last_child = index;
+    parent->entries++;
+
+    /* Add to the lookup hash */
+    uint32_t bucket = tmpfs_hash_name(dir, name);
+    inode->hash_next = tmpfs_hash[bucket];
+    tmpfs_hash[bucket] = index;
+
+    tmpfs_fill_node(&tmpfs_found_node, index);
+    return &tmpfs_found_node;
+}
+
+/**
+ * Remove a file or empty directory
+ */
+static int tmpfs_unlink(fs_node_t *node, const char *name) {
+    int16_t dir = tmpfs_index_of(node);
+    if (dir < 0 || tmpfs_inodes[dir].type != FS_DIRECTORY) {
+        return FS_ERR_NOTDIR;
+    }
+
+    int16_t index = tmpfs_lookup(dir, name);
+    if (index < 0) {
+        return FS_ERR_NOENT;
+    }
+
+    tmpfs_inode_t *inode = &tmpfs_inodes[index];
+    tmpfs_inode_t *parent = &tmpfs_inodes[dir];
+
+    if (inode->type == FS_DIRECTORY && inode->entries > 0) {
+        return FS_ERR_NOTEMPTY;
+    }
+
+    tmpfs_shrink(inode, 0);
+
+    /* Remove from the lookup hash */
+    int16_t *link = &tmpfs_hash[tmpfs_hash_name(dir, name)];
+    while (*link != index) {
+        link = &tmpfs_inodes[*link].hash_next;
+    }
+    *link = inode->hash_next;
+
+    /* Remove from the directory listing */
+    if (inode->prev >= 0) {
+        tmpfs_inodes[inode->prev].next = inode->next;
+    } else {
+        parent->first_child = inode->next;
+    }
+    if (inode->next >= 0) {
+        tmpfs_inodes[inode->next].prev = inode->prev;
+    } else {
+        parent->last_child = inode->prev;
+    }
+    parent->entries--;
+
+    memset(inode, 0, sizeof(tmpfs_inode_t));
+
+    return FS_OK;
+}
+
+/**
+ * Initialize the tmpfs driver
+ */
+void tmpfs_init(void) {
+    tmpfs_pool = NULL;
+    tmpfs_block_count = 0;
+    tmpfs_blocks_used = 0;
+
+    /* Register filesystem type */
+    fs_register(&tmpfs_fstype);
+}
+
+/**
+ * Mount the tmpfs instance
+ */
+fs_node_t *tmpfs_mount(uint8_t drive) {
+    (void)drive;
+
+    if (tmpfs_pool) {
+        return &tmpfs_root_node;
+    }
+
+    /* Memory ends at 1MB + upper memory; only identity-mapped memory
+     * is usable */
+    mem_info_t mem;
+    kernel_get_mem_info(&mem);
+
+    uint32_t mem_end = PAGING_IDENTITY_SIZE;
+    if (mem.mem_upper + 1024 < PAGING_IDENTITY_SIZE / 1024) {
+        mem_end = (mem.mem_upper + 1024) * 1024;
+    }
+
+    if (mem_end < TMPFS_POOL_BASE + TMPFS_BLOCK_SIZE) {
+        frame_release(TMPFS_POOL_BASE, TMPFS_POOL_BASE + TMPFS_POOL_SIZE);
+        return NULL;
+    }
+
+    uint32_t pool_size = mem_end - TMPFS_POOL_BASE;
+    if (pool_size > TMPFS_POOL_SIZE) {
+        pool_size = TMPFS_POOL_SIZE;
+    }
+
+    tmpfs_pool = (uint8_t *)TMPFS_POOL_BASE;
+    tmpfs_block_count = pool_size / TMPFS_BLOCK_SIZE;
+    tmpfs_blocks_used = 0;
+    memset(tmpfs_bitmap, 0, sizeof(tmpfs_bitmap));
+    memset(tmpfs_inodes, 0, sizeof(tmpfs_inodes));
+    memset(tmpfs_hash, 0xFF, sizeof(tmpfs_hash));   /* All chains empty (-1) */
+
+    /* Root directory */
+    tmpfs_inode_t *root = &tmpfs_inodes[0];
+    root->type = FS_DIRECTORY;
+    root->parent = -1;
+    root->hash_next = -1;
+    root->prev = -1;
+    root->next = -1;
+    root->first_child = -1;
+    root->last_child = -1;
+    root->used = true;
+
+    tmpfs_fill_node(&tmpfs_root_node, 0);
+    return &tmpfs_root_node;
+}
+
+/**
+ * Unmount tmpfs
+ */
+int tmpfs_unmount(fs_node_t *root) {
+    if (root != &tmpfs_root_node || !tmpfs_pool) {
+        return FS_ERR_INVALID;
+    }
+
+    if (tmpfs_inodes[0].entries > 0) {
+        return FS_ERR_BUSY;
+    }
+
+    tmpfs_pool = NULL;
+    tmpfs_block_count = 0;
+
+    return FS_OK;
+}
+
+/**
+ * Get tmpfs storage usage
+ */
+void tmpfs_usage(uint32_t *used, uint32_t *total) {
+    if (used) {
+        *used = tmpfs_blocks_used;
+    }
+    if (total) {
+        *total = tmpfs_block_count;
+    }
+}
@@ -3,24 +3,58 @@
  * Implements VGA mode 12h (640x480, 16 colors)
  * Implements VGA mode 13h (320x200, 256 colors)
  * Implements VGA mode X (320x240, 256 colors)
+ *
+ * In the 256-color modes video memory is mapped write-combining where the
+ * CPU supports it, so runs of pixel writes reach the card as bursts instead
+ * of one bus cycle each.
  */
 
 #include <vga_gfx.h>
 #include <vga.h>
 #include <vga_font.h>
 #include <ports.h>
+#include <paging.h>
 #include <string.h>
 
 /* Graphics mode state */
 static int gfx_mode_active = 0;
 static int current_mode = VGA_MODE_TEXT;
 
+/* Write-combining: wanted for the 256-color modes, and currently mapped */
+static int wc_wanted = 1;
+static int wc_mapped = 0;
+
 /* VGA video memory pointer */
 static volatile uint8_t *vga_mem = (volatile uint8_t *)VGA_GFX_MEMORY;
 
 /* Forward declarations */
 static void restore_default_16_color_palette(void);
 
+/**
+ * Map video memory write-combining in the 256-color modes
+ * Mode 12h and text mode read video memory to load the VGA latches, which
+ * needs reads and writes in program order, so they keep the default type.
+ */
+static void vga_gfx_update_wc(void) {
+    int want = wc_wanted && gfx_mode_active && current_mode != VGA_MODE_12H;
+    
+    if (want == wc_mapped) return;
+    
+    if (paging_set_write_combining(VGA_GFX_MEMORY, VGA_GFX_MEMORY + VGA_GFX_WINDOW,
+                                   want != 0) == 0) {
+        wc_mapped = want;
+    }
+}
+
+/**
+ * Push out writes held in the write-combining buffers
+ */
+static inline void vga_gfx_flush(void) {
+    if (wc_mapped) {
+        __asm__ volatile ("lock; addl $0, (%%esp)" : : : "memory");
+    }
+}
+
 /* Mode 12h register values */
 static const uint8_t mode12h_misc = 0xE3;
 
@@ -150,6 +184,7 @@ void vga_gfx_init(void) {
     
     gfx_mode_active = 1;
     current_mode = VGA_MODE_12H;
+    vga_gfx_update_wc();
     
     /* Clear screen to black */
     vga_gfx_clear(GFX_BLACK);
@@ -258,6 +293,10 @@ static void restore_default_16_color_palette(void) {
 void vga_gfx_exit(void) {
     if (!gfx_mode_active) return;
     
+    /* Text mode keeps the default memory type */
+    gfx_mode_active = 0;
+    vga_gfx_update_wc();
+    
     /* Set mode 3 (80x25 text) */
     write_regs(mode3_seq, mode3_crtc, mode3_gc, mode3_attr, mode3_misc);
     
@@ -648,6 +687,7 @@ void vga_gfx_init_13h(void) {
     
     gfx_mode_active = 1;
     current_mode = VGA_MODE_13H;
+    vga_gfx_update_wc();
     
     /* Clear screen to black */
     vga_13h_clear(0);
@@ -670,6 +710,8 @@ uint8_t vga_13h_get_pixel(int x, int y) {
     if (!gfx_mode_active || current_mode != VGA_MODE_13H) return 0;
     if (x < 0 || x >= VGA_13H_WIDTH || y < 0 || y >= VGA_13H_HEIGHT) return 0;
     
+    /* Reads may pass writes still in the write-combining buffers */
+    vga_gfx_flush();
     return vga_mem[y * VGA_13H_WIDTH + x];
 }
 
@@ -682,6 +724,7 @@ void vga_13h_clear(uint8_t color) {
     for (uint32_t i = 0; i < VGA_13H_WIDTH * VGA_13H_HEIGHT; i++) {
         vga_mem[i] = color;
     }
+    vga_gfx_flush();
 }
 
 /* ============================================================================
@@ -739,6 +782,7 @@ void vga_gfx_init_x(void) {
     
     gfx_mode_active = 1;
     current_mode = VGA_MODE_X;
+    vga_gfx_update_wc();
     
     /* Clear screen to black */
     vga_x_clear(0);
@@ -794,6 +838,7 @@ void vga_x_clear(uint8_t color) {
     for (uint32_t i = 0; i < size; i++) {
         vga_mem[i] = color;
     }
+    vga_gfx_flush();
 }
 
 /**
@@ -862,6 +907,7 @@ void vga_gfx_init_y(void) {
     
     gfx_mode_active = 1;
     current_mode = VGA_MODE_Y;
+    vga_gfx_update_wc();
     
     /* Clear screen to black */
     vga_y_clear(0);
@@ -917,4 +963,74 @@ void vga_y_clear(uint8_t color) {
     for (uint32_t i = 0; i < size; i++) {
         vga_mem[i] = color;
     }
+    vga_gfx_flush();
+}
+
+/**
+ * Copy a block of pixels to the screen (256-color modes)
+ */
+void vga_gfx_blit(int x, int y, int w, int h, const uint8_t *pixels) {
+    if (!gfx_mode_active || current_mode == VGA_MODE_12H || w <= 0 || h <= 0) return;
+    
+    int width = VGA_13H_WIDTH;
+    int height = current_mode == VGA_MODE_X ? VGA_X_HEIGHT : VGA_13H_HEIGHT;
+    int pitch = w;
+    
+    /* Clip to the screen */
+    if (x < 0) {
+        pixels -= x;
+        w += x;
+        x = 0;
+    }
+    if (y < 0) {
+        pixels -= y * pitch;
+        h += y;
+        y = 0;
+    }
+    if (x + w > width) w = width - x;
+    if (y + h > height) h = height - y;
+    if (w <= 0 || h <= 0) return;
+    
+    if (current_mode == VGA_MODE_13H) {
+        for (int row = 0; row < h; row++) {
+            volatile uint8_t *dst = vga_mem + (y + row) * VGA_13H_WIDTH + x;
+            const uint8_t *src = pixels + row * pitch;
+            for (int col = 0; col < w; col++) {
+                dst[col] = src[col];
+            }
+        }
+        vga_gfx_flush();
+        return;
+    }
+    
+    /* Planar modes: one pass per plane, so each row is a run of bytes */
+    for (int plane = 0; plane < 4; plane++) {
+        int first = x + ((plane - x) & 3);
+        if (first >= x + w) continue;
+        
+        outb(VGA_SEQ_INDEX, VGA_SEQ_PLANE_WRITE);
+        outb(VGA_SEQ_DATA, 1 << plane);
+        
+        for (int row = 0; row < h; row++) {
+            volatile uint8_t *dst = vga_mem + (y + row) * (width / 4);
+            const uint8_t *src = pixels + row * pitch;
+            for (int col = first; col < x + w; col += 4) {
+                dst[col / 4] = src[col - x];
+            }
+        }
+    }
+    vga_gfx_flush();
+}
+
+/**
+ * Choose whether the 256-color modes map video memory write-combining
+ */
+int vga_gfx_set_write_combining(int enable) {
+    if (!(paging_get_features() & PAGING_FEATURE_WC)) {
+        return -1;
+    }
+    
+    wc_wanted = enable != 0;
+    vga_gfx_update_wc();
+    return 0;
 }
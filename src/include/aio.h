@@ -0,0 +1,61 @@
+/**
+ * Asynchronous File I/O Header
+ * Background file reads with a completion queue
+ */
+
+#ifndef AIO_H
+#define AIO_H
+
+#include "stdint.h"
+#include "fs.h"
+
+/* Maximum requests in flight or waiting to be reaped */
+#define AIO_MAX_REQUESTS    16
+
+/* Completion record */
+typedef struct {
+    uint32_t token;             /* Token given at submission */
+    int32_t result;             /* Bytes read, or -1 on error */
+} aio_completion_t;
+
+/**
+ * Initialize the asynchronous I/O queue
+ */
+void aio_init(void);
+
+/**
+ * Queue a file read
+ * Pages already in the page cache are copied at once; missing pages are
+ * read in the background on filesystems with readpage_async. Files on
+ * other filesystems are read synchronously and complete immediately.
+ * @param node: File node (pinned until the request completes)
+ * @param offset: File offset
+ * @param size: Bytes to read
+ * @param buffer: Destination (must stay valid until the completion is reaped)
+ * @param token: Value reported back with the completion
+ * @return 0 if queued, -1 if the queue is full
+ */
+int aio_submit(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer, uint32_t token);
+
+/**
+ * Take one completion without blocking
+ * @param out: Completion record
+ * @return 1 if a completion was taken, 0 if none is ready
+ */
+int aio_poll(aio_completion_t *out);
+
+/**
+ * Wait for a completion
+ * Interrupts are enabled while waiting so the device can make progress.
+ * @param out: Completion record
+ * @return 1 if a completion was taken, 0 if no request is outstanding
+ */
+int aio_wait(aio_completion_t *out);
+
+/**
+ * Drop all requests and completions (called when a program starts or ends)
+ * Device reads already in flight finish into the page cache only.
+ */
+void aio_cancel_all(void);
+
+#endif /* AIO_H */
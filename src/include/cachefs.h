@@ -0,0 +1,141 @@
+/**
+ * cachefs Header
+ * Persistent cache of CD-ROM file pages on an ATA disk partition
+ */
+
+#ifndef CACHEFS_H
+#define CACHEFS_H
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "fs.h"
+#include "mbr.h"
+
+/* MBR partition type of the cache region ("non-FS data") */
+#define CACHEFS_PART_TYPE       0xDA
+
+/* On-disk format */
+#define CACHEFS_MAGIC           "CACHEFS1"
+#define CACHEFS_VERSION         1
+#define CACHEFS_SECTOR_SIZE     512
+#define CACHEFS_PAGE_SECTORS    (FS_PAGE_SIZE / CACHEFS_SECTOR_SIZE)
+
+/* Limits */
+#define CACHEFS_MAX_ENTRIES     2048    /* Cached pages (index held in memory) */
+#define CACHEFS_WAYS            4       /* Index entries a page may occupy */
+#define CACHEFS_MAX_VOLUMES     8       /* CD-ROM volumes with cached pages */
+#define CACHEFS_KEY_SIZE        48      /* Volume ID (32) + creation date (16) */
+#define CACHEFS_MAX_QUEUED      4       /* Stores waiting for cachefs_flush() */
+
+/* Error codes */
+#define CACHEFS_OK              0
+#define CACHEFS_ERR_MISS        -1      /* Page not cached (or failed its checksum) */
+#define CACHEFS_ERR_NODEV       -2      /* No cache partition */
+#define CACHEFS_ERR_IO          -3      /* Disk error */
+
+/* Cached volume: the PVD fields that tell CD-ROMs apart */
+typedef struct {
+    char key[CACHEFS_KEY_SIZE];
+} __attribute__((packed)) cachefs_volume_t;
+
+/* Superblock (first sector of the partition) */
+typedef struct {
+    char magic[8];              /* CACHEFS_MAGIC */
+    uint32_t version;           /* CACHEFS_VERSION */
+    uint32_t entries;           /* Index entries (one data slot each) */
+    uint32_t index_start;       /* First index sector (partition relative) */
+    uint32_t data_start;        /* First data sector (partition relative) */
+    cachefs_volume_t volumes[CACHEFS_MAX_VOLUMES];  /* Empty key: unused */
+    uint8_t reserved[100];
+    uint32_t checksum;          /* CRC-32 of the bytes before it */
+} __attribute__((packed)) cachefs_super_t;
+
+/* Index entry; entry i owns data slot i (CACHEFS_PAGE_SECTORS sectors) */
+typedef struct {
+    uint32_t extent;            /* Extent LBA of the file on the CD-ROM */
+    uint32_t page;              /* Page index within the file */
+    uint32_t bytes;             /* File bytes in the page */
+    uint32_t checksum;          /* CRC-32 of those bytes */
+    uint32_t stamp;             /* Store order (lowest is replaced first) */
+    uint8_t volume;             /* Volume slot in the superblock */
+    uint8_t valid;              /* Entry holds a page */
+    uint8_t reserved[10];
+} __attribute__((packed)) cachefs_entry_t;
+
+/* Cache status */
+typedef struct {
+    bool present;               /* A cache partition is in use */
+    uint8_t drive;              /* ATA drive holding it */
+    uint32_t entries;           /* Capacity in pages */
+    uint32_t used;              /* Pages cached */
+    uint32_t hits;              /* Pages read from the disk since boot */
+    uint32_t misses;            /* Lookups that went to the CD-ROM */
+    uint32_t stores;            /* Pages written to the disk */
+} cachefs_info_t;
+
+/**
+ * Find the cache partition on the ATA disks and load its index
+ * A partition without a valid superblock is formatted.
+ * @return 0 on success, CACHEFS_ERR_NODEV if no disk has a cache partition
+ */
+int cachefs_init(void);
+
+/**
+ * Get the volume slot for a CD-ROM, claiming one if needed
+ * When all slots are taken, the least recently stored volume is dropped.
+ * @param key: CACHEFS_KEY_SIZE bytes identifying the volume
+ * @return Volume slot, or -1 if there is no cache
+ */
+int cachefs_attach(const char *key);
+
+/**
+ * Read a cached file page
+ * @param volume: Slot from cachefs_attach()
+ * @param extent: Extent LBA of the file
+ * @param page: Page index within the file
+ * @param buffer: FS_PAGE_SIZE buffer (whole sectors are read; bytes past
+ *                the file data are not meaningful)
+ * @param bytes: File bytes in the page
+ * @return 0 on a hit, CACHEFS_ERR_MISS otherwise
+ */
+int cachefs_read(int volume, uint32_t extent, uint32_t page, uint8_t *buffer, uint32_t bytes);
+
+/**
+ * Store a file page read from the CD-ROM (written through to the disk)
+ * @param volume: Slot from cachefs_attach()
+ * @param extent: Extent LBA of the file
+ * @param page: Page index within the file
+ * @param buffer: Page data
+ * @param bytes: File bytes in the page
+ * @return 0 on success, error code on failure
+ */
+int cachefs_store(int volume, uint32_t extent, uint32_t page, const uint8_t *buffer, uint32_t bytes);
+
+/**
+ * Queue a file page for storing later (safe in interrupt context)
+ * Only copies the page; cachefs_flush() writes it to the disk. Pages
+ * arriving while the queue is full are not cached.
+ * @param volume: Slot from cachefs_attach()
+ * @param extent: Extent LBA of the file
+ * @param page: Page index within the file
+ * @param buffer: Page data
+ * @param bytes: File bytes in the page
+ * @return 0 if queued, CACHEFS_ERR_NODEV without a cache, or
+ *         CACHEFS_ERR_MISS if the page was dropped
+ */
+int cachefs_queue_store(int volume, uint32_t extent, uint32_t page, const uint8_t *buffer,
+                        uint32_t bytes);
+
+/**
+ * Write the queued pages to the disk
+ * Must not be called from interrupt handlers.
+ */
+void cachefs_flush(void);
+
+/**
+ * Get cache status
+ * @param info: Filled with the current status
+ */
+void cachefs_get_info(cachefs_info_t *info);
+
+#endif /* CACHEFS_H */
@@ -0,0 +1,226 @@
+/**
+ * FAT32 Filesystem Driver Header
+ * Read/write FAT32 volumes on ATA disks
+ */
+
+#ifndef FAT32_H
+#define FAT32_H
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "fs.h"
+
+/* On-disk constants */
+#define FAT32_SECTOR_SIZE       512
+#define FAT32_DIRENT_SIZE       32
+#define FAT32_ENTRIES_PER_SECTOR (FAT32_SECTOR_SIZE / FAT32_DIRENT_SIZE)
+#define FAT32_FIRST_CLUSTER     2       /* First data cluster number */
+#define FAT32_CLUSTER_MASK      0x0FFFFFFF
+#define FAT32_CLUSTER_BAD       0x0FFFFFF7
+#define FAT32_CLUSTER_EOC       0x0FFFFFF8  /* Values from here on end a chain */
+#define FAT32_CLUSTER_LAST      0x0FFFFFFF  /* Value written to end a chain */
+#define FAT32_FSINFO_LEAD       0x41615252
+#define FAT32_FSINFO_STRUCT     0x61417272
+#define FAT32_FSINFO_TRAIL      0xAA550000
+#define FAT32_FREE_UNKNOWN      0xFFFFFFFF
+
+/* Directory entry attributes */
+#define FAT32_ATTR_READONLY     0x01
+#define FAT32_ATTR_HIDDEN       0x02
+#define FAT32_ATTR_SYSTEM       0x04
+#define FAT32_ATTR_VOLUME_ID    0x08
+#define FAT32_ATTR_DIRECTORY    0x10
+#define FAT32_ATTR_ARCHIVE      0x20
+#define FAT32_ATTR_LFN          0x0F    /* Long name entry */
+
+/* Special first bytes of a directory entry name */
+#define FAT32_ENTRY_END         0x00    /* This and all later entries are free */
+#define FAT32_ENTRY_DELETED     0xE5
+
+/* Long name entries */
+#define FAT32_LFN_LAST          0x40    /* Flag on the order of the last entry */
+#define FAT32_LFN_ORDER_MASK    0x1F
+#define FAT32_LFN_CHARS         13      /* UCS-2 characters per entry */
+#define FAT32_MAX_LFN_ENTRIES   20      /* 255 characters */
+
+/* Case flags of an 8.3 name (nt_case, as written by Windows NT) */
+#define FAT32_CASE_LOWER_BASE   0x08
+#define FAT32_CASE_LOWER_EXT    0x10
+
+/* Date written to new entries (1980-01-01: there is no clock) */
+#define FAT32_DEFAULT_DATE      ((1 << 5) | 1)
+
+/* Limits */
+#define FAT32_MAX_VOLUMES       2       /* Volumes mounted at the same time */
+#define FAT32_MAX_CLUSTERS      (256 * 1024)    /* Clusters tracked by the free bitmap */
+#define FAT32_CACHE_SECTORS     64      /* FAT and directory sectors kept in memory */
+#define FAT32_MAX_FILES         16      /* Files with a cluster-run map */
+#define FAT32_MAX_RUNS          64      /* Runs per map (later clusters walk the FAT) */
+#define FAT32_IO_SECTORS        128     /* Sectors per disk transfer */
+
+/* Device identifier of FAT32 nodes: FAT32_DEV + drive (outside the IDE
+ * drive numbers used by ISO9660 and the tmpfs device) */
+#define FAT32_DEV               0x200
+
+/* Boot sector with the FAT32 BIOS parameter block */
+typedef struct {
+    uint8_t jump[3];
+    char oem[8];
+    uint16_t bytes_per_sector;
+    uint8_t sectors_per_cluster;
+    uint16_t reserved_sectors;  /* Sectors before the first FAT */
+    uint8_t fat_count;
+    uint16_t root_entries;      /* 0 on FAT32 */
+    uint16_t total_sectors_16;  /* 0 on FAT32 */
+    uint8_t media;
+    uint16_t fat_size_16;       /* 0 on FAT32 */
+    uint16_t sectors_per_track;
+    uint16_t heads;
+    uint32_t hidden_sectors;
+    uint32_t total_sectors_32;
+    uint32_t fat_size_32;       /* Sectors per FAT */
+    uint16_t ext_flags;
+    uint16_t fs_version;
+    uint32_t root_cluster;      /* First cluster of the root directory */
+    uint16_t fsinfo_sector;     /* FSInfo sector (0 or 0xFFFF if none) */
+    uint16_t backup_boot_sector;
+    uint8_t reserved[12];
+    uint8_t drive_number;
+    uint8_t reserved1;
+    uint8_t boot_signature;
+    uint32_t volume_serial;
+    char volume_label[11];
+    char fs_type[8];            /* "FAT32   " (informational) */
+} __attribute__((packed)) fat32_bpb_t;
+
+/* FSInfo sector: free space hints */
+typedef struct {
+    uint32_t lead_signature;    /* FAT32_FSINFO_LEAD */
+    uint8_t reserved[480];
+    uint32_t struct_signature;  /* FAT32_FSINFO_STRUCT */
+    uint32_t free_count;        /* Free clusters, or FAT32_FREE_UNKNOWN */
+    uint32_t next_free;         /* Where to start looking for free clusters */
+    uint8_t reserved2[12];
+    uint32_t trail_signature;   /* FAT32_FSINFO_TRAIL */
+} __attribute__((packed)) fat32_fsinfo_t;
+
+/* Short (8.3) directory entry */
+typedef struct {
+    char name[11];              /* Base and extension, space padded */
+    uint8_t attr;               /* FAT32_ATTR_* */
+    uint8_t nt_case;            /* FAT32_CASE_* */
+    uint8_t create_time_tenth;
+    uint16_t create_time;
+    uint16_t create_date;
+    uint16_t access_date;
+    uint16_t cluster_high;      /* First cluster, high word */
+    uint16_t write_time;
+    uint16_t write_date;
+    uint16_t cluster_low;       /* First cluster, low word */
+    uint32_t size;              /* File size in bytes (0 for directories) */
+} __attribute__((packed)) fat32_dirent_t;
+
+/* Long name directory entry (stored before its short entry, last part first) */
+typedef struct {
+    uint8_t order;              /* Sequence number, FAT32_LFN_LAST on the last part */
+    uint16_t name1[5];
+    uint8_t attr;               /* FAT32_ATTR_LFN */
+    uint8_t type;               /* 0 */
+    uint8_t checksum;           /* Checksum of the short name */
+    uint16_t name2[6];
+    uint16_t cluster;           /* 0 */
+    uint16_t name3[2];
+} __attribute__((packed)) fat32_lfn_t;
+
+/* Run of contiguous clusters in a file */
+typedef struct {
+    uint32_t file_cluster;      /* Cluster index within the file */
+    uint32_t disk_cluster;      /* First cluster on disk */
+    uint32_t count;             /* Number of clusters */
+} fat32_run_t;
+
+/* Mounted volume */
+typedef struct fat32_volume {
+    uint8_t drive;              /* IDE drive */
+    uint32_t lba_start;         /* First sector of the volume */
+    uint32_t fat_start;         /* First sector of the first FAT */
+    uint32_t fat_size;          /* Sectors per FAT */
+    uint8_t fat_count;          /* FAT copies (all written, first one read) */
+    uint32_t data_start;        /* First sector of cluster 2 */
+    uint32_t cluster_sectors;   /* Sectors per cluster */
+    uint32_t cluster_count;     /* Data clusters (numbered from 2) */
+    uint32_t root_cluster;      /* First cluster of the root directory */
+    uint32_t fsinfo_lba;        /* FSInfo sector, 0 if none */
+    uint32_t *bitmap;           /* Free-cluster bitmap (bit set = in use) */
+    uint32_t tracked;           /* Clusters covered by the bitmap */
+    uint32_t free_count;        /* Free clusters in the bitmap */
+    uint32_t next_free;         /* Allocation hint (next-fit) */
+    bool fsinfo_dirty;          /* Free count changed since the last sync */
+    bool mounted;               /* Volume in use */
+    fs_node_t root;             /* Root directory node */
+} fat32_volume_t;
+
+/* File with a cluster-run map; its directory entry is updated on sync */
+typedef struct {
+    fat32_volume_t *vol;        /* Volume */
+    uint32_t inode;             /* Position of the short directory entry */
+    uint32_t first_cluster;     /* First cluster, 0 for an empty file */
+    uint32_t size;              /* File size in bytes */
+    uint32_t clusters;          /* Clusters in the chain */
+    uint32_t last_cluster;      /* Last cluster of the chain (0 if empty) */
+    fat32_run_t runs[FAT32_MAX_RUNS];   /* Sorted by file_cluster */
+    uint32_t run_count;         /* Runs in use (cover a prefix of the chain) */
+    uint32_t walk_index;        /* Last cluster found past the runs by walking */
+    uint32_t walk_cluster;      /* the FAT, so sequential access resumes there */
+    uint32_t lru;               /* Last use stamp (higher is more recent) */
+    bool dirty;                 /* Size or first cluster not yet in the entry */
+    bool used;                  /* Slot in use */
+} fat32_file_t;
+
+/**
+ * Initialize the FAT32 driver and register the "fat32" filesystem type
+ */
+void fat32_init(void);
+
+/**
+ * Check whether a drive holds a FAT32 volume (whole disk or the first
+ * FAT32 partition of its MBR) without mounting it
+ * @param drive: IDE drive number
+ * @return true if a volume was found
+ */
+bool fat32_probe(uint8_t drive);
+
+/**
+ * Mount the FAT32 volume of a drive
+ * Reads the whole FAT once to build the free-cluster bitmap.
+ * @param drive: IDE drive number
+ * @return Root node or NULL on error
+ */
+fs_node_t *fat32_mount(uint8_t drive);
+
+/**
+ * Unmount a FAT32 volume (writes back all pending changes)
+ * @param root: Root node
+ * @return 0 on success, error code on failure
+ */
+int fat32_unmount(fs_node_t *root);
+
+/**
+ * Write back pending directory entry and FAT changes of all volumes
+ * Done automatically when a file is closed, after create and unlink, and
+ * when the system halts.
+ * @return 0 on success, FS_ERR_IO if a sector could not be written
+ */
+int fat32_sync(void);
+
+/**
+ * Get the free space of a mounted volume
+ * @param drive: IDE drive number
+ * @param free: Free clusters (may be NULL)
+ * @param total: Data clusters (may be NULL)
+ * @param cluster_size: Bytes per cluster (may be NULL)
+ * @return 0 on success, FS_ERR_NOTMOUNT if the drive has no mounted volume
+ */
+int fat32_usage(uint8_t drive, uint32_t *free, uint32_t *total, uint32_t *cluster_size);
+
+#endif /* FAT32_H */
@@ -0,0 +1,112 @@
+/**
+ * Physical Frame Allocator Header
+ * Buddy allocator for 4KB page frames of the identity-mapped memory
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "stdint.h"
+#include "paging.h"
+
+/* Frame size (one page) */
+#define FRAME_SIZE              PAGE_SIZE
+
+/* Frames the allocator manages: the identity-mapped memory, the only
+ * physical memory the kernel can reach */
+#define FRAME_COUNT             (PAGING_IDENTITY_SIZE / FRAME_SIZE)
+
+/* Largest block: 2^FRAME_MAX_ORDER frames (4MB) */
+#define FRAME_MAX_ORDER         10
+
+/* Frame allocator status */
+typedef struct {
+    uint32_t total;             /* Frames available to the allocator */
+    uint32_t free;              /* Frames not allocated */
+    uint32_t free_blocks[FRAME_MAX_ORDER + 1];  /* Free blocks per order */
+} frame_info_t;
+
+/* Reclaim callback: frees cached memory when no block is free
+ * @param count: Frames wanted
+ * @return Frames freed (0 if nothing is left to free) */
+typedef uint32_t (*frame_reclaim_fn)(uint32_t count);
+
+/**
+ * Start describing physical memory
+ * Every frame starts out reserved; frame_add_region() makes RAM usable,
+ * frame_reserve() takes ranges in use back out, and frame_start() hands
+ * the rest to the allocator.
+ */
+void frame_init(void);
+
+/**
+ * Mark a range of RAM as usable (from the boot memory map)
+ * Partial frames at either end are left out; memory beyond the identity
+ * map is ignored.
+ * @param start: First byte
+ * @param end: End of the range (exclusive)
+ */
+void frame_add_region(uint64_t start, uint64_t end);
+
+/**
+ * Keep a range out of the allocator (kernel image, program area)
+ * Partial frames at either end are reserved too.
+ * @param start: First byte
+ * @param end: End of the range (exclusive)
+ */
+void frame_reserve(uint32_t start, uint32_t end);
+
+/**
+ * Hold a range of RAM back for a pool that decides later whether it uses it
+ * Like frame_reserve(), but frame_release() can still hand the frames to
+ * the allocator after frame_start().
+ * @param start: First byte
+ * @param end: End of the range (exclusive)
+ */
+void frame_hold(uint32_t start, uint32_t end);
+
+/**
+ * Build the free lists from the usable frames that are not reserved
+ * Must be called once, after the regions are described.
+ */
+void frame_start(void);
+
+/**
+ * Hand held frames a pool does not use to the allocator
+ * Only whole frames inside the range are released; frames that were not
+ * held (not RAM, reserved, released already) are skipped.
+ * @param start: First byte
+ * @param end: End of the range (exclusive)
+ */
+void frame_release(uint32_t start, uint32_t end);
+
+/**
+ * Register the callback that frees cached memory under pressure
+ * @param fn: Called by frame_alloc() when no block of the order is free
+ */
+void frame_register_reclaim(frame_reclaim_fn fn);
+
+/**
+ * Allocate a block of 2^order contiguous frames
+ * When no block is free, the reclaim callback frees cached memory first.
+ * @param order: Block order (0 for a single frame)
+ * @return Physical (= kernel) address aligned to the block size, or 0 if
+ *         no block is free
+ */
+uint32_t frame_alloc(uint32_t order);
+
+/**
+ * Free a block from frame_alloc()
+ * Merges it with its free buddies.
+ * @param addr: Block address
+ * @param order: Order it was allocated with
+ */
+void frame_free(uint32_t addr, uint32_t order);
+
+/**
+ * Get allocator status
+ * @param info: Filled with the counts
+ */
+void frame_get_info(frame_info_t *info);
+
+#endif /* FRAME_H */
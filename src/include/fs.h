@@ -9,6 +9,9 @@
 #include "stdint.h"
 #include "stdbool.h"
 
+/* Page cache page size */
+#define FS_PAGE_SIZE    4096
+
 /* Maximum path length */
 #define FS_MAX_PATH     256
 #define FS_MAX_NAME     256     /* Supports Rock Ridge long filenames */
@@ -29,6 +32,12 @@
 #define FS_OPEN_CREATE  0x08
 #define FS_OPEN_TRUNC   0x10
 
+/* Mount flags (fs_mount_at) */
+#define FS_MOUNT_LAZY   0x01    /* Mount on first access instead of now */
+
+/* Maximum number of mounted filesystems (including the root) */
+#define FS_MAX_MOUNTS   8
+
 /* Seek origins */
 #define FS_SEEK_SET     0   /* From beginning */
 #define FS_SEEK_CUR     1   /* From current position */
@@ -46,6 +55,8 @@
 #define FS_ERR_NOENT    -8
 #define FS_ERR_EXIST    -9
 #define FS_ERR_NOTMOUNT -10
+#define FS_ERR_BUSY     -11
+#define FS_ERR_NOTEMPTY -12
 
 /* Forward declarations */
 struct fs_node;
@@ -58,6 +69,12 @@ typedef void (*open_fn)(struct fs_node *);
 typedef void (*close_fn)(struct fs_node *);
 typedef struct dirent *(*readdir_fn)(struct fs_node *, uint32_t);
 typedef struct fs_node *(*finddir_fn)(struct fs_node *, const char *);
+typedef int (*readpage_fn)(struct fs_node *, uint32_t, uint8_t *);
+typedef void (*fs_io_done_fn)(void *, int);
+typedef int (*readpage_async_fn)(struct fs_node *, uint32_t, uint8_t *, fs_io_done_fn, void *);
+typedef struct fs_node *(*create_fn)(struct fs_node *, const char *, uint32_t);
+typedef int (*unlink_fn)(struct fs_node *, const char *);
+typedef int (*truncate_fn)(struct fs_node *, uint32_t);
 
 /* Filesystem node (file/directory) */
 typedef struct fs_node {
@@ -66,6 +83,7 @@ typedef struct fs_node {
     uint32_t inode;             /* Inode number */
     uint32_t length;            /* File size in bytes */
     uint32_t impl;              /* Implementation-defined */
+    uint32_t dev;               /* Device identifier (with inode, names the file) */
     
     /* Filesystem operations */
     read_fn read;
@@ -75,9 +93,29 @@ typedef struct fs_node {
     readdir_fn readdir;
     finddir_fn finddir;
     
+    /* Writable filesystems only: create and remove directory entries,
+     * resize files. Drivers keep the length of the node they are given
+     * up to date on write and truncate. */
+    create_fn create;
+    unlink_fn unlink;
+    truncate_fn truncate;
+    
+    /* Fill one FS_PAGE_SIZE page of file data (zero past end of file).
+     * When set, fs_read serves the file through the page cache. */
+    readpage_fn readpage;
+    
+    /* Start filling a page in the background; the driver calls done
+     * (possibly from interrupt context, or before returning when the data
+     * is at hand) with FS_OK or an error code, and returns FS_ERR_BUSY
+     * if the device cannot take the request now */
+    readpage_async_fn readpage_async;
+    
     /* For mount points */
     struct fs_node *ptr;        /* Mounted filesystem root */
     
+    /* Containing directory (set by the VFS path cache, NULL for root) */
+    struct fs_node *parent;
+    
     /* Private data for filesystem driver */
     void *private_data;
 } fs_node_t;
@@ -88,6 +126,38 @@ typedef struct dirent {
     uint32_t inode;             /* Inode number */
 } dirent_t;
 
+/* File status (returned by fs_stat) */
+typedef struct fs_stat {
+    uint32_t size;              /* File size in bytes */
+    uint32_t type;              /* Node type (FS_FILE, FS_DIRECTORY, ...) */
+    uint32_t inode;             /* Inode number (extent LBA on ISO9660) */
+    uint32_t generation;        /* Mount generation of the filesystem */
+} fs_stat_t;
+
+/* VFS I/O statistics */
+typedef struct fs_io_stats {
+    uint32_t sectors_read;      /* Device sectors read by filesystem drivers */
+    uint32_t namei_calls;       /* Path resolutions */
+    uint32_t finddir_calls;     /* Directory lookups */
+    uint32_t readdir_calls;     /* Directory entry reads */
+    uint32_t dcache_hits;       /* Path components resolved from the path cache */
+    uint32_t dcache_misses;     /* Path components resolved by the driver */
+    uint32_t page_hits;         /* File pages served from the page cache */
+    uint32_t page_misses;       /* File pages read through the driver */
+} fs_io_stats_t;
+
+/* Mount table entry (returned by fs_get_mount) */
+typedef struct fs_mount_info {
+    char path[FS_MAX_PATH];     /* Mount point ("/" for the root) */
+    char fstype[32];            /* Filesystem type name */
+    uint32_t drive;             /* Drive number passed to the driver */
+    uint32_t flags;             /* FS_MOUNT_* flags */
+    uint32_t active;            /* 1 if mounted, 0 while a lazy mount is pending */
+    uint32_t block_size;        /* Bytes per allocation block (0 if not reported) */
+    uint32_t blocks;            /* Blocks for file data */
+    uint32_t blocks_free;       /* Blocks not in use */
+} fs_mount_info_t;
+
 /* Filesystem type structure */
 typedef struct filesystem {
     char name[32];              /* Filesystem name (e.g., "iso9660") */
@@ -95,6 +165,9 @@ typedef struct filesystem {
     /* Mount/unmount operations */
     fs_node_t *(*mount)(uint8_t drive);
     int (*unmount)(fs_node_t *root);
+    
+    /* Space of a mounted volume (optional) */
+    int (*usage)(uint8_t drive, uint32_t *free, uint32_t *total, uint32_t *block_size);
 } filesystem_t;
 
 /* VFS functions */
@@ -146,12 +219,30 @@ dirent_t *fs_readdir(fs_node_t *node, uint32_t index);
 
 /**
  * Find a file in a directory
+ * The node comes straight from the driver; release it with fs_node_free()
+ * once done with it.
  * @param node: Directory node
  * @param name: Filename to find
  * @return File node or NULL
  */
 fs_node_t *fs_finddir(fs_node_t *node, const char *name);
 
+/**
+ * Allocate a node for a driver to return from finddir, create or mount
+ * The VFS copies finddir and create results into its path cache and frees
+ * them; mount roots stay allocated while mounted.
+ * @return Zeroed node, or NULL if out of memory
+ */
+fs_node_t *fs_node_alloc(void);
+
+/**
+ * Free a node from fs_node_alloc()
+ * Nodes a driver keeps elsewhere (static ones) are left alone, so any
+ * node a driver returned can be passed.
+ * @param node: Node, or NULL
+ */
+void fs_node_free(fs_node_t *node);
+
 /**
  * Mount a filesystem
  * @param drive: Drive number
@@ -160,6 +251,29 @@ fs_node_t *fs_finddir(fs_node_t *node, const char *name);
  */
 fs_node_t *fs_mount(uint8_t drive, const char *fstype);
 
+/**
+ * Mount a filesystem on a directory of an already mounted filesystem
+ * The directory stays pinned in the path cache and is followed to the
+ * mounted root by all lookups. With FS_MOUNT_LAZY the device is not
+ * touched until the mount point is first used; if mounting fails then,
+ * the directory underneath shows through.
+ * @param path: Existing directory to mount on (e.g., "/tmp")
+ * @param drive: Drive number
+ * @param fstype: Filesystem type name
+ * @param flags: FS_MOUNT_* flags
+ * @return 0 on success, error code on failure
+ */
+int fs_mount_at(const char *path, uint8_t drive, const char *fstype, uint32_t flags);
+
+/**
+ * Get an entry of the mount table
+ * The root filesystem comes first.
+ * @param index: Entry index
+ * @param info: Structure to fill
+ * @return 0 on success, FS_ERR_NOENT past the last entry
+ */
+int fs_get_mount(uint32_t index, fs_mount_info_t *info);
+
 /**
  * Register a filesystem type
  * @param fs: Filesystem structure
@@ -173,11 +287,155 @@ int fs_register(filesystem_t *fs);
  */
 fs_node_t *fs_root(void);
 
+/**
+ * Get file status of a node
+ * @param node: File or directory node
+ * @param st: Structure to fill
+ * @return 0 on success, error code on failure
+ */
+int fs_stat(fs_node_t *node, fs_stat_t *st);
+
+/**
+ * Get the current mount generation
+ * Incremented every time a filesystem is mounted, so cached lookups
+ * can tell whether they belong to the current set of mounts.
+ * @return Mount generation
+ */
+uint32_t fs_mount_generation(void);
+
+/**
+ * Get VFS I/O statistics
+ * @param stats: Structure to fill
+ */
+void fs_get_io_stats(fs_io_stats_t *stats);
+
+/**
+ * Reset VFS I/O statistics to zero
+ */
+void fs_reset_io_stats(void);
+
+/**
+ * Account device sectors read by a filesystem driver
+ * @param count: Number of sectors read
+ */
+void fs_account_sectors(uint32_t count);
+
 /**
  * Resolve a path to a node
+ * Results come from the path cache and stay valid until evicted by a
+ * later lookup; use fs_node_get() to keep a node across lookups.
+ * "." and ".." are resolved through parent links.
  * @param path: Path string (e.g., "/boot/kernel.bin")
  * @return File node or NULL
  */
 fs_node_t *fs_namei(const char *path);
 
+/**
+ * Pin a node returned by fs_namei() so it is not evicted
+ * @param node: Node to pin
+ */
+void fs_node_get(fs_node_t *node);
+
+/**
+ * Release a node pinned with fs_node_get()
+ * @param node: Node to release
+ */
+void fs_node_put(fs_node_t *node);
+
+/**
+ * Create a file or directory
+ * @param path: Path of the new entry (its parent must exist)
+ * @param type: FS_FILE or FS_DIRECTORY
+ * @return New node (as from fs_namei), or NULL on error or if it exists
+ */
+fs_node_t *fs_create(const char *path, uint32_t type);
+
+/**
+ * Remove a file or empty directory
+ * Fails with FS_ERR_BUSY while the node is pinned (e.g. open).
+ * @param path: Path of the entry
+ * @return 0 on success, error code on failure
+ */
+int fs_unlink(const char *path);
+
+/**
+ * Change the size of a file
+ * Growing a file fills the new space with zeros.
+ * @param node: File node
+ * @param length: New size in bytes
+ * @return 0 on success, error code on failure
+ */
+int fs_truncate(fs_node_t *node, uint32_t length);
+
+/**
+ * Get the normalized absolute path of a node returned by fs_namei()
+ * @param node: Node
+ * @param buf: Buffer to store the path
+ * @param size: Buffer size
+ * @return 0 on success, error code on failure
+ */
+int fs_realpath(fs_node_t *node, char *buf, uint32_t size);
+
+/**
+ * Drop all unpinned entries from the path cache
+ */
+void fs_dcache_flush(void);
+
+/**
+ * Get a page of file data from the page cache, reading it if needed
+ * The page stays in memory until released with fs_page_put().
+ * @param node: File node with a readpage operation
+ * @param index: Page index within the file
+ * @return Page data (FS_PAGE_SIZE bytes), or NULL on error
+ */
+uint8_t *fs_page_get(fs_node_t *node, uint32_t index);
+
+/**
+ * Release a page obtained with fs_page_get()
+ * @param data: Page data pointer
+ */
+void fs_page_put(uint8_t *data);
+
+/* Completion callback for fs_page_read_async(): data is the pinned page,
+ * or NULL if the read failed */
+typedef void (*fs_page_done_fn)(void *ctx, uint8_t *data);
+
+/**
+ * Get a pinned page of file data only if it is already in the page cache
+ * @param node: File node with a readpage operation
+ * @param index: Page index within the file
+ * @return Page data (release with fs_page_put()), or NULL on a miss
+ */
+uint8_t *fs_page_peek(fs_node_t *node, uint32_t index);
+
+/**
+ * Start reading a page of file data into the page cache in the background
+ * The caller should check fs_page_peek() first; the page is not looked up.
+ * @param node: File node with a readpage_async operation (copied, so it
+ *              need not outlive the call)
+ * @param index: Page index within the file
+ * @param done: Called with the pinned page, usually from interrupt context
+ *              (before this call returns if the driver had the data at hand)
+ * @param ctx: Argument for done
+ * @return 0 if the read was started, FS_ERR_BUSY if the device is busy,
+ *         or another error code
+ */
+int fs_page_read_async(fs_node_t *node, uint32_t index, fs_page_done_fn done, void *ctx);
+
+/**
+ * Reclaim memory from the page cache
+ * Frees the frames of the pages; the frame allocator calls this when it
+ * runs out.
+ * @param count: Number of unpinned pages to free (0 frees all of them)
+ * @return Number of pages freed
+ */
+uint32_t fs_page_cache_shrink(uint32_t count);
+
+/**
+ * Get page cache usage
+ * @param used: Pages currently holding file data (may be NULL)
+ * @param total: Page cache capacity in pages (may be NULL)
+ */
+void fs_page_cache_usage(uint32_t *used, uint32_t *total);
+
 #endif /* FS_H */
@@ -131,6 +131,19 @@ typedef struct {
     uint8_t     nien;           /* Interrupts disabled flag */
 } ide_channel_t;
 
+/* Completion callback for asynchronous reads (called from interrupt
+ * context with IDE_OK or an error code) */
+typedef void (*ide_done_fn)(void *ctx, int status);
+
+/* Asynchronous ATAPI read in progress on a channel */
+typedef struct {
+    bool        active;         /* Request in flight */
+    uint16_t    *buffer;        /* Next destination word */
+    uint8_t     remaining;      /* Sectors still to transfer */
+    ide_done_fn done;           /* Completion callback */
+    void        *ctx;           /* Callback argument */
+} ide_async_t;
+
 /* Function declarations */
 
 /**
@@ -175,6 +188,23 @@ int ide_write_sectors(uint8_t drive, uint32_t lba, uint8_t sectors, const void *
  */
 int ide_atapi_read(uint8_t drive, uint32_t lba, uint8_t sectors, void *buffer);
 
+/**
+ * Start reading sectors from an ATAPI device in the background
+ * The channel raises an interrupt for every sector, so the transfer makes
+ * progress while the caller runs with interrupts enabled. Synchronous
+ * requests on the same channel wait for it to finish first.
+ * @param drive: Drive number (0-3)
+ * @param lba: Logical Block Address to read from
+ * @param sectors: Number of sectors to read
+ * @param buffer: Buffer to store data (must stay valid until done is called)
+ * @param done: Called from interrupt context when the transfer ends
+ * @param ctx: Argument for done
+ * @return 0 if the read was started, IDE_ERR_BUSY if the channel already has
+ *         an asynchronous read in flight, or another error code
+ */
+int ide_atapi_read_async(uint8_t drive, uint32_t lba, uint8_t sectors, void *buffer,
+                         ide_done_fn done, void *ctx);
+
 /**
  * Eject ATAPI device media
  * @param drive: Drive number (0-3)
@@ -201,5 +231,6 @@ void ide_print_info(void);
 #define IDE_ERR_READ        -4      /* Read error */
 #define IDE_ERR_WRITE       -5      /* Write error */
 #define IDE_ERR_INVALID     -6      /* Invalid parameter */
+#define IDE_ERR_BUSY        -7      /* Channel busy with an asynchronous read */
 
 #endif /* IDE_H */
@@ -78,11 +78,23 @@ typedef struct {
 /* IRQ handler function type */
 typedef void (*irq_handler_t)(interrupt_frame_t *frame);
 
+/* Exception handler type: returns non-zero if the exception was resolved */
+typedef int (*exception_handler_t)(interrupt_frame_t *frame);
+
+/* Deferred work function type (runs after the interrupt is acknowledged) */
+typedef void (*deferred_fn_t)(void);
+
+/* Maximum queued deferred work functions */
+#define IRQ_MAX_DEFERRED    8
+
 /* Function declarations */
 void idt_init(void);
 void idt_set_gate(uint8_t num, uint32_t base, uint16_t selector, uint8_t flags);
 void irq_install_handler(uint8_t irq, irq_handler_t handler);
 void irq_uninstall_handler(uint8_t irq);
+void isr_install_handler(uint8_t num, exception_handler_t handler);
+void irq_defer(deferred_fn_t fn);
+void irq_run_deferred(void);
 
 /* PIC functions */
 void pic_init(void);
@@ -0,0 +1,123 @@
+/**
+ * Program Image Cache Header
+ * Keeps the segments of loaded programs in memory for repeated runs
+ */
+
+#ifndef IMGCACHE_H
+#define IMGCACHE_H
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "fs.h"
+#include "initramfs.h"
+#include "loader.h"
+
+/* Pool holding the cached segment contents (right after the initramfs) */
+#define IMGCACHE_POOL_BASE      (INITRAMFS_BASE + INITRAMFS_MAX_SIZE)
+#define IMGCACHE_POOL_SIZE      (4 * 1024 * 1024)
+
+/* Limits */
+#define IMGCACHE_MAX_IMAGES     8
+#define IMGCACHE_MAX_PATH       64
+
+/* Segment of a cached image; BSS (memsz - filesz) is not stored */
+typedef struct {
+    uint32_t vaddr;             /* Link address */
+    uint32_t filesz;            /* Bytes kept in the pool */
+    uint32_t memsz;             /* Bytes in memory (rest is zeroed) */
+    uint32_t flags;             /* Segment attributes (PF_*) */
+    uint32_t pool_offset;       /* Offset of the contents in the pool */
+} imgcache_segment_t;
+
+/* Cached program image */
+typedef struct {
+    char path[IMGCACHE_MAX_PATH];       /* Path it was loaded from */
+    uint32_t dev;               /* Device of the file */
+    uint32_t inode;             /* Inode of the file */
+    uint32_t generation;        /* Mount generation at load time */
+    uint32_t type;              /* ET_EXEC or ET_DYN */
+    uint32_t entry;             /* Entry point (link address) */
+    uint32_t dynamic;           /* Dynamic section (link address, 0 if none) */
+    uint32_t file_size;         /* Size of the ELF file */
+    uint32_t pool_offset;       /* First pool byte used */
+    uint32_t pool_bytes;        /* Pool bytes used (all segments) */
+    imgcache_segment_t segments[LOADER_MAX_PHDRS];
+    uint32_t segment_count;
+    uint32_t lru;               /* Last use stamp (higher is more recent) */
+    uint32_t hits;              /* Loads served from the cache */
+    bool used;                  /* Slot in use */
+} imgcache_image_t;
+
+/* Cache status */
+typedef struct {
+    uint32_t images;            /* Images cached */
+    uint32_t bytes_used;        /* Pool bytes in use */
+    uint32_t bytes_total;       /* Pool size (0 if memory is too small) */
+    uint32_t hits;              /* Loads served from the cache */
+    uint32_t misses;            /* Loads that read the file */
+} imgcache_info_t;
+
+/* Cached image description */
+typedef struct {
+    char path[IMGCACHE_MAX_PATH];       /* Path it was loaded from */
+    uint32_t bytes;             /* Pool bytes used */
+    uint32_t hits;              /* Loads served from the cache */
+} imgcache_image_info_t;
+
+/**
+ * Initialize the image cache
+ * The cache stays disabled if memory does not reach the end of the pool.
+ */
+void imgcache_init(void);
+
+/**
+ * Look up a program in the cache
+ * Describes the cached image at its link addresses, without any
+ * filesystem access; imgcache_copy() then puts it in place. Only images
+ * loaded under the current mount generation are used.
+ * @param path: Path of the program
+ * @param ehdr: Type, entry point and program header count filled on a hit
+ * @param phdrs: Loadable segments (and the dynamic section) filled on a hit
+ * @param file_size: Set to the size of the program file on a hit
+ * @return Image index on a hit, -1 otherwise
+ */
+int imgcache_lookup(const char *path, elf32_ehdr_t *ehdr, elf32_phdr_t *phdrs,
+                    uint32_t *file_size);
+
+/**
+ * Copy the file part of a cached image's segments into place
+ * BSS is left to the caller.
+ * @param index: Image index from imgcache_lookup()
+ * @param bias: Added to every link address (0 for fixed-address programs)
+ */
+void imgcache_copy(int index, uint32_t bias);
+
+/**
+ * Keep the image of a program that was just loaded
+ * Must be called before the program runs or is relocated, while its
+ * segments are still pristine and all in place. Files on writable
+ * filesystems are not cached.
+ * @param path: Path the program was loaded from
+ * @param node: File node
+ * @param ehdr: Validated ELF header
+ * @param phdrs: Checked program headers, at their load addresses
+ * @param bias: Load address minus link address (0 for fixed-address programs)
+ */
+void imgcache_store(const char *path, fs_node_t *node, const elf32_ehdr_t *ehdr,
+                    const elf32_phdr_t *phdrs, uint32_t bias);
+
+/**
+ * Get cache status
+ * @param info: Filled with the current status
+ */
+void imgcache_get_info(imgcache_info_t *info);
+
+/**
+ * Describe a cached image
+ * @param index: Image index (0 to images - 1)
+ * @param info: Filled with the description
+ * @return 0 on success, -1 past the last image
+ */
+int imgcache_get_image(uint32_t index, imgcache_image_info_t *info);
+
+#endif /* IMGCACHE_H */
@@ -0,0 +1,87 @@
+/**
+ * initramfs Header
+ * Read-only root filesystem from a cpio "newc" archive in memory
+ */
+
+#ifndef INITRAMFS_H
+#define INITRAMFS_H
+
+#include "stdint.h"
+#include "fs.h"
+#include "tmpfs.h"
+
+/* Where the kernel moves the archive at boot (right after the tmpfs
+ * pool), away from the program area GRUB may have loaded it into */
+#define INITRAMFS_BASE          (TMPFS_POOL_BASE + TMPFS_POOL_SIZE)
+#define INITRAMFS_MAX_SIZE      (4 * 1024 * 1024)
+
+/* Limits */
+#define INITRAMFS_MAX_ENTRIES   256     /* Files and directories, including root */
+#define INITRAMFS_MAX_NAME      64      /* Name length including terminator */
+#define INITRAMFS_HASH_SIZE     256     /* Directory lookup hash buckets */
+
+/* Device identifier of initramfs nodes (outside the IDE drive numbers) */
+#define INITRAMFS_DEV           0x101
+
+/* cpio "newc" format */
+#define CPIO_NEWC_MAGIC         "070701"
+#define CPIO_TRAILER            "TRAILER!!!"
+#define CPIO_MODE_TYPE          0170000     /* File type bits of mode */
+#define CPIO_MODE_DIR           0040000
+#define CPIO_MODE_FILE          0100000
+
+/* cpio "newc" header: all numbers are 8 ASCII hex digits; followed by
+ * the name and the file data, each padded to a multiple of 4 bytes */
+typedef struct {
+    char magic[6];              /* "070701" */
+    char ino[8];
+    char mode[8];               /* File type and permissions */
+    char uid[8];
+    char gid[8];
+    char nlink[8];
+    char mtime[8];
+    char filesize[8];           /* Data size in bytes */
+    char devmajor[8];
+    char devminor[8];
+    char rdevmajor[8];
+    char rdevminor[8];
+    char namesize[8];           /* Name length including terminator */
+    char check[8];
+} __attribute__((packed)) cpio_newc_header_t;
+
+/* initramfs entry: a file or directory in the archive */
+typedef struct {
+    char name[INITRAMFS_MAX_NAME];  /* Name in the parent directory */
+    uint32_t type;              /* FS_FILE or FS_DIRECTORY */
+    const uint8_t *data;        /* File data inside the archive */
+    uint32_t size;              /* File size in bytes */
+    int16_t parent;             /* Parent directory entry index */
+    int16_t hash_next;          /* Next entry in lookup hash chain */
+    int16_t next;               /* Next sibling in parent directory */
+    int16_t first_child;        /* Directory: first child */
+    int16_t last_child;         /* Directory: last child */
+} initramfs_entry_t;
+
+/**
+ * Initialize the initramfs driver and register the "initramfs" filesystem type
+ * @param image: Archive in memory (must stay in place while mounted)
+ * @param size: Archive size in bytes (0 if there is no archive)
+ */
+void initramfs_init(const uint8_t *image, uint32_t size);
+
+/**
+ * Mount the initramfs
+ * The archive is indexed on the first mount.
+ * @param drive: Ignored
+ * @return Root node or NULL if there is no valid archive
+ */
+fs_node_t *initramfs_mount(uint8_t drive);
+
+/**
+ * Unmount the initramfs
+ * @param root: Root node
+ * @return 0 on success, error code on failure
+ */
+int initramfs_unmount(fs_node_t *root);
+
+#endif /* INITRAMFS_H */
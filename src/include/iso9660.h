@@ -141,6 +141,15 @@ typedef struct {
     uint8_t  reserved[653];     /* Reserved */
 } __attribute__((packed)) iso9660_pvd_t;
 
+/* Directories whose records were checked for Rock Ridge names that
+ * differ from the sorted identifiers */
+#define ISO9660_ORDER_CACHE     16
+
+typedef struct {
+    uint32_t    extent;         /* Directory extent LBA, 0 if unused */
+    uint8_t     sorted;         /* Names follow the identifier order */
+} iso9660_order_t;
+
 /* ISO9660 filesystem private data */
 typedef struct {
     uint8_t     drive;          /* IDE drive number */
@@ -153,15 +162,11 @@ typedef struct {
     uint8_t     has_joliet;     /* Joliet extensions detected */
     uint32_t    joliet_root_lba;/* Joliet root directory LBA */
     uint32_t    joliet_root_size;/* Joliet root directory size */
+    int         cache_volume;   /* cachefs volume slot, -1 if pages are not cached */
+    iso9660_order_t order[ISO9660_ORDER_CACHE];/* Checked directories */
+    uint32_t    order_next;     /* Slot to replace next */
 } iso9660_fs_t;
 
-/* ISO9660 file private data */
-typedef struct {
-    uint32_t    lba;            /* Starting LBA */
-    uint32_t    size;           /* File size */
-    uint8_t     flags;          /* File flags */
-} iso9660_file_t;
-
 /* Function declarations */
 
 /**
@@ -171,6 +176,8 @@ void iso9660_init(void);
 
 /**
  * Mount an ISO9660 filesystem from a drive
+ * Every drive has its own volume state, so discs in several drives
+ * can be mounted at the same time.
  * @param drive: IDE drive number
  * @return Root node or NULL on error
  */
@@ -184,9 +191,17 @@ fs_node_t *iso9660_mount(uint8_t drive);
 int iso9660_unmount(fs_node_t *root);
 
 /**
- * Check if Rock Ridge extensions are available on mounted filesystem
+ * Get the volume ID of the filesystem mounted from a drive
+ * @param drive: IDE drive number
+ * @return Volume ID (empty if none)
+ */
+const char *iso9660_get_volume_id(uint8_t drive);
+
+/**
+ * Check if Rock Ridge extensions are available on a mounted filesystem
+ * @param drive: IDE drive number
  * @return 1 if Rock Ridge is supported, 0 otherwise
  */
-int iso9660_has_rock_ridge(void);
+int iso9660_has_rock_ridge(uint8_t drive);
 
 #endif /* ISO9660_H */
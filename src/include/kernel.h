@@ -18,6 +18,8 @@ typedef struct {
     uint32_t mem_lower;     /* Lower memory in KB (below 1MB) */
     uint32_t mem_upper;     /* Upper memory in KB (above 1MB) */
     uint32_t total_kb;      /* Total usable memory in KB */
+    uint32_t frames_free;   /* 4KB frames free in the frame allocator */
+    uint32_t frames_used;   /* Frames it has handed out */
 } mem_info_t;
 
 /* Get memory information */
@@ -0,0 +1,123 @@
+/**
+ * Kernel Heap Header
+ * Slab caches for fixed-size kernel objects and kmalloc() on top of them
+ */
+
+#ifndef KMALLOC_H
+#define KMALLOC_H
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "stddef.h"
+
+/* Object caches (kmalloc size classes included) */
+#define KMEM_MAX_CACHES         16
+
+/* Cache name length, including the terminator */
+#define KMEM_NAME_LEN           16
+
+/* kmalloc() size classes: powers of two from 16 bytes to 2KB; larger
+ * requests get whole frames */
+#define KMEM_MIN_SIZE           16
+#define KMEM_MAX_SIZE           2048
+
+/* Slabs span up to 2^KMEM_MAX_SLAB_ORDER frames, so large objects do not
+ * waste most of a frame */
+#define KMEM_MAX_SLAB_ORDER     2
+
+/* Cache usage statistics */
+typedef struct {
+    char name[KMEM_NAME_LEN];   /* Cache name ("kmalloc-large" for frame blocks) */
+    uint32_t object_size;       /* Bytes per object (0 for frame blocks) */
+    uint32_t slab_size;         /* Bytes per slab */
+    uint32_t slabs;             /* Slabs (frame blocks) held */
+    uint32_t objects;           /* Objects the slabs hold */
+    uint32_t in_use;            /* Objects allocated */
+    uint32_t peak;              /* Most objects allocated at once */
+    uint32_t allocs;            /* Allocations */
+    uint32_t frees;             /* Frees */
+    uint32_t failures;          /* Allocations that found no memory */
+} kmem_cache_info_t;
+
+typedef struct kmem_cache kmem_cache_t;
+
+/**
+ * Initialize the kernel heap and the kmalloc() size classes
+ * Must be called after frame_start(). Neither the heap nor the caches are
+ * safe to use from interrupt handlers.
+ */
+void kmalloc_init(void);
+
+/**
+ * Create a cache of fixed-size objects
+ * Memory comes from the frame allocator a slab at a time as objects are
+ * allocated, and goes back when a slab empties.
+ * @param name: Name shown in the statistics (truncated to KMEM_NAME_LEN - 1)
+ * @param size: Object size in bytes (up to KMEM_MAX_SIZE)
+ * @return Cache, or NULL if the size is invalid or no cache slot is left
+ */
+kmem_cache_t *kmem_cache_create(const char *name, uint32_t size);
+
+/**
+ * Allocate an object from a cache
+ * @param cache: Cache from kmem_cache_create()
+ * @return Uninitialized object (8-byte aligned), or NULL if out of memory
+ */
+void *kmem_cache_alloc(kmem_cache_t *cache);
+
+/**
+ * Return an object to its cache
+ * @param cache: Cache the object was allocated from
+ * @param ptr: Object, or NULL (ignored)
+ */
+void kmem_cache_free(kmem_cache_t *cache, void *ptr);
+
+/**
+ * Check whether a pointer is an object of a cache
+ * Safe to call with any pointer; says nothing about whether the object
+ * is currently allocated.
+ * @param cache: Cache to check
+ * @param ptr: Pointer to check
+ * @return true if ptr is the start of an object slot of the cache
+ */
+bool kmem_cache_owns(kmem_cache_t *cache, const void *ptr);
+
+/**
+ * Allocate memory from the kernel heap
+ * @param size: Bytes needed
+ * @return Uninitialized memory (8-byte aligned, frame aligned above
+ *         KMEM_MAX_SIZE), or NULL if out of memory
+ */
+void *kmalloc(size_t size);
+
+/**
+ * Allocate zeroed memory from the kernel heap
+ * @param size: Bytes needed
+ * @return Zeroed memory, or NULL if out of memory
+ */
+void *kzalloc(size_t size);
+
+/**
+ * Free memory from kmalloc() or kzalloc()
+ * @param ptr: Memory, or NULL (ignored)
+ */
+void kfree(void *ptr);
+
+/**
+ * Get the statistics of a cache
+ * The caches come in creation order, followed by one entry for
+ * allocations too large for a size class.
+ * @param index: Cache index, from 0
+ * @param info: Filled with the statistics
+ * @return 0 on success, -1 past the last entry
+ */
+int kmem_get_cache_info(uint32_t index, kmem_cache_info_t *info);
+
+/**
+ * Print every allocated object with the code that allocated it
+ * Only builds with KMEM_DEBUG track allocation sites; others print
+ * nothing.
+ */
+void kmem_leak_report(void);
+
+#endif /* KMALLOC_H */
@@ -12,8 +12,28 @@
 /* Program load address (4MB mark, above kernel) */
 #define PROGRAM_LOAD_ADDR   0x400000
 
-/* Maximum program size (64KB) */
-#define PROGRAM_MAX_SIZE    0x10000
+/* End of the program area (the tmpfs pool starts here); every loadable
+ * segment must lie between PROGRAM_LOAD_ADDR and this address */
+#define PROGRAM_AREA_END    0x01000000
+
+/* Maximum number of program headers */
+#define LOADER_MAX_PHDRS    16
+
+/* Images of suspended programs whose addresses a child needed, kept
+ * while it runs (28MB, right after the program image cache pool) */
+#define LOADER_SAVE_BASE    0x01C00000
+#define LOADER_SAVE_SIZE    (8 * 1024 * 1024)
+
+/* Shared runtime (built from src/user/runtime.c), loaded once at boot
+ * right after the save area (36MB); programs call into it through the
+ * jump table at its start: RUNTIME_MAGIC, the entry count, the entries */
+#define RUNTIME_BASE        (LOADER_SAVE_BASE + LOADER_SAVE_SIZE)
+#define RUNTIME_MAX_SIZE    (256 * 1024)
+#define RUNTIME_PATH        "/lib/runtime"
+#define RUNTIME_MAGIC       0x544E5552  /* "RUNT" in little endian */
+
+/* Maximum nesting of programs started with exec */
+#define LOADER_MAX_DEPTH    8
 
 /* ELF Magic Number */
 #define ELF_MAGIC 0x464C457F  /* "\x7FELF" in little endian */
@@ -26,6 +46,7 @@
 
 /* ELF Type */
 #define ET_EXEC         2     /* Executable file */
+#define ET_DYN          3     /* Position-independent executable */
 
 /* ELF Machine */
 #define EM_386          3     /* Intel 80386 */
@@ -33,12 +54,25 @@
 /* Program Header Types */
 #define PT_NULL         0     /* Unused entry */
 #define PT_LOAD         1     /* Loadable segment */
+#define PT_DYNAMIC      2     /* Dynamic section */
 
 /* Program Header Flags */
 #define PF_X            0x1   /* Execute */
 #define PF_W            0x2   /* Write */
 #define PF_R            0x4   /* Read */
 
+/* Dynamic Section Tags */
+#define DT_NULL         0     /* End of the section */
+#define DT_RELA         7     /* Relocations with addends */
+#define DT_REL          17    /* Relocation table */
+#define DT_RELSZ        18    /* Size of the relocation table */
+#define DT_RELENT       19    /* Size of a relocation entry */
+#define DT_TEXTREL      22    /* Relocations in read-only segments */
+
+/* Relocation Types */
+#define R_386_NONE      0     /* No relocation */
+#define R_386_RELATIVE  8     /* Add the load bias */
+
 /**
  * ELF32 Header
  */
@@ -73,23 +107,109 @@ typedef struct {
     uint32_t p_align;         /* Alignment of segment */
 } __attribute__((packed)) elf32_phdr_t;
 
+/**
+ * ELF32 Dynamic Section Entry
+ */
+typedef struct {
+    int32_t  d_tag;           /* DT_* tag */
+    uint32_t d_val;           /* Value or link address */
+} __attribute__((packed)) elf32_dyn_t;
+
+/**
+ * ELF32 Relocation
+ */
+typedef struct {
+    uint32_t r_offset;        /* Link address of the word to relocate */
+    uint32_t r_info;          /* Type in the low byte */
+} __attribute__((packed)) elf32_rel_t;
+
+/* Compressed executable (built by tools/mklz4exe.sh): header, one entry
+ * per loadable segment, then one LZ4 frame per segment with its file bytes */
+#define LZ4EXE_MAGIC    0x5A333945  /* "E93Z" in little endian */
+
+/**
+ * Compressed executable header
+ */
+typedef struct {
+    uint32_t magic;           /* LZ4EXE_MAGIC */
+    uint32_t entry;           /* Entry point address */
+    uint32_t segment_count;   /* Entries following the header */
+    uint32_t dynamic;         /* Dynamic section of a position-independent
+                                 program (link address), 0 otherwise */
+} __attribute__((packed)) lz4exe_header_t;
+
+/**
+ * Compressed executable segment
+ */
+typedef struct {
+    uint32_t vaddr;           /* Virtual address in memory */
+    uint32_t filesz;          /* Bytes the frame decodes to */
+    uint32_t memsz;           /* Size of segment in memory */
+    uint32_t flags;           /* Segment attributes (PF_*) */
+    uint32_t offset;          /* Offset of the frame in the file */
+    uint32_t size;            /* Bytes in the frame (0 if filesz is 0) */
+} __attribute__((packed)) lz4exe_segment_t;
+
 /**
  * Program structure
  */
 typedef struct {
     uint32_t entry;         /* Entry point address */
     uint32_t size;          /* Program size */
-    uint32_t load_addr;     /* Load address */
+    uint32_t load_addr;     /* Lowest segment address */
+    uint32_t mem_size;      /* Bytes from load_addr to the end of the last segment */
     char name[64];          /* Program name */
 } program_t;
 
+/* Startup profiles kept, most recent first */
+#define LOADER_PROFILES         8
+
+/* Startup phases timed in a profile */
+#define LOADER_PHASE_LOOKUP     0   /* Image cache and path lookup */
+#define LOADER_PHASE_HEADERS    1   /* Reading and checking the headers */
+#define LOADER_PHASE_PLACE      2   /* Choosing addresses, saving programs in the way */
+#define LOADER_PHASE_SEGMENTS   3   /* Copying or decoding segment contents */
+#define LOADER_PHASE_PAGER      4   /* Mapping the pages, zeroing BSS */
+#define LOADER_PHASE_RELOCATE   5   /* Applying relocations */
+#define LOADER_PHASE_EXEC       6   /* From loader_exec() to the entry point */
+#define LOADER_PHASES           7
+
+/* Profile flags */
+#define LOADER_PROFILE_CACHED       0x01    /* Image came from the image cache */
+#define LOADER_PROFILE_COMPRESSED   0x02    /* Decoded from a compressed executable */
+#define LOADER_PROFILE_PIE          0x04    /* Position-independent, relocated */
+#define LOADER_PROFILE_RAN          0x08    /* Loaded and started */
+
+/**
+ * Startup profile of one program load (and run)
+ * Times are in microseconds (PIT based, about 1us resolution).
+ */
+typedef struct {
+    char name[64];              /* Path the program was loaded from */
+    uint32_t flags;             /* LOADER_PROFILE_* */
+    int32_t result;             /* Exit code, or the load error */
+    uint32_t phase_us[LOADER_PHASES];
+    uint32_t run_us;            /* From the entry point to the exit */
+    uint32_t load_addr;         /* Lowest segment address */
+    uint32_t mem_size;          /* Bytes from load_addr to the end of the image */
+    uint32_t bytes_read;        /* File bytes read while loading */
+    uint32_t bytes_zeroed;      /* BSS bytes zeroed while loading */
+    uint32_t run_pages;         /* Pages filled on first access while running */
+    uint32_t run_bytes_read;    /* File bytes read for them */
+} loader_profile_t;
+
 /**
  * Initialize the program loader
  */
 void loader_init(void);
 
 /**
- * Load a flat binary program from filesystem
+ * Load an ELF program from filesystem
+ * Reads the headers first, then each segment straight to its address.
+ * Position-independent programs (ET_DYN) go to the first free range above
+ * the suspended programs and get their R_386_RELATIVE relocations applied.
+ * Compressed executables are recognized by their magic; their frames are
+ * read into free program memory above the image and decoded in place.
  * @param path: Path to the program file
  * @param prog: Program structure to fill
  * @return 0 on success, negative error code on failure
@@ -97,7 +217,8 @@ void loader_init(void);
 int loader_load(const char *path, program_t *prog);
 
 /**
- * Load a program from a memory buffer
+ * Load an ELF program from a memory buffer
+ * Segments are copied straight from the buffer to their addresses.
  * @param data: Program binary data
  * @param size: Size of program data
  * @param name: Program name
@@ -109,11 +230,52 @@ int loader_load_from_memory(const uint8_t *data, uint32_t size,
 
 /**
  * Execute a loaded program
+ * Returns when the program exits or returns from its entry point. Its
+ * file mappings and background reads are dropped then.
  * @param prog: Program to execute
- * @return Program exit code
+ * @return Program exit code, or -1 if programs are nested too deeply
  */
 int loader_exec(program_t *prog);
 
+/**
+ * Run a program as a child of the running one
+ * The caller stays in place if the child fits elsewhere; otherwise its
+ * image is saved, the child is loaded over it, and the image is put back
+ * afterwards. Either way the caller continues as after a function call.
+ * Its stack is not touched: the child runs below it on the same stack.
+ * @param path: Path to the program file
+ * @return Child exit code, or -1 if it could not be loaded
+ */
+int loader_run(const char *path);
+
+/**
+ * Load the shared runtime
+ * Reads the image to RUNTIME_BASE and maps it read-only except for
+ * writable segments. The image must start with the jump table and every
+ * entry must point into the runtime area. The rest of the area stays
+ * unmapped, so a program calling into a runtime that is not loaded is
+ * terminated.
+ * @param path: Path to the runtime image (ELF linked at RUNTIME_BASE)
+ * @return 0 on success, negative error code on failure
+ */
+int loader_load_runtime(const char *path);
+
+/**
+ * Get a recent startup profile
+ * A profile is recorded when its program exits or fails to load, so a
+ * parent's profile follows the profiles of the children it ran.
+ * @param index: 0 for the most recent, up to LOADER_PROFILES - 1
+ * @param profile: Filled with the profile
+ * @return 0 on success, -1 past the last recorded profile
+ */
+int loader_get_profile(uint32_t index, loader_profile_t *profile);
+
+/**
+ * Get the program nesting level
+ * @return Number of programs started and not yet finished
+ */
+uint32_t loader_get_depth(void);
+
 /**
  * Check if a program is currently running
  * @return 1 if program is running, 0 otherwise
@@ -128,14 +290,9 @@ program_t *loader_get_current(void);
 
 /**
  * Signal that the current program has exited
+ * Unwinds to the loader_exec() that started it. Does not return.
  * @param exit_code: Exit code from program
  */
 void loader_exit(int exit_code);
 
-/**
- * Set the parent program to restart after child exits
- * @param path: Path to the parent program
- */
-void loader_set_parent(const char *path);
-
 #endif /* LOADER_H */
@@ -0,0 +1,37 @@
+/**
+ * LZ4 Decompression Header
+ * Decoder for the LZ4 frame format
+ */
+
+#ifndef LZ4_H
+#define LZ4_H
+
+#include "stdint.h"
+
+/* Frame format */
+#define LZ4_FRAME_MAGIC         0x184D2204
+#define LZ4_FLG_VERSION_MASK    0xC0
+#define LZ4_FLG_VERSION         0x40    /* Version 01 */
+#define LZ4_FLG_BLOCK_CHECKSUM  0x10
+#define LZ4_FLG_CONTENT_SIZE    0x08
+#define LZ4_FLG_CONTENT_CHECKSUM 0x04
+#define LZ4_FLG_DICT_ID         0x01
+#define LZ4_BLOCK_UNCOMPRESSED  0x80000000  /* Flag in a block size */
+
+/* Sequence format */
+#define LZ4_MIN_MATCH           4
+
+/**
+ * Decode an LZ4 frame
+ * Blocks may be linked or independent; they are decoded back to back into
+ * dst. Checksums are skipped, not verified.
+ * @param src: Frame
+ * @param src_size: Bytes in the frame
+ * @param dst: Output buffer
+ * @param dst_size: Size of the output buffer
+ * @return Bytes written to dst, or -1 if the frame is malformed or does
+ *         not fit
+ */
+int lz4_decompress_frame(const uint8_t *src, uint32_t src_size, uint8_t *dst, uint32_t dst_size);
+
+#endif /* LZ4_H */
@@ -0,0 +1,49 @@
+/**
+ * MBR Partition Table Header
+ * Layout of the partition table in the first sector of an ATA disk
+ */
+
+#ifndef MBR_H
+#define MBR_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#define MBR_TABLE_OFFSET        446     /* Partition table offset in sector 0 */
+#define MBR_PARTITIONS          4       /* Primary partition entries */
+#define MBR_SIGNATURE_OFFSET    510     /* Boot signature offset in sector 0 */
+#define MBR_SIGNATURE           0xAA55  /* Boot signature */
+
+/* Partition types */
+#define MBR_TYPE_FAT32_CHS      0x0B    /* FAT32 */
+#define MBR_TYPE_FAT32_LBA      0x0C    /* FAT32 (LBA addressed) */
+
+/* Partition table entry */
+typedef struct {
+    uint8_t status;             /* 0x80 if bootable */
+    uint8_t chs_first[3];       /* CHS address of first sector (unused) */
+    uint8_t type;               /* Partition type */
+    uint8_t chs_last[3];        /* CHS address of last sector (unused) */
+    uint32_t lba_first;         /* First sector */
+    uint32_t sectors;           /* Number of sectors */
+} __attribute__((packed)) mbr_part_t;
+
+/**
+ * Check the boot signature of a first sector
+ * @param sector: 512-byte sector 0 of a disk
+ * @return true if the sector carries a partition table signature
+ */
+static inline bool mbr_valid(const uint8_t *sector) {
+    return *(const uint16_t *)(sector + MBR_SIGNATURE_OFFSET) == MBR_SIGNATURE;
+}
+
+/**
+ * Get the partition table of a first sector
+ * @param sector: 512-byte sector 0 of a disk
+ * @return The MBR_PARTITIONS table entries
+ */
+static inline const mbr_part_t *mbr_partitions(const uint8_t *sector) {
+    return (const mbr_part_t *)(sector + MBR_TABLE_OFFSET);
+}
+
+#endif /* MBR_H */
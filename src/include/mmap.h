@@ -0,0 +1,49 @@
+/**
+ * File Mapping Header
+ * Maps file pages from the VFS page cache into a virtual window
+ */
+
+#ifndef MMAP_H
+#define MMAP_H
+
+#include "stdint.h"
+#include "fs.h"
+
+/* File mapping window (outside the identity-mapped memory) */
+#define MMAP_BASE           0x20000000
+#define MMAP_SIZE           (16 * 1024 * 1024)
+
+/* Maximum number of simultaneous mappings */
+#define MMAP_MAX_REGIONS    16
+
+/**
+ * Initialize the file mapping window
+ * Must be called after paging_init()
+ */
+void mmap_init(void);
+
+/**
+ * Map part of a file read-only into the mapping window
+ * Pages are filled from the page cache on first access.
+ * @param node: File node (must support readpage)
+ * @param offset: File offset (page aligned)
+ * @param length: Bytes to map (0 maps up to end of file)
+ * @return Address of the mapping, or 0 on error
+ */
+uint32_t mmap_file(fs_node_t *node, uint32_t offset, uint32_t length);
+
+/**
+ * Remove a mapping
+ * @param addr: Address returned by mmap_file()
+ * @return 0 on success, -1 if addr is not a mapping
+ */
+int mmap_unmap(uint32_t addr);
+
+/**
+ * Remove the mappings made at a program nesting level and deeper
+ * (called when a program finishes)
+ * @param level: First nesting level to drop (see loader_get_depth())
+ */
+void mmap_unmap_from(uint32_t level);
+
+#endif /* MMAP_H */
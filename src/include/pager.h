@@ -0,0 +1,129 @@
+/**
+ * Program Pager Header
+ * Fills program pages on first access instead of at load time
+ */
+
+#ifndef PAGER_H
+#define PAGER_H
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "fs.h"
+#include "loader.h"
+
+/* Segment of a program as seen by the pager */
+typedef struct {
+    uint32_t start;             /* First byte */
+    uint32_t file_end;          /* End of the bytes with contents */
+    uint32_t end;               /* End of the segment (rest is zero) */
+    uint32_t offset;            /* File offset of start */
+    bool writable;              /* PF_W set */
+    bool resident;              /* Contents already in place */
+} pager_segment_t;
+
+/* Work done for the program at one nesting level */
+typedef struct {
+    uint32_t pages_filled;      /* Pages filled on first access */
+    uint32_t bytes_read;        /* File bytes read into them */
+    uint32_t bytes_zeroed;      /* BSS bytes zeroed (at start or on access) */
+} pager_stats_t;
+
+/* Pages of the program at one nesting level */
+typedef struct {
+    pager_segment_t segments[LOADER_MAX_PHDRS];
+    uint32_t segment_count;
+    fs_node_t *node;            /* File of the other segments (pinned) */
+    uint32_t first_page;        /* Pages handed to the pager */
+    uint32_t end_page;
+    bool active;                /* Pages handed over, not yet released */
+    pager_stats_t stats;        /* Since pager_begin() */
+} pager_space_t;
+
+/**
+ * Initialize the pager and take over page faults in the program area
+ * Must be called after paging_init()
+ */
+void pager_init(void);
+
+/**
+ * Start describing the program that will run at a nesting level
+ * Releases whatever the level described before.
+ * @param level: Nesting level (loader_get_depth() while it runs)
+ */
+void pager_begin(uint32_t level);
+
+/**
+ * Add a loadable segment
+ * @param level: Nesting level
+ * @param phdr: Checked program header
+ * @param node: File to read the contents from on first access, or NULL if
+ *              they are already in place (pinned until the level is released)
+ */
+void pager_add_segment(uint32_t level, const elf32_phdr_t *phdr, fs_node_t *node);
+
+/**
+ * Hand the pages of the added segments to the pager
+ * Pages whose contents are not in place are unmapped and filled on the
+ * first access; pages holding only zeroes share one zero page until the
+ * first write. BSS bytes in pages that stay mapped are zeroed now.
+ * @param level: Nesting level
+ */
+void pager_start(uint32_t level);
+
+/**
+ * Give the pages of a level back as ordinary memory
+ * Maps them again and unpins the file.
+ * @param level: Nesting level
+ */
+void pager_release(uint32_t level);
+
+/**
+ * Make a range of the running program present (and writable)
+ * Called before device transfers into or out of program memory, so no
+ * page fault has to read the program file in the middle of a transfer.
+ * @param addr: First byte
+ * @param size: Bytes in the range
+ * @param write: Also break zero page sharing
+ * @return 0 on success, -1 if part of the range is not program memory
+ */
+int pager_prefault(uint32_t addr, uint32_t size, bool write);
+
+/**
+ * Make a range of the program at a nesting level present (and writable)
+ * Used by the loader to relocate a program before it runs.
+ * @param level: Nesting level
+ * @param addr: First byte
+ * @param size: Bytes in the range
+ * @param write: Also break zero page sharing
+ * @return 0 on success, -1 if a page cannot be filled or written
+ */
+int pager_fill_range(uint32_t level, uint32_t addr, uint32_t size, bool write);
+
+/**
+ * Get the work done for a nesting level since pager_begin()
+ * @param level: Nesting level
+ * @param stats: Filled with the counters (zero for an unused level)
+ */
+void pager_get_stats(uint32_t level, pager_stats_t *stats);
+
+/**
+ * Save the pages of a range, then map it as ordinary memory
+ * Only pages that are present and not the zero page are copied; the
+ * others are restored unfilled.
+ * @param start: First byte (rounded down to a page)
+ * @param end: End of the range (rounded up to a page)
+ * @param dst: Save buffer
+ * @param capacity: Bytes available at dst
+ * @return Bytes used, or -1 if they do not fit
+ */
+int pager_save(uint32_t start, uint32_t end, uint8_t *dst, uint32_t capacity);
+
+/**
+ * Restore a range saved with pager_save()
+ * @param start: Same as for pager_save()
+ * @param end: Same as for pager_save()
+ * @param src: Save buffer
+ */
+void pager_restore(uint32_t start, uint32_t end, const uint8_t *src);
+
+#endif /* PAGER_H */
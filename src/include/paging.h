@@ -0,0 +1,131 @@
+/**
+ * Paging Header
+ * x86 two-level paging with an identity-mapped kernel view
+ */
+
+#ifndef PAGING_H
+#define PAGING_H
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "idt.h"
+
+/* Page size */
+#define PAGE_SIZE           4096
+
+/* Page table entry flags */
+#define PAGE_PRESENT        0x001   /* Page is mapped */
+#define PAGE_WRITE          0x002   /* Page is writable */
+#define PAGE_USER           0x004   /* Page is accessible from ring 3 */
+#define PAGE_WRITETHROUGH   0x008   /* Write-through caching */
+#define PAGE_NOCACHE        0x010   /* Caching disabled */
+#define PAGE_ACCESSED       0x020   /* Set by CPU on access */
+#define PAGE_DIRTY          0x040   /* Set by CPU on write */
+#define PAGE_LARGE          0x080   /* Directory entry maps 4MB itself (PSE) */
+#define PAGE_GLOBAL         0x100   /* Kept in the TLB across CR3 loads */
+
+/* Write-combining: the PAT entry PAGE_WRITETHROUGH selects is reprogrammed
+ * to write-combining when the CPU has a PAT */
+#define PAGE_WRITECOMBINE   PAGE_WRITETHROUGH
+
+/* Page fault error code bits */
+#define PF_ERR_PRESENT      0x01    /* Fault on a present page (protection) */
+#define PF_ERR_WRITE        0x02    /* Fault caused by a write */
+
+/* Identity-mapped physical memory (covers kernel, program area and caches) */
+#define PAGING_IDENTITY_SIZE    (64 * 1024 * 1024)
+
+/* Paging features in use (paging_get_features()) */
+#define PAGING_FEATURE_LARGE    0x01    /* RAM identity-mapped with 4MB pages */
+#define PAGING_FEATURE_GLOBAL   0x02    /* Identity map marked global */
+#define PAGING_FEATURE_WC       0x04    /* Write-combining mappings (PAT) */
+
+/* Maximum number of page fault regions */
+#define PAGING_MAX_FAULT_REGIONS 4
+
+/* Page fault handler for a virtual address region
+ * @param addr: Faulting virtual address
+ * @param err: Page fault error code
+ * @return Non-zero if the fault was resolved and the access can be retried */
+typedef int (*page_fault_handler_t)(uint32_t addr, uint32_t err);
+
+/**
+ * Initialize paging
+ * Identity-maps PAGING_IDENTITY_SIZE bytes and enables paging. Where the
+ * CPU allows it, each 4MB of RAM past the first is mapped with one large
+ * page, and every identity page is global. A large page is split into 4KB
+ * pages the first time one of its pages is mapped or unmapped.
+ * Must be called after the memory size is known (kernel_get_mem_info()).
+ */
+void paging_init(void);
+
+/**
+ * Get the paging features in use
+ * @return PAGING_FEATURE_* flags
+ */
+uint32_t paging_get_features(void);
+
+/**
+ * Make an identity-mapped range write-combining, or give it back its
+ * default memory type
+ * For framebuffers written in bulk whose reads have no side effects;
+ * stores may reach the device late and out of order until the next I/O
+ * instruction, locked instruction or interrupt.
+ * @param start: First byte (rounded down to a page)
+ * @param end: End of the range (rounded up to a page)
+ * @param enable: true for write-combining, false for the default type
+ * @return 0 on success, -1 without PAT support or outside the identity map
+ */
+int paging_set_write_combining(uint32_t start, uint32_t end, bool enable);
+
+/**
+ * Provide page tables for a virtual region outside the identity map
+ * All pages start unmapped.
+ * @param start: Region start (4MB aligned)
+ * @param tables: Page tables to use (one per 4MB, page aligned)
+ * @param count: Number of page tables
+ * @return 0 on success, -1 on error
+ */
+int paging_add_tables(uint32_t start, uint32_t *tables, uint32_t count);
+
+/**
+ * Map a virtual page to a physical page
+ * The page table for the address must exist.
+ * @param virt: Virtual address (page aligned)
+ * @param phys: Physical address (page aligned)
+ * @param flags: PAGE_* flags (PAGE_PRESENT is implied)
+ * @return 0 on success, -1 if there is no page table for the address
+ */
+int paging_map(uint32_t virt, uint32_t phys, uint32_t flags);
+
+/**
+ * Unmap a virtual page
+ * @param virt: Virtual address (page aligned)
+ */
+void paging_unmap(uint32_t virt);
+
+/**
+ * Get the physical address a virtual page is mapped to
+ * @param virt: Virtual address
+ * @param phys: Set to the physical address if mapped
+ * @return 1 if mapped, 0 if not
+ */
+int paging_get_mapping(uint32_t virt, uint32_t *phys);
+
+/**
+ * Get the page table entry of a virtual page
+ * @param virt: Virtual address
+ * @return Physical address and PAGE_* flags, 0 if there is no entry
+ */
+uint32_t paging_get_entry(uint32_t virt);
+
+/**
+ * Register a page fault handler for a virtual region
+ * @param start: Region start
+ * @param end: Region end (exclusive)
+ * @param handler: Handler called for faults inside the region
+ * @return 0 on success, -1 if the region table is full
+ */
+int paging_register_fault_handler(uint32_t start, uint32_t end, page_fault_handler_t handler);
+
+#endif /* PAGING_H */
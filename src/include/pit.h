@@ -51,4 +51,7 @@ void pit_wait_ticks(uint32_t ticks);
 /* Read current channel 0 count */
 uint16_t pit_read_count(void);
 
+/* Get time since PIT initialization in microseconds */
+uint32_t pit_get_micros(void);
+
 #endif /* PIT_H */
@@ -37,12 +37,63 @@
 #define SYS_IDEINFO       25  /* Get IDE device information */
 #define SYS_PCIINFO       26  /* Get PCI device information */
 #define SYS_MEMINFO       27  /* Get memory information */
+#define SYS_STAT          28  /* Get file status by path */
+#define SYS_FSTAT         29  /* Get file status by file descriptor */
+#define SYS_UPTIME        30  /* Get time since boot in microseconds */
+#define SYS_FSSTATS       31  /* Get (and optionally reset) VFS I/O statistics */
+#define SYS_REALPATH      32  /* Resolve a path to its normalized absolute form */
+#define SYS_MMAP          33  /* Map an open file into memory (read-only) */
+#define SYS_MUNMAP        34  /* Remove a file mapping */
+#define SYS_LSEEK         35  /* Set file position */
+#define SYS_PREAD         36  /* Read at an offset without moving the position */
+#define SYS_FWRITE        37  /* Write to file */
+#define SYS_MKDIR         38  /* Create directory */
+#define SYS_UNLINK        39  /* Remove file or empty directory */
+#define SYS_FTRUNCATE     40  /* Change the size of an open file */
+#define SYS_GETMOUNT      41  /* Get a mount table entry */
+#define SYS_SENDFILE      42  /* Copy file data to another descriptor in the kernel */
+#define SYS_AREAD         43  /* Queue a background read at an offset */
+#define SYS_POLL_COMPLETION 44  /* Take a finished background read, if any */
+#define SYS_WAIT_COMPLETION 45  /* Wait for a background read to finish */
+#define SYS_IMGCACHE      46  /* Get program image cache status or an image */
+#define SYS_EXECPROF      47  /* Get a recent program startup profile */
+#define SYS_KMEMSTAT      48  /* Get kernel object cache statistics */
+#define SYS_VGA_BLIT      49  /* Copy a block of pixels to the screen (256-color modes) */
+#define SYS_VGA_WC        50  /* Enable/disable write-combining video memory */
+
+/* SYS_PREAD arguments (passed by pointer, registers hold only three) */
+typedef struct {
+    uint32_t buf;           /* Buffer to read into */
+    uint32_t size;          /* Number of bytes to read */
+    uint32_t offset;        /* File offset to read from */
+} syscall_pread_args_t;
+
+/* SYS_SENDFILE arguments (passed by pointer like SYS_PREAD) */
+typedef struct {
+    uint32_t in_fd;         /* File descriptor to copy from */
+    uint32_t offset;        /* Offset in in_fd, or SENDFILE_OFFSET_CUR */
+    uint32_t count;         /* Maximum number of bytes to copy */
+} syscall_sendfile_args_t;
+
+/* SYS_SENDFILE offset: copy from the file position of in_fd and advance it */
+#define SENDFILE_OFFSET_CUR 0xFFFFFFFF
+
+/* SYS_AREAD arguments (passed by pointer like SYS_PREAD) */
+typedef struct {
+    uint32_t buf;           /* Buffer to read into (must stay valid until completion) */
+    uint32_t size;          /* Number of bytes to read */
+    uint32_t offset;        /* File offset to read from */
+    uint32_t token;         /* Value reported back with the completion */
+} syscall_aread_args_t;
+
+/* SYS_IMGCACHE index: fill the cache status instead of an image */
+#define IMGCACHE_INFO_STATUS 0xFFFFFFFF
 
 /* System call interrupt number */
 #define SYSCALL_INT     0x80
 
 /* Maximum number of system calls */
-#define NUM_SYSCALLS    28
+#define NUM_SYSCALLS    51
 
 /**
  * Initialize the system call interface
@@ -59,4 +110,11 @@ void syscall_init(void);
  */
 int syscall_handler(uint32_t eax, uint32_t ebx, uint32_t ecx, uint32_t edx);
 
+/**
+ * Close the files opened at a program nesting level and deeper
+ * (called when a program finishes)
+ * @param level: First nesting level to close (see loader_get_depth())
+ */
+void syscall_close_from(uint32_t level);
+
 #endif /* SYSCALL_H */
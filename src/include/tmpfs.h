@@ -0,0 +1,82 @@
+/**
+ * tmpfs Header
+ * Writable RAM-backed filesystem for scratch files
+ */
+
+#ifndef TMPFS_H
+#define TMPFS_H
+
+#include "stdint.h"
+#include "fs.h"
+
+/* Storage block size (file data is allocated in extents of blocks) */
+#define TMPFS_BLOCK_SIZE        4096
+
+/* Storage pool: identity-mapped memory above the program area that
+ * nothing else uses; clipped to installed memory at mount time */
+#define TMPFS_POOL_BASE         0x01000000      /* 16MB */
+#define TMPFS_POOL_SIZE         (4 * 1024 * 1024)
+#define TMPFS_MAX_BLOCKS        (TMPFS_POOL_SIZE / TMPFS_BLOCK_SIZE)
+
+/* Limits */
+#define TMPFS_MAX_INODES        128     /* Files and directories, including root */
+#define TMPFS_MAX_EXTENTS       16      /* Extents per file */
+#define TMPFS_MAX_NAME          64      /* Name length including terminator */
+#define TMPFS_HASH_SIZE         256     /* Directory lookup hash buckets */
+
+/* Device identifier of tmpfs nodes (outside the IDE drive numbers) */
+#define TMPFS_DEV               0x100
+
+/* Run of contiguous storage blocks */
+typedef struct {
+    uint16_t start;             /* First block */
+    uint16_t count;             /* Number of blocks */
+} tmpfs_extent_t;
+
+/* tmpfs inode: a file or directory together with its directory entry */
+typedef struct {
+    char name[TMPFS_MAX_NAME];  /* Name in the parent directory */
+    uint32_t type;              /* FS_FILE or FS_DIRECTORY */
+    uint32_t size;              /* File size in bytes */
+    uint32_t blocks;            /* Blocks allocated across all extents (may
+                                 * exceed the size while the file is open) */
+    tmpfs_extent_t extents[TMPFS_MAX_EXTENTS];
+    uint32_t extent_count;      /* Extents in use */
+    uint32_t entries;           /* Directory: number of children */
+    int16_t parent;             /* Parent directory inode index */
+    int16_t hash_next;          /* Next inode in lookup hash chain */
+    int16_t prev;               /* Previous sibling in parent directory */
+    int16_t next;               /* Next sibling in parent directory */
+    int16_t first_child;        /* Directory: first child */
+    int16_t last_child;         /* Directory: last child */
+    bool used;                  /* Slot in use */
+} tmpfs_inode_t;
+
+/**
+ * Initialize the tmpfs driver and register the "tmpfs" filesystem type
+ */
+void tmpfs_init(void);
+
+/**
+ * Mount the tmpfs instance
+ * There is a single instance; mounting again returns the same root.
+ * @param drive: Ignored
+ * @return Root node or NULL if there is no memory for the pool
+ */
+fs_node_t *tmpfs_mount(uint8_t drive);
+
+/**
+ * Unmount tmpfs
+ * @param root: Root node
+ * @return 0 on success, error code on failure
+ */
+int tmpfs_unmount(fs_node_t *root);
+
+/**
+ * Get tmpfs storage usage
+ * @param used: Blocks holding file data (may be NULL)
+ * @param total: Blocks in the pool (may be NULL)
+ */
+void tmpfs_usage(uint32_t *used, uint32_t *total);
+
+#endif /* TMPFS_H */
@@ -37,8 +37,9 @@
 #define VGA_Y_HEIGHT    200
 #define VGA_Y_COLORS    256
 
-/* VGA graphics memory address */
+/* VGA graphics memory address and window size */
 #define VGA_GFX_MEMORY  0xA0000
+#define VGA_GFX_WINDOW  0x10000
 
 /* VGA I/O ports for graphics mode */
 #define VGA_GC_INDEX    0x3CE   /* Graphics Controller Index */
@@ -258,4 +259,21 @@ void vga_y_clear(uint8_t color);
  */
 void vga_set_palette(uint8_t index, uint8_t r, uint8_t g, uint8_t b);
 
+/**
+ * Copy a block of pixels to the screen (modes 13h, X and Y)
+ * The block is clipped to the screen.
+ * @param x, y: Top-left corner on the screen
+ * @param w, h: Block size
+ * @param pixels: w * h color indices, row by row
+ */
+void vga_gfx_blit(int x, int y, int w, int h, const uint8_t *pixels);
+
+/**
+ * Choose whether the 256-color modes map video memory write-combining
+ * Enabled by default; takes effect at once if such a mode is active.
+ * @param enable: Nonzero for write-combining, 0 for the default type
+ * @return 0 on success, -1 if the CPU cannot write-combine
+ */
+int vga_gfx_set_write_combining(int enable);
+
 #endif /* VGA_GFX_H */
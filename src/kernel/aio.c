@@ -0,0 +1,279 @@
+/**
+ * Asynchronous File I/O Implementation
+ * Background file reads with a completion queue
+ *
+ * A request walks its file range one page at a time. Pages already in the
+ * page cache are copied at once; on a miss the request starts a background
+ * page read and parks. The device interrupt enters the page into the page
+ * cache and hands it to the request, which queues aio_process() as
+ * deferred work to copy the page out and move on. Finished requests post
+ * their token and result to the completion queue.
+ */
+
+#include <aio.h>
+#include <cachefs.h>
+#include <idt.h>
+#include <kernel.h>
+#include <string.h>
+
+/* Queued read */
+typedef struct {
+    fs_node_t *node;            /* File (pinned in the path cache) */
+    uint8_t *buffer;            /* Destination */
+    uint32_t offset;            /* Next file offset to copy */
+    uint32_t remaining;         /* Bytes still to copy */
+    uint32_t done;              /* Bytes copied so far */
+    uint32_t token;             /* Value reported with the completion */
+    uint8_t *page;              /* Pinned page delivered by a background read */
+    bool waiting;               /* Background page read in flight */
+    bool failed;                /* A page could not be read */
+    bool cancelled;             /* Dropped; freed once its page read lands */
+    bool used;                  /* Slot in use */
+} aio_request_t;
+
+static aio_request_t aio_requests[AIO_MAX_REQUESTS];
+
+/* Completion queue (ring); never overflows because requests count
+ * against AIO_MAX_REQUESTS until their completion is reaped */
+static aio_completion_t aio_completions[AIO_MAX_REQUESTS];
+static uint32_t aio_head = 0;
+static uint32_t aio_count = 0;
+
+/* Submitted requests whose completion has not been reaped */
+static uint32_t aio_outstanding = 0;
+
+/* Forward declarations */
+static void aio_process(void);
+
+/**
+ * Append a completion to the queue
+ */
+static void aio_push(uint32_t token, int32_t result) {
+    aio_completion_t *slot = &aio_completions[(aio_head + aio_count) % AIO_MAX_REQUESTS];
+
+    slot->token = token;
+    slot->result = result;
+    aio_count++;
+}
+
+/**
+ * Retire a request, posting its completion unless it was cancelled
+ */
+static void aio_finish(aio_request_t *req) {
+    if (req->page) {
+        fs_page_put(req->page);
+        req->page = NULL;
+    }
+
+    if (!req->cancelled) {
+        aio_push(req->token, (req->failed && req->done == 0) ? -1 : (int32_t)req->done);
+    }
+
+    fs_node_put(req->node);
+    req->used = false;
+}
+
+/**
+ * Page read completion (interrupt context)
+ */
+static void aio_page_done(void *ctx, uint8_t *data) {
+    aio_request_t *req = (aio_request_t *)ctx;
+
+    req->waiting = false;
+    if (data) {
+        req->page = data;
+    } else {
+        req->failed = true;
+    }
+
+    /* Copy out after the interrupt has been acknowledged */
+    irq_defer(aio_process);
+}
+
+/**
+ * Copy as many pages as are available, starting a read for the first
+ * missing one
+ */
+static void aio_advance(aio_request_t *req) {
+    if (req->waiting) {
+        return;
+    }
+
+    while (req->remaining > 0 && !req->failed && !req->cancelled) {
+        uint32_t index = req->offset / FS_PAGE_SIZE;
+        uint8_t *data = req->page;
+        req->page = NULL;
+
+        if (!data) {
+            data = fs_page_peek(req->node, index);
+        }
+
+        if (!data) {
+            req->waiting = true;
+            int err = fs_page_read_async(req->node, index, aio_page_done, req);
+            if (err == FS_OK) {
+                /* The driver may have completed the read already */
+                if (req->waiting) {
+                    return;
+                }
+                continue;
+            }
+            req->waiting = false;
+
+            /* The device is busy with another request; retried when
+             * that one completes */
+            if (err == FS_ERR_BUSY) {
+                return;
+            }
+            req->failed = true;
+            break;
+        }
+
+        /* Calculate bytes to copy from this page */
+        uint32_t page_offset = req->offset % FS_PAGE_SIZE;
+        uint32_t bytes = FS_PAGE_SIZE - page_offset;
+        if (bytes > req->remaining) {
+            bytes = req->remaining;
+        }
+
+        memcpy(req->buffer + req->done, data + page_offset, bytes);
+        fs_page_put(data);
+
+        req->offset += bytes;
+        req->done += bytes;
+        req->remaining -= bytes;
+    }
+
+    aio_finish(req);
+}
+
+/**
+ * Advance every queued request (deferred work after device interrupts)
+ */
+static void aio_process(void) {
+    for (int i = 0; i < AIO_MAX_REQUESTS; i++) {
+        if (aio_requests[i].used) {
+            aio_advance(&aio_requests[i]);
+        }
+    }
+}
+
+/**
+ * Initialize the asynchronous I/O queue
+ */
+void aio_init(void) {
+    memset(aio_requests, 0, sizeof(aio_requests));
+    aio_head = 0;
+    aio_count = 0;
+    aio_outstanding = 0;
+
+    cachefs_flush();
+}
+
+/**
+ * Queue a file read
+ */
+int aio_submit(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer, uint32_t token) {
+    if (!node || !buffer || aio_outstanding >= AIO_MAX_REQUESTS) {
+        return -1;
+    }
+
+    /* Filesystems without background reads complete at once */
+    if (!node->readpage || !node->readpage_async) {
+        int n = fs_read(node, offset, size, buffer);
+        aio_outstanding++;
+        aio_push(token, n < 0 ? -1 : n);
+        return 0;
+    }
+
+    aio_request_t *req = NULL;
+    for (int i = 0; i < AIO_MAX_REQUESTS; i++) {
+        if (!aio_requests[i].used) {
+            req = &aio_requests[i];
+            break;
+        }
+    }
+
+    if (!req) {
+        return -1;      /* Every slot holds a cancelled read still in flight */
+    }
+
+    /* Check bounds */
+    if (offset >= node->length) {
+        size = 0;
+    } else if (size > node->length - offset) {
+        size = node->length - offset;
+    }
+
+    memset(req, 0, sizeof(aio_request_t));
+    req->node = node;
+    req->buffer = buffer;
+    req->offset = offset;
+    req->remaining = size;
+    req->token = token;
+    req->used = true;
+    fs_node_get(node);
+    aio_outstanding++;
+
+    aio_advance(req);
+    return 0;
+}
+
+/**
+ * Take one completion without blocking
+ */
+int aio_poll(aio_completion_t *out) {
+    aio_process();
+
+    /* Write pages the completions queued for the disk cache */
+    cachefs_flush();
+
+    if (aio_count == 0) {
+        return 0;
+    }
+
+    if (out) {
+        *out = aio_completions[aio_head];
+    }
+    aio_head = (aio_head + 1) % AIO_MAX_REQUESTS;
+    aio_count--;
+    aio_outstanding--;
+    return 1;
+}
+
+/**
+ * Wait for a completion
+ */
+int aio_wait(aio_completion_t *out) {
+    while (!aio_poll(out)) {
+        if (aio_outstanding == 0) {
+            return 0;
+        }
+
+        /* Let device interrupts in until something happens */
+        __asm__ volatile ("sti; hlt; cli");
+    }
+
+    return 1;
+}
+
+/**
+ * Drop all requests and completions
+ */
+void aio_cancel_all(void) {
+    for (int i = 0; i < AIO_MAX_REQUESTS; i++) {
+        aio_request_t *req = &aio_requests[i];
+        if (!req->used) {
+            continue;
+        }
+
+        req->cancelled = true;
+        if (!req->waiting) {
+            aio_finish(req);
+        }
+    }
+
+    aio_head = 0;
+    aio_count = 0;
+    aio_outstanding = 0;
+}
@@ -0,0 +1,294 @@
+/**
+ * Physical Frame Allocator Implementation
+ * Buddy allocator for 4KB page frames of the identity-mapped memory
+ *
+ * Free memory is kept as blocks of 2^order frames, aligned to their size,
+ * on one list per order. Allocation takes a block of the smallest order
+ * that fits and splits it, putting the upper halves back on the lower
+ * lists; freeing merges a block with its buddy (the block it was split
+ * from, at address ^ size) for as long as the buddy is free too. Both take
+ * O(FRAME_MAX_ORDER) steps.
+ *
+ * The list links live in the first bytes of the free blocks themselves,
+ * which the identity map makes reachable, so the only static state is one
+ * byte per frame: the order of the free block it starts, or a mark that it
+ * is in use.
+ */
+
+#include <frame.h>
+#include <string.h>
+
+/* Frame states */
+#define FRAME_RESERVED      0x00    /* Not RAM, or in use */
+#define FRAME_USABLE        0x40    /* RAM, not yet handed to the allocator */
+#define FRAME_HELD          0x20    /* RAM kept for a pool that may not use it */
+#define FRAME_FREE          0x80    /* Starts a free block; low bits: order */
+#define FRAME_ORDER_MASK    0x0F
+
+/* Links of a free block, stored at its address */
+typedef struct {
+    uint32_t next;              /* Next free block of the order, 0 if none */
+    uint32_t prev;              /* Previous one, 0 at the head */
+} frame_link_t;
+
+static uint8_t frame_state[FRAME_COUNT];
+static uint32_t frame_lists[FRAME_MAX_ORDER + 1];
+static uint32_t frame_free_blocks[FRAME_MAX_ORDER + 1];
+static uint32_t frame_total = 0;
+static uint32_t frame_free_count = 0;
+
+/* Cache shrinker run when no block is free */
+static frame_reclaim_fn frame_reclaim = NULL;
+static bool frame_reclaiming = false;
+
+/**
+ * Put a block on the free list of its order
+ */
+static void frame_push(uint32_t addr, uint32_t order) {
+    frame_link_t *link = (frame_link_t *)addr;
+
+    link->next = frame_lists[order];
+    link->prev = 0;
+    if (link->next) {
+        ((frame_link_t *)link->next)->prev = addr;
+    }
+    frame_lists[order] = addr;
+
+    frame_state[addr / FRAME_SIZE] = FRAME_FREE | order;
+    frame_free_blocks[order]++;
+}
+
+/**
+ * Take a block off the free list of its order
+ */
+static void frame_unlink(uint32_t addr, uint32_t order) {
+    frame_link_t *link = (frame_link_t *)addr;
+
+    if (link->prev) {
+        ((frame_link_t *)link->prev)->next = link->next;
+    } else {
+        frame_lists[order] = link->next;
+    }
+    if (link->next) {
+        ((frame_link_t *)link->next)->prev = link->prev;
+    }
+
+    frame_state[addr / FRAME_SIZE] = FRAME_RESERVED;
+    frame_free_blocks[order]--;
+}
+
+/**
+ * Start describing physical memory
+ */
+void frame_init(void) {
+    memset(frame_state, FRAME_RESERVED, sizeof(frame_state));
+    memset(frame_lists, 0, sizeof(frame_lists));
+    memset(frame_free_blocks, 0, sizeof(frame_free_blocks));
+    frame_total = 0;
+    frame_free_count = 0;
+}
+
+/**
+ * Mark a range of RAM as usable
+ */
+void frame_add_region(uint64_t start, uint64_t end) {
+    uint64_t limit = (uint64_t)FRAME_COUNT * FRAME_SIZE;
+
+    if (end > limit) {
+        end = limit;
+    }
+
+    uint64_t first = (start + FRAME_SIZE - 1) / FRAME_SIZE;
+    uint64_t last = end / FRAME_SIZE;
+    for (uint64_t frame = first; frame < last; frame++) {
+        frame_state[frame] = FRAME_USABLE;
+    }
+}
+
+/**
+ * Keep a range out of the allocator
+ */
+void frame_reserve(uint32_t start, uint32_t end) {
+    uint32_t first = start / FRAME_SIZE;
+    uint32_t last = (end / FRAME_SIZE) + (end % FRAME_SIZE != 0);
+
+    if (last > FRAME_COUNT) {
+        last = FRAME_COUNT;
+    }
+    for (uint32_t frame = first; frame < last; frame++) {
+        frame_state[frame] = FRAME_RESERVED;
+    }
+}
+
+/**
+ * Hold a range of RAM back for a pool
+ */
+void frame_hold(uint32_t start, uint32_t end) {
+    uint32_t first = start / FRAME_SIZE;
+    uint32_t last = (end / FRAME_SIZE) + (end % FRAME_SIZE != 0);
+
+    if (last > FRAME_COUNT) {
+        last = FRAME_COUNT;
+    }
+    for (uint32_t frame = first; frame < last; frame++) {
+        if (frame_state[frame] == FRAME_USABLE) {
+            frame_state[frame] = FRAME_HELD;
+        }
+    }
+}
+
+/**
+ * Hand held frames the pool does not use to the allocator
+ */
+void frame_release(uint32_t start, uint32_t end) {
+    uint32_t first = (start + FRAME_SIZE - 1) / FRAME_SIZE;
+    uint32_t last = end / FRAME_SIZE;
+
+    if (last > FRAME_COUNT) {
+        last = FRAME_COUNT;
+    }
+    for (uint32_t frame = first; frame < last; frame++) {
+        if (frame_state[frame] == FRAME_HELD) {
+            frame_state[frame] = FRAME_RESERVED;
+            frame_total++;
+            frame_free(frame * FRAME_SIZE, 0);
+        }
+    }
+}
+
+/**
+ * Build the free lists
+ */
+void frame_start(void) {
+    uint32_t frame = 0;
+
+    /* Cover each run of usable frames with the largest aligned blocks */
+    while (frame < FRAME_COUNT) {
+        if (frame_state[frame] != FRAME_USABLE) {
+            frame++;
+            continue;
+        }
+
+        uint32_t order = FRAME_MAX_ORDER;
+        while (order > 0) {
+            uint32_t count = 1u << order;
+            uint32_t i = 0;
+            if (frame % count == 0 && frame + count <= FRAME_COUNT) {
+                while (i < count && frame_state[frame + i] == FRAME_USABLE) {
+                    i++;
+                }
+            }
+            if (i == count) {
+                break;
+            }
+            order--;
+        }
+
+        /* Frames inside the block must not look usable or free */
+        uint32_t count = 1u << order;
+        memset(&frame_state[frame], FRAME_RESERVED, count);
+        frame_push(frame * FRAME_SIZE, order);
+        frame_total += count;
+        frame_free_count += count;
+        frame += count;
+    }
+}
+
+/**
+ * Take a block of 2^order frames off the free lists
+ * @return Block address, or 0 if no block is large enough
+ */
+static uint32_t frame_take(uint32_t order) {
+    uint32_t from = order;
+
+    while (from <= FRAME_MAX_ORDER && frame_lists[from] == 0) {
+        from++;
+    }
+    if (from > FRAME_MAX_ORDER) {
+        return 0;
+    }
+
+    uint32_t addr = frame_lists[from];
+    frame_unlink(addr, from);
+
+    /* Return the upper halves of larger blocks */
+    while (from > order) {
+        from--;
+        frame_push(addr + (FRAME_SIZE << from), from);
+    }
+
+    frame_free_count -= 1u << order;
+    return addr;
+}
+
+/**
+ * Register the callback that frees cached memory under pressure
+ */
+void frame_register_reclaim(frame_reclaim_fn fn) {
+    frame_reclaim = fn;
+}
+
+/**
+ * Allocate a block of 2^order frames
+ */
+uint32_t frame_alloc(uint32_t order) {
+    if (order > FRAME_MAX_ORDER) {
+        return 0;
+    }
+
+    uint32_t addr = frame_take(order);
+
+    /* Shrink caches until the block fits; freed frames need not merge
+     * into a large enough block at once. The reclaimer itself only frees. */
+    while (addr == 0 && frame_reclaim && !frame_reclaiming) {
+        frame_reclaiming = true;
+        uint32_t freed = frame_reclaim(1u << order);
+        frame_reclaiming = false;
+        if (freed == 0) {
+            break;
+        }
+        addr = frame_take(order);
+    }
+
+    return addr;
+}
+
+/**
+ * Free a block from frame_alloc()
+ */
+void frame_free(uint32_t addr, uint32_t order) {
+    uint32_t frame = addr / FRAME_SIZE;
+
+    if (addr == 0 || order > FRAME_MAX_ORDER || addr % (FRAME_SIZE << order) != 0 ||
+        frame >= FRAME_COUNT || (frame_state[frame] & FRAME_FREE)) {
+        return;
+    }
+
+    frame_free_count += 1u << order;
+
+    /* Merge with the buddy while it is a free block of the same order */
+    while (order < FRAME_MAX_ORDER) {
+        uint32_t buddy = addr ^ (FRAME_SIZE << order);
+        if (buddy / FRAME_SIZE >= FRAME_COUNT ||
+            frame_state[buddy / FRAME_SIZE] != (FRAME_FREE | order)) {
+            break;
+        }
+
+        frame_unlink(buddy, order);
+        if (buddy < addr) {
+            addr = buddy;
+        }
+        order++;
+    }
+
+    frame_push(addr, order);
+}
+
+/**
+ * Get allocator status
+ */
+void frame_get_info(frame_info_t *info) {
+    info->total = frame_total;
+    info->free = frame_free_count;
+    memcpy(info->free_blocks, frame_free_blocks, sizeof(frame_free_blocks));
+}
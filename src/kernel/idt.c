@@ -14,6 +14,13 @@ static idt_ptr_t idt_ptr;
 /* IRQ handlers array */
 static irq_handler_t irq_handlers[16] = { 0 };
 
+/* Exception handlers array (e.g. page faults) */
+static exception_handler_t exception_handlers[32] = { 0 };
+
+/* Deferred work queued by interrupt handlers, run after the EOI */
+static deferred_fn_t deferred_work[IRQ_MAX_DEFERRED];
+static volatile uint32_t deferred_count = 0;
+
 /* Exception messages */
 static const char *exception_messages[] = {
     "Division By Zero",
@@ -155,6 +162,9 @@ void irq_install_handler(uint8_t irq, irq_handler_t handler) {
     if (irq < 16) {
         irq_handlers[irq] = handler;
         pic_clear_mask(irq);  /* Enable this IRQ */
+        if (irq >= 8) {
+            pic_clear_mask(2);  /* Slave PIC cascade */
+        }
     }
 }
 
@@ -168,11 +178,26 @@ void irq_uninstall_handler(uint8_t irq) {
     }
 }
 
+/**
+ * Install an exception handler
+ * The handler runs before the panic screen and can resolve the exception
+ */
+void isr_install_handler(uint8_t num, exception_handler_t handler) {
+    if (num < 32) {
+        exception_handlers[num] = handler;
+    }
+}
+
 /**
  * ISR handler - called from assembly stub
  */
 void isr_handler(interrupt_frame_t *frame) {
     if (frame->int_no < 32) {
+        /* Give a registered handler the chance to resolve it */
+        if (exception_handlers[frame->int_no] && exception_handlers[frame->int_no](frame)) {
+            return;
+        }
+        
         /* CPU exception */
         vga_set_color(VGA_COLOR_WHITE, VGA_COLOR_RED);
         vga_print("\n*** KERNEL PANIC ***\n");
@@ -184,6 +209,15 @@ void isr_handler(interrupt_frame_t *frame) {
         vga_print_hex(frame->err_code);
         vga_print("\n");
 
+        /* Page faults report the faulting address in CR2 */
+        if (frame->int_no == 14) {
+            uint32_t cr2;
+            __asm__ volatile ("mov %%cr2, %0" : "=r"(cr2));
+            vga_print("Fault Address: 0x");
+            vga_print_hex(cr2);
+            vga_print("\n");
+        }
+
         vga_print("EIP: 0x");
         vga_print_hex(frame->eip);
         vga_print("  CS: 0x");
@@ -212,6 +246,40 @@ void irq_handler(interrupt_frame_t *frame) {
 
     /* Send End of Interrupt */
     pic_send_eoi(irq);
+
+    /* Run work the handler queued (interrupts are still disabled) */
+    irq_run_deferred();
+}
+
+/**
+ * Queue a function to run once the current interrupt has been acknowledged
+ * A function that is already queued is not queued twice.
+ */
+void irq_defer(deferred_fn_t fn) {
+    for (uint32_t i = 0; i < deferred_count; i++) {
+        if (deferred_work[i] == fn) {
+            return;
+        }
+    }
+
+    if (deferred_count < IRQ_MAX_DEFERRED) {
+        deferred_work[deferred_count++] = fn;
+    }
+}
+
+/**
+ * Run and clear queued deferred work
+ * Must be called with interrupts disabled.
+ */
+void irq_run_deferred(void) {
+    while (deferred_count > 0) {
+        deferred_fn_t fn = deferred_work[0];
+        deferred_count--;
+        for (uint32_t i = 0; i < deferred_count; i++) {
+            deferred_work[i] = deferred_work[i + 1];
+        }
+        fn();
+    }
 }
 
 /**
@@ -0,0 +1,295 @@
+/**
+ * Program Image Cache Implementation
+ * Keeps the segments of loaded programs in memory for repeated runs
+ *
+ * Right after a compressed program has been decoded, and before it runs,
+ * the file part of each segment is copied into a pool past the initramfs.
+ * Loading the same path again under the same mount generation copies the
+ * segments back instead of reading and decoding the file, so running a
+ * program again costs a memory copy. Images are kept unrelocated at their
+ * link addresses, so a position-independent program can come back at a
+ * different address. (ELF programs are read a page at a
+ * time on first access and are not kept here.) Only files on
+ * read-only filesystems are kept, as their contents cannot change without
+ * a new mount. Images occupy contiguous pool ranges; when no gap is large
+ * enough, the least recently used images are dropped.
+ */
+
+#include <frame.h>
+#include <imgcache.h>
+#include <kernel.h>
+#include <string.h>
+
+static imgcache_image_t imgcache_images[IMGCACHE_MAX_IMAGES];
+static uint32_t imgcache_clock = 0;
+
+/* Pool size (0 if memory is too small) and statistics */
+static uint32_t imgcache_capacity = 0;
+static uint32_t imgcache_hits = 0;
+static uint32_t imgcache_misses = 0;
+
+/**
+ * Find a pool range of size bytes not used by any image
+ * @param offset: Set to the start of the range
+ * @return true if one was found
+ */
+static bool imgcache_find_gap(uint32_t size, uint32_t *offset) {
+    uint32_t start = 0;
+
+    /* First fit: try the pool start, then the end of every image */
+    for (int candidate = -1; candidate < IMGCACHE_MAX_IMAGES; candidate++) {
+        if (candidate >= 0) {
+            imgcache_image_t *image = &imgcache_images[candidate];
+            if (!image->used) {
+                continue;
+            }
+            start = image->pool_offset + image->pool_bytes;
+        }
+
+        if (size > imgcache_capacity || start > imgcache_capacity - size) {
+            continue;
+        }
+
+        bool overlap = false;
+        for (int i = 0; i < IMGCACHE_MAX_IMAGES && !overlap; i++) {
+            imgcache_image_t *image = &imgcache_images[i];
+            overlap = image->used && image->pool_offset < start + size &&
+                      start < image->pool_offset + image->pool_bytes;
+        }
+
+        if (!overlap) {
+            *offset = start;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Drop the least recently used image
+ * @return false if the cache is empty
+ */
+static bool imgcache_evict(void) {
+    imgcache_image_t *victim = NULL;
+
+    for (int i = 0; i < IMGCACHE_MAX_IMAGES; i++) {
+        imgcache_image_t *image = &imgcache_images[i];
+        if (image->used && (!victim || image->lru < victim->lru)) {
+            victim = image;
+        }
+    }
+
+    if (!victim) {
+        return false;
+    }
+
+    victim->used = false;
+    return true;
+}
+
+/**
+ * Initialize the image cache
+ */
+void imgcache_init(void) {
+    mem_info_t mem;
+
+    memset(imgcache_images, 0, sizeof(imgcache_images));
+    imgcache_clock = 0;
+    imgcache_hits = 0;
+    imgcache_misses = 0;
+
+    /* Upper memory starts at 1MB */
+    kernel_get_mem_info(&mem);
+    if ((IMGCACHE_POOL_BASE + IMGCACHE_POOL_SIZE) / 1024 <= mem.mem_upper + 1024) {
+        imgcache_capacity = IMGCACHE_POOL_SIZE;
+    } else {
+        imgcache_capacity = 0;
+        frame_release(IMGCACHE_POOL_BASE, IMGCACHE_POOL_BASE + IMGCACHE_POOL_SIZE);
+    }
+}
+
+/**
+ * Look up a program in the cache
+ */
+int imgcache_lookup(const char *path, elf32_ehdr_t *ehdr, elf32_phdr_t *phdrs,
+                    uint32_t *file_size) {
+    uint32_t generation = fs_mount_generation();
+
+    for (int i = 0; i < IMGCACHE_MAX_IMAGES; i++) {
+        imgcache_image_t *image = &imgcache_images[i];
+        if (!image->used || strcmp(image->path, path) != 0) {
+            continue;
+        }
+
+        /* Loaded before a mount changed what the path refers to */
+        if (image->generation != generation) {
+            image->used = false;
+            continue;
+        }
+
+        memset(ehdr, 0, sizeof(elf32_ehdr_t));
+        ehdr->e_type = image->type;
+        ehdr->e_entry = image->entry;
+        ehdr->e_phnum = image->segment_count;
+
+        for (uint32_t s = 0; s < image->segment_count; s++) {
+            imgcache_segment_t *seg = &image->segments[s];
+            memset(&phdrs[s], 0, sizeof(elf32_phdr_t));
+            phdrs[s].p_type = PT_LOAD;
+            phdrs[s].p_vaddr = seg->vaddr;
+            phdrs[s].p_filesz = seg->filesz;
+            phdrs[s].p_memsz = seg->memsz;
+            phdrs[s].p_flags = seg->flags;
+        }
+
+        if (image->dynamic) {
+            elf32_phdr_t *dyn = &phdrs[ehdr->e_phnum++];
+            memset(dyn, 0, sizeof(elf32_phdr_t));
+            dyn->p_type = PT_DYNAMIC;
+            dyn->p_vaddr = image->dynamic;
+        }
+
+        image->lru = ++imgcache_clock;
+        image->hits++;
+        imgcache_hits++;
+        *file_size = image->file_size;
+        return i;
+    }
+
+    imgcache_misses++;
+    return -1;
+}
+
+/**
+ * Copy a cached image into place
+ */
+void imgcache_copy(int index, uint32_t bias) {
+    imgcache_image_t *image = &imgcache_images[index];
+    const uint8_t *pool = (const uint8_t *)IMGCACHE_POOL_BASE;
+
+    for (uint32_t s = 0; s < image->segment_count; s++) {
+        imgcache_segment_t *seg = &image->segments[s];
+        memcpy((void *)(seg->vaddr + bias), pool + seg->pool_offset, seg->filesz);
+    }
+}
+
+/**
+ * Keep the image of a program that was just loaded
+ */
+void imgcache_store(const char *path, fs_node_t *node, const elf32_ehdr_t *ehdr,
+                    const elf32_phdr_t *phdrs, uint32_t bias) {
+    if (imgcache_capacity == 0 || node->write || strlen(path) >= IMGCACHE_MAX_PATH) {
+        return;
+    }
+
+    /* Drop older copies of the same program */
+    for (int i = 0; i < IMGCACHE_MAX_IMAGES; i++) {
+        imgcache_image_t *image = &imgcache_images[i];
+        if (image->used && (strcmp(image->path, path) == 0 ||
+                            (image->dev == node->dev && image->inode == node->inode))) {
+            image->used = false;
+        }
+    }
+
+    uint32_t bytes = 0;
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        if (phdrs[i].p_type == PT_LOAD) {
+            bytes += phdrs[i].p_filesz;
+        }
+    }
+    if (bytes > imgcache_capacity) {
+        return;
+    }
+
+    /* Free slot and pool range, dropping old images until both exist */
+    imgcache_image_t *image = NULL;
+    uint32_t offset = 0;
+    while (true) {
+        image = NULL;
+        for (int i = 0; i < IMGCACHE_MAX_IMAGES && !image; i++) {
+            if (!imgcache_images[i].used) {
+                image = &imgcache_images[i];
+            }
+        }
+
+        if (image && imgcache_find_gap(bytes, &offset)) {
+            break;
+        }
+        if (!imgcache_evict()) {
+            return;
+        }
+    }
+
+    memset(image, 0, sizeof(imgcache_image_t));
+    strcpy(image->path, path);
+    image->dev = node->dev;
+    image->inode = node->inode;
+    image->generation = fs_mount_generation();
+    image->type = ehdr->e_type;
+    image->entry = ehdr->e_entry - bias;
+    image->file_size = node->length;
+    image->pool_offset = offset;
+    image->pool_bytes = bytes;
+
+    uint8_t *pool = (uint8_t *)IMGCACHE_POOL_BASE;
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        if (phdrs[i].p_type == PT_DYNAMIC) {
+            image->dynamic = phdrs[i].p_vaddr - bias;
+        }
+        if (phdrs[i].p_type != PT_LOAD) {
+            continue;
+        }
+
+        imgcache_segment_t *seg = &image->segments[image->segment_count++];
+        seg->vaddr = phdrs[i].p_vaddr - bias;
+        seg->filesz = phdrs[i].p_filesz;
+        seg->memsz = phdrs[i].p_memsz;
+        seg->flags = phdrs[i].p_flags;
+        seg->pool_offset = offset;
+        memcpy(pool + offset, (const void *)phdrs[i].p_vaddr, seg->filesz);
+        offset += seg->filesz;
+    }
+
+    image->lru = ++imgcache_clock;
+    image->used = true;
+}
+
+/**
+ * Get cache status
+ */
+void imgcache_get_info(imgcache_info_t *info) {
+    memset(info, 0, sizeof(imgcache_info_t));
+
+    for (int i = 0; i < IMGCACHE_MAX_IMAGES; i++) {
+        if (imgcache_images[i].used) {
+            info->images++;
+            info->bytes_used += imgcache_images[i].pool_bytes;
+        }
+    }
+
+    info->bytes_total = imgcache_capacity;
+    info->hits = imgcache_hits;
+    info->misses = imgcache_misses;
+}
+
+/**
+ * Describe a cached image
+ */
+int imgcache_get_image(uint32_t index, imgcache_image_info_t *info) {
+    for (int i = 0; i < IMGCACHE_MAX_IMAGES; i++) {
+        imgcache_image_t *image = &imgcache_images[i];
+        if (!image->used) {
+            continue;
+        }
+
+        if (index-- == 0) {
+            strcpy(info->path, image->path);
+            info->bytes = image->pool_bytes;
+            info->hits = image->hits;
+            return 0;
+        }
+    }
+
+    return -1;
+}
@@ -3,18 +3,29 @@
  * Main kernel entry point and core functionality
  */
 
+#include <aio.h>
+#include <cachefs.h>
+#include <fat32.h>
+#include <frame.h>
 #include <fs.h>
 #include <ide.h>
 #include <idt.h>
+#include <imgcache.h>
+#include <initramfs.h>
 #include <iso9660.h>
 #include <kernel.h>
 #include <keyboard.h>
+#include <kmalloc.h>
 #include <loader.h>
+#include <mmap.h>
+#include <pager.h>
+#include <paging.h>
 #include <pci.h>
 #include <pit.h>
 #include <speaker.h>
 #include <string.h>
 #include <syscall.h>
+#include <tmpfs.h>
 #include <vga.h>
 
 /* Multiboot magic number */
@@ -24,13 +35,25 @@
 #define MBOOT_FLAGS     0
 #define MBOOT_MEM_LOWER 4
 #define MBOOT_MEM_UPPER 8
+#define MBOOT_MODS_COUNT 20
+#define MBOOT_MODS_ADDR 24
+#define MBOOT_MMAP_LENGTH 44
+#define MBOOT_MMAP_ADDR 48
 
 /* Multiboot flags */
 #define MBOOT_FLAG_MEM  (1 << 0)
+#define MBOOT_FLAG_MODS (1 << 3)
+#define MBOOT_FLAG_MMAP (1 << 6)
+
+/* Multiboot memory map entry type of usable RAM */
+#define MBOOT_MMAP_AVAILABLE 1
 
 /* Stored memory information */
 static mem_info_t kernel_mem_info;
 
+/* External symbol from linker script */
+extern uint32_t __kernel_end;
+
 /**
  * Get memory information
  */
@@ -39,7 +62,91 @@ void kernel_get_mem_info(mem_info_t *info) {
         info->mem_lower = kernel_mem_info.mem_lower;
         info->mem_upper = kernel_mem_info.mem_upper;
         info->total_kb = kernel_mem_info.total_kb;
+
+        frame_info_t frames;
+        frame_get_info(&frames);
+        info->frames_free = frames.free;
+        info->frames_used = frames.total - frames.free;
+    }
+}
+
+/**
+ * Hand the free physical memory to the frame allocator
+ * Uses the multiboot memory map, or the lower/upper sizes without one.
+ * Everything below the end of the kernel and the program area stay out.
+ * The pools after the program area (tmpfs, initramfs, image cache, save
+ * area, shared runtime) are held; each owner releases what it does not
+ * use once it knows. Must run after kernel_relocate_initramfs(), which is
+ * the last user of the modules.
+ * @param initramfs_size: Bytes of the archive at INITRAMFS_BASE
+ */
+static void kernel_init_frames(unsigned int *mboot_info, uint32_t initramfs_size) {
+    frame_init();
+
+    uint32_t flags = mboot_info ? mboot_info[MBOOT_FLAGS / 4] : 0;
+    if (flags & MBOOT_FLAG_MMAP) {
+        /* Entries: size (not counting itself), base, length, type */
+        uint32_t addr = mboot_info[MBOOT_MMAP_ADDR / 4];
+        uint32_t end = addr + mboot_info[MBOOT_MMAP_LENGTH / 4];
+        while (addr < end) {
+            uint32_t size = *(uint32_t *)addr;
+            uint64_t base = *(uint64_t *)(addr + 4);
+            uint64_t length = *(uint64_t *)(addr + 12);
+            uint32_t type = *(uint32_t *)(addr + 20);
+
+            if (type == MBOOT_MMAP_AVAILABLE) {
+                frame_add_region(base, base + length);
+            }
+            addr += size + 4;
+        }
+    } else if (flags & MBOOT_FLAG_MEM) {
+        frame_add_region(0, (uint64_t)kernel_mem_info.mem_lower * 1024);
+        frame_add_region(0x100000, 0x100000 + (uint64_t)kernel_mem_info.mem_upper * 1024);
+    }
+
+    /* The modules are free again: the initramfs was copied out of them.
+     * The linker script keeps the kernel small enough that the memory
+     * from its end to the program area always reaches the allocator. */
+    frame_reserve(0, (uint32_t)&__kernel_end);
+    frame_reserve(PROGRAM_LOAD_ADDR, PROGRAM_AREA_END);
+    frame_hold(PROGRAM_AREA_END, RUNTIME_BASE + RUNTIME_MAX_SIZE);
+
+    frame_start();
+
+    /* The archive is in place already; the rest of its area is free */
+    frame_release(INITRAMFS_BASE + initramfs_size, INITRAMFS_BASE + INITRAMFS_MAX_SIZE);
+}
+
+/**
+ * Move the initramfs module to INITRAMFS_BASE
+ * GRUB loads modules right after the kernel, where they can overlap the
+ * program area, so the archive is moved before anything else uses memory.
+ * @return Archive size in bytes, or 0 if there is no usable module
+ */
+static uint32_t kernel_relocate_initramfs(unsigned int *mboot_info) {
+    uint32_t flags = mboot_info[MBOOT_FLAGS / 4];
+    if (!(flags & MBOOT_FLAG_MODS) || mboot_info[MBOOT_MODS_COUNT / 4] == 0) {
+        return 0;
+    }
+
+    /* Module list entries: start, end, command line, reserved */
+    unsigned int *module = (unsigned int *)mboot_info[MBOOT_MODS_ADDR / 4];
+    uint32_t start = module[0];
+    uint32_t end = module[1];
+
+    if (end <= start || end - start > INITRAMFS_MAX_SIZE) {
+        vga_print("Warning: initramfs module too large, ignored\n");
+        return 0;
+    }
+
+    uint32_t size = end - start;
+    if ((INITRAMFS_BASE + size) / 1024 > kernel_mem_info.mem_upper + 1024) {
+        vga_print("Warning: not enough memory for initramfs, ignored\n");
+        return 0;
     }
+
+    memmove((void *)INITRAMFS_BASE, (const void *)start, size);
+    return size;
 }
 
 /**
@@ -62,6 +169,7 @@ void kernel_main(unsigned int magic, unsigned int *mboot_info) {
     kernel_mem_info.mem_lower = 0;
     kernel_mem_info.mem_upper = 0;
     kernel_mem_info.total_kb = 0;
+    uint32_t initramfs_size = 0;
     
     if (mboot_info) {
         uint32_t flags = mboot_info[MBOOT_FLAGS / 4];
@@ -72,12 +180,43 @@ void kernel_main(unsigned int magic, unsigned int *mboot_info) {
             kernel_mem_info.total_kb = kernel_mem_info.mem_lower + 
                                        kernel_mem_info.mem_upper + 1024;
         }
+        initramfs_size = kernel_relocate_initramfs(mboot_info);
     }
 
+    /* Physical memory the fixed areas leave over */
+    vga_print("Initializing frame allocator...\n");
+    kernel_init_frames(mboot_info, initramfs_size);
+
+    /* Slab caches for kernel objects on top of it */
+    vga_print("Initializing kernel heap...\n");
+    kmalloc_init();
+
     /* Initialize IDT (Interrupt Descriptor Table) */
     vga_print("Initializing IDT...\n");
     idt_init();
 
+    /* Enable paging (identity map), the file mapping window and
+     * demand paging of programs */
+    vga_print("Initializing paging...\n");
+    paging_init();
+    mmap_init();
+    pager_init();
+
+    uint32_t paging_features = paging_get_features();
+    if (paging_features) {
+        vga_print("Paging features:");
+        if (paging_features & PAGING_FEATURE_LARGE) {
+            vga_print(" 4MB pages");
+        }
+        if (paging_features & PAGING_FEATURE_GLOBAL) {
+            vga_print(" global");
+        }
+        if (paging_features & PAGING_FEATURE_WC) {
+            vga_print(" write-combining");
+        }
+        vga_print("\n");
+    }
+
     /* Initialize PIT timer (1000 Hz = 1ms resolution) */
     vga_print("Initializing PIT...\n");
     pit_init(1000);
@@ -93,10 +232,12 @@ void kernel_main(unsigned int magic, unsigned int *mboot_info) {
     /* Initialize system call interface */
     vga_print("Initializing syscall interface...\n");
     syscall_init();
+    aio_init();
 
     /* Initialize program loader */
     vga_print("Initializing program loader...\n");
     loader_init();
+    imgcache_init();
 
     /* Initialize PC speaker */
     vga_print("Initializing PC Speaker...\n");
@@ -133,31 +274,118 @@ void kernel_main(unsigned int magic, unsigned int *mboot_info) {
     vga_print("Initializing ISO9660...\n");
     iso9660_init();
 
-    /* Try to mount CD-ROM filesystems from all ATAPI drives */
-    vga_print("Mounting CD-ROM filesystems...\n");
+    /* CD-ROM file pages are kept on an ATA disk with a cache partition */
+    if (cachefs_init() == CACHEFS_OK) {
+        cachefs_info_t cache;
+        cachefs_get_info(&cache);
+        vga_print("Using disk cache on drive ");
+        vga_putchar('0' + cache.drive);
+        vga_print(" (");
+        vga_print_dec(cache.used);
+        vga_print(" of ");
+        vga_print_dec(cache.entries);
+        vga_print(" pages in use).\n");
+    }
+
+    /* Initialize FAT32 filesystem driver */
+    vga_print("Initializing FAT32...\n");
+    fat32_init();
 
-    fs_node_t *cdrom_roots[4] = {NULL};
-    int mounted_count = 0;
-    
-    for (int i = 0; i < 4; i++) {
-        ide_device_t *dev = ide_get_device(i);
-        if (dev && dev->type == IDE_TYPE_ATAPI) {
-            cdrom_roots[i] = fs_mount(i, "iso9660");
-            if (cdrom_roots[i]) {
+    /* Initialize initramfs driver */
+    vga_print("Initializing initramfs...\n");
+    initramfs_init((const uint8_t *)INITRAMFS_BASE, initramfs_size);
+
+    /* Prefer the initramfs as root: programs then load from memory and the
+     * CD-ROM is only read once something under /cdrom is used */
+    int root_drive = -1;
+    if (initramfs_size && fs_mount(0, "initramfs")) {
+        vga_print("Mounted initramfs as root (");
+        vga_print_dec(initramfs_size / 1024);
+        vga_print(" KB).\n");
+    } else {
+        /* Mount the first CD-ROM with an ISO9660 filesystem as root */
+        vga_print("Mounting CD-ROM filesystems...\n");
+
+        for (int i = 0; i < IDE_MAX_DRIVES; i++) {
+            ide_device_t *dev = ide_get_device(i);
+            if (dev && dev->type == IDE_TYPE_ATAPI && fs_mount(i, "iso9660")) {
                 vga_print("Mounted ISO9660 filesystem from drive ");
                 vga_putchar('0' + i);
-                vga_putchar('.');
-                vga_print("\n");
-                mounted_count++;
+                vga_print(" as root.\n");
+                root_drive = i;
+                break;
             }
         }
+        if (root_drive < 0) {
+            vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+            vga_print("Error: No CD-ROM filesystems mounted!\n");
+            vga_print("Cannot continue without a filesystem!\n");
+            vga_print("System halted!\n");
+            asm volatile("hlt");
+        }
     }
-    if (mounted_count == 0) {
-        vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
-        vga_print("Error: No CD-ROM filesystems mounted!\n");
-        vga_print("Cannot continue without a filesystem!\n");
-        vga_print("System halted!\n");
-        asm volatile("hlt");
+
+    /* Every other CD-ROM drive gets its own mount point; none of them is
+     * read until something under it is used */
+    static const char *cdrom_paths[IDE_MAX_DRIVES] = { "/cdrom", "/cdrom1", "/cdrom2", "/cdrom3" };
+    int cdrom_count = 0;
+
+    for (int i = 0; i < IDE_MAX_DRIVES; i++) {
+        ide_device_t *dev = ide_get_device(i);
+        if (!dev || dev->type != IDE_TYPE_ATAPI || i == root_drive) {
+            continue;
+        }
+
+        const char *path = cdrom_paths[cdrom_count++];
+        if (fs_mount_at(path, i, "iso9660", FS_MOUNT_LAZY) == FS_OK) {
+            vga_print("CD-ROM drive ");
+            vga_putchar('0' + i);
+            vga_print(" will be mounted on ");
+            vga_print(path);
+            vga_print(" on first use.\n");
+        }
+    }
+
+    /* ATA disks with a FAT32 volume are mounted on /disk, /disk1, ...;
+     * the FAT is only scanned once something under them is used */
+    static const char *disk_paths[IDE_MAX_DRIVES] = { "/disk", "/disk1", "/disk2", "/disk3" };
+    int disk_count = 0;
+
+    for (int i = 0; i < IDE_MAX_DRIVES; i++) {
+        ide_device_t *dev = ide_get_device(i);
+        if (!dev || dev->type != IDE_TYPE_ATA || !fat32_probe(i)) {
+            continue;
+        }
+
+        const char *path = disk_paths[disk_count++];
+        if (fs_mount_at(path, i, "fat32", FS_MOUNT_LAZY) == FS_OK) {
+            vga_print("FAT32 disk on drive ");
+            vga_putchar('0' + i);
+            vga_print(" will be mounted on ");
+            vga_print(path);
+            vga_print(" on first use.\n");
+        }
+    }
+
+    /* Mount the RAM filesystem for scratch files */
+    vga_print("Mounting tmpfs on /tmp...\n");
+    tmpfs_init();
+    if (fs_mount_at("/tmp", 0, "tmpfs", 0) == FS_OK) {
+        uint32_t blocks;
+        tmpfs_usage(NULL, &blocks);
+        vga_print("Mounted tmpfs on /tmp (");
+        vga_print_dec(blocks * (TMPFS_BLOCK_SIZE / 1024));
+        vga_print(" KB).\n");
+    } else {
+        vga_set_color(VGA_COLOR_WARNING, VGA_COLOR_BLACK);
+        vga_print("Warning: Could not mount tmpfs on /tmp\n");
+        vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+    }
+
+    /* Library code shared by the programs, resident from now on */
+    vga_print("Loading shared runtime...\n");
+    if (loader_load_runtime(RUNTIME_PATH) == 0) {
+        vga_print("Loaded shared runtime from " RUNTIME_PATH ".\n");
     }
 
     /* Run the shell from filesystem */
@@ -175,6 +403,9 @@ void kernel_main(unsigned int magic, unsigned int *mboot_info) {
         vga_print("Failed to load: /user/shell\n");
     }
 
+    /* Write back what the FAT32 caches still hold */
+    fat32_sync();
+
     vga_set_color(VGA_COLOR_INFO, VGA_COLOR_BLACK);
     vga_print("=== System Halted ===\n");
     vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
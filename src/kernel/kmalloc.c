@@ -0,0 +1,569 @@
+/**
+ * Kernel Heap Implementation
+ * Slab caches for fixed-size kernel objects and kmalloc() on top of them
+ *
+ * A cache hands out objects of one size from slabs: blocks of 1 to
+ * 2^KMEM_MAX_SLAB_ORDER frames from the frame allocator, with a small
+ * header in the first bytes and the objects after it. Free objects of a
+ * slab are chained through their first word, so allocating and freeing
+ * are a list operation. Slabs with free objects sit on the cache's
+ * partial list, full ones on its full list; a slab that empties goes back
+ * to the frame allocator once the other slabs have a slab's worth of
+ * free objects, so memory follows the load in both directions.
+ *
+ * kmalloc() rounds small requests up to a power-of-two size class with a
+ * cache of its own and gives larger ones whole frame blocks. One byte per
+ * frame records what the heap uses it for, which is how kfree() and
+ * kmem_cache_owns() find the slab of any pointer.
+ *
+ * Builds with KMEM_DEBUG put a tag after every object with its state and
+ * the address of the code that allocated it, which catches double frees
+ * and lets kmem_leak_report() list what is still allocated.
+ */
+
+#include <kmalloc.h>
+#include <frame.h>
+#include <string.h>
+#include <vga.h>
+
+/* What a frame is used for (kmem_frames) */
+#define KMEM_FRAME_NONE         0x00    /* Not the heap's */
+#define KMEM_FRAME_SLAB         0x80    /* Part of a slab; low bits: frame index in it */
+#define KMEM_FRAME_LARGE        0x40    /* Starts a kmalloc() block; low bits: order */
+#define KMEM_FRAME_LOW_MASK     0x0F
+
+/* Slab header, at the start of the slab's first frame */
+typedef struct kmem_slab {
+    struct kmem_slab *next;     /* Next slab on the same list */
+    struct kmem_slab *prev;     /* Previous one, NULL at the head */
+    kmem_cache_t *cache;        /* Owning cache */
+    void *free;                 /* First free object, NULL if full */
+    uint32_t in_use;            /* Objects allocated */
+} kmem_slab_t;
+
+/* Objects start here, 8-byte aligned */
+#define KMEM_SLAB_HEADER        ((sizeof(kmem_slab_t) + 7) & ~7u)
+
+#ifdef KMEM_DEBUG
+/* Tag after each object */
+typedef struct {
+    uint32_t state;             /* KMEM_TAG_LIVE or KMEM_TAG_FREE */
+    uint32_t caller;            /* Return address of the allocation */
+} kmem_tag_t;
+
+#define KMEM_TAG_LIVE           0x4556494C  /* "LIVE" */
+#define KMEM_TAG_FREE           0x45455246  /* "FREE" */
+
+/* Freed objects are filled with this to expose use after free */
+#define KMEM_POISON             0x6B
+
+/* Objects listed per cache by kmem_leak_report() */
+#define KMEM_REPORT_MAX         8
+#endif
+
+/* Object cache */
+struct kmem_cache {
+    char name[KMEM_NAME_LEN];
+    uint32_t size;              /* Object size requested */
+    uint32_t stride;            /* Bytes between objects */
+    uint32_t order;             /* Slab size: 2^order frames */
+    uint32_t per_slab;          /* Objects per slab */
+    kmem_slab_t *partial;       /* Slabs with free objects */
+    kmem_slab_t *full;          /* Slabs without */
+    uint32_t slabs;
+    uint32_t in_use;
+    uint32_t peak;
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t failures;
+};
+
+/* Usage of kmalloc() frame blocks */
+typedef struct {
+    uint32_t blocks;            /* Blocks allocated */
+    uint32_t frames;            /* Frames they span */
+    uint32_t peak;
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t failures;
+} kmem_large_t;
+
+static kmem_cache_t kmem_caches[KMEM_MAX_CACHES];
+static uint32_t kmem_cache_count = 0;
+
+/* kmalloc() size classes, from KMEM_MIN_SIZE up */
+#define KMEM_CLASSES            8
+static const char *kmem_class_names[KMEM_CLASSES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048"
+};
+static kmem_cache_t *kmem_classes[KMEM_CLASSES];
+
+static kmem_large_t kmem_large;
+static uint8_t kmem_frames[FRAME_COUNT];
+
+/**
+ * Put a slab at the head of a list
+ */
+static void kmem_list_add(kmem_slab_t **list, kmem_slab_t *slab) {
+    slab->prev = NULL;
+    slab->next = *list;
+    if (slab->next) {
+        slab->next->prev = slab;
+    }
+    *list = slab;
+}
+
+/**
+ * Take a slab off a list
+ */
+static void kmem_list_del(kmem_slab_t **list, kmem_slab_t *slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *list = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+}
+
+#ifdef KMEM_DEBUG
+/**
+ * Get the tag of an object
+ */
+static kmem_tag_t *kmem_tag(kmem_cache_t *cache, void *obj) {
+    return (kmem_tag_t *)((uint8_t *)obj + cache->stride - sizeof(kmem_tag_t));
+}
+#endif
+
+/**
+ * Get the slab a pointer falls in
+ * @return Slab, or NULL if the pointer is not in one
+ */
+static kmem_slab_t *kmem_slab_of(const void *ptr) {
+    uint32_t frame = (uint32_t)ptr / FRAME_SIZE;
+
+    if (frame >= FRAME_COUNT || !(kmem_frames[frame] & KMEM_FRAME_SLAB)) {
+        return NULL;
+    }
+
+    frame -= kmem_frames[frame] & KMEM_FRAME_LOW_MASK;
+    return (kmem_slab_t *)(frame * FRAME_SIZE);
+}
+
+/**
+ * Check that a pointer is the start of an object slot of its slab
+ */
+static bool kmem_is_object(kmem_slab_t *slab, const void *ptr) {
+    kmem_cache_t *cache = slab->cache;
+    uint32_t offset = (uint32_t)ptr - (uint32_t)slab;
+
+    if (offset < KMEM_SLAB_HEADER) {
+        return false;
+    }
+    offset -= KMEM_SLAB_HEADER;
+
+    return offset % cache->stride == 0 && offset / cache->stride < cache->per_slab;
+}
+
+/**
+ * Report a pointer the heap cannot free
+ */
+static void kmem_bad_free(const char *what, const void *ptr) {
+    vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+    vga_print("Error: ");
+    vga_print(what);
+    vga_print(" 0x");
+    vga_print_hex((uint32_t)ptr);
+    vga_print("!\n");
+    vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+}
+
+/**
+ * Get a new slab for a cache and put it on the partial list
+ * @return Slab, or NULL if no frames are free
+ */
+static kmem_slab_t *kmem_slab_create(kmem_cache_t *cache) {
+    uint32_t addr = frame_alloc(cache->order);
+    if (!addr) {
+        return NULL;
+    }
+
+    kmem_slab_t *slab = (kmem_slab_t *)addr;
+    slab->cache = cache;
+    slab->in_use = 0;
+
+    /* Chain the objects in address order */
+    uint8_t *obj = (uint8_t *)addr + KMEM_SLAB_HEADER;
+    void **link = &slab->free;
+    for (uint32_t i = 0; i < cache->per_slab; i++) {
+        *link = obj;
+        link = (void **)obj;
+#ifdef KMEM_DEBUG
+        kmem_tag(cache, obj)->state = KMEM_TAG_FREE;
+        kmem_tag(cache, obj)->caller = 0;
+#endif
+        obj += cache->stride;
+    }
+    *link = NULL;
+
+    for (uint32_t i = 0; i < (1u << cache->order); i++) {
+        kmem_frames[addr / FRAME_SIZE + i] = KMEM_FRAME_SLAB | i;
+    }
+
+    kmem_list_add(&cache->partial, slab);
+    cache->slabs++;
+    return slab;
+}
+
+/**
+ * Give an empty slab back to the frame allocator
+ */
+static void kmem_slab_destroy(kmem_cache_t *cache, kmem_slab_t *slab) {
+    uint32_t addr = (uint32_t)slab;
+
+    kmem_list_del(&cache->partial, slab);
+    cache->slabs--;
+
+    memset(&kmem_frames[addr / FRAME_SIZE], KMEM_FRAME_NONE, 1u << cache->order);
+    frame_free(addr, cache->order);
+}
+
+/**
+ * Allocate an object, recording who asked for it
+ */
+static void *kmem_alloc_from(kmem_cache_t *cache, uint32_t caller) {
+    kmem_slab_t *slab = cache->partial;
+
+    if (!slab) {
+        slab = kmem_slab_create(cache);
+        if (!slab) {
+            cache->failures++;
+            return NULL;
+        }
+    }
+
+    void *obj = slab->free;
+    slab->free = *(void **)obj;
+    slab->in_use++;
+    if (!slab->free) {
+        kmem_list_del(&cache->partial, slab);
+        kmem_list_add(&cache->full, slab);
+    }
+
+    cache->allocs++;
+    cache->in_use++;
+    if (cache->in_use > cache->peak) {
+        cache->peak = cache->in_use;
+    }
+
+#ifdef KMEM_DEBUG
+    kmem_tag(cache, obj)->state = KMEM_TAG_LIVE;
+    kmem_tag(cache, obj)->caller = caller;
+#else
+    (void)caller;
+#endif
+
+    return obj;
+}
+
+/**
+ * Return an object to its slab
+ */
+static void kmem_free_to(kmem_slab_t *slab, void *obj) {
+    kmem_cache_t *cache = slab->cache;
+
+#ifdef KMEM_DEBUG
+    kmem_tag_t *tag = kmem_tag(cache, obj);
+    if (tag->state != KMEM_TAG_LIVE) {
+        kmem_bad_free("Double free of kernel object", obj);
+        return;
+    }
+    memset(obj, KMEM_POISON, cache->stride - sizeof(kmem_tag_t));
+    tag->state = KMEM_TAG_FREE;
+#endif
+
+    if (!slab->free) {
+        kmem_list_del(&cache->full, slab);
+        kmem_list_add(&cache->partial, slab);
+    }
+    *(void **)obj = slab->free;
+    slab->free = obj;
+    slab->in_use--;
+
+    cache->frees++;
+    cache->in_use--;
+
+    /* Keep one slab's worth of free objects, release the rest */
+    if (slab->in_use == 0 &&
+        (cache->slabs - 1) * cache->per_slab - cache->in_use >= cache->per_slab) {
+        kmem_slab_destroy(cache, slab);
+    }
+}
+
+/**
+ * Initialize the kernel heap
+ */
+void kmalloc_init(void) {
+    memset(kmem_caches, 0, sizeof(kmem_caches));
+    memset(&kmem_large, 0, sizeof(kmem_large));
+    memset(kmem_frames, KMEM_FRAME_NONE, sizeof(kmem_frames));
+    kmem_cache_count = 0;
+
+    for (uint32_t i = 0; i < KMEM_CLASSES; i++) {
+        kmem_classes[i] = kmem_cache_create(kmem_class_names[i], KMEM_MIN_SIZE << i);
+    }
+}
+
+/**
+ * Create a cache of fixed-size objects
+ */
+kmem_cache_t *kmem_cache_create(const char *name, uint32_t size) {
+    if (!name || size == 0 || size > KMEM_MAX_SIZE || kmem_cache_count >= KMEM_MAX_CACHES) {
+        return NULL;
+    }
+
+    kmem_cache_t *cache = &kmem_caches[kmem_cache_count++];
+    memset(cache, 0, sizeof(kmem_cache_t));
+    strncpy(cache->name, name, KMEM_NAME_LEN - 1);
+    cache->size = size;
+    cache->stride = (size + 7) & ~7u;
+#ifdef KMEM_DEBUG
+    cache->stride += sizeof(kmem_tag_t);
+#endif
+
+    /* Smallest slab that wastes at most an eighth of itself */
+    while (cache->order < KMEM_MAX_SLAB_ORDER) {
+        uint32_t bytes = FRAME_SIZE << cache->order;
+        if ((bytes - KMEM_SLAB_HEADER) % cache->stride <= bytes / 8) {
+            break;
+        }
+        cache->order++;
+    }
+    cache->per_slab = ((FRAME_SIZE << cache->order) - KMEM_SLAB_HEADER) / cache->stride;
+
+    return cache;
+}
+
+/**
+ * Allocate an object from a cache
+ */
+void *kmem_cache_alloc(kmem_cache_t *cache) {
+    if (!cache) {
+        return NULL;
+    }
+    return kmem_alloc_from(cache, (uint32_t)__builtin_return_address(0));
+}
+
+/**
+ * Return an object to its cache
+ */
+void kmem_cache_free(kmem_cache_t *cache, void *ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    kmem_slab_t *slab = kmem_slab_of(ptr);
+    if (!slab || slab->cache != cache || !kmem_is_object(slab, ptr)) {
+        kmem_bad_free("Free of object not in cache at", ptr);
+        return;
+    }
+
+    kmem_free_to(slab, ptr);
+}
+
+/**
+ * Check whether a pointer is an object of a cache
+ */
+bool kmem_cache_owns(kmem_cache_t *cache, const void *ptr) {
+    kmem_slab_t *slab = kmem_slab_of(ptr);
+    return slab && slab->cache == cache && kmem_is_object(slab, ptr);
+}
+
+/**
+ * Allocate memory from the kernel heap
+ */
+void *kmalloc(size_t size) {
+    uint32_t caller = (uint32_t)__builtin_return_address(0);
+
+    if (size == 0) {
+        return NULL;
+    }
+
+    if (size <= KMEM_MAX_SIZE) {
+        uint32_t index = 0;
+        while ((uint32_t)(KMEM_MIN_SIZE << index) < size) {
+            index++;
+        }
+        return kmem_alloc_from(kmem_classes[index], caller);
+    }
+
+    /* Too large for a size class: a block of whole frames */
+    uint32_t order = 0;
+    while ((uint32_t)(FRAME_SIZE << order) < size && order <= FRAME_MAX_ORDER) {
+        order++;
+    }
+
+    uint32_t addr = order <= FRAME_MAX_ORDER ? frame_alloc(order) : 0;
+    if (!addr) {
+        kmem_large.failures++;
+        return NULL;
+    }
+
+    kmem_frames[addr / FRAME_SIZE] = KMEM_FRAME_LARGE | order;
+    kmem_large.allocs++;
+    kmem_large.blocks++;
+    kmem_large.frames += 1u << order;
+    if (kmem_large.blocks > kmem_large.peak) {
+        kmem_large.peak = kmem_large.blocks;
+    }
+
+    return (void *)addr;
+}
+
+/**
+ * Allocate zeroed memory from the kernel heap
+ */
+void *kzalloc(size_t size) {
+    void *ptr = kmalloc(size);
+    if (ptr) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+/**
+ * Free memory from kmalloc()
+ */
+void kfree(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    kmem_slab_t *slab = kmem_slab_of(ptr);
+    if (slab && kmem_is_object(slab, ptr)) {
+        kmem_free_to(slab, ptr);
+        return;
+    }
+
+    uint32_t frame = (uint32_t)ptr / FRAME_SIZE;
+    if ((uint32_t)ptr % FRAME_SIZE != 0 || frame >= FRAME_COUNT ||
+        (kmem_frames[frame] & ~KMEM_FRAME_LOW_MASK) != KMEM_FRAME_LARGE) {
+        kmem_bad_free("Free of memory not from kmalloc at", ptr);
+        return;
+    }
+
+    uint32_t order = kmem_frames[frame] & KMEM_FRAME_LOW_MASK;
+    kmem_frames[frame] = KMEM_FRAME_NONE;
+    frame_free((uint32_t)ptr, order);
+
+    kmem_large.frees++;
+    kmem_large.blocks--;
+    kmem_large.frames -= 1u << order;
+}
+
+/**
+ * Get the statistics of a cache
+ */
+int kmem_get_cache_info(uint32_t index, kmem_cache_info_t *info) {
+    memset(info, 0, sizeof(kmem_cache_info_t));
+
+    if (index < kmem_cache_count) {
+        kmem_cache_t *cache = &kmem_caches[index];
+        strcpy(info->name, cache->name);
+        info->object_size = cache->size;
+        info->slab_size = FRAME_SIZE << cache->order;
+        info->slabs = cache->slabs;
+        info->objects = cache->slabs * cache->per_slab;
+        info->in_use = cache->in_use;
+        info->peak = cache->peak;
+        info->allocs = cache->allocs;
+        info->frees = cache->frees;
+        info->failures = cache->failures;
+        return 0;
+    }
+
+    if (index == kmem_cache_count) {
+        strcpy(info->name, "kmalloc-large");
+        info->slab_size = FRAME_SIZE;
+        info->slabs = kmem_large.frames;
+        info->objects = kmem_large.blocks;
+        info->in_use = kmem_large.blocks;
+        info->peak = kmem_large.peak;
+        info->allocs = kmem_large.allocs;
+        info->frees = kmem_large.frees;
+        info->failures = kmem_large.failures;
+        return 0;
+    }
+
+    return -1;
+}
+
+#ifdef KMEM_DEBUG
+/**
+ * Print the allocated objects of a slab list
+ * @param listed: Objects of the cache printed so far (updated)
+ */
+static void kmem_report_list(kmem_cache_t *cache, kmem_slab_t *slab, uint32_t *listed) {
+    for (; slab; slab = slab->next) {
+        uint8_t *obj = (uint8_t *)slab + KMEM_SLAB_HEADER;
+        for (uint32_t i = 0; i < cache->per_slab; i++, obj += cache->stride) {
+            kmem_tag_t *tag = kmem_tag(cache, obj);
+            if (tag->state != KMEM_TAG_LIVE || (*listed)++ >= KMEM_REPORT_MAX) {
+                continue;
+            }
+            vga_print("  ");
+            vga_print(cache->name);
+            vga_print(" 0x");
+            vga_print_hex((uint32_t)obj);
+            vga_print(" from 0x");
+            vga_print_hex(tag->caller);
+            vga_print("\n");
+        }
+    }
+}
+
+/**
+ * Print every allocated object
+ */
+void kmem_leak_report(void) {
+    vga_set_color(VGA_COLOR_INFO, VGA_COLOR_BLACK);
+    vga_print("Allocated kernel objects:\n");
+
+    for (uint32_t i = 0; i < kmem_cache_count; i++) {
+        kmem_cache_t *cache = &kmem_caches[i];
+        uint32_t listed = 0;
+
+        kmem_report_list(cache, cache->partial, &listed);
+        kmem_report_list(cache, cache->full, &listed);
+        if (listed > KMEM_REPORT_MAX) {
+            vga_print("  ");
+            vga_print(cache->name);
+            vga_print(": ");
+            vga_print_dec(listed - KMEM_REPORT_MAX);
+            vga_print(" more\n");
+        }
+    }
+
+    /* Frame blocks carry no tag: list them by size */
+    for (uint32_t frame = 0; frame < FRAME_COUNT; frame++) {
+        if ((kmem_frames[frame] & ~KMEM_FRAME_LOW_MASK) != KMEM_FRAME_LARGE) {
+            continue;
+        }
+        vga_print("  kmalloc-large 0x");
+        vga_print_hex(frame * FRAME_SIZE);
+        vga_print(" (");
+        vga_print_dec((FRAME_SIZE << (kmem_frames[frame] & KMEM_FRAME_LOW_MASK)) / 1024);
+        vga_print(" KB)\n");
+    }
+
+    vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+}
+#else
+/**
+ * Allocation sites are not tracked without KMEM_DEBUG
+ */
+void kmem_leak_report(void) {
+}
+#endif
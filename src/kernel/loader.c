@@ -4,6 +4,18 @@
  */
 
 #include <loader.h>
+#include <aio.h>
+#include <fat32.h>
+#include <frame.h>
+#include <imgcache.h>
+#include <kernel.h>
+#include <kmalloc.h>
+#include <lz4.h>
+#include <mmap.h>
+#include <pager.h>
+#include <paging.h>
+#include <pit.h>
+#include <syscall.h>
 #include <vga.h>
 #include <string.h>
 
@@ -12,25 +24,176 @@ static program_t current_program;
 static int program_running = 0;
 static int program_exit_code = 0;
 
-/* Parent program path for returning after child exits */
-static char parent_path[64];
-static int has_parent = 0;
+/* Registers of a loader_exec() call, restored when its program exits */
+typedef struct {
+    uint32_t ebx;
+    uint32_t esi;
+    uint32_t edi;
+    uint32_t ebp;
+    uint32_t esp;
+    uint32_t eip;           /* Return point inside loader_call() */
+} loader_context_t;
 
-/* Temporary buffer for reading ELF file */
-static uint8_t elf_buffer[PROGRAM_MAX_SIZE];
+/* Program started by loader_exec() and not yet finished */
+typedef struct {
+    loader_context_t context;
+    int exited;             /* Left through loader_exit() */
+} loader_frame_t;
+
+static loader_frame_t loader_frames[LOADER_MAX_DEPTH];
+static uint32_t loader_depth = 0;
+
+/* Save area for the images of suspended programs (0 if memory is too
+ * small) and bytes of it in use, stacked by nesting level */
+static uint32_t loader_save_capacity = 0;
+static uint32_t loader_save_used = 0;
+
+/* Addresses of the program at each nesting level, and where its image went
+ * if a later program needed them */
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+    uint32_t save_offset;   /* Offset of the image in the save area */
+    int saved;              /* Image in the save area, addresses reused */
+} loader_range_t;
+
+static loader_range_t loader_ranges[LOADER_MAX_DEPTH];
+
+/* Load address minus link address of the program being loaded */
+static uint32_t loader_bias = 0;
+
+/* Startup profile of the program at each nesting level, and the last
+ * LOADER_PROFILES finished ones (a ring, loader_profile_count recorded) */
+static loader_profile_t loader_profile_levels[LOADER_MAX_DEPTH];
+static loader_profile_t loader_profiles[LOADER_PROFILES];
+static uint32_t loader_profile_count = 0;
+
+/* Profile of the program being loaded, and when its last phase ended */
+static loader_profile_t *loader_profile = NULL;
+static uint32_t loader_phase_time = 0;
+
+/* Shared runtime in place at RUNTIME_BASE */
+static int runtime_loaded = 0;
+
+/* ELF header and program headers of the program being loaded */
+static elf32_ehdr_t elf_header;
+static elf32_phdr_t elf_phdrs[LOADER_MAX_PHDRS];
+
+/* Segment table of the compressed executable being loaded */
+static lz4exe_segment_t lz4exe_segments[LOADER_MAX_PHDRS];
 
 /* External symbol from linker script */
 extern uint32_t __kernel_end;
 
+/**
+ * Page fault handler for the shared runtime area
+ * Reached when a program calls a runtime that is not loaded, or writes to
+ * or runs past the loaded one.
+ */
+static int loader_runtime_fault(uint32_t addr, uint32_t err) {
+    (void)err;
+    
+    if (loader_depth == 0) {
+        return 0;
+    }
+    
+    vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+    if (runtime_loaded) {
+        vga_print("Error: Bad access to the shared runtime at 0x");
+        vga_print_hex(addr);
+        vga_print("\n");
+    } else {
+        vga_print("Error: Shared runtime not loaded!\n");
+    }
+    vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+    
+    /* Terminate the program; does not return */
+    loader_exit(-1);
+    return 0;
+}
+
 /**
  * Initialize the program loader
  */
 void loader_init(void) {
+    mem_info_t mem;
+    
     program_running = 0;
     program_exit_code = 0;
-    has_parent = 0;
-    parent_path[0] = '\0';
+    loader_depth = 0;
+    loader_save_used = 0;
+    loader_profile_count = 0;
     memset(&current_program, 0, sizeof(program_t));
+    memset(loader_ranges, 0, sizeof(loader_ranges));
+    
+    /* Upper memory starts at 1MB */
+    kernel_get_mem_info(&mem);
+    if ((LOADER_SAVE_BASE + LOADER_SAVE_SIZE) / 1024 <= mem.mem_upper + 1024) {
+        loader_save_capacity = LOADER_SAVE_SIZE;
+    } else {
+        loader_save_capacity = 0;
+        frame_release(LOADER_SAVE_BASE, LOADER_SAVE_BASE + LOADER_SAVE_SIZE);
+    }
+    
+    /* The runtime area faults until the runtime is loaded */
+    runtime_loaded = 0;
+    for (uint32_t page = RUNTIME_BASE; page < RUNTIME_BASE + RUNTIME_MAX_SIZE; page += PAGE_SIZE) {
+        paging_unmap(page);
+    }
+    paging_register_fault_handler(RUNTIME_BASE, RUNTIME_BASE + RUNTIME_MAX_SIZE,
+                                  loader_runtime_fault);
+}
+
+/**
+ * Call a program entry point, saving the registers needed to come back
+ * @param entry: Entry point
+ * @param ctx: Filled with the registers and return point
+ * @return 0 if the entry point returns, the exit code passed to
+ *         loader_resume() otherwise
+ */
+static int loader_call(uint32_t entry, loader_context_t *ctx) {
+    int result;
+    
+    /* Interrupts are enabled, also when started from inside SYS_EXEC, so
+     * background reads make progress while the program runs */
+    __asm__ volatile (
+        "movl %%ebx, 0(%%ecx)\n\t"
+        "movl %%esi, 4(%%ecx)\n\t"
+        "movl %%edi, 8(%%ecx)\n\t"
+        "movl %%ebp, 12(%%ecx)\n\t"
+        "movl %%esp, 16(%%ecx)\n\t"
+        "movl $1f, 20(%%ecx)\n\t"
+        "sti\n\t"
+        "call *%%edx\n\t"
+        "xorl %%eax, %%eax\n"
+        "1:"
+        : "=a" (result), "+c" (ctx), "+d" (entry)
+        :
+        : "memory", "cc"
+    );
+    
+    return result;
+}
+
+/**
+ * Continue after the loader_call() that filled a context
+ * Everything the program pushed below that call is discarded.
+ * @param ctx: Context of the call
+ * @param code: Value returned by loader_call()
+ */
+static void __attribute__((noreturn)) loader_resume(loader_context_t *ctx, int code) {
+    __asm__ volatile (
+        "movl 0(%%ecx), %%ebx\n\t"
+        "movl 4(%%ecx), %%esi\n\t"
+        "movl 8(%%ecx), %%edi\n\t"
+        "movl 12(%%ecx), %%ebp\n\t"
+        "movl 16(%%ecx), %%esp\n\t"
+        "jmp *20(%%ecx)"
+        :
+        : "c" (ctx), "a" (code)
+        : "memory"
+    );
+    __builtin_unreachable();
 }
 
 /**
@@ -62,8 +225,8 @@ static int elf_validate(elf32_ehdr_t *ehdr) {
         return -3;
     }
     
-    /* Check file type (must be executable) */
-    if (ehdr->e_type != ET_EXEC) {
+    /* Check file type (must be executable, fixed or position-independent) */
+    if (ehdr->e_type != ET_EXEC && ehdr->e_type != ET_DYN) {
         vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
         vga_print("Error: Not an executable ELF file!\n");
         vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
@@ -90,51 +253,451 @@ static int elf_validate(elf32_ehdr_t *ehdr) {
 }
 
 /**
- * Load ELF segments into memory
+ * Check the program headers of a validated ELF header
+ * Every loadable segment must lie inside the given area and, for its
+ * file part, inside the file.
+ * @param file_size: Size of the ELF file
+ * @param area_start: First address segments may use
+ * @param area_end: End of the area
  * @return 0 on success, negative error code on failure
  */
-static int elf_load_segments(uint8_t *elf_data, elf32_ehdr_t *ehdr) {
-    elf32_phdr_t *phdr = (elf32_phdr_t *)(elf_data + ehdr->e_phoff);
+static int elf_check_segments(elf32_ehdr_t *ehdr, elf32_phdr_t *phdr, uint32_t file_size,
+                              uint32_t area_start, uint32_t area_end) {
+    int loadable = 0;
+    int entry_found = 0;
     
     for (int i = 0; i < ehdr->e_phnum; i++) {
-        if (phdr[i].p_type == PT_LOAD) {
-            /* Get segment info */
-            uint32_t vaddr = phdr[i].p_vaddr;
-            uint32_t filesz = phdr[i].p_filesz;
-            uint32_t memsz = phdr[i].p_memsz;
-            uint32_t offset = phdr[i].p_offset;
-            
-            /* Copy segment data from file to memory */
-            if (filesz > 0) {
-                memcpy((void *)vaddr, elf_data + offset, filesz);
+        if (phdr[i].p_type != PT_LOAD) {
+            continue;
+        }
+        
+        uint32_t vaddr = phdr[i].p_vaddr;
+        uint32_t filesz = phdr[i].p_filesz;
+        uint32_t memsz = phdr[i].p_memsz;
+        uint32_t offset = phdr[i].p_offset;
+        
+        if (filesz > memsz || offset > file_size || filesz > file_size - offset) {
+            vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+            vga_print("Error: ELF segment outside the file!\n");
+            vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+            return -8;
+        }
+        
+        if (vaddr < area_start || vaddr > area_end || memsz > area_end - vaddr) {
+            vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+            vga_print("Error: ELF segment outside its load area!\n");
+            vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+            return -9;
+        }
+        
+        if (ehdr->e_entry >= vaddr && ehdr->e_entry - vaddr < memsz) {
+            entry_found = 1;
+        }
+        loadable++;
+    }
+    
+    if (loadable == 0 || !entry_found) {
+        vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+        vga_print("Error: ELF entry point is not in a loadable segment!\n");
+        vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+        return -10;
+    }
+    
+    return 0;
+}
+
+/**
+ * Check the program header table location and size
+ * @param file_size: Size of the ELF file
+ * @return 0 on success, negative error code on failure
+ */
+static int elf_check_phdrs(elf32_ehdr_t *ehdr, uint32_t file_size) {
+    if (ehdr->e_phentsize != sizeof(elf32_phdr_t) || ehdr->e_phnum > LOADER_MAX_PHDRS ||
+        ehdr->e_phoff > file_size ||
+        ehdr->e_phnum * sizeof(elf32_phdr_t) > file_size - ehdr->e_phoff) {
+        vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+        vga_print("Error: Unsupported ELF program header table!\n");
+        vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+        return -7;
+    }
+    
+    return 0;
+}
+
+/**
+ * Charge the time since the previous phase of the load to a phase
+ * @param phase: LOADER_PHASE_*
+ */
+static void loader_phase(int phase) {
+    uint32_t now = pit_get_micros();
+    
+    loader_profile->phase_us[phase] += now - loader_phase_time;
+    loader_phase_time = now;
+}
+
+/**
+ * Keep a finished profile with the recent ones
+ */
+static void loader_profile_commit(const loader_profile_t *profile) {
+    memcpy(&loader_profiles[loader_profile_count % LOADER_PROFILES], profile,
+           sizeof(loader_profile_t));
+    loader_profile_count++;
+}
+
+/**
+ * Finish the load part of the profile started by loader_begin()
+ * Failed loads are recorded now, the others when the program exits.
+ * @param ret: Result of the load
+ * @param prog: Loaded program (if ret is 0)
+ */
+static void loader_profile_loaded(int ret, const program_t *prog) {
+    loader_profile_t *profile = loader_profile;
+    pager_stats_t stats;
+    
+    if (!profile) {
+        return;
+    }
+    loader_profile = NULL;
+    
+    /* Pages filled for relocations count as loading */
+    pager_get_stats(loader_depth + 1, &stats);
+    profile->bytes_read += stats.bytes_read;
+    profile->bytes_zeroed = stats.bytes_zeroed;
+    
+    if (ret < 0) {
+        profile->result = ret;
+        loader_profile_commit(profile);
+    } else {
+        profile->load_addr = prog->load_addr;
+        profile->mem_size = prog->mem_size;
+    }
+}
+
+/**
+ * Read from the file of the program being loaded, counting the bytes
+ * @return Bytes read, or negative on error (as fs_read())
+ */
+static int loader_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buf) {
+    int bytes_read = fs_read(node, offset, size, buf);
+    
+    if (bytes_read > 0 && loader_profile) {
+        loader_profile->bytes_read += (uint32_t)bytes_read;
+    }
+    return bytes_read;
+}
+
+/**
+ * Get the addresses spanned by the loadable segments in elf_phdrs
+ * @param start: Set to the lowest segment address
+ * @param end: Set to the end of the highest segment
+ */
+static void loader_get_extent(uint32_t *start, uint32_t *end) {
+    *start = UINT32_MAX;
+    *end = 0;
+    
+    for (int i = 0; i < elf_header.e_phnum; i++) {
+        elf32_phdr_t *phdr = &elf_phdrs[i];
+        if (phdr->p_type != PT_LOAD) {
+            continue;
+        }
+        
+        if (phdr->p_vaddr < *start) {
+            *start = phdr->p_vaddr;
+        }
+        if (phdr->p_vaddr + phdr->p_memsz > *end) {
+            *end = phdr->p_vaddr + phdr->p_memsz;
+        }
+    }
+}
+
+/**
+ * Fill a program structure after the segments of elf_header are in place
+ */
+static void loader_fill_program(program_t *prog, uint32_t size, const char *name) {
+    uint32_t start, end;
+    loader_get_extent(&start, &end);
+    
+    prog->entry = elf_header.e_entry;
+    prog->size = size;
+    prog->load_addr = start;
+    prog->mem_size = end - start;
+    strncpy(prog->name, name, sizeof(prog->name) - 1);
+    prog->name[sizeof(prog->name) - 1] = '\0';
+}
+
+/**
+ * Check if a range is clear of the programs below a nesting level that
+ * are still in place
+ * @param level: Nesting level the range is for
+ * @return 1 if no such program overlaps it, 0 otherwise
+ */
+static int loader_range_free(uint32_t level, uint32_t start, uint32_t end) {
+    for (uint32_t l = 1; l < level; l++) {
+        loader_range_t *range = &loader_ranges[l - 1];
+        if (!range->saved && range->start < end && range->end > start) {
+            return 0;
+        }
+    }
+    
+    return 1;
+}
+
+/**
+ * Find a load address for a position-independent program
+ * First fit among the start of the program area and the ends of the
+ * programs still in place, so a child usually goes right above its parent
+ * and neither has to be copied. If nothing fits, the program goes to the
+ * start of the area and the programs in its way are saved.
+ * @param level: Nesting level the program will run at
+ * @param size: Bytes from its first page to the end of its last segment
+ * @return Load address (page aligned)
+ */
+static uint32_t loader_find_range(uint32_t level, uint32_t size) {
+    uint32_t best = 0;
+    
+    for (uint32_t l = 0; l < level; l++) {
+        uint32_t start = PROGRAM_LOAD_ADDR;
+        if (l > 0) {
+            loader_range_t *range = &loader_ranges[l - 1];
+            if (range->saved) {
+                continue;
             }
-            
-            /* Zero out the BSS section (memsz > filesz) */
-            if (memsz > filesz) {
-                memset((void *)(vaddr + filesz), 0, memsz - filesz);
+            start = (range->end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        }
+        
+        if (start > PROGRAM_AREA_END || size > PROGRAM_AREA_END - start ||
+            (best != 0 && start >= best)) {
+            continue;
+        }
+        if (loader_range_free(level, start, start + size)) {
+            best = start;
+        }
+    }
+    
+    return best ? best : PROGRAM_LOAD_ADDR;
+}
+
+/**
+ * Choose the addresses of the program described in elf_header and make
+ * room for it
+ * Position-independent programs are moved to a free range and their
+ * headers adjusted by the load bias. Programs below the level that are
+ * still in the way are saved to the save area; loader_run() puts them
+ * back when the program is done.
+ * @param level: Nesting level the program will run at
+ * @param file_size: Size of the file the segments come from, UINT32_MAX if
+ *                   their file parts were checked already
+ * @return 0 on success, negative error code on failure
+ */
+static int loader_place(uint32_t level, uint32_t file_size) {
+    uint32_t start, end;
+    
+    loader_bias = 0;
+    if (elf_header.e_type == ET_DYN) {
+        loader_profile->flags |= LOADER_PROFILE_PIE;
+        loader_get_extent(&start, &end);
+        start &= ~(PAGE_SIZE - 1);
+        
+        if (start < end) {
+            loader_bias = loader_find_range(level, end - start) - start;
+        }
+        for (int i = 0; i < elf_header.e_phnum; i++) {
+            if (elf_phdrs[i].p_type == PT_LOAD || elf_phdrs[i].p_type == PT_DYNAMIC) {
+                elf_phdrs[i].p_vaddr += loader_bias;
             }
         }
+        elf_header.e_entry += loader_bias;
     }
     
+    int ret = elf_check_segments(&elf_header, elf_phdrs, file_size, PROGRAM_LOAD_ADDR,
+                                 PROGRAM_AREA_END);
+    if (ret < 0) {
+        return ret;
+    }
+    
+    /* Pages the suspended programs have not touched yet are not copied
+     * and stay unfilled */
+    loader_get_extent(&start, &end);
+    for (uint32_t l = 1; l < level; l++) {
+        loader_range_t *range = &loader_ranges[l - 1];
+        if (range->saved || range->start >= end || range->end <= start) {
+            continue;
+        }
+        
+        int saved = pager_save(range->start, range->end,
+                               (uint8_t *)(LOADER_SAVE_BASE + loader_save_used),
+                               loader_save_capacity - loader_save_used);
+        if (saved < 0) {
+            vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+            vga_print("Error: No room to suspend the running programs!\n");
+            vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+            return -1;
+        }
+        range->saved = 1;
+        range->save_offset = loader_save_used;
+        loader_save_used += (uint32_t)saved;
+    }
+    
+    loader_ranges[level - 1].start = start;
+    loader_ranges[level - 1].end = end;
+    loader_ranges[level - 1].saved = 0;
     return 0;
 }
 
 /**
- * Load a program from a memory buffer (ELF format)
+ * Make part of the program being loaded present for the relocation code
+ * @param level: Nesting level the program will run at
+ * @param write: Also make it writable
+ * @return 0 on success, -1 if it is outside the program or cannot be filled
  */
-int loader_load_from_memory(const uint8_t *data, uint32_t size, 
-                            const char *name, program_t *prog) {
-    if (!data || !prog) {
+static int loader_reloc_access(uint32_t level, uint32_t addr, uint32_t size, bool write) {
+    loader_range_t *range = &loader_ranges[level - 1];
+    
+    if (addr < range->start || addr > range->end || size > range->end - addr) {
         return -1;
     }
+    return pager_fill_range(level, addr, size, write);
+}
+
+/**
+ * Apply the relocations of a position-independent program
+ * The linker resolves everything except the absolute addresses the
+ * program stores in data, which are R_386_RELATIVE entries: each gets the
+ * load bias added. Only the pages holding them are filled now.
+ * @param level: Nesting level the program will run at
+ * @return 0 on success, negative error code on failure
+ */
+static int loader_relocate(uint32_t level) {
+    elf32_phdr_t *dynamic = NULL;
     
-    if (size > PROGRAM_MAX_SIZE) {
+    if (elf_header.e_type != ET_DYN) {
+        return 0;
+    }
+    for (int i = 0; i < elf_header.e_phnum; i++) {
+        if (elf_phdrs[i].p_type == PT_DYNAMIC) {
+            dynamic = &elf_phdrs[i];
+        }
+    }
+    if (!dynamic) {
+        return 0;
+    }
+    
+    /* Find the relocation table */
+    uint32_t rel = 0;
+    uint32_t rel_size = 0;
+    uint32_t rel_entry = sizeof(elf32_rel_t);
+    int ret = 0;
+    
+    for (uint32_t addr = dynamic->p_vaddr; ret == 0; addr += sizeof(elf32_dyn_t)) {
+        if (loader_reloc_access(level, addr, sizeof(elf32_dyn_t), false) < 0) {
+            ret = -14;
+            break;
+        }
+        
+        elf32_dyn_t *entry = (elf32_dyn_t *)addr;
+        if (entry->d_tag == DT_NULL) {
+            break;
+        }
+        
+        switch (entry->d_tag) {
+            case DT_REL:
+                rel = entry->d_val + loader_bias;
+                break;
+            case DT_RELSZ:
+                rel_size = entry->d_val;
+                break;
+            case DT_RELENT:
+                rel_entry = entry->d_val;
+                break;
+            case DT_RELA:
+            case DT_TEXTREL:
+                ret = -15;
+                break;
+        }
+    }
+    
+    if (ret == 0 && rel_size > 0 &&
+        (rel_entry != sizeof(elf32_rel_t) || loader_reloc_access(level, rel, rel_size, false) < 0)) {
+        ret = -14;
+    }
+    
+    for (uint32_t offset = 0; ret == 0 && offset + sizeof(elf32_rel_t) <= rel_size;
+         offset += sizeof(elf32_rel_t)) {
+        elf32_rel_t *reloc = (elf32_rel_t *)(rel + offset);
+        uint32_t type = reloc->r_info & 0xFF;
+        
+        if (type == R_386_NONE) {
+            continue;
+        }
+        if (type != R_386_RELATIVE) {
+            ret = -15;
+            break;
+        }
+        
+        uint32_t target = reloc->r_offset + loader_bias;
+        if (loader_reloc_access(level, target, sizeof(uint32_t), true) < 0) {
+            ret = -14;
+            break;
+        }
+        *(uint32_t *)target += loader_bias;
+    }
+    
+    if (ret < 0) {
         vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
-        vga_print("Error: Program too large!\n");
+        vga_print(ret == -15 ? "Error: Unsupported relocation type!\n" :
+                               "Error: Bad relocation table!\n");
         vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
-        return -2;
     }
     
+    return ret;
+}
+
+/**
+ * Hand the segments described in elf_phdrs to the pager
+ * @param level: Nesting level the program will run at
+ * @param node: File to read the segments from on first access, or NULL if
+ *              their file bytes are already in place
+ */
+static void loader_start_pager(uint32_t level, fs_node_t *node) {
+    for (int i = 0; i < elf_header.e_phnum; i++) {
+        if (elf_phdrs[i].p_type == PT_LOAD) {
+            pager_add_segment(level, &elf_phdrs[i], node);
+        }
+    }
+    pager_start(level);
+}
+
+/**
+ * Start loading a program at the next nesting level, and its profile
+ * @param name: Name of the program
+ * @return Nesting level, or 0 if programs are nested too deeply
+ */
+static uint32_t loader_begin(const char *name) {
+    uint32_t level = loader_depth + 1;
+    
+    loader_profile = NULL;
+    if (level > LOADER_MAX_DEPTH) {
+        vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+        vga_print("Error: Programs nested too deeply!\n");
+        vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+        return 0;
+    }
+    
+    loader_profile = &loader_profile_levels[level - 1];
+    memset(loader_profile, 0, sizeof(loader_profile_t));
+    strncpy(loader_profile->name, name, sizeof(loader_profile->name) - 1);
+    loader_phase_time = pit_get_micros();
+    
+    /* Whatever the level held before becomes ordinary memory again */
+    pager_begin(level);
+    return level;
+}
+
+/**
+ * Load a program from a memory buffer, see loader_load_from_memory()
+ */
+static int loader_load_buffer(const uint8_t *data, uint32_t size, const char *name,
+                              program_t *prog) {
     if (size < sizeof(elf32_ehdr_t)) {
         vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
         vga_print("Error: File too small for ELF header!\n");
@@ -142,45 +705,256 @@ int loader_load_from_memory(const uint8_t *data, uint32_t size,
         return -3;
     }
     
-    /* Copy to temporary buffer for parsing */
-    memcpy(elf_buffer, data, size);
+    uint32_t level = loader_begin(name);
+    if (level == 0) {
+        return -1;
+    }
     
-    /* Validate ELF header */
-    elf32_ehdr_t *ehdr = (elf32_ehdr_t *)elf_buffer;
-    int ret = elf_validate(ehdr);
+    /* Parse the headers in place; only they are copied */
+    memcpy(&elf_header, data, sizeof(elf32_ehdr_t));
+    int ret = elf_validate(&elf_header);
+    if (ret == 0) {
+        ret = elf_check_phdrs(&elf_header, size);
+    }
     if (ret < 0) {
         return ret;
     }
     
-    /* Load ELF segments */
-    ret = elf_load_segments(elf_buffer, ehdr);
+    memcpy(elf_phdrs, data + elf_header.e_phoff, elf_header.e_phnum * sizeof(elf32_phdr_t));
+    loader_phase(LOADER_PHASE_HEADERS);
+    
+    ret = loader_place(level, size);
     if (ret < 0) {
         return ret;
     }
+    loader_phase(LOADER_PHASE_PLACE);
     
-    /* Fill program structure */
-    prog->entry = ehdr->e_entry;
-    prog->size = size;
-    prog->load_addr = PROGRAM_LOAD_ADDR;
+    /* Copy each segment from the buffer to its address; the pager zeroes
+     * the BSS */
+    for (int i = 0; i < elf_header.e_phnum; i++) {
+        elf32_phdr_t *phdr = &elf_phdrs[i];
+        if (phdr->p_type == PT_LOAD) {
+            memcpy((void *)phdr->p_vaddr, data + phdr->p_offset, phdr->p_filesz);
+        }
+    }
+    loader_phase(LOADER_PHASE_SEGMENTS);
     
-    if (name) {
-        strncpy(prog->name, name, sizeof(prog->name) - 1);
-        prog->name[sizeof(prog->name) - 1] = '\0';
-    } else {
-        strcpy(prog->name, "unknown");
+    loader_start_pager(level, NULL);
+    loader_phase(LOADER_PHASE_PAGER);
+    
+    ret = loader_relocate(level);
+    if (ret < 0) {
+        return ret;
     }
+    loader_phase(LOADER_PHASE_RELOCATE);
     
+    loader_fill_program(prog, size, name);
     return 0;
 }
 
 /**
- * Load a program from filesystem (ELF format)
+ * Load a program from a memory buffer (ELF format)
  */
-int loader_load(const char *path, program_t *prog) {
-    if (!path || !prog) {
+int loader_load_from_memory(const uint8_t *data, uint32_t size, 
+                            const char *name, program_t *prog) {
+    if (!data || !prog) {
+        return -1;
+    }
+    
+    int ret = loader_load_buffer(data, size, name ? name : "unknown", prog);
+    loader_profile_loaded(ret, prog);
+    return ret;
+}
+
+/**
+ * Check the headers of an ELF file and read its program headers
+ * Expects the ELF header in elf_header. The segments themselves are read
+ * by the pager on first access.
+ * @return 0 on success, negative error code on failure
+ */
+static int loader_read_elf(fs_node_t *node) {
+    int ret = elf_validate(&elf_header);
+    if (ret == 0) {
+        ret = elf_check_phdrs(&elf_header, node->length);
+    }
+    if (ret < 0) {
+        return ret;
+    }
+    
+    uint32_t phdr_size = elf_header.e_phnum * sizeof(elf32_phdr_t);
+    int bytes_read = loader_read(node, elf_header.e_phoff, phdr_size, (uint8_t *)elf_phdrs);
+    if (bytes_read != (int)phdr_size) {
+        vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+        vga_print("Error: Failed to read file!\n");
+        vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+        return -4;
+    }
+    
+    return 0;
+}
+
+/**
+ * Read the segment table of a compressed executable
+ * Expects the start of the file in elf_header. The segments are described
+ * in elf_header and elf_phdrs afterwards, as for an ELF file.
+ * @return 0 on success, negative error code on failure
+ */
+static int loader_read_lz4(fs_node_t *node) {
+    lz4exe_header_t header;
+    memcpy(&header, &elf_header, sizeof(lz4exe_header_t));
+    
+    /* The dynamic section takes one more program header */
+    uint32_t max_segments = header.dynamic ? LOADER_MAX_PHDRS - 1 : LOADER_MAX_PHDRS;
+    uint32_t table_size = header.segment_count * sizeof(lz4exe_segment_t);
+    if (header.segment_count == 0 || header.segment_count > max_segments ||
+        table_size > node->length - sizeof(lz4exe_header_t)) {
+        vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+        vga_print("Error: Unsupported compressed program header!\n");
+        vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+        return -7;
+    }
+    
+    int bytes_read = loader_read(node, sizeof(lz4exe_header_t), table_size, (uint8_t *)lz4exe_segments);
+    if (bytes_read != (int)table_size) {
+        vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+        vga_print("Error: Failed to read file!\n");
+        vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+        return -4;
+    }
+    
+    /* Describe the decoded segments as program headers */
+    memset(&elf_header, 0, sizeof(elf32_ehdr_t));
+    memset(elf_phdrs, 0, sizeof(elf_phdrs));
+    elf_header.e_type = header.dynamic ? ET_DYN : ET_EXEC;
+    elf_header.e_entry = header.entry;
+    elf_header.e_phnum = header.segment_count;
+    
+    for (uint32_t i = 0; i < header.segment_count; i++) {
+        lz4exe_segment_t *seg = &lz4exe_segments[i];
+        
+        if (seg->offset > node->length || seg->size > node->length - seg->offset ||
+            (seg->size == 0) != (seg->filesz == 0)) {
+            vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+            vga_print("Error: Compressed segment outside the file!\n");
+            vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+            return -8;
+        }
+        
+        elf_phdrs[i].p_type = PT_LOAD;
+        elf_phdrs[i].p_vaddr = seg->vaddr;
+        elf_phdrs[i].p_filesz = seg->filesz;
+        elf_phdrs[i].p_memsz = seg->memsz;
+        elf_phdrs[i].p_flags = seg->flags;
+    }
+    
+    if (header.dynamic) {
+        elf_phdrs[elf_header.e_phnum].p_type = PT_DYNAMIC;
+        elf_phdrs[elf_header.e_phnum].p_vaddr = header.dynamic;
+        elf_header.e_phnum++;
+    }
+    
+    return 0;
+}
+
+/**
+ * Decode the frames of a compressed executable into its placed segments
+ * Frames cannot be decoded a page at a time, so the file bytes are put in
+ * place now; only BSS is left to the pager.
+ * @param level: Nesting level the program will run at
+ * @return 0 on success, negative error code on failure
+ */
+static int loader_decode_lz4(fs_node_t *node, uint32_t level) {
+    /* Frames are read into free program memory above the image and above
+     * the suspended programs there */
+    loader_range_t *image = &loader_ranges[level - 1];
+    uint32_t scratch = image->end;
+    for (uint32_t l = 1; l < level; l++) {
+        loader_range_t *range = &loader_ranges[l - 1];
+        if (!range->saved && range->end > image->start && range->end > scratch) {
+            scratch = range->end;
+        }
+    }
+    scratch = (scratch + 15) & ~15u;
+    
+    /* The segments come first in elf_phdrs, in table order */
+    for (int i = 0; i < elf_header.e_phnum; i++) {
+        lz4exe_segment_t *seg = &lz4exe_segments[i];
+        
+        if (elf_phdrs[i].p_type == PT_LOAD && seg->size > 0) {
+            if (scratch > PROGRAM_AREA_END || seg->size > PROGRAM_AREA_END - scratch) {
+                vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+                vga_print("Error: No room to decompress program!\n");
+                vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+                return -11;
+            }
+            
+            int bytes_read = loader_read(node, seg->offset, seg->size, (uint8_t *)scratch);
+            if (bytes_read != (int)seg->size) {
+                vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+                vga_print("Error: Failed to read file!\n");
+                vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+                return -4;
+            }
+            
+            if (lz4_decompress_frame((const uint8_t *)scratch, seg->size,
+                                     (uint8_t *)elf_phdrs[i].p_vaddr,
+                                     seg->filesz) != (int)seg->filesz) {
+                vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+                vga_print("Error: Corrupt compressed segment!\n");
+                vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+                return -12;
+            }
+        }
+    }
+    
+    return 0;
+}
+
+/**
+ * Load a program from filesystem, see loader_load()
+ */
+static int loader_load_file(const char *path, program_t *prog) {
+    /* The path may live in the calling program, which the segments may
+     * overwrite: take the name first */
+    char name[sizeof(prog->name)];
+    strncpy(name, path, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    int cacheable = strlen(path) < sizeof(name);
+    
+    uint32_t level = loader_begin(name);
+    if (level == 0) {
         return -1;
     }
     
+    /* Programs run before under the same mounts come from memory */
+    uint32_t file_size;
+    int cached = cacheable ? imgcache_lookup(name, &elf_header, elf_phdrs, &file_size) : -1;
+    if (cached >= 0) {
+        loader_profile->flags |= LOADER_PROFILE_CACHED;
+        loader_phase(LOADER_PHASE_LOOKUP);
+        
+        int ret = loader_place(level, UINT32_MAX);
+        if (ret < 0) {
+            return ret;
+        }
+        loader_phase(LOADER_PHASE_PLACE);
+        
+        imgcache_copy(cached, loader_bias);
+        loader_phase(LOADER_PHASE_SEGMENTS);
+        
+        loader_start_pager(level, NULL);
+        loader_phase(LOADER_PHASE_PAGER);
+        
+        ret = loader_relocate(level);
+        if (ret < 0) {
+            return ret;
+        }
+        loader_phase(LOADER_PHASE_RELOCATE);
+        
+        loader_fill_program(prog, file_size, name);
+        return 0;
+    }
+    
     /* Find the file */
     fs_node_t *node = fs_namei(path);
     if (!node) {
@@ -191,14 +965,7 @@ int loader_load(const char *path, program_t *prog) {
         vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
         return -1;
     }
-    
-    /* Check file size */
-    if (node->length > PROGRAM_MAX_SIZE) {
-        vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
-        vga_print("Error: Program too large!\n");
-        vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
-        return -2;
-    }
+    loader_phase(LOADER_PHASE_LOOKUP);
     
     if (node->length < sizeof(elf32_ehdr_t)) {
         vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
@@ -207,39 +974,76 @@ int loader_load(const char *path, program_t *prog) {
         return -3;
     }
     
-    /* Read entire ELF file into buffer */
-    int bytes_read = fs_read(node, 0, node->length, elf_buffer);
-    
-    if (bytes_read < 0) {
+    /* Read and check the headers before touching the program area */
+    int bytes_read = loader_read(node, 0, sizeof(elf32_ehdr_t), (uint8_t *)&elf_header);
+    if (bytes_read != (int)sizeof(elf32_ehdr_t)) {
         vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
         vga_print("Error: Failed to read file!\n");
         vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
         return -4;
     }
     
-    /* Validate ELF header */
-    elf32_ehdr_t *ehdr = (elf32_ehdr_t *)elf_buffer;
-    int ret = elf_validate(ehdr);
+    /* Compressed executables carry their own segment table and are
+     * decoded in place, where the image cache can keep them for the next
+     * run; ELF segments are read from the file on first access */
+    int compressed = *(uint32_t *)elf_header.e_ident == LZ4EXE_MAGIC;
+    int ret;
+    if (compressed) {
+        loader_profile->flags |= LOADER_PROFILE_COMPRESSED;
+        ret = loader_read_lz4(node);
+    } else {
+        ret = loader_read_elf(node);
+    }
     if (ret < 0) {
         return ret;
     }
+    loader_phase(LOADER_PHASE_HEADERS);
     
-    /* Load ELF segments */
-    ret = elf_load_segments(elf_buffer, ehdr);
+    /* The frames were checked against the file already */
+    ret = loader_place(level, compressed ? UINT32_MAX : node->length);
     if (ret < 0) {
         return ret;
     }
+    loader_phase(LOADER_PHASE_PLACE);
     
-    /* Fill program structure */
-    prog->entry = ehdr->e_entry;
-    prog->size = (uint32_t)bytes_read;
-    prog->load_addr = PROGRAM_LOAD_ADDR;
-    strncpy(prog->name, path, sizeof(prog->name) - 1);
-    prog->name[sizeof(prog->name) - 1] = '\0';
+    if (compressed) {
+        ret = loader_decode_lz4(node, level);
+        if (ret < 0) {
+            return ret;
+        }
+        
+        if (cacheable) {
+            imgcache_store(name, node, &elf_header, elf_phdrs, loader_bias);
+        }
+        loader_phase(LOADER_PHASE_SEGMENTS);
+    }
+    
+    loader_start_pager(level, compressed ? NULL : node);
+    loader_phase(LOADER_PHASE_PAGER);
+    
+    ret = loader_relocate(level);
+    if (ret < 0) {
+        return ret;
+    }
+    loader_phase(LOADER_PHASE_RELOCATE);
     
+    loader_fill_program(prog, node->length, name);
     return 0;
 }
 
+/**
+ * Load a program from filesystem (ELF or compressed format)
+ */
+int loader_load(const char *path, program_t *prog) {
+    if (!path || !prog) {
+        return -1;
+    }
+    
+    int ret = loader_load_file(path, prog);
+    loader_profile_loaded(ret, prog);
+    return ret;
+}
+
 /**
  * Execute a loaded program
  */
@@ -248,6 +1052,23 @@ int loader_exec(program_t *prog) {
         return -1;
     }
     
+    if (loader_depth >= LOADER_MAX_DEPTH) {
+        vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+        vga_print("Error: Programs nested too deeply!\n");
+        vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+        return -1;
+    }
+    
+    /* Profile started when the program was loaded */
+    loader_profile_t *profile = &loader_profile_levels[loader_depth];
+    uint32_t exec_start = pit_get_micros();
+    
+    /* Background reads of the caller would land in the new image */
+    aio_cancel_all();
+    
+    loader_frame_t *frame = &loader_frames[loader_depth++];
+    frame->exited = 0;
+    
     /* Store current program info */
     memcpy(&current_program, prog, sizeof(program_t));
     program_running = 1;
@@ -263,23 +1084,245 @@ int loader_exec(program_t *prog) {
     vga_print(")\n");
     vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
     
-    /* Call the program entry point */
-    typedef void (*program_entry_t)(void);
-    program_entry_t entry = (program_entry_t)prog->entry;
+    pager_stats_t before;
+    pager_get_stats(loader_depth, &before);
+    uint32_t entry_time = pit_get_micros();
+    profile->phase_us[LOADER_PHASE_EXEC] = entry_time - exec_start;
     
-    /* Jump to program */
-    entry();
+    /* Comes back here from loader_exit() too */
+    int exit_code = loader_call(prog->entry, &frame->context);
     
-    /* If we get here, program returned without calling exit */
+    pager_stats_t after;
+    pager_get_stats(loader_depth, &after);
+    profile->run_us = pit_get_micros() - entry_time;
+    profile->run_pages = after.pages_filled - before.pages_filled;
+    profile->run_bytes_read = after.bytes_read - before.bytes_read;
+    profile->result = exit_code;
+    profile->flags |= LOADER_PROFILE_RAN;
+    loader_profile_commit(profile);
+    
+    if (!frame->exited) {
+        vga_set_color(VGA_COLOR_INFO, VGA_COLOR_BLACK);
+        vga_print("Program returned without exit\n");
+        vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+    }
+    
+    /* Drop file mappings, background reads and open files of the program */
+    loader_depth--;
+    mmap_unmap_from(loader_depth + 1);
+    pager_release(loader_depth + 1);
+    aio_cancel_all();
+    syscall_close_from(loader_depth + 1);
     program_running = 0;
     
-    vga_set_color(VGA_COLOR_INFO, VGA_COLOR_BLACK);
-    vga_print("Program returned without exit\n");
-    vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+    return exit_code;
+}
+
+/**
+ * Run a program as a child of the running one
+ */
+int loader_run(const char *path) {
+    program_t parent;
+    program_t child;
+    uint32_t save_offset = loader_save_used;
+    int suspended = program_running;
+    
+    /* The caller stays in place unless the child needs its addresses, in
+     * which case loader_load() saves it; its stack stays above the child's
+     * either way */
+    if (suspended) {
+        memcpy(&parent, &current_program, sizeof(program_t));
+    }
+    
+    int exit_code = -1;
+    if (loader_load(path, &child) == 0) {
+        exit_code = loader_exec(&child);
+    }
     
+    /* Pages of a child that failed to load or start */
+    pager_release(loader_depth + 1);
+    
+    /* Put back the programs saved to make room for the child */
+    for (uint32_t level = 1; level <= loader_depth; level++) {
+        loader_range_t *range = &loader_ranges[level - 1];
+        if (range->saved && range->save_offset >= save_offset) {
+            pager_restore(range->start, range->end,
+                          (const uint8_t *)(LOADER_SAVE_BASE + range->save_offset));
+            range->saved = 0;
+        }
+    }
+    loader_save_used = save_offset;
+    
+    if (suspended) {
+        memcpy(&current_program, &parent, sizeof(program_t));
+        program_running = 1;
+    }
+    
+    return exit_code;
+}
+
+/**
+ * Map the pages of the runtime segments in elf_phdrs
+ * @param final: Use the segment flags; otherwise map every page writable
+ *               so the segments can be read in
+ */
+static void loader_map_runtime(bool final) {
+    for (uint32_t page = RUNTIME_BASE; page < RUNTIME_BASE + RUNTIME_MAX_SIZE; page += PAGE_SIZE) {
+        int used = 0;
+        int writable = !final;
+        
+        for (int i = 0; i < elf_header.e_phnum; i++) {
+            elf32_phdr_t *phdr = &elf_phdrs[i];
+            if (phdr->p_type == PT_LOAD && phdr->p_vaddr < page + PAGE_SIZE &&
+                phdr->p_vaddr + phdr->p_memsz > page) {
+                used = 1;
+                writable = writable || (phdr->p_flags & PF_W);
+            }
+        }
+        
+        if (used) {
+            paging_map(page, page, writable ? PAGE_WRITE : 0);
+        }
+    }
+}
+
+/**
+ * Read the shared runtime to RUNTIME_BASE and check it, see loader_load_runtime()
+ */
+static int loader_read_runtime(const char *path) {
+    mem_info_t mem;
+    
+    kernel_get_mem_info(&mem);
+    if ((RUNTIME_BASE + RUNTIME_MAX_SIZE) / 1024 > mem.mem_upper + 1024) {
+        vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+        vga_print("Error: Not enough memory for the shared runtime!\n");
+        vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+        return -1;
+    }
+    
+    fs_node_t *node = fs_namei(path);
+    if (!node) {
+        vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+        vga_print("Error: File not found: ");
+        vga_print(path);
+        vga_print("\n");
+        vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+        return -1;
+    }
+    
+    if (node->length < sizeof(elf32_ehdr_t) ||
+        fs_read(node, 0, sizeof(elf32_ehdr_t), (uint8_t *)&elf_header) !=
+            (int)sizeof(elf32_ehdr_t)) {
+        vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+        vga_print("Error: Failed to read file!\n");
+        vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+        return -4;
+    }
+    
+    /* The runtime is linked for its fixed address */
+    int ret = loader_read_elf(node);
+    if (ret == 0 && elf_header.e_type != ET_EXEC) {
+        vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+        vga_print("Error: Not a shared runtime image!\n");
+        vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+        ret = -13;
+    }
+    if (ret == 0) {
+        ret = elf_check_segments(&elf_header, elf_phdrs, node->length, RUNTIME_BASE,
+                                 RUNTIME_BASE + RUNTIME_MAX_SIZE);
+    }
+    if (ret < 0) {
+        return ret;
+    }
+    
+    /* Read the whole image now: it stays resident */
+    loader_map_runtime(false);
+    for (int i = 0; i < elf_header.e_phnum; i++) {
+        elf32_phdr_t *phdr = &elf_phdrs[i];
+        if (phdr->p_type != PT_LOAD) {
+            continue;
+        }
+        
+        int bytes_read = fs_read(node, phdr->p_offset, phdr->p_filesz, (uint8_t *)phdr->p_vaddr);
+        if (bytes_read != (int)phdr->p_filesz) {
+            ret = -4;
+            break;
+        }
+        memset((void *)(phdr->p_vaddr + phdr->p_filesz), 0, phdr->p_memsz - phdr->p_filesz);
+    }
+    
+    /* Jump table: magic, entry count, then the entries, which must all
+     * fit in the image and point into it */
+    if (ret == 0) {
+        uint32_t *table = (uint32_t *)RUNTIME_BASE;
+        uint32_t count = table[1];
+        
+        if (table[0] != RUNTIME_MAGIC || count == 0 ||
+            count > RUNTIME_MAX_SIZE / sizeof(uint32_t) - 2) {
+            ret = -13;
+        }
+        for (uint32_t i = 0; ret == 0 && i < count; i++) {
+            if (table[2 + i] < RUNTIME_BASE || table[2 + i] >= RUNTIME_BASE + RUNTIME_MAX_SIZE) {
+                ret = -13;
+            }
+        }
+    }
+    
+    if (ret < 0) {
+        for (uint32_t page = RUNTIME_BASE; page < RUNTIME_BASE + RUNTIME_MAX_SIZE;
+             page += PAGE_SIZE) {
+            paging_unmap(page);
+        }
+        
+        vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+        vga_print(ret == -4 ? "Error: Failed to read file!\n" :
+                              "Error: Not a shared runtime image!\n");
+        vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+        return ret;
+    }
+    
+    loader_map_runtime(true);
+    runtime_loaded = 1;
     return 0;
 }
 
+/**
+ * Load the shared runtime
+ */
+int loader_load_runtime(const char *path) {
+    int ret = loader_read_runtime(path);
+    if (ret < 0) {
+        /* Only the page of the jump table stays unmapped, so programs
+         * calling into the missing runtime still fault there */
+        for (uint32_t page = RUNTIME_BASE + PAGE_SIZE; page < RUNTIME_BASE + RUNTIME_MAX_SIZE;
+             page += PAGE_SIZE) {
+            paging_map(page, page, PAGE_WRITE);
+        }
+        frame_release(RUNTIME_BASE + PAGE_SIZE, RUNTIME_BASE + RUNTIME_MAX_SIZE);
+    }
+    return ret;
+}
+
+/**
+ * Get a recent startup profile
+ */
+int loader_get_profile(uint32_t index, loader_profile_t *profile) {
+    if (index >= LOADER_PROFILES || index >= loader_profile_count) {
+        return -1;
+    }
+    
+    uint32_t slot = (loader_profile_count - 1 - index) % LOADER_PROFILES;
+    memcpy(profile, &loader_profiles[slot], sizeof(loader_profile_t));
+    return 0;
+}
+
+/**
+ * Get the program nesting level
+ */
+uint32_t loader_get_depth(void) {
+    return loader_depth;
+}
+
 /**
  * Check if a program is running
  */
@@ -298,7 +1341,7 @@ program_t *loader_get_current(void) {
 }
 
 /**
- * Signal program exit and restart parent if exists
+ * Signal program exit and return to the loader_exec() that started it
  */
 void loader_exit(int exit_code) {
     program_exit_code = exit_code;
@@ -311,33 +1354,22 @@ void loader_exit(int exit_code) {
     vga_print("\n");
     vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
     
-    /* If there's a parent program, reload and restart it */
-    if (has_parent && parent_path[0] != '\0') {
-        program_t parent;
-        has_parent = 0;  /* Clear before reloading to avoid infinite loop */
-        
-        if (loader_load(parent_path, &parent) == 0) {
-            parent_path[0] = '\0';
-            loader_exec(&parent);
-            /* If exec returns, fall through to halt */
-        }
+    if (loader_depth > 0) {
+        loader_frame_t *frame = &loader_frames[loader_depth - 1];
+        frame->exited = 1;
+        loader_resume(&frame->context, exit_code);
     }
     
-    /* Fallback: halt the machine */
+    /* Fallback: halt the machine, with the disk up to date */
+    fat32_sync();
+#ifdef KMEM_DEBUG
+    /* List what stays allocated once the path cache lets go */
+    fs_dcache_flush();
+    kmem_leak_report();
+#endif
     vga_print("System halted!\n");
     __asm__ volatile ("cli");
     while (1) {
         __asm__ volatile ("hlt");
     }
 }
-
-/**
- * Set the parent program path (called before exec'ing a child)
- */
-void loader_set_parent(const char *path) {
-    if (path) {
-        strncpy(parent_path, path, sizeof(parent_path) - 1);
-        parent_path[sizeof(parent_path) - 1] = '\0';
-        has_parent = 1;
-    }
-}
@@ -0,0 +1,185 @@
+/**
+ * File Mapping Implementation
+ * Maps file pages from the VFS page cache into a virtual window
+ *
+ * A mapping only reserves virtual space. The first access to a page
+ * faults, and the handler points the page table entry at the page cache
+ * page holding that part of the file, pinning it until the mapping is
+ * removed. No data is copied.
+ */
+
+#include <mmap.h>
+#include <kernel.h>
+#include <loader.h>
+#include <paging.h>
+#include <string.h>
+#include <vga.h>
+
+/* Page tables for the mapping window */
+#define MMAP_TABLES     (MMAP_SIZE / (1024 * PAGE_SIZE))
+
+/* Mapping region */
+typedef struct {
+    uint32_t base;          /* Virtual start address */
+    uint32_t pages;         /* Number of pages */
+    uint32_t first_page;    /* File page index of the first page */
+    fs_node_t *node;        /* Mapped file (pinned in the path cache) */
+    uint32_t owner;         /* Nesting level of the program that mapped it */
+    bool used;              /* Slot in use */
+} mmap_region_t;
+
+static uint32_t mmap_tables[MMAP_TABLES][1024] __attribute__((aligned(PAGE_SIZE)));
+static mmap_region_t mmap_regions[MMAP_MAX_REGIONS];
+
+/**
+ * Find the mapping containing an address
+ */
+static mmap_region_t *mmap_find(uint32_t addr) {
+    for (int i = 0; i < MMAP_MAX_REGIONS; i++) {
+        mmap_region_t *region = &mmap_regions[i];
+        if (region->used && addr >= region->base &&
+            addr < region->base + region->pages * PAGE_SIZE) {
+            return region;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Find free virtual space for a mapping (first fit)
+ * @return Start address, or 0 if the window is full
+ */
+static uint32_t mmap_find_space(uint32_t pages) {
+    uint32_t base = MMAP_BASE;
+    uint32_t size = pages * PAGE_SIZE;
+
+    while (base + size <= MMAP_BASE + MMAP_SIZE) {
+        uint32_t next = 0;
+
+        for (int i = 0; i < MMAP_MAX_REGIONS; i++) {
+            mmap_region_t *region = &mmap_regions[i];
+            uint32_t end = region->base + region->pages * PAGE_SIZE;
+            if (region->used && region->base < base + size && end > base && end > next) {
+                next = end;
+            }
+        }
+
+        if (!next) {
+            return base;
+        }
+        base = next;
+    }
+
+    return 0;
+}
+
+/**
+ * Page fault handler for the mapping window
+ */
+static int mmap_fault(uint32_t addr, uint32_t err) {
+    mmap_region_t *region = mmap_find(addr);
+    uint8_t *page = NULL;
+
+    /* Mappings are read-only; other faults are unmapped accesses */
+    if (region && !(err & PF_ERR_WRITE)) {
+        uint32_t index = region->first_page + (addr - region->base) / PAGE_SIZE;
+        page = fs_page_get(region->node, index);
+    }
+
+    if (!page) {
+        vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+        vga_print(region ? "Error: Invalid access to mapped file at 0x"
+                         : "Error: Access to unmapped address 0x");
+        vga_print_hex(addr);
+        vga_print("\n");
+        vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+
+        /* Terminate the program; does not return */
+        loader_exit(-1);
+        return 0;
+    }
+
+    /* Page cache memory is identity mapped: virtual == physical */
+    paging_map(addr & ~(PAGE_SIZE - 1), (uint32_t)page, PAGE_PRESENT);
+    return 1;
+}
+
+/**
+ * Initialize the file mapping window
+ */
+void mmap_init(void) {
+    memset(mmap_regions, 0, sizeof(mmap_regions));
+    paging_add_tables(MMAP_BASE, &mmap_tables[0][0], MMAP_TABLES);
+    paging_register_fault_handler(MMAP_BASE, MMAP_BASE + MMAP_SIZE, mmap_fault);
+}
+
+/**
+ * Map part of a file into the mapping window
+ */
+uint32_t mmap_file(fs_node_t *node, uint32_t offset, uint32_t length) {
+    if (!node || !node->readpage || (offset % PAGE_SIZE) || offset >= node->length) {
+        return 0;
+    }
+
+    /* Clamp to end of file */
+    if (length == 0 || length > node->length - offset) {
+        length = node->length - offset;
+    }
+
+    uint32_t pages = (length + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t base = mmap_find_space(pages);
+    if (!base) {
+        return 0;
+    }
+
+    for (int i = 0; i < MMAP_MAX_REGIONS; i++) {
+        mmap_region_t *region = &mmap_regions[i];
+        if (!region->used) {
+            region->base = base;
+            region->pages = pages;
+            region->first_page = offset / PAGE_SIZE;
+            region->node = node;
+            region->owner = loader_get_depth();
+            region->used = true;
+            fs_node_get(node);
+            return base;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Remove a mapping
+ */
+int mmap_unmap(uint32_t addr) {
+    mmap_region_t *region = mmap_find(addr);
+    if (!region || region->base != addr) {
+        return -1;
+    }
+
+    /* Release the page cache pages that were faulted in */
+    for (uint32_t i = 0; i < region->pages; i++) {
+        uint32_t virt = region->base + i * PAGE_SIZE;
+        uint32_t phys;
+        if (paging_get_mapping(virt, &phys)) {
+            fs_page_put((uint8_t *)phys);
+            paging_unmap(virt);
+        }
+    }
+
+    fs_node_put(region->node);
+    memset(region, 0, sizeof(mmap_region_t));
+    return 0;
+}
+
+/**
+ * Remove the mappings made at a nesting level and deeper
+ */
+void mmap_unmap_from(uint32_t level) {
+    for (int i = 0; i < MMAP_MAX_REGIONS; i++) {
+        if (mmap_regions[i].used && mmap_regions[i].owner >= level) {
+            mmap_unmap(mmap_regions[i].base);
+        }
+    }
+}
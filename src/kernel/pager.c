@@ -0,0 +1,408 @@
+/**
+ * Program Pager Implementation
+ * Fills program pages on first access instead of at load time
+ *
+ * The loader describes each segment of a program and hands its pages to
+ * the pager, which unmaps the ones whose contents are not in place yet.
+ * The first access faults: pages with file contents are read from the
+ * program file (through the page cache where the filesystem has one),
+ * and pages holding only BSS map a shared zero page read-only until the
+ * first write, which gives them their own zeroed page. Program memory is
+ * identity mapped, so a filled page is simply mapped to itself again.
+ * Startup thus costs the pages a program touches, not its image size.
+ *
+ * Each nesting level has its own description, so a suspended parent keeps
+ * filling its pages after the child exits. Pages not handed to any level
+ * stay ordinary identity-mapped memory.
+ */
+
+#include <pager.h>
+#include <paging.h>
+#include <string.h>
+#include <vga.h>
+
+/* Results of pager_fill() */
+#define PAGER_OK                0
+#define PAGER_ERR_UNMAPPED      -1      /* Not in a segment */
+#define PAGER_ERR_READONLY      -2      /* Write to a read-only segment */
+#define PAGER_ERR_READ          -3      /* File could not be read */
+
+static pager_space_t pager_spaces[LOADER_MAX_DEPTH];
+
+/* Shared page backing untouched BSS */
+static uint8_t pager_zero_page[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+
+/**
+ * Get the description of a nesting level
+ * @return Description, or NULL if there is none for the level
+ */
+static pager_space_t *pager_space(uint32_t level) {
+    if (level == 0 || level > LOADER_MAX_DEPTH) {
+        return NULL;
+    }
+    return &pager_spaces[level - 1];
+}
+
+/**
+ * Fill a page of a program, or make it writable
+ * @param page: Page address
+ * @param write: Page must be writable afterwards
+ * @return PAGER_OK or a PAGER_ERR_* code
+ */
+static int pager_fill(pager_space_t *space, uint32_t page, bool write) {
+    uint32_t entry = paging_get_entry(page);
+    bool in_segment = false;
+    bool has_file = false;
+    bool writable = false;
+
+    if ((entry & PAGE_PRESENT) && (!write || (entry & PAGE_WRITE))) {
+        return PAGER_OK;
+    }
+
+    for (uint32_t i = 0; i < space->segment_count; i++) {
+        pager_segment_t *seg = &space->segments[i];
+        if (seg->start < page + PAGE_SIZE && seg->end > page) {
+            in_segment = true;
+            writable = writable || seg->writable;
+        }
+        if (seg->start < page + PAGE_SIZE && seg->file_end > page) {
+            has_file = true;
+        }
+    }
+
+    if (!in_segment) {
+        return PAGER_ERR_UNMAPPED;
+    }
+    if (write && !writable) {
+        return PAGER_ERR_READONLY;
+    }
+
+    /* First write to a shared zero page */
+    if (entry & PAGE_PRESENT) {
+        if ((entry & ~0xFFF) != (uint32_t)pager_zero_page) {
+            return PAGER_ERR_READONLY;
+        }
+        paging_map(page, page, PAGE_WRITE);
+        memset((void *)page, 0, PAGE_SIZE);
+        space->stats.bytes_zeroed += PAGE_SIZE;
+        return PAGER_OK;
+    }
+
+    space->stats.pages_filled++;
+
+    /* BSS only: share the zero page until it is written */
+    if (!has_file) {
+        if (write) {
+            paging_map(page, page, PAGE_WRITE);
+            memset((void *)page, 0, PAGE_SIZE);
+            space->stats.bytes_zeroed += PAGE_SIZE;
+        } else {
+            paging_map(page, (uint32_t)pager_zero_page, 0);
+        }
+        return PAGER_OK;
+    }
+
+    paging_map(page, page, PAGE_WRITE);
+    memset((void *)page, 0, PAGE_SIZE);
+
+    for (uint32_t i = 0; i < space->segment_count; i++) {
+        pager_segment_t *seg = &space->segments[i];
+        if (seg->resident || seg->start >= page + PAGE_SIZE || seg->file_end <= page) {
+            continue;
+        }
+
+        uint32_t from = seg->start > page ? seg->start : page;
+        uint32_t to = seg->file_end < page + PAGE_SIZE ? seg->file_end : page + PAGE_SIZE;
+        int bytes_read = fs_read(space->node, seg->offset + (from - seg->start), to - from,
+                                 (uint8_t *)from);
+        if (bytes_read != (int)(to - from)) {
+            paging_unmap(page);
+            return PAGER_ERR_READ;
+        }
+        space->stats.bytes_read += to - from;
+    }
+
+    if (!writable) {
+        paging_map(page, page, 0);
+    }
+    return PAGER_OK;
+}
+
+/**
+ * Page fault handler for the program area
+ */
+static int pager_fault(uint32_t addr, uint32_t err) {
+    pager_space_t *space = pager_space(loader_get_depth());
+    if (!space || !space->active) {
+        return 0;
+    }
+
+    int ret = pager_fill(space, addr & ~(PAGE_SIZE - 1), (err & PF_ERR_WRITE) != 0);
+    if (ret == PAGER_OK) {
+        return 1;
+    }
+
+    vga_set_color(VGA_COLOR_ERROR, VGA_COLOR_BLACK);
+    if (ret == PAGER_ERR_READONLY) {
+        vga_print("Error: Write to read-only program memory at 0x");
+    } else if (ret == PAGER_ERR_READ) {
+        vga_print("Error: Failed to read program page at 0x");
+    } else {
+        vga_print("Error: Access to unmapped program address 0x");
+    }
+    vga_print_hex(addr);
+    vga_print("\n");
+    vga_set_color(VGA_COLOR_NORMAL, VGA_COLOR_BLACK);
+
+    /* Terminate the program; does not return */
+    loader_exit(-1);
+    return 0;
+}
+
+/**
+ * Initialize the pager
+ */
+void pager_init(void) {
+    memset(pager_spaces, 0, sizeof(pager_spaces));
+    memset(pager_zero_page, 0, sizeof(pager_zero_page));
+    paging_register_fault_handler(PROGRAM_LOAD_ADDR, PROGRAM_AREA_END, pager_fault);
+}
+
+/**
+ * Start describing the program of a nesting level
+ */
+void pager_begin(uint32_t level) {
+    pager_release(level);
+}
+
+/**
+ * Add a loadable segment
+ */
+void pager_add_segment(uint32_t level, const elf32_phdr_t *phdr, fs_node_t *node) {
+    pager_space_t *space = pager_space(level);
+    if (!space || space->segment_count >= LOADER_MAX_PHDRS) {
+        return;
+    }
+
+    pager_segment_t *seg = &space->segments[space->segment_count++];
+    seg->start = phdr->p_vaddr;
+    seg->file_end = phdr->p_vaddr + phdr->p_filesz;
+    seg->end = phdr->p_vaddr + phdr->p_memsz;
+    seg->offset = phdr->p_offset;
+    seg->writable = (phdr->p_flags & PF_W) != 0;
+    seg->resident = (node == NULL);
+
+    if (node && !space->node) {
+        fs_node_get(node);
+        space->node = node;
+    }
+}
+
+/**
+ * Hand the pages of the added segments to the pager
+ */
+void pager_start(uint32_t level) {
+    pager_space_t *space = pager_space(level);
+    if (!space || space->segment_count == 0) {
+        return;
+    }
+
+    uint32_t first = PROGRAM_AREA_END;
+    uint32_t end = PROGRAM_LOAD_ADDR;
+    for (uint32_t i = 0; i < space->segment_count; i++) {
+        if (space->segments[i].start < first) {
+            first = space->segments[i].start;
+        }
+        if (space->segments[i].end > end) {
+            end = space->segments[i].end;
+        }
+    }
+    space->first_page = first & ~(PAGE_SIZE - 1);
+    space->end_page = (end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+
+    /* A program's segments are either all in place or all read from its
+     * file, so no page mixes the two */
+    for (uint32_t page = space->first_page; page < space->end_page; page += PAGE_SIZE) {
+        bool in_segment = false;
+        bool resident = false;
+        bool writable = false;
+
+        for (uint32_t i = 0; i < space->segment_count; i++) {
+            pager_segment_t *seg = &space->segments[i];
+            if (seg->start < page + PAGE_SIZE && seg->end > page) {
+                in_segment = true;
+                writable = writable || seg->writable;
+            }
+            if (seg->resident && seg->start < page + PAGE_SIZE && seg->file_end > page) {
+                resident = true;
+            }
+        }
+
+        if (!in_segment) {
+            continue;
+        }
+
+        if (!resident) {
+            paging_unmap(page);
+            continue;
+        }
+
+        /* Contents in place: zero the BSS sharing the page */
+        paging_map(page, page, PAGE_WRITE);
+        for (uint32_t i = 0; i < space->segment_count; i++) {
+            pager_segment_t *seg = &space->segments[i];
+            uint32_t from = seg->file_end > page ? seg->file_end : page;
+            uint32_t to = seg->end < page + PAGE_SIZE ? seg->end : page + PAGE_SIZE;
+            if (from < to) {
+                memset((void *)from, 0, to - from);
+                space->stats.bytes_zeroed += to - from;
+            }
+        }
+
+        if (!writable) {
+            paging_map(page, page, 0);
+        }
+    }
+
+    space->active = true;
+}
+
+/**
+ * Give the pages of a level back as ordinary memory
+ */
+void pager_release(uint32_t level) {
+    pager_space_t *space = pager_space(level);
+    if (!space) {
+        return;
+    }
+
+    if (space->active) {
+        for (uint32_t page = space->first_page; page < space->end_page; page += PAGE_SIZE) {
+            paging_map(page, page, PAGE_WRITE);
+        }
+    }
+
+    if (space->node) {
+        fs_node_put(space->node);
+    }
+    memset(space, 0, sizeof(pager_space_t));
+}
+
+/**
+ * Make a range of the running program present
+ */
+int pager_prefault(uint32_t addr, uint32_t size, bool write) {
+    return pager_fill_range(loader_get_depth(), addr, size, write);
+}
+
+/**
+ * Make a range of the program at a nesting level present
+ */
+int pager_fill_range(uint32_t level, uint32_t addr, uint32_t size, bool write) {
+    pager_space_t *space = pager_space(level);
+    if (!space || !space->active || size == 0) {
+        return 0;
+    }
+
+    if (addr + size < addr) {
+        return -1;
+    }
+
+    uint32_t first = addr & ~(PAGE_SIZE - 1);
+    if (first < space->first_page) {
+        first = space->first_page;
+    }
+    uint32_t end = addr + size;
+    if (end > space->end_page) {
+        end = space->end_page;
+    }
+
+    for (uint32_t page = first; page < end; page += PAGE_SIZE) {
+        uint32_t entry = paging_get_entry(page);
+        if ((entry & PAGE_PRESENT) && (!write || (entry & PAGE_WRITE))) {
+            continue;
+        }
+        if (pager_fill(space, page, write) != PAGER_OK) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Get the work done for a level
+ */
+void pager_get_stats(uint32_t level, pager_stats_t *stats) {
+    pager_space_t *space = pager_space(level);
+    if (space) {
+        memcpy(stats, &space->stats, sizeof(pager_stats_t));
+    } else {
+        memset(stats, 0, sizeof(pager_stats_t));
+    }
+}
+
+/**
+ * Save the pages of a range
+ */
+int pager_save(uint32_t start, uint32_t end, uint8_t *dst, uint32_t capacity) {
+    uint32_t first = start & ~(PAGE_SIZE - 1);
+    uint32_t last = (end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    uint32_t pages = (last - first) / PAGE_SIZE;
+    uint32_t filled = 0;
+
+    for (uint32_t page = first; page < last; page += PAGE_SIZE) {
+        uint32_t entry = paging_get_entry(page);
+        if ((entry & PAGE_PRESENT) && (entry & ~0xFFF) != (uint32_t)pager_zero_page) {
+            filled++;
+        }
+    }
+
+    /* Page table entries, then the contents of the filled pages */
+    uint32_t needed = pages * sizeof(uint32_t) + filled * PAGE_SIZE;
+    if (needed > capacity) {
+        return -1;
+    }
+
+    uint32_t *entries = (uint32_t *)dst;
+    uint8_t *data = dst + pages * sizeof(uint32_t);
+    for (uint32_t i = 0; i < pages; i++) {
+        uint32_t page = first + i * PAGE_SIZE;
+        entries[i] = paging_get_entry(page);
+        if ((entries[i] & PAGE_PRESENT) && (entries[i] & ~0xFFF) != (uint32_t)pager_zero_page) {
+            memcpy(data, (const void *)page, PAGE_SIZE);
+            data += PAGE_SIZE;
+        }
+        paging_map(page, page, PAGE_WRITE);
+    }
+
+    return (int)needed;
+}
+
+/**
+ * Restore a saved range
+ */
+void pager_restore(uint32_t start, uint32_t end, const uint8_t *src) {
+    uint32_t first = start & ~(PAGE_SIZE - 1);
+    uint32_t last = (end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    uint32_t pages = (last - first) / PAGE_SIZE;
+
+    const uint32_t *entries = (const uint32_t *)src;
+    const uint8_t *data = src + pages * sizeof(uint32_t);
+    for (uint32_t i = 0; i < pages; i++) {
+        uint32_t page = first + i * PAGE_SIZE;
+        uint32_t entry = entries[i];
+
+        if (!(entry & PAGE_PRESENT)) {
+            paging_unmap(page);
+            continue;
+        }
+
+        if ((entry & ~0xFFF) != (uint32_t)pager_zero_page) {
+            paging_map(page, page, PAGE_WRITE);
+            memcpy((void *)page, data, PAGE_SIZE);
+            data += PAGE_SIZE;
+        }
+        paging_map(page, entry & ~0xFFF, entry & 0xFFF);
+    }
+}
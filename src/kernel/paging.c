@@ -0,0 +1,359 @@
+/**
+ * Paging Implementation
+ * x86 two-level paging with an identity-mapped kernel view
+ *
+ * Everything the kernel and programs use today (kernel image, program
+ * area, VGA memory, caches) lives in the identity-mapped low memory, so
+ * existing pointers keep working. Other regions, such as the file mapping
+ * window, get their own page tables and are filled in on page faults.
+ *
+ * On CPUs with PSE, each 4MB of the identity map that is entirely RAM
+ * above the first is one large page, so the kernel's caches and heap cost
+ * one TLB entry per 4MB. The first 4MB always uses a page table, since it
+ * mixes RAM with VGA memory and ROM of other memory types. A large page is
+ * split into its page table when a page of it is mapped differently (the
+ * pager does this for the program area). With PAT, the PAT entry selected
+ * by PAGE_WRITETHROUGH becomes write-combining for framebuffers.
+ */
+
+#include <paging.h>
+#include <kernel.h>
+#include <string.h>
+
+/* Number of page tables for the identity map */
+#define IDENTITY_TABLES     (PAGING_IDENTITY_SIZE / (1024 * PAGE_SIZE))
+
+/* Bytes mapped by a large page (or one page table) */
+#define LARGE_PAGE_SIZE     (1024 * PAGE_SIZE)
+
+/* CPUID leaf 1 EDX feature bits */
+#define CPUID_PSE           (1 << 3)
+#define CPUID_PGE           (1 << 13)
+#define CPUID_PAT           (1 << 16)
+
+/* CR4 bits */
+#define CR4_PSE             (1 << 4)
+#define CR4_PGE             (1 << 7)
+
+/* PAT: power-on layout (WB, WT, UC-, UC, twice) with entry 1 turned into
+ * write-combining (type 1) */
+#define MSR_PAT             0x277
+#define PAT_LOW             0x00070106
+#define PAT_HIGH            0x00070406
+
+/* Page directory and identity-map page tables */
+static uint32_t page_directory[1024] __attribute__((aligned(PAGE_SIZE)));
+static uint32_t identity_tables[IDENTITY_TABLES][1024] __attribute__((aligned(PAGE_SIZE)));
+
+/* Page fault regions */
+static struct {
+    uint32_t start;
+    uint32_t end;
+    page_fault_handler_t handler;
+} fault_regions[PAGING_MAX_FAULT_REGIONS];
+static int fault_region_count = 0;
+
+/* PAGING_FEATURE_* in use */
+static uint32_t paging_features = 0;
+
+/**
+ * Invalidate the TLB entry of one page
+ */
+static inline void paging_invlpg(uint32_t virt) {
+    __asm__ volatile ("invlpg (%0)" : : "r"(virt) : "memory");
+}
+
+/**
+ * Get the CPUID leaf 1 feature flags
+ * @return EDX feature bits, 0 if the CPU has no CPUID
+ */
+static uint32_t paging_cpu_features(void) {
+    uint32_t flags;
+    uint32_t toggled;
+
+    /* CPUID exists if the ID flag (bit 21) of EFLAGS can be changed */
+    __asm__ volatile (
+        "pushfl\n"
+        "popl %0\n"
+        "movl %0, %1\n"
+        "xorl $0x200000, %1\n"
+        "pushl %1\n"
+        "popfl\n"
+        "pushfl\n"
+        "popl %1\n"
+        "pushl %0\n"
+        "popfl\n"
+        : "=&r"(flags), "=&r"(toggled) : : "cc"
+    );
+    if (!((flags ^ toggled) & 0x200000)) {
+        return 0;
+    }
+
+    uint32_t eax = 1, ebx, ecx, edx;
+    __asm__ volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return edx;
+}
+
+/**
+ * Turn a large identity page into its page table, mapping the same
+ */
+static void paging_split(uint32_t index) {
+    uint32_t pde = page_directory[index];
+    uint32_t flags = pde & (PAGE_WRITE | PAGE_USER | PAGE_WRITETHROUGH |
+                            PAGE_NOCACHE | PAGE_GLOBAL);
+    uint32_t *table = identity_tables[index];
+
+    for (uint32_t i = 0; i < 1024; i++) {
+        table[i] = ((pde & ~(LARGE_PAGE_SIZE - 1)) + i * PAGE_SIZE) | flags | PAGE_PRESENT;
+    }
+    page_directory[index] = (uint32_t)table | PAGE_PRESENT | PAGE_WRITE;
+
+    /* Any address in the large page drops its TLB entry */
+    paging_invlpg(index * LARGE_PAGE_SIZE);
+}
+
+/**
+ * Get the page table entry for a virtual address
+ * A large page covering the address is split first.
+ * @return Entry pointer, or NULL if no page table covers the address
+ */
+static uint32_t *paging_get_pte(uint32_t virt) {
+    uint32_t pde = page_directory[virt >> 22];
+
+    if (!(pde & PAGE_PRESENT)) {
+        return NULL;
+    }
+
+    if (pde & PAGE_LARGE) {
+        paging_split(virt >> 22);
+        pde = page_directory[virt >> 22];
+    }
+
+    uint32_t *table = (uint32_t *)(pde & ~0xFFF);
+    return &table[(virt >> 12) & 0x3FF];
+}
+
+/**
+ * Get the mapping of a virtual page as a page table entry
+ * Large pages are described as the 4KB page the address falls in.
+ * @return Entry, 0 if nothing maps the page
+ */
+static uint32_t paging_lookup(uint32_t virt) {
+    uint32_t pde = page_directory[virt >> 22];
+
+    if (!(pde & PAGE_PRESENT)) {
+        return 0;
+    }
+
+    if (pde & PAGE_LARGE) {
+        return (pde & ~(LARGE_PAGE_SIZE - 1)) + (virt & (LARGE_PAGE_SIZE - 1) & ~0xFFF) +
+               (pde & 0x1FF & ~PAGE_LARGE);
+    }
+
+    uint32_t *table = (uint32_t *)(pde & ~0xFFF);
+    return table[(virt >> 12) & 0x3FF];
+}
+
+/**
+ * Page fault handler (exception 14)
+ */
+static int paging_fault(interrupt_frame_t *frame) {
+    uint32_t addr;
+    __asm__ volatile ("mov %%cr2, %0" : "=r"(addr));
+
+    for (int i = 0; i < fault_region_count; i++) {
+        if (addr >= fault_regions[i].start && addr < fault_regions[i].end) {
+            return fault_regions[i].handler(addr, frame->err_code);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Initialize paging
+ */
+void paging_init(void) {
+    uint32_t cpu = paging_cpu_features();
+    uint32_t global = 0;
+    uint32_t cr4;
+    mem_info_t mem;
+
+    memset(page_directory, 0, sizeof(page_directory));
+    fault_region_count = 0;
+    paging_features = 0;
+
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+    if (cpu & CPUID_PSE) {
+        cr4 |= CR4_PSE;
+        paging_features |= PAGING_FEATURE_LARGE;
+    }
+    if (cpu & CPUID_PGE) {
+        cr4 |= CR4_PGE;
+        global = PAGE_GLOBAL;
+        paging_features |= PAGING_FEATURE_GLOBAL;
+    }
+    __asm__ volatile ("mov %0, %%cr4" : : "r"(cr4));
+
+    /* Nothing is mapped through PAT entry 1 yet, so it can change now */
+    if (cpu & CPUID_PAT) {
+        __asm__ volatile ("wrmsr" : : "c"(MSR_PAT), "a"(PAT_LOW), "d"(PAT_HIGH));
+        paging_features |= PAGING_FEATURE_WC;
+    }
+
+    /* RAM is contiguous from 1MB up to the end of upper memory */
+    kernel_get_mem_info(&mem);
+    uint32_t ram_end = 0x100000 + mem.mem_upper * 1024;
+
+    /* Identity-map low memory */
+    for (uint32_t t = 0; t < IDENTITY_TABLES; t++) {
+        for (uint32_t i = 0; i < 1024; i++) {
+            uint32_t phys = (t * 1024 + i) * PAGE_SIZE;
+            identity_tables[t][i] = phys | PAGE_PRESENT | PAGE_WRITE | global;
+        }
+
+        if ((paging_features & PAGING_FEATURE_LARGE) && t > 0 &&
+            (t + 1) * LARGE_PAGE_SIZE <= ram_end) {
+            page_directory[t] = (t * LARGE_PAGE_SIZE) | PAGE_PRESENT | PAGE_WRITE |
+                                PAGE_LARGE | global;
+        } else {
+            page_directory[t] = (uint32_t)identity_tables[t] | PAGE_PRESENT | PAGE_WRITE;
+        }
+    }
+
+    isr_install_handler(14, paging_fault);
+
+    /* Load page directory, enable paging and write protection
+     * (so ring 0 writes to read-only pages fault as well) */
+    __asm__ volatile (
+        "mov %0, %%cr3\n"
+        "mov %%cr0, %%eax\n"
+        "or $0x80010000, %%eax\n"
+        "mov %%eax, %%cr0\n"
+        : : "r"(page_directory) : "eax", "memory"
+    );
+}
+
+/**
+ * Get the paging features in use
+ */
+uint32_t paging_get_features(void) {
+    return paging_features;
+}
+
+/**
+ * Make an identity-mapped range write-combining or default
+ */
+int paging_set_write_combining(uint32_t start, uint32_t end, bool enable) {
+    if (!(paging_features & PAGING_FEATURE_WC) || start >= end || end > PAGING_IDENTITY_SIZE) {
+        return -1;
+    }
+
+    for (uint32_t page = start & ~(PAGE_SIZE - 1); page < end; page += PAGE_SIZE) {
+        uint32_t *pte = paging_get_pte(page);
+        if (!pte || !(*pte & PAGE_PRESENT)) {
+            continue;
+        }
+        *pte &= ~(PAGE_WRITETHROUGH | PAGE_NOCACHE);
+        if (enable) {
+            *pte |= PAGE_WRITECOMBINE;
+        }
+        paging_invlpg(page);
+    }
+
+    /* No line of the range may stay cached under the old type */
+    __asm__ volatile ("wbinvd" : : : "memory");
+
+    return 0;
+}
+
+/**
+ * Provide page tables for a virtual region
+ */
+int paging_add_tables(uint32_t start, uint32_t *tables, uint32_t count) {
+    uint32_t first = start >> 22;
+
+    if ((start & 0x3FFFFF) || first + count > 1024) {
+        return -1;
+    }
+
+    for (uint32_t t = 0; t < count; t++) {
+        if (page_directory[first + t] & PAGE_PRESENT) {
+            return -1;
+        }
+    }
+
+    for (uint32_t t = 0; t < count; t++) {
+        uint32_t *table = tables + t * 1024;
+        memset(table, 0, PAGE_SIZE);
+        page_directory[first + t] = (uint32_t)table | PAGE_PRESENT | PAGE_WRITE;
+    }
+
+    return 0;
+}
+
+/**
+ * Map a virtual page to a physical page
+ */
+int paging_map(uint32_t virt, uint32_t phys, uint32_t flags) {
+    uint32_t *pte = paging_get_pte(virt);
+    if (!pte) {
+        return -1;
+    }
+
+    *pte = (phys & ~0xFFF) | (flags & 0xFFF) | PAGE_PRESENT;
+    paging_invlpg(virt);
+
+    return 0;
+}
+
+/**
+ * Unmap a virtual page
+ */
+void paging_unmap(uint32_t virt) {
+    uint32_t *pte = paging_get_pte(virt);
+    if (pte) {
+        *pte = 0;
+        paging_invlpg(virt);
+    }
+}
+
+/**
+ * Get the physical address a virtual page is mapped to
+ */
+int paging_get_mapping(uint32_t virt, uint32_t *phys) {
+    uint32_t entry = paging_lookup(virt);
+
+    if (!(entry & PAGE_PRESENT)) {
+        return 0;
+    }
+
+    if (phys) {
+        *phys = (entry & ~0xFFF) | (virt & 0xFFF);
+    }
+
+    return 1;
+}
+
+/**
+ * Get the page table entry of a virtual page
+ */
+uint32_t paging_get_entry(uint32_t virt) {
+    return paging_lookup(virt);
+}
+
+/**
+ * Register a page fault handler for a virtual region
+ */
+int paging_register_fault_handler(uint32_t start, uint32_t end, page_fault_handler_t handler) {
+    if (!handler || fault_region_count >= PAGING_MAX_FAULT_REGIONS) {
+        return -1;
+    }
+
+    fault_regions[fault_region_count].start = start;
+    fault_regions[fault_region_count].end = end;
+    fault_regions[fault_region_count].handler = handler;
+    fault_region_count++;
+
+    return 0;
+}
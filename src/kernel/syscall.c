@@ -3,12 +3,17 @@
  * Provides system call interface for userspace programs
  */
 
+#include <aio.h>
 #include <fs.h>
 #include <ide.h>
 #include <idt.h>
+#include <imgcache.h>
 #include <kernel.h>
 #include <keyboard.h>
+#include <kmalloc.h>
 #include <loader.h>
+#include <mmap.h>
+#include <pager.h>
 #include <pci.h>
 #include <pit.h>
 #include <speaker.h>
@@ -45,10 +50,33 @@ static int sys_vga_palette(uint32_t index, uint32_t rgb, uint32_t unused);
 static int sys_ideinfo(uint32_t drive, uint32_t buf, uint32_t unused);
 static int sys_pciinfo(uint32_t index, uint32_t buf, uint32_t unused);
 static int sys_meminfo(uint32_t buf, uint32_t unused1, uint32_t unused2);
-static int sys_fopen(uint32_t path, uint32_t unused1, uint32_t unused2);
+static int sys_fopen(uint32_t path, uint32_t flags, uint32_t unused);
 static int sys_fclose(uint32_t fd, uint32_t unused1, uint32_t unused2);
 static int sys_fread(uint32_t fd, uint32_t buf, uint32_t size);
 static int sys_fsize(uint32_t fd, uint32_t unused1, uint32_t unused2);
+static int sys_stat(uint32_t path, uint32_t buf, uint32_t unused);
+static int sys_fstat(uint32_t fd, uint32_t buf, uint32_t unused);
+static int sys_uptime(uint32_t unused1, uint32_t unused2, uint32_t unused3);
+static int sys_fsstats(uint32_t buf, uint32_t reset, uint32_t unused);
+static int sys_realpath(uint32_t path, uint32_t buf, uint32_t size);
+static int sys_mmap(uint32_t fd, uint32_t offset, uint32_t length);
+static int sys_munmap(uint32_t addr, uint32_t unused1, uint32_t unused2);
+static int sys_lseek(uint32_t fd, uint32_t offset, uint32_t whence);
+static int sys_pread(uint32_t fd, uint32_t args, uint32_t unused);
+static int sys_fwrite(uint32_t fd, uint32_t buf, uint32_t size);
+static int sys_mkdir(uint32_t path, uint32_t unused1, uint32_t unused2);
+static int sys_unlink(uint32_t path, uint32_t unused1, uint32_t unused2);
+static int sys_ftruncate(uint32_t fd, uint32_t length, uint32_t unused);
+static int sys_getmount(uint32_t index, uint32_t buf, uint32_t unused);
+static int sys_sendfile(uint32_t out_fd, uint32_t args, uint32_t unused);
+static int sys_aread(uint32_t fd, uint32_t args, uint32_t unused);
+static int sys_poll_completion(uint32_t buf, uint32_t unused1, uint32_t unused2);
+static int sys_wait_completion(uint32_t buf, uint32_t unused1, uint32_t unused2);
+static int sys_imgcache(uint32_t index, uint32_t buf, uint32_t unused);
+static int sys_execprof(uint32_t index, uint32_t buf, uint32_t unused);
+static int sys_kmemstat(uint32_t index, uint32_t buf, uint32_t unused);
+static int sys_vga_blit(uint32_t packed_xy, uint32_t packed_wh, uint32_t pixels);
+static int sys_vga_wc(uint32_t enable, uint32_t unused1, uint32_t unused2);
 
 /* Maximum open files */
 #define MAX_OPEN_FILES  16
@@ -57,8 +85,14 @@ static int sys_fsize(uint32_t fd, uint32_t unused1, uint32_t unused2);
 static struct {
     fs_node_t *node;    /* File node or NULL if slot is free */
     uint32_t offset;    /* Current read/write position */
+    uint32_t flags;     /* FS_OPEN_* flags */
+    uint32_t owner;     /* Nesting level of the program that opened it */
 } open_files[MAX_OPEN_FILES];
 
+/* SYS_SENDFILE bounce buffer for files that bypass the page cache */
+#define SENDFILE_CHUNK  16384
+static uint8_t sendfile_buf[SENDFILE_CHUNK];
+
 /* System call table */
 static syscall_fn syscall_table[NUM_SYSCALLS] = {
     [SYS_EXIT]    = sys_exit,
@@ -89,6 +123,29 @@ static syscall_fn syscall_table[NUM_SYSCALLS] = {
     [SYS_IDEINFO]      = sys_ideinfo,
     [SYS_PCIINFO]      = sys_pciinfo,
     [SYS_MEMINFO]      = sys_meminfo,
+    [SYS_STAT]         = sys_stat,
+    [SYS_FSTAT]        = sys_fstat,
+    [SYS_UPTIME]       = sys_uptime,
+    [SYS_FSSTATS]      = sys_fsstats,
+    [SYS_REALPATH]     = sys_realpath,
+    [SYS_MMAP]         = sys_mmap,
+    [SYS_MUNMAP]       = sys_munmap,
+    [SYS_LSEEK]        = sys_lseek,
+    [SYS_PREAD]        = sys_pread,
+    [SYS_FWRITE]       = sys_fwrite,
+    [SYS_MKDIR]        = sys_mkdir,
+    [SYS_UNLINK]       = sys_unlink,
+    [SYS_FTRUNCATE]    = sys_ftruncate,
+    [SYS_GETMOUNT]     = sys_getmount,
+    [SYS_SENDFILE]     = sys_sendfile,
+    [SYS_AREAD]        = sys_aread,
+    [SYS_POLL_COMPLETION] = sys_poll_completion,
+    [SYS_WAIT_COMPLETION] = sys_wait_completion,
+    [SYS_IMGCACHE]     = sys_imgcache,
+    [SYS_EXECPROF]     = sys_execprof,
+    [SYS_KMEMSTAT]     = sys_kmemstat,
+    [SYS_VGA_BLIT]     = sys_vga_blit,
+    [SYS_VGA_WC]       = sys_vga_wc,
 };
 
 /**
@@ -170,32 +227,14 @@ static int sys_getchar(uint32_t unused1, uint32_t unused2, uint32_t unused3) {
 
 /**
  * SYS_EXEC - Execute a program
- * Returns exit code on success, negative on error
- * The executed program runs and returns when it calls exit()
+ * Returns the child's exit code, -1 if it could not be loaded
+ * The caller is suspended while the child runs and continues afterwards
  */
 static int sys_exec(uint32_t path, uint32_t unused1, uint32_t unused2) {
     (void)unused1;
     (void)unused2;
     
-    const char *prog_path = (const char *)path;
-    program_t prog;
-    
-    /* Save current program as parent before loading child */
-    program_t *current = loader_get_current();
-    if (current != NULL) {
-        loader_set_parent(current->name);
-    }
-    
-    if (loader_load(prog_path, &prog) != 0) {
-        return -1;
-    }
-    
-    /* Execute the program - this will NOT return! 
-     * When child exits, loader_exit will restart the parent */
-    loader_exec(&prog);
-    
-    /* Never reached - parent restarts from beginning */
-    return 0;
+    return loader_run((const char *)path);
 }
 
 /**
@@ -445,6 +484,47 @@ static int sys_vga_palette(uint32_t index, uint32_t rgb, uint32_t unused) {
     return 0;
 }
 
+/**
+ * SYS_VGA_BLIT - Copy a block of pixels to the screen (modes 13h, X, Y)
+ * @param packed_xy: x | (y << 16), each a signed 16-bit value
+ * @param packed_wh: w | (h << 16)
+ * @param pixels: w * h color indices, row by row
+ * @return: 0 on success, -1 if not in a 256-color mode, the block is empty
+ *          or pixels is invalid
+ */
+static int sys_vga_blit(uint32_t packed_xy, uint32_t packed_wh, uint32_t pixels) {
+    int mode = vga_gfx_get_mode();
+    int x = (int16_t)(packed_xy & 0xFFFF);
+    int y = (int16_t)(packed_xy >> 16);
+    int w = (int)(packed_wh & 0xFFFF);
+    int h = (int)(packed_wh >> 16);
+    
+    if (mode != VGA_MODE_13H && mode != VGA_MODE_X && mode != VGA_MODE_Y) {
+        return -1;
+    }
+    if (w == 0 || h == 0) {
+        return -1;
+    }
+    if (!pixels || pager_prefault(pixels, (uint32_t)w * (uint32_t)h, false) < 0) {
+        return -1;
+    }
+    
+    vga_gfx_blit(x, y, w, h, (const uint8_t *)pixels);
+    return 0;
+}
+
+/**
+ * SYS_VGA_WC - Enable/disable write-combining video memory
+ * @param enable: Nonzero to map the 256-color modes write-combining
+ * @return: 0 on success, -1 if the CPU cannot write-combine
+ */
+static int sys_vga_wc(uint32_t enable, uint32_t unused1, uint32_t unused2) {
+    (void)unused1;
+    (void)unused2;
+    
+    return vga_gfx_set_write_combining(enable != 0);
+}
+
 /**
  * SYS_IDEINFO - Get IDE device information
  * @param drive: Drive number (0-3), or 0xFF to get drive count
@@ -559,14 +639,72 @@ static int sys_meminfo(uint32_t buf, uint32_t unused1, uint32_t unused2) {
     return 0;
 }
 
+/**
+ * SYS_IMGCACHE - Get program image cache status or a cached image
+ * @param index: Image index, or IMGCACHE_INFO_STATUS for the status
+ * @param buf: Pointer to imgcache_image_info_t (or imgcache_info_t) to fill
+ * @return: 0 on success, -1 past the last image
+ */
+static int sys_imgcache(uint32_t index, uint32_t buf, uint32_t unused) {
+    (void)unused;
+    
+    if (!buf) {
+        return -1;
+    }
+    
+    if (index == IMGCACHE_INFO_STATUS) {
+        imgcache_get_info((imgcache_info_t *)buf);
+        return 0;
+    }
+    
+    return imgcache_get_image(index, (imgcache_image_info_t *)buf);
+}
+
+/**
+ * SYS_EXECPROF - Get a recent program startup profile
+ * @param index: 0 for the most recent, up to LOADER_PROFILES - 1
+ * @param buf: Pointer to loader_profile_t to fill
+ * @return: 0 on success, -1 past the last recorded profile
+ */
+static int sys_execprof(uint32_t index, uint32_t buf, uint32_t unused) {
+    (void)unused;
+    
+    if (!buf) {
+        return -1;
+    }
+    
+    return loader_get_profile(index, (loader_profile_t *)buf);
+}
+
+/**
+ * SYS_KMEMSTAT - Get kernel object cache statistics
+ * @param index: Cache index, from 0 (the last entry covers kmalloc()
+ *               blocks too large for a cache)
+ * @param buf: Pointer to kmem_cache_info_t to fill
+ * @return: 0 on success, -1 past the last entry
+ */
+static int sys_kmemstat(uint32_t index, uint32_t buf, uint32_t unused) {
+    (void)unused;
+    
+    if (!buf) {
+        return -1;
+    }
+    
+    return kmem_get_cache_info(index, (kmem_cache_info_t *)buf);
+}
+
 /**
  * SYS_FOPEN - Open a file
  * @param path: Path to the file
+ * @param flags: FS_OPEN_* flags (0 opens for reading)
  * @return: File descriptor (3+) on success, -1 on error
  */
-static int sys_fopen(uint32_t path, uint32_t unused1, uint32_t unused2) {
-    (void)unused1;
-    (void)unused2;
+static int sys_fopen(uint32_t path, uint32_t flags, uint32_t unused) {
+    (void)unused;
+    
+    if (flags == 0) {
+        flags = FS_OPEN_READ;
+    }
     
     const char *file_path = (const char *)path;
     
@@ -583,8 +721,11 @@ static int sys_fopen(uint32_t path, uint32_t unused1, uint32_t unused2) {
         return -1;  /* No free file descriptors */
     }
     
-    /* Resolve path to node */
+    /* Resolve path to node, creating the file if asked to */
     fs_node_t *node = fs_namei(file_path);
+    if (!node && (flags & FS_OPEN_CREATE)) {
+        node = fs_create(file_path, FS_FILE);
+    }
     if (!node) {
         return -1;  /* File not found */
     }
@@ -594,17 +735,45 @@ static int sys_fopen(uint32_t path, uint32_t unused1, uint32_t unused2) {
         return -1;  /* Cannot open directories with fopen */
     }
     
-    /* Open the file */
+    /* Writing needs a writable filesystem */
+    if ((flags & FS_OPEN_WRITE) && !node->write) {
+        return -1;
+    }
+    
+    if ((flags & FS_OPEN_TRUNC) && (flags & FS_OPEN_WRITE)) {
+        if (fs_truncate(node, 0) != FS_OK) {
+            return -1;
+        }
+    }
+    
+    /* Open the file and keep its node in the path cache while open */
     fs_open(node);
+    fs_node_get(node);
     
     /* Store in file descriptor table */
     int idx = fd - 3;
     open_files[idx].node = node;
     open_files[idx].offset = 0;
+    open_files[idx].flags = flags;
+    open_files[idx].owner = loader_get_depth();
     
     return fd;
 }
 
+/**
+ * Close an open file descriptor slot and release its node
+ */
+static void syscall_close_slot(int idx) {
+    fs_close(open_files[idx].node);
+    fs_node_put(open_files[idx].node);
+    
+    /* Clear the slot */
+    open_files[idx].node = NULL;
+    open_files[idx].offset = 0;
+    open_files[idx].flags = 0;
+    open_files[idx].owner = 0;
+}
+
 /**
  * SYS_FCLOSE - Close a file
  * @param fd: File descriptor
@@ -624,16 +793,21 @@ static int sys_fclose(uint32_t fd, uint32_t unused1, uint32_t unused2) {
         return -1;  /* Not open */
     }
     
-    /* Close the file */
-    fs_close(open_files[idx].node);
-    
-    /* Clear the slot */
-    open_files[idx].node = NULL;
-    open_files[idx].offset = 0;
-    
+    syscall_close_slot(idx);
     return 0;
 }
 
+/**
+ * Close the files opened at a nesting level and deeper
+ */
+void syscall_close_from(uint32_t level) {
+    for (int i = 0; i < MAX_OPEN_FILES; i++) {
+        if (open_files[i].node != NULL && open_files[i].owner >= level) {
+            syscall_close_slot(i);
+        }
+    }
+}
+
 /**
  * SYS_FREAD - Read from a file
  * @param fd: File descriptor
@@ -652,9 +826,18 @@ static int sys_fread(uint32_t fd, uint32_t buf, uint32_t size) {
         return -1;  /* Not open */
     }
     
+    if (!(open_files[idx].flags & FS_OPEN_READ)) {
+        return -1;  /* Opened write-only */
+    }
+    
     fs_node_t *node = open_files[idx].node;
     uint8_t *buffer = (uint8_t *)buf;
     
+    /* Fill the buffer pages before the driver writes to them */
+    if (pager_prefault(buf, size, true) < 0) {
+        return -1;
+    }
+    
     /* Read from current offset */
     int bytes_read = fs_read(node, open_files[idx].offset, size, buffer);
     
@@ -687,6 +870,525 @@ static int sys_fsize(uint32_t fd, uint32_t unused1, uint32_t unused2) {
     return (int)open_files[idx].node->length;
 }
 
+/**
+ * SYS_STAT - Get file status by path
+ * Does not take a file descriptor slot
+ * @param path: Path to the file or directory
+ * @param buf: Buffer to store fs_stat_t structure
+ * @return: 0 on success, -1 on error
+ */
+static int sys_stat(uint32_t path, uint32_t buf, uint32_t unused) {
+    (void)unused;
+    
+    if (!path || !buf) {
+        return -1;
+    }
+    
+    fs_node_t *node = fs_namei((const char *)path);
+    if (!node) {
+        return -1;  /* Not found */
+    }
+    
+    return (fs_stat(node, (fs_stat_t *)buf) == FS_OK) ? 0 : -1;
+}
+
+/**
+ * SYS_FSTAT - Get file status by file descriptor
+ * @param fd: File descriptor
+ * @param buf: Buffer to store fs_stat_t structure
+ * @return: 0 on success, -1 on error
+ */
+static int sys_fstat(uint32_t fd, uint32_t buf, uint32_t unused) {
+    (void)unused;
+    
+    /* Validate file descriptor */
+    if (fd < 3 || fd >= 3 + MAX_OPEN_FILES || !buf) {
+        return -1;
+    }
+    
+    int idx = fd - 3;
+    if (open_files[idx].node == NULL) {
+        return -1;  /* Not open */
+    }
+    
+    return (fs_stat(open_files[idx].node, (fs_stat_t *)buf) == FS_OK) ? 0 : -1;
+}
+
+/**
+ * SYS_UPTIME - Get time since boot in microseconds
+ * @return: Microseconds since the PIT was initialized (wraps after ~71 min)
+ */
+static int sys_uptime(uint32_t unused1, uint32_t unused2, uint32_t unused3) {
+    (void)unused1;
+    (void)unused2;
+    (void)unused3;
+    
+    return (int)pit_get_micros();
+}
+
+/**
+ * SYS_FSSTATS - Get VFS I/O statistics
+ * @param buf: Buffer to store fs_io_stats_t structure (may be NULL)
+ * @param reset: Non-zero to reset the counters after reading them
+ * @return: 0 on success
+ */
+static int sys_fsstats(uint32_t buf, uint32_t reset, uint32_t unused) {
+    (void)unused;
+    
+    if (buf) {
+        fs_get_io_stats((fs_io_stats_t *)buf);
+    }
+    
+    if (reset) {
+        fs_reset_io_stats();
+    }
+    
+    return 0;
+}
+
+/**
+ * SYS_REALPATH - Resolve a path to its normalized absolute form
+ * Resolves ".", ".." and repeated slashes, and uses the names as
+ * stored on the filesystem
+ * @param path: Path to resolve
+ * @param buf: Buffer to store the resolved path
+ * @param size: Buffer size
+ * @return: 0 on success, -1 if not found or the buffer is too small
+ */
+static int sys_realpath(uint32_t path, uint32_t buf, uint32_t size) {
+    if (!path || !buf) {
+        return -1;
+    }
+    
+    fs_node_t *node = fs_namei((const char *)path);
+    if (!node) {
+        return -1;
+    }
+    
+    return (fs_realpath(node, (char *)buf, size) == FS_OK) ? 0 : -1;
+}
+
+/**
+ * SYS_MMAP - Map an open file into memory (read-only)
+ * Pages are loaded on first access; the mapping stays valid after the
+ * file is closed, until munmap or program exit
+ * @param fd: File descriptor
+ * @param offset: File offset (multiple of 4096)
+ * @param length: Bytes to map (0 maps up to end of file)
+ * @return: Address of the mapping, or 0 on error
+ */
+static int sys_mmap(uint32_t fd, uint32_t offset, uint32_t length) {
+    /* Validate file descriptor */
+    if (fd < 3 || fd >= 3 + MAX_OPEN_FILES) {
+        return 0;
+    }
+    
+    int idx = fd - 3;
+    if (open_files[idx].node == NULL) {
+        return 0;  /* Not open */
+    }
+    
+    return (int)mmap_file(open_files[idx].node, offset, length);
+}
+
+/**
+ * SYS_MUNMAP - Remove a file mapping
+ * @param addr: Address returned by SYS_MMAP
+ * @return: 0 on success, -1 on error
+ */
+static int sys_munmap(uint32_t addr, uint32_t unused1, uint32_t unused2) {
+    (void)unused1;
+    (void)unused2;
+    
+    return mmap_unmap(addr);
+}
+
+/**
+ * SYS_LSEEK - Set file position
+ * @param fd: File descriptor
+ * @param offset: Signed offset relative to whence
+ * @param whence: FS_SEEK_SET, FS_SEEK_CUR or FS_SEEK_END
+ * @return: New position, or -1 on error
+ */
+static int sys_lseek(uint32_t fd, uint32_t offset, uint32_t whence) {
+    /* Validate file descriptor */
+    if (fd < 3 || fd >= 3 + MAX_OPEN_FILES) {
+        return -1;
+    }
+    
+    int idx = fd - 3;
+    if (open_files[idx].node == NULL) {
+        return -1;  /* Not open */
+    }
+    
+    int32_t base;
+    switch (whence) {
+        case FS_SEEK_SET: base = 0; break;
+        case FS_SEEK_CUR: base = (int32_t)open_files[idx].offset; break;
+        case FS_SEEK_END: base = (int32_t)open_files[idx].node->length; break;
+        default: return -1;
+    }
+    
+    int32_t position = base + (int32_t)offset;
+    if (position < 0) {
+        return -1;
+    }
+    
+    open_files[idx].offset = (uint32_t)position;
+    return position;
+}
+
+/**
+ * SYS_PREAD - Read at an offset without moving the file position
+ * @param fd: File descriptor
+ * @param args: Pointer to syscall_pread_args_t (buffer, size, offset)
+ * @return: Number of bytes read, or -1 on error
+ */
+static int sys_pread(uint32_t fd, uint32_t args, uint32_t unused) {
+    (void)unused;
+    
+    /* Validate file descriptor */
+    if (fd < 3 || fd >= 3 + MAX_OPEN_FILES || !args) {
+        return -1;
+    }
+    
+    int idx = fd - 3;
+    if (open_files[idx].node == NULL) {
+        return -1;  /* Not open */
+    }
+    
+    if (!(open_files[idx].flags & FS_OPEN_READ)) {
+        return -1;  /* Opened write-only */
+    }
+    
+    syscall_pread_args_t *req = (syscall_pread_args_t *)args;
+    if (!req->buf || pager_prefault(req->buf, req->size, true) < 0) {
+        return -1;
+    }
+    
+    int bytes_read = fs_read(open_files[idx].node, req->offset, req->size, (uint8_t *)req->buf);
+    return (bytes_read < 0) ? -1 : bytes_read;
+}
+
+/**
+ * SYS_FWRITE - Write to a file
+ * Writes at the current position (at the end of the file when opened
+ * with FS_OPEN_APPEND) and advances it.
+ * @param fd: File descriptor opened with FS_OPEN_WRITE
+ * @param buf: Data to write
+ * @param size: Number of bytes to write
+ * @return: Number of bytes written, or -1 on error
+ */
+static int sys_fwrite(uint32_t fd, uint32_t buf, uint32_t size) {
+    /* Validate file descriptor */
+    if (fd < 3 || fd >= 3 + MAX_OPEN_FILES || !buf) {
+        return -1;
+    }
+    
+    int idx = fd - 3;
+    if (open_files[idx].node == NULL) {
+        return -1;  /* Not open */
+    }
+    
+    if (!(open_files[idx].flags & FS_OPEN_WRITE)) {
+        return -1;  /* Opened read-only */
+    }
+    
+    fs_node_t *node = open_files[idx].node;
+    if (open_files[idx].flags & FS_OPEN_APPEND) {
+        open_files[idx].offset = node->length;
+    }
+    
+    if (pager_prefault(buf, size, false) < 0) {
+        return -1;
+    }
+    
+    int bytes_written = fs_write(node, open_files[idx].offset, size, (const uint8_t *)buf);
+    if (bytes_written < 0) {
+        return -1;
+    }
+    
+    open_files[idx].offset += bytes_written;
+    return bytes_written;
+}
+
+/**
+ * SYS_MKDIR - Create a directory
+ * @param path: Path of the new directory (its parent must exist)
+ * @return: 0 on success, -1 on error
+ */
+static int sys_mkdir(uint32_t path, uint32_t unused1, uint32_t unused2) {
+    (void)unused1;
+    (void)unused2;
+    
+    if (!path) {
+        return -1;
+    }
+    
+    return fs_create((const char *)path, FS_DIRECTORY) ? 0 : -1;
+}
+
+/**
+ * SYS_UNLINK - Remove a file or empty directory
+ * Open files cannot be removed.
+ * @param path: Path of the entry
+ * @return: 0 on success, -1 on error
+ */
+static int sys_unlink(uint32_t path, uint32_t unused1, uint32_t unused2) {
+    (void)unused1;
+    (void)unused2;
+    
+    if (!path) {
+        return -1;
+    }
+    
+    return (fs_unlink((const char *)path) == FS_OK) ? 0 : -1;
+}
+
+/**
+ * SYS_FTRUNCATE - Change the size of an open file
+ * The file position is not moved.
+ * @param fd: File descriptor opened with FS_OPEN_WRITE
+ * @param length: New size in bytes (growing fills with zeros)
+ * @return: 0 on success, -1 on error
+ */
+static int sys_ftruncate(uint32_t fd, uint32_t length, uint32_t unused) {
+    (void)unused;
+    
+    /* Validate file descriptor */
+    if (fd < 3 || fd >= 3 + MAX_OPEN_FILES) {
+        return -1;
+    }
+    
+    int idx = fd - 3;
+    if (open_files[idx].node == NULL) {
+        return -1;  /* Not open */
+    }
+    
+    if (!(open_files[idx].flags & FS_OPEN_WRITE)) {
+        return -1;  /* Opened read-only */
+    }
+    
+    return (fs_truncate(open_files[idx].node, length) == FS_OK) ? 0 : -1;
+}
+
+/**
+ * SYS_GETMOUNT - Get a mount table entry
+ * @param index: Entry index (the root filesystem comes first)
+ * @param buf: Buffer to store fs_mount_info_t structure
+ * @return: 0 on success, -1 past the last entry
+ */
+static int sys_getmount(uint32_t index, uint32_t buf, uint32_t unused) {
+    (void)unused;
+    
+    if (!buf) {
+        return -1;
+    }
+    
+    return (fs_get_mount(index, (fs_mount_info_t *)buf) == FS_OK) ? 0 : -1;
+}
+
+/**
+ * Write one chunk of SYS_SENDFILE data to its destination
+ * @param out: open_files index, or -1 for the console
+ * @return: Number of bytes written, or -1 on error
+ */
+static int sendfile_write(int out, const uint8_t *data, uint32_t size) {
+    if (out < 0) {
+        for (uint32_t i = 0; i < size; i++) {
+            vga_putchar((char)data[i]);
+        }
+        return (int)size;
+    }
+    
+    fs_node_t *node = open_files[out].node;
+    if (open_files[out].flags & FS_OPEN_APPEND) {
+        open_files[out].offset = node->length;
+    }
+    
+    int written = fs_write(node, open_files[out].offset, size, data);
+    if (written < 0) {
+        return -1;
+    }
+    
+    open_files[out].offset += written;
+    return written;
+}
+
+/**
+ * SYS_SENDFILE - Copy file data to another descriptor without a user buffer
+ * Files served by the page cache are written straight from their cached
+ * pages; others go through a kernel buffer in SENDFILE_CHUNK pieces.
+ * @param out_fd: STDOUT, or a file descriptor opened with FS_OPEN_WRITE
+ * @param args: Pointer to syscall_sendfile_args_t (in_fd, offset, count)
+ * @return: Number of bytes copied (0 at end of file), or -1 on error
+ */
+static int sys_sendfile(uint32_t out_fd, uint32_t args, uint32_t unused) {
+    (void)unused;
+    
+    if (!args) {
+        return -1;
+    }
+    
+    syscall_sendfile_args_t *req = (syscall_sendfile_args_t *)args;
+    uint32_t in_fd = req->in_fd;
+    
+    /* Validate the source */
+    if (in_fd < 3 || in_fd >= 3 + MAX_OPEN_FILES || in_fd == out_fd) {
+        return -1;
+    }
+    
+    int in = in_fd - 3;
+    if (open_files[in].node == NULL || !(open_files[in].flags & FS_OPEN_READ)) {
+        return -1;
+    }
+    
+    /* Validate the destination: the console or a writable file */
+    int out = -1;
+    if (out_fd != 1) {
+        if (out_fd < 3 || out_fd >= 3 + MAX_OPEN_FILES) {
+            return -1;
+        }
+        out = out_fd - 3;
+        if (open_files[out].node == NULL || !(open_files[out].flags & FS_OPEN_WRITE)) {
+            return -1;
+        }
+    }
+    
+    fs_node_t *node = open_files[in].node;
+    bool use_pos = (req->offset == SENDFILE_OFFSET_CUR);
+    uint32_t offset = use_pos ? open_files[in].offset : req->offset;
+    uint32_t count = req->count;
+    uint32_t done = 0;
+    
+    /* Stop at end of file */
+    if (offset >= node->length) {
+        count = 0;
+    } else if (count > node->length - offset) {
+        count = node->length - offset;
+    }
+    
+    while (done < count) {
+        uint32_t pos = offset + done;
+        uint32_t chunk = count - done;
+        const uint8_t *data;
+        uint8_t *page = NULL;
+        
+        if (node->readpage) {
+            /* Pin the cached page and write from it directly */
+            page = fs_page_get(node, pos / FS_PAGE_SIZE);
+            if (!page) {
+                break;
+            }
+            uint32_t page_offset = pos % FS_PAGE_SIZE;
+            if (chunk > FS_PAGE_SIZE - page_offset) {
+                chunk = FS_PAGE_SIZE - page_offset;
+            }
+            data = page + page_offset;
+        } else {
+            if (chunk > SENDFILE_CHUNK) {
+                chunk = SENDFILE_CHUNK;
+            }
+            int bytes_read = fs_read(node, pos, chunk, sendfile_buf);
+            if (bytes_read <= 0) {
+                break;
+            }
+            chunk = (uint32_t)bytes_read;
+            data = sendfile_buf;
+        }
+        
+        int written = sendfile_write(out, data, chunk);
+        
+        if (page) {
+            fs_page_put(page);
+        }
+        
+        if (written <= 0) {
+            break;
+        }
+        
+        done += written;
+        if ((uint32_t)written < chunk) {
+            break;      /* Destination full */
+        }
+    }
+    
+    if (use_pos) {
+        open_files[in].offset += done;
+    }
+    
+    /* Report errors only if nothing was copied */
+    return (done == 0 && count > 0) ? -1 : (int)done;
+}
+
+/**
+ * SYS_AREAD - Queue a read that completes in the background
+ * Missing pages are read with device interrupts while the program keeps
+ * running; the data is in the buffer once the completion carrying token
+ * has been taken with SYS_POLL_COMPLETION or SYS_WAIT_COMPLETION.
+ * @param fd: File descriptor (may be closed before the read completes)
+ * @param args: Pointer to syscall_aread_args_t (buffer, size, offset, token)
+ * @return: 0 if queued, -1 on error or if too many reads are outstanding
+ */
+static int sys_aread(uint32_t fd, uint32_t args, uint32_t unused) {
+    (void)unused;
+    
+    /* Validate file descriptor */
+    if (fd < 3 || fd >= 3 + MAX_OPEN_FILES || !args) {
+        return -1;
+    }
+    
+    int idx = fd - 3;
+    if (open_files[idx].node == NULL) {
+        return -1;  /* Not open */
+    }
+    
+    if (!(open_files[idx].flags & FS_OPEN_READ)) {
+        return -1;  /* Opened write-only */
+    }
+    
+    /* The buffer is filled from interrupt handlers, where its pages
+     * cannot be read in */
+    syscall_aread_args_t *req = (syscall_aread_args_t *)args;
+    if (!req->buf || pager_prefault(req->buf, req->size, true) < 0) {
+        return -1;
+    }
+    
+    return aio_submit(open_files[idx].node, req->offset, req->size, (uint8_t *)req->buf, req->token);
+}
+
+/**
+ * SYS_POLL_COMPLETION - Take a finished background read without blocking
+ * @param buf: Pointer to aio_completion_t (token and bytes read or -1)
+ * @return: 1 if a completion was stored, 0 if none is ready
+ */
+static int sys_poll_completion(uint32_t buf, uint32_t unused1, uint32_t unused2) {
+    (void)unused1;
+    (void)unused2;
+    
+    if (pager_prefault(buf, sizeof(aio_completion_t), true) < 0) {
+        return -1;
+    }
+    
+    return aio_poll((aio_completion_t *)buf);
+}
+
+/**
+ * SYS_WAIT_COMPLETION - Wait for a background read to finish
+ * @param buf: Pointer to aio_completion_t (token and bytes read or -1)
+ * @return: 1 if a completion was stored, 0 if no read is outstanding
+ */
+static int sys_wait_completion(uint32_t buf, uint32_t unused1, uint32_t unused2) {
+    (void)unused1;
+    (void)unused2;
+    
+    if (pager_prefault(buf, sizeof(aio_completion_t), true) < 0) {
+        return -1;
+    }
+    
+    return aio_wait((aio_completion_t *)buf);
+}
+
 /**
  * Main system call handler
  * Called from the INT 0x80 handler
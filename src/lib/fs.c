@@ -4,13 +4,65 @@
  */
 
 #include <fs.h>
+#include <frame.h>
 #include <kernel.h>
+#include <kmalloc.h>
 #include <string.h>
 #include <vga.h>
 
 /* Maximum number of registered filesystems */
 #define MAX_FILESYSTEMS 8
 
+/* Path cache size (entries; memory is taken as entries are added) and
+ * hash buckets */
+#define FS_DCACHE_LIMIT     1024
+#define FS_DCACHE_BUCKETS   256
+
+/* Page cache size (at most this many pages of FS_PAGE_SIZE bytes, taken
+ * from the frame allocator as they are used) and hash buckets */
+#define FS_PAGE_CACHE_PAGES 512
+#define FS_PAGE_HASH_SIZE   1024
+
+/* Page cache entry: one page of one file */
+typedef struct fs_page {
+    uint32_t dev;               /* Device of the file */
+    uint32_t inode;             /* Inode of the file */
+    uint32_t index;             /* Page index within the file */
+    uint32_t lru;               /* Last use stamp (higher is more recent) */
+    uint32_t pins;              /* Pins from fs_page_get() */
+    int16_t next;               /* Next page in hash chain, -1 for end */
+    uint8_t *data;              /* Page frame, NULL until used or after reclaim */
+    bool valid;                 /* Page holds file data */
+    bool busy;                  /* Being filled by an asynchronous read */
+    fs_page_done_fn done;       /* Asynchronous read: completion callback */
+    void *done_ctx;             /* Asynchronous read: callback argument */
+} fs_page_t;
+
+/* Mount table entry */
+typedef struct fs_mount {
+    filesystem_t *fs;           /* Filesystem type */
+    fs_node_t *root;            /* Mounted root (NULL while a lazy mount is pending) */
+    struct fs_dentry *point;    /* Mount point entry (the root entry for "/") */
+    uint32_t flags;             /* FS_MOUNT_* flags */
+    uint8_t drive;              /* Drive number passed to the driver */
+    bool used;                  /* Slot in use */
+} fs_mount_t;
+
+/* Path cache entry: owns a copy of a resolved node */
+typedef struct fs_dentry {
+    fs_node_t node;             /* Must be first: nodes map back to entries */
+    char path[FS_MAX_PATH];     /* Normalized absolute path */
+    uint32_t hash;              /* Hash of path */
+    uint32_t refcount;          /* Pins from fs_node_get() */
+    uint32_t children;          /* Cached entries whose parent is this one */
+    struct fs_dentry *parent;   /* Parent entry (NULL for root) */
+    struct fs_dentry *hash_next; /* Next entry in the hash bucket */
+    struct fs_dentry *lru_prev; /* More recently used neighbour */
+    struct fs_dentry *lru_next; /* Less recently used neighbour */
+    fs_mount_t *mount;          /* Mount table entry if this is a mount point */
+    bool used;                  /* Slot in use */
+} fs_dentry_t;
+
 /* Registered filesystems */
 static filesystem_t *filesystems[MAX_FILESYSTEMS];
 static int fs_count = 0;
@@ -18,13 +70,65 @@ static int fs_count = 0;
 /* Root filesystem node */
 static fs_node_t *fs_root_node = NULL;
 
+/* Mount table (mount points are found by FS_MOUNTPOINT on their node, so
+ * path walks never scan it) */
+static fs_mount_t fs_mounts[FS_MAX_MOUNTS];
+
+/* Mount generation (bumped on every mount) */
+static uint32_t fs_generation = 0;
+
+/* I/O statistics */
+static fs_io_stats_t fs_stats;
+
+/* Path cache: entries from the "dentry" slab cache, found through hash
+ * chains, kept on a list from most to least recently used */
+static kmem_cache_t *fs_dentry_cache = NULL;
+static fs_dentry_t *fs_dcache_buckets[FS_DCACHE_BUCKETS];
+static fs_dentry_t *fs_dcache_lru_head = NULL;
+static fs_dentry_t *fs_dcache_lru_tail = NULL;
+static uint32_t fs_dcache_count = 0;
+static fs_dentry_t *fs_root_dentry = NULL;
+
+/* Nodes drivers hand to the VFS (see fs_node_alloc()) */
+static kmem_cache_t *fs_node_cache = NULL;
+
+/* Page cache (data in whole frames, so pages can be mapped directly) */
+static fs_page_t fs_pages[FS_PAGE_CACHE_PAGES];
+static int16_t fs_page_hash[FS_PAGE_HASH_SIZE];
+static uint32_t fs_page_clock = 0;
+
+/* Forward declarations */
+static int fs_read_cached(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
+static fs_node_t *fs_follow_mount(fs_node_t *node);
+
 /**
  * Initialize the virtual filesystem
  */
 void fs_init(void) {
     fs_count = 0;
     fs_root_node = NULL;
+    fs_generation = 0;
     memset(filesystems, 0, sizeof(filesystems));
+    memset(fs_mounts, 0, sizeof(fs_mounts));
+    memset(&fs_stats, 0, sizeof(fs_stats));
+    if (!fs_dentry_cache) {
+        fs_dentry_cache = kmem_cache_create("dentry", sizeof(fs_dentry_t));
+        fs_node_cache = kmem_cache_create("fs_node", sizeof(fs_node_t));
+    }
+    memset(fs_dcache_buckets, 0, sizeof(fs_dcache_buckets));
+    fs_dcache_lru_head = NULL;
+    fs_dcache_lru_tail = NULL;
+    fs_dcache_count = 0;
+    fs_root_dentry = NULL;
+    for (int i = 0; i < FS_PAGE_CACHE_PAGES; i++) {
+        if (fs_pages[i].data) {
+            frame_free((uint32_t)fs_pages[i].data, 0);
+        }
+    }
+    memset(fs_pages, 0, sizeof(fs_pages));
+    memset(fs_page_hash, 0xFF, sizeof(fs_page_hash));   /* All chains empty (-1) */
+    fs_page_clock = 0;
+    frame_register_reclaim(fs_page_cache_shrink);
 }
 
 /**
@@ -36,8 +140,10 @@ int fs_read(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
     }
     
     /* Follow mount points */
-    if ((node->flags & FS_MOUNTPOINT) && node->ptr) {
-        node = node->ptr;
+    node = fs_follow_mount(node);
+    
+    if (node->readpage) {
+        return fs_read_cached(node, offset, size, buffer);
     }
     
     if (node->read) {
@@ -56,9 +162,7 @@ int fs_write(fs_node_t *node, uint32_t offset, uint32_t size, const uint8_t *buf
     }
     
     /* Follow mount points */
-    if ((node->flags & FS_MOUNTPOINT) && node->ptr) {
-        node = node->ptr;
-    }
+    node = fs_follow_mount(node);
     
     if (node->write) {
         return node->write(node, offset, size, buffer);
@@ -76,9 +180,7 @@ void fs_open(fs_node_t *node) {
     }
     
     /* Follow mount points */
-    if ((node->flags & FS_MOUNTPOINT) && node->ptr) {
-        node = node->ptr;
-    }
+    node = fs_follow_mount(node);
     
     if (node->open) {
         node->open(node);
@@ -94,9 +196,7 @@ void fs_close(fs_node_t *node) {
     }
     
     /* Follow mount points */
-    if ((node->flags & FS_MOUNTPOINT) && node->ptr) {
-        node = node->ptr;
-    }
+    node = fs_follow_mount(node);
     
     if (node->close) {
         node->close(node);
@@ -111,10 +211,10 @@ dirent_t *fs_readdir(fs_node_t *node, uint32_t index) {
         return NULL;
     }
     
+    fs_stats.readdir_calls++;
+    
     /* Follow mount points */
-    if ((node->flags & FS_MOUNTPOINT) && node->ptr) {
-        node = node->ptr;
-    }
+    node = fs_follow_mount(node);
     
     /* Must be a directory */
     if ((node->flags & 0x07) != FS_DIRECTORY) {
@@ -136,10 +236,10 @@ fs_node_t *fs_finddir(fs_node_t *node, const char *name) {
         return NULL;
     }
     
+    fs_stats.finddir_calls++;
+    
     /* Follow mount points */
-    if ((node->flags & FS_MOUNTPOINT) && node->ptr) {
-        node = node->ptr;
-    }
+    node = fs_follow_mount(node);
     
     /* Must be a directory */
     if ((node->flags & 0x07) != FS_DIRECTORY) {
@@ -153,6 +253,652 @@ fs_node_t *fs_finddir(fs_node_t *node, const char *name) {
     return NULL;
 }
 
+/**
+ * Hash a normalized path (FNV-1a)
+ */
+static uint32_t fs_dcache_hash(const char *path) {
+    uint32_t hash = 2166136261u;
+    
+    while (*path) {
+        hash ^= (uint8_t)*path++;
+        hash *= 16777619u;
+    }
+    
+    return hash;
+}
+
+/**
+ * Map a node pointer back to its path cache entry
+ * @return Entry, or NULL if the node is not owned by the cache
+ */
+static fs_dentry_t *fs_dentry_of(fs_node_t *node) {
+    fs_dentry_t *entry = (fs_dentry_t *)node;
+    
+    if (!kmem_cache_owns(fs_dentry_cache, entry) || !entry->used) {
+        return NULL;
+    }
+    
+    return entry;
+}
+
+/**
+ * Follow a mount point to the root of the filesystem mounted on it
+ * Lazy mounts happen here, on first use. If one fails, the mount point
+ * is dropped and the directory underneath is used.
+ */
+static fs_node_t *fs_follow_mount(fs_node_t *node) {
+    if (!(node->flags & FS_MOUNTPOINT)) {
+        return node;
+    }
+    
+    if (!node->ptr) {
+        fs_dentry_t *entry = fs_dentry_of(node);
+        fs_mount_t *mount = entry ? entry->mount : NULL;
+        if (mount) {
+            mount->root = mount->fs->mount(mount->drive);
+            if (mount->root) {
+                node->ptr = mount->root;
+                fs_generation++;
+            }
+        }
+        
+        if (!node->ptr) {
+            /* Drop the mount and its pin on the mount point */
+            node->flags &= ~FS_MOUNTPOINT;
+            if (mount) {
+                memset(mount, 0, sizeof(fs_mount_t));
+                entry->mount = NULL;
+            }
+            if (entry && entry->refcount > 0) {
+                entry->refcount--;
+            }
+            return node;
+        }
+    }
+    
+    return node->ptr;
+}
+
+/**
+ * Put an entry at the most recently used end of the LRU list
+ */
+static void fs_dcache_lru_push(fs_dentry_t *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = fs_dcache_lru_head;
+    if (fs_dcache_lru_head) {
+        fs_dcache_lru_head->lru_prev = entry;
+    } else {
+        fs_dcache_lru_tail = entry;
+    }
+    fs_dcache_lru_head = entry;
+}
+
+/**
+ * Take an entry off the LRU list
+ */
+static void fs_dcache_lru_unlink(fs_dentry_t *entry) {
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        fs_dcache_lru_head = entry->lru_next;
+    }
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        fs_dcache_lru_tail = entry->lru_prev;
+    }
+}
+
+/**
+ * Look up a normalized path in the path cache
+ */
+static fs_dentry_t *fs_dcache_lookup(const char *path) {
+    uint32_t hash = fs_dcache_hash(path);
+    fs_dentry_t *entry = fs_dcache_buckets[hash % FS_DCACHE_BUCKETS];
+    
+    for (; entry; entry = entry->hash_next) {
+        if (entry->hash == hash && strcmp(entry->path, path) == 0) {
+            fs_dcache_lru_unlink(entry);
+            fs_dcache_lru_push(entry);
+            return entry;
+        }
+    }
+    
+    return NULL;
+}
+
+/**
+ * Make a filled-in entry findable
+ */
+static void fs_dcache_link(fs_dentry_t *entry) {
+    fs_dentry_t **bucket = &fs_dcache_buckets[entry->hash % FS_DCACHE_BUCKETS];
+    
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    fs_dcache_lru_push(entry);
+    fs_dcache_count++;
+    entry->used = true;
+}
+
+/**
+ * Remove an entry from the path cache and free it
+ */
+static void fs_dcache_remove(fs_dentry_t *entry) {
+    fs_dentry_t **link = &fs_dcache_buckets[entry->hash % FS_DCACHE_BUCKETS];
+    
+    while (*link && *link != entry) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) {
+        *link = entry->hash_next;
+    }
+    fs_dcache_lru_unlink(entry);
+    fs_dcache_count--;
+    
+    if (entry->parent) {
+        entry->parent->children--;
+    }
+    memset(entry, 0, sizeof(fs_dentry_t));
+    kmem_cache_free(fs_dentry_cache, entry);
+}
+
+/**
+ * Get a new path cache entry, evicting the least recently used unpinned
+ * leaf entry if the cache is at its limit or out of memory
+ * @return Zeroed entry, or NULL if every entry is pinned
+ */
+static fs_dentry_t *fs_dcache_alloc(void) {
+    fs_dentry_t *entry = NULL;
+    
+    if (fs_dcache_count < FS_DCACHE_LIMIT) {
+        entry = kmem_cache_alloc(fs_dentry_cache);
+    }
+    
+    if (!entry) {
+        fs_dentry_t *victim = fs_dcache_lru_tail;
+        while (victim && (victim->refcount > 0 || victim->children > 0)) {
+            victim = victim->lru_prev;
+        }
+        if (!victim) {
+            return NULL;
+        }
+        
+        fs_dcache_remove(victim);
+        entry = kmem_cache_alloc(fs_dentry_cache);
+        if (!entry) {
+            return NULL;
+        }
+    }
+    
+    memset(entry, 0, sizeof(fs_dentry_t));
+    return entry;
+}
+
+/**
+ * Add a node found by a driver to the path cache
+ * @param parent: Entry of the directory the node was found in
+ * @param node: Node returned by the driver (copied)
+ * @param path: Normalized absolute path of the node
+ * @return New entry, or NULL if the cache is full of pinned entries
+ */
+static fs_dentry_t *fs_dcache_insert(fs_dentry_t *parent, fs_node_t *node, const char *path) {
+    /* Keep the parent from being evicted to make room */
+    parent->children++;
+    
+    fs_dentry_t *entry = fs_dcache_alloc();
+    if (!entry) {
+        parent->children--;
+        return NULL;
+    }
+    
+    memcpy(&entry->node, node, sizeof(fs_node_t));
+    entry->node.parent = &parent->node;
+    strcpy(entry->path, path);
+    entry->hash = fs_dcache_hash(path);
+    entry->parent = parent;
+    fs_dcache_link(entry);
+    
+    return entry;
+}
+
+/**
+ * Drop all unpinned entries from the path cache
+ */
+void fs_dcache_flush(void) {
+    bool removed = true;
+    
+    /* Remove leaves until only pinned entries and their ancestors remain */
+    while (removed) {
+        removed = false;
+        fs_dentry_t *entry = fs_dcache_lru_tail;
+        while (entry) {
+            fs_dentry_t *prev = entry->lru_prev;
+            if (entry->refcount == 0 && entry->children == 0) {
+                fs_dcache_remove(entry);
+                removed = true;
+            }
+            entry = prev;
+        }
+    }
+}
+
+/**
+ * Allocate a node for a driver
+ */
+fs_node_t *fs_node_alloc(void) {
+    fs_node_t *node = kmem_cache_alloc(fs_node_cache);
+    if (node) {
+        memset(node, 0, sizeof(fs_node_t));
+    }
+    return node;
+}
+
+/**
+ * Free a node from fs_node_alloc()
+ */
+void fs_node_free(fs_node_t *node) {
+    if (node && kmem_cache_owns(fs_node_cache, node)) {
+        kmem_cache_free(fs_node_cache, node);
+    }
+}
+
+/**
+ * Pin a node so it is not evicted from the path cache
+ */
+void fs_node_get(fs_node_t *node) {
+    fs_dentry_t *entry = node ? fs_dentry_of(node) : NULL;
+    if (entry) {
+        entry->refcount++;
+    }
+}
+
+/**
+ * Release a pinned node
+ */
+void fs_node_put(fs_node_t *node) {
+    fs_dentry_t *entry = node ? fs_dentry_of(node) : NULL;
+    if (entry && entry->refcount > 0) {
+        entry->refcount--;
+    }
+}
+
+/**
+ * Get the normalized absolute path of a node
+ */
+int fs_realpath(fs_node_t *node, char *buf, uint32_t size) {
+    if (!node || !buf || size == 0) {
+        return FS_ERR_INVALID;
+    }
+    
+    fs_dentry_t *entry = fs_dentry_of(node);
+    if (!entry) {
+        return FS_ERR_NOENT;
+    }
+    
+    if (strlen(entry->path) >= size) {
+        return FS_ERR_NOSPACE;
+    }
+    
+    strcpy(buf, entry->path);
+    return FS_OK;
+}
+
+/**
+ * Hash a page identity into a bucket index
+ */
+static uint32_t fs_page_bucket(uint32_t dev, uint32_t inode, uint32_t index) {
+    uint32_t hash = (inode * 2654435761u) ^ (index * 40503u) ^ (dev << 24);
+    return hash % FS_PAGE_HASH_SIZE;
+}
+
+/**
+ * Unlink a page from its hash chain and mark it free
+ */
+static void fs_page_remove(fs_page_t *page) {
+    int16_t *link = &fs_page_hash[fs_page_bucket(page->dev, page->inode, page->index)];
+    int16_t self = (int16_t)(page - fs_pages);
+    
+    while (*link >= 0) {
+        if (*link == self) {
+            *link = page->next;
+            break;
+        }
+        link = &fs_pages[*link].next;
+    }
+    
+    page->valid = false;
+    page->next = -1;
+}
+
+/**
+ * Find a cached page of a file
+ * @return Page entry, or NULL if the page is not cached
+ */
+static fs_page_t *fs_page_find(uint32_t dev, uint32_t inode, uint32_t index) {
+    uint32_t bucket = fs_page_bucket(dev, inode, index);
+    
+    for (int16_t i = fs_page_hash[bucket]; i >= 0; i = fs_pages[i].next) {
+        fs_page_t *page = &fs_pages[i];
+        if (page->dev == dev && page->inode == inode && page->index == index) {
+            return page;
+        }
+    }
+    
+    return NULL;
+}
+
+/**
+ * Take a free page, or evict the least recently used unpinned one
+ * A free entry without a frame gets one from the frame allocator; when
+ * none is left, a cached page is evicted instead.
+ * @return Page entry with data (not in the hash), or NULL if every page
+ *         is pinned
+ */
+static fs_page_t *fs_page_victim(void) {
+    fs_page_t *victim = NULL;
+    
+    for (int i = 0; i < FS_PAGE_CACHE_PAGES; i++) {
+        fs_page_t *page = &fs_pages[i];
+        if (!page->busy && !page->valid) {
+            if (!page->data) {
+                page->data = (uint8_t *)frame_alloc(0);
+            }
+            if (page->data) {
+                return page;
+            }
+            break;
+        }
+    }
+    
+    for (int i = 0; i < FS_PAGE_CACHE_PAGES; i++) {
+        fs_page_t *page = &fs_pages[i];
+        if (page->busy || !page->data) {
+            continue;
+        }
+        if (!page->valid) {
+            victim = page;
+            break;
+        }
+        if (page->pins == 0 && (!victim || page->lru < victim->lru)) {
+            victim = page;
+        }
+    }
+    
+    if (victim && victim->valid) {
+        fs_page_remove(victim);
+    }
+    
+    return victim;
+}
+
+/**
+ * Enter a filled page into the hash
+ */
+static void fs_page_insert(fs_page_t *page, uint32_t dev, uint32_t inode, uint32_t index) {
+    uint32_t bucket = fs_page_bucket(dev, inode, index);
+    
+    page->dev = dev;
+    page->inode = inode;
+    page->index = index;
+    page->lru = ++fs_page_clock;
+    page->valid = true;
+    page->next = fs_page_hash[bucket];
+    fs_page_hash[bucket] = (int16_t)(page - fs_pages);
+}
+
+/**
+ * Find a page of a file in the page cache, reading it on a miss
+ * @return Page entry, or NULL on I/O error or if every page is pinned
+ */
+static fs_page_t *fs_page_lookup(fs_node_t *node, uint32_t index) {
+    fs_page_t *page = fs_page_find(node->dev, node->inode, index);
+    if (page) {
+        page->lru = ++fs_page_clock;
+        fs_stats.page_hits++;
+        return page;
+    }
+    
+    /* Miss: read into a free or evicted page */
+    fs_page_t *victim = fs_page_victim();
+    if (!victim) {
+        return NULL;
+    }
+    
+    fs_stats.page_misses++;
+    uint8_t *data = victim->data;
+    if (node->readpage(node, index, data) != FS_OK) {
+        return NULL;
+    }
+    
+    victim->pins = 0;
+    fs_page_insert(victim, node->dev, node->inode, index);
+    
+    return victim;
+}
+
+/**
+ * Read file data through the page cache
+ */
+static int fs_read_cached(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
+    /* Check bounds */
+    if (offset >= node->length) {
+        return 0;
+    }
+    
+    if (size > node->length - offset) {
+        size = node->length - offset;
+    }
+    
+    uint32_t bytes_read = 0;
+    
+    while (bytes_read < size) {
+        uint32_t pos = offset + bytes_read;
+        fs_page_t *page = fs_page_lookup(node, pos / FS_PAGE_SIZE);
+        if (!page) {
+            return bytes_read ? (int)bytes_read : FS_ERR_IO;
+        }
+        
+        /* Calculate bytes to copy from this page */
+        uint32_t page_offset = pos % FS_PAGE_SIZE;
+        uint32_t bytes_to_copy = FS_PAGE_SIZE - page_offset;
+        if (bytes_to_copy > size - bytes_read) {
+            bytes_to_copy = size - bytes_read;
+        }
+        
+        memcpy(buffer + bytes_read, page->data + page_offset, bytes_to_copy);
+        bytes_read += bytes_to_copy;
+    }
+    
+    return bytes_read;
+}
+
+/**
+ * Get a pinned page of file data
+ */
+uint8_t *fs_page_get(fs_node_t *node, uint32_t index) {
+    if (!node) {
+        return NULL;
+    }
+    
+    /* Follow mount points */
+    node = fs_follow_mount(node);
+    
+    if (!node->readpage) {
+        return NULL;
+    }
+    
+    fs_page_t *page = fs_page_lookup(node, index);
+    if (!page) {
+        return NULL;
+    }
+    
+    page->pins++;
+    return page->data;
+}
+
+/**
+ * Release a pinned page
+ */
+void fs_page_put(uint8_t *data) {
+    uint8_t *base = (uint8_t *)((uint32_t)data & ~(FS_PAGE_SIZE - 1));
+    
+    if (!data) {
+        return;
+    }
+    
+    for (int i = 0; i < FS_PAGE_CACHE_PAGES; i++) {
+        fs_page_t *page = &fs_pages[i];
+        if (page->data == base) {
+            if (page->pins > 0) {
+                page->pins--;
+            }
+            return;
+        }
+    }
+}
+
+/**
+ * Get a pinned page of file data if it is cached
+ */
+uint8_t *fs_page_peek(fs_node_t *node, uint32_t index) {
+    if (!node) {
+        return NULL;
+    }
+    
+    /* Follow mount points */
+    node = fs_follow_mount(node);
+    
+    fs_page_t *page = fs_page_find(node->dev, node->inode, index);
+    if (!page) {
+        return NULL;
+    }
+    
+    page->lru = ++fs_page_clock;
+    page->pins++;
+    fs_stats.page_hits++;
+    return page->data;
+}
+
+/**
+ * Driver completion for fs_page_read_async()
+ * The page was reserved as busy and pinned for the requester.
+ */
+static void fs_page_read_done(void *ctx, int status) {
+    fs_page_t *page = (fs_page_t *)ctx;
+    
+    page->busy = false;
+    
+    if (status != FS_OK) {
+        page->pins = 0;
+        page->done(page->done_ctx, NULL);
+        return;
+    }
+    
+    /* A synchronous read may have cached the same page meanwhile */
+    fs_page_t *cached = fs_page_find(page->dev, page->inode, page->index);
+    if (cached) {
+        page->pins = 0;
+        cached->pins++;
+        page->done(page->done_ctx, cached->data);
+        return;
+    }
+    
+    fs_page_insert(page, page->dev, page->inode, page->index);
+    page->done(page->done_ctx, page->data);
+}
+
+/**
+ * Start filling a page of file data in the background
+ */
+int fs_page_read_async(fs_node_t *node, uint32_t index, fs_page_done_fn done, void *ctx) {
+    if (!node || !done) {
+        return FS_ERR_INVALID;
+    }
+    
+    /* Follow mount points */
+    node = fs_follow_mount(node);
+    
+    if (!node->readpage_async) {
+        return FS_ERR_INVALID;
+    }
+    
+    fs_page_t *page = fs_page_victim();
+    if (!page) {
+        return FS_ERR_NOMEM;
+    }
+    
+    /* Reserve the page: busy pages are never chosen as victims, and the
+     * identity is kept here until the page is entered into the hash */
+    page->dev = node->dev;
+    page->inode = node->inode;
+    page->index = index;
+    page->pins = 1;
+    page->busy = true;
+    page->done = done;
+    page->done_ctx = ctx;
+    
+    fs_stats.page_misses++;
+    int err = node->readpage_async(node, index, page->data,
+                                   fs_page_read_done, page);
+    if (err != FS_OK) {
+        page->busy = false;
+        page->pins = 0;
+        fs_stats.page_misses--;
+    }
+    
+    return err;
+}
+
+/**
+ * Reclaim memory from the page cache, least recently used pages first
+ * Also run by the frame allocator when it has no free block.
+ */
+uint32_t fs_page_cache_shrink(uint32_t count) {
+    uint32_t freed = 0;
+    
+    while (count == 0 || freed < count) {
+        fs_page_t *victim = NULL;
+        
+        for (int i = 0; i < FS_PAGE_CACHE_PAGES; i++) {
+            fs_page_t *page = &fs_pages[i];
+            if (page->valid && page->pins == 0 && (!victim || page->lru < victim->lru)) {
+                victim = page;
+            }
+        }
+        
+        if (!victim) {
+            break;
+        }
+        
+        fs_page_remove(victim);
+        frame_free((uint32_t)victim->data, 0);
+        victim->data = NULL;
+        freed++;
+    }
+    
+    return freed;
+}
+
+/**
+ * Get page cache usage
+ */
+void fs_page_cache_usage(uint32_t *used, uint32_t *total) {
+    uint32_t count = 0;
+    
+    for (int i = 0; i < FS_PAGE_CACHE_PAGES; i++) {
+        if (fs_pages[i].valid) {
+            count++;
+        }
+    }
+    
+    if (used) {
+        *used = count;
+    }
+    if (total) {
+        *total = FS_PAGE_CACHE_PAGES;
+    }
+}
+
 /**
  * Register a filesystem type
  */
@@ -177,6 +923,19 @@ static filesystem_t *fs_find(const char *name) {
     return NULL;
 }
 
+/**
+ * Get a free mount table slot
+ * @return Slot (not yet marked used), or NULL if the table is full
+ */
+static fs_mount_t *fs_mount_alloc(void) {
+    for (int i = 0; i < FS_MAX_MOUNTS; i++) {
+        if (!fs_mounts[i].used) {
+            return &fs_mounts[i];
+        }
+    }
+    return NULL;
+}
+
 /**
  * Mount a filesystem
  */
@@ -191,14 +950,139 @@ fs_node_t *fs_mount(uint8_t drive, const char *fstype) {
     }
     
     fs_node_t *root = fs->mount(drive);
-    if (root && !fs_root_node) {
+    if (root) {
+        fs_generation++;
+        
+        /* Cached lookups may cross the new mount */
+        fs_dcache_flush();
+        
         /* First mount becomes root filesystem */
-        fs_root_node = root;
+        if (!fs_root_node) {
+            fs_mount_t *mount = fs_mount_alloc();
+            fs_root_dentry = mount ? fs_dcache_alloc() : NULL;
+            if (!fs_root_dentry) {
+                fs_node_free(root);
+                return NULL;
+            }
+            
+            memcpy(&fs_root_dentry->node, root, sizeof(fs_node_t));
+            fs_root_dentry->node.parent = NULL;
+            strcpy(fs_root_dentry->path, "/");
+            fs_root_dentry->hash = fs_dcache_hash("/");
+            fs_root_dentry->refcount = 1;   /* Never evicted */
+            fs_dcache_link(fs_root_dentry);
+            fs_root_node = &fs_root_dentry->node;
+            
+            /* The entry holds the root from now on */
+            fs_node_free(root);
+            root = fs_root_node;
+            
+            mount->fs = fs;
+            mount->root = root;
+            mount->point = fs_root_dentry;
+            mount->flags = 0;
+            mount->drive = drive;
+            mount->used = true;
+        }
     }
     
     return root;
 }
 
+/**
+ * Mount a filesystem on a directory
+ */
+int fs_mount_at(const char *path, uint8_t drive, const char *fstype, uint32_t flags) {
+    fs_node_t *dir = fs_namei(path);
+    if (!dir) {
+        return FS_ERR_NOENT;
+    }
+    
+    if ((dir->flags & 0x07) != FS_DIRECTORY) {
+        return FS_ERR_NOTDIR;
+    }
+    
+    if (dir->flags & FS_MOUNTPOINT) {
+        return FS_ERR_BUSY;
+    }
+    
+    /* The mount point lives in the path cache entry, so pin it for good
+     * (fs_mount() flushes everything else). The root is not a candidate. */
+    fs_dentry_t *entry = fs_dentry_of(dir);
+    if (!entry || !entry->parent) {
+        return FS_ERR_INVALID;
+    }
+    
+    filesystem_t *fs = fs_find(fstype);
+    if (!fs || !fs->mount) {
+        return FS_ERR_INVALID;
+    }
+    
+    fs_mount_t *mount = fs_mount_alloc();
+    if (!mount) {
+        return FS_ERR_NOSPACE;
+    }
+    
+    /* Lazy: only remember what to mount, but still drop cached lookups
+     * below the mount point as fs_mount() would */
+    fs_node_t *root = NULL;
+    entry->refcount++;
+    if (flags & FS_MOUNT_LAZY) {
+        fs_dcache_flush();
+    } else {
+        root = fs_mount(drive, fstype);
+        if (!root) {
+            entry->refcount--;
+            return FS_ERR_NOTMOUNT;
+        }
+    }
+    
+    mount->fs = fs;
+    mount->root = root;
+    mount->point = entry;
+    mount->flags = flags;
+    mount->drive = drive;
+    mount->used = true;
+    
+    entry->mount = mount;
+    dir->ptr = root;
+    dir->flags |= FS_MOUNTPOINT;
+    
+    return FS_OK;
+}
+
+/**
+ * Get an entry of the mount table
+ */
+int fs_get_mount(uint32_t index, fs_mount_info_t *info) {
+    if (!info) {
+        return FS_ERR_INVALID;
+    }
+    
+    for (int i = 0; i < FS_MAX_MOUNTS; i++) {
+        fs_mount_t *mount = &fs_mounts[i];
+        if (!mount->used || index-- > 0) {
+            continue;
+        }
+        
+        strcpy(info->path, mount->point->path);
+        strcpy(info->fstype, mount->fs->name);
+        info->drive = mount->drive;
+        info->flags = mount->flags;
+        info->active = mount->root ? 1 : 0;
+        info->block_size = 0;
+        info->blocks = 0;
+        info->blocks_free = 0;
+        if (mount->root && mount->fs->usage) {
+            mount->fs->usage(mount->drive, &info->blocks_free, &info->blocks,
+                             &info->block_size);
+        }
+        return FS_OK;
+    }
+    
+    return FS_ERR_NOENT;
+}
+
 /**
  * Get the root filesystem node
  */
@@ -206,6 +1090,79 @@ fs_node_t *fs_root(void) {
     return fs_root_node;
 }
 
+/**
+ * Get file status of a node
+ */
+int fs_stat(fs_node_t *node, fs_stat_t *st) {
+    if (!node || !st) {
+        return FS_ERR_INVALID;
+    }
+    
+    /* Follow mount points */
+    node = fs_follow_mount(node);
+    
+    st->size = node->length;
+    st->type = node->flags & 0x07;
+    st->inode = node->inode;
+    st->generation = fs_generation;
+    
+    return FS_OK;
+}
+
+/**
+ * Get the current mount generation
+ */
+uint32_t fs_mount_generation(void) {
+    return fs_generation;
+}
+
+/**
+ * Get VFS I/O statistics
+ */
+void fs_get_io_stats(fs_io_stats_t *stats) {
+    if (stats) {
+        memcpy(stats, &fs_stats, sizeof(fs_io_stats_t));
+    }
+}
+
+/**
+ * Reset VFS I/O statistics
+ */
+void fs_reset_io_stats(void) {
+    memset(&fs_stats, 0, sizeof(fs_stats));
+}
+
+/**
+ * Account device sectors read by a filesystem driver
+ */
+void fs_account_sectors(uint32_t count) {
+    fs_stats.sectors_read += count;
+}
+
+/**
+ * Build the cache key of a child: parent path + "/" + name
+ * @return 0 on success, -1 if the path would be too long
+ */
+static int fs_child_path(char *dst, const char *parent, const char *name) {
+    uint32_t parent_len = strlen(parent);
+    uint32_t name_len = strlen(name);
+    
+    /* Root is "/", so it needs no separator */
+    uint32_t sep = (parent_len > 1) ? 1 : 0;
+    
+    if (parent_len + sep + name_len >= FS_MAX_PATH) {
+        return -1;
+    }
+    
+    memcpy(dst, parent, parent_len);
+    if (sep) {
+        dst[parent_len] = '/';
+    }
+    memcpy(dst + parent_len + sep, name, name_len + 1);
+    
+    return 0;
+}
+
 /**
  * Resolve a path to a node
  */
@@ -214,23 +1171,31 @@ fs_node_t *fs_namei(const char *path) {
         return NULL;
     }
     
-    /* Handle root path */
-    if (path[0] == '/' && path[1] == '\0') {
-        return fs_root_node;
-    }
+    fs_stats.namei_calls++;
     
-    /* Start from root */
-    fs_node_t *current = fs_root_node;
-    
-    /* Skip leading slash */
-    if (*path == '/') {
-        path++;
+    /* Normalized paths usually hit the cache as a whole */
+    if (path[0] == '/') {
+        fs_dentry_t *hit = fs_dcache_lookup(path);
+        if (hit) {
+            fs_stats.dcache_hits++;
+            return &hit->node;
+        }
     }
     
-    /* Parse path components */
+    /* Walk from the root, one cached prefix at a time */
+    fs_dentry_t *current = fs_root_dentry;
     char component[FS_MAX_NAME];
+    char key[FS_MAX_PATH];
     
-    while (*path && current) {
+    while (*path) {
+        /* Skip slashes */
+        while (*path == '/') {
+            path++;
+        }
+        if (!*path) {
+            break;
+        }
+        
         /* Extract next path component */
         int i = 0;
         while (*path && *path != '/' && i < FS_MAX_NAME - 1) {
@@ -238,25 +1203,192 @@ fs_node_t *fs_namei(const char *path) {
         }
         component[i] = '\0';
         
-        /* Skip trailing slashes */
-        while (*path == '/') {
-            path++;
-        }
-        
-        /* Handle special cases */
+        /* Current directory - do nothing */
         if (strcmp(component, ".") == 0) {
-            /* Current directory - do nothing */
             continue;
         }
         
+        /* Parent directory - follow the parent link (root is its own parent) */
         if (strcmp(component, "..") == 0) {
-            /* Parent directory - not fully implemented yet */
+            if (current->parent) {
+                current = current->parent;
+            }
             continue;
         }
         
-        /* Find component in current directory */
-        current = fs_finddir(current, component);
+        if (fs_child_path(key, current->path, component) < 0) {
+            return NULL;
+        }
+        
+        fs_dentry_t *next = fs_dcache_lookup(key);
+        if (next) {
+            fs_stats.dcache_hits++;
+            current = next;
+            continue;
+        }
+        
+        /* Not cached: ask the driver */
+        fs_stats.dcache_misses++;
+        fs_node_t *found = fs_finddir(&current->node, component);
+        if (!found) {
+            return NULL;
+        }
+        
+        /* Key the entry by the name the driver reports, so lookups that
+         * differ only in case share one entry */
+        if (found->name[0] && strcmp(found->name, component) != 0) {
+            if (fs_child_path(key, current->path, found->name) < 0) {
+                fs_node_free(found);
+                return NULL;
+            }
+            next = fs_dcache_lookup(key);
+        }
+        
+        /* The entry keeps a copy, the driver's node is done with */
+        if (!next) {
+            next = fs_dcache_insert(current, found, key);
+        }
+        fs_node_free(found);
+        if (!next) {
+            return NULL;
+        }
+        
+        current = next;
+    }
+    
+    return &current->node;
+}
+
+/**
+ * Split a path into its parent directory and last component
+ * @param path: Path to split (trailing slashes are ignored)
+ * @param parent: Buffer of FS_MAX_PATH bytes for the parent path
+ * @param name: Buffer of FS_MAX_NAME bytes for the last component
+ * @return 0 on success, -1 if the path has no usable last component
+ */
+static int fs_split_path(const char *path, char *parent, char *name) {
+    uint32_t len = strlen(path);
+    
+    while (len > 0 && path[len - 1] == '/') {
+        len--;
+    }
+    
+    uint32_t start = len;
+    while (start > 0 && path[start - 1] != '/') {
+        start--;
+    }
+    
+    if (start == len || len - start >= FS_MAX_NAME || start >= FS_MAX_PATH) {
+        return -1;
+    }
+    
+    memcpy(name, path + start, len - start);
+    name[len - start] = '\0';
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        return -1;
+    }
+    
+    /* Relative paths resolve from the root, like fs_namei() */
+    if (start == 0) {
+        strcpy(parent, "/");
+    } else {
+        memcpy(parent, path, start);
+        parent[start] = '\0';
+    }
+    
+    return 0;
+}
+
+/**
+ * Create a file or directory
+ */
+fs_node_t *fs_create(const char *path, uint32_t type) {
+    char parent_path[FS_MAX_PATH];
+    char name[FS_MAX_NAME];
+    
+    if (!path || (type != FS_FILE && type != FS_DIRECTORY)) {
+        return NULL;
+    }
+    
+    if (fs_split_path(path, parent_path, name) < 0 || fs_namei(path)) {
+        return NULL;
+    }
+    
+    fs_node_t *dir = fs_namei(parent_path);
+    if (!dir) {
+        return NULL;
+    }
+    
+    /* Follow mount points */
+    dir = fs_follow_mount(dir);
+    
+    if ((dir->flags & 0x07) != FS_DIRECTORY || !dir->create) {
+        return NULL;
+    }
+    
+    fs_node_t *created = dir->create(dir, name, type);
+    if (!created) {
+        return NULL;
+    }
+    fs_node_free(created);
+    
+    /* Enter the new node into the path cache */
+    return fs_namei(path);
+}
+
+/**
+ * Remove a file or empty directory
+ */
+int fs_unlink(const char *path) {
+    fs_node_t *node = fs_namei(path);
+    if (!node) {
+        return FS_ERR_NOENT;
+    }
+    
+    fs_dentry_t *entry = fs_dentry_of(node);
+    if (!entry || !entry->parent) {
+        return FS_ERR_INVALID;
+    }
+    
+    /* Open files and mount points pin their entries */
+    if (entry->refcount > 0) {
+        return FS_ERR_BUSY;
+    }
+    
+    /* Cached children exist in the directory */
+    if (entry->children > 0) {
+        return FS_ERR_NOTEMPTY;
+    }
+    
+    fs_node_t *dir = fs_follow_mount(&entry->parent->node);
+    
+    if (!dir->unlink) {
+        return FS_ERR_INVALID;
+    }
+    
+    int result = dir->unlink(dir, node->name);
+    if (result == FS_OK) {
+        fs_dcache_remove(entry);
+    }
+    
+    return result;
+}
+
+/**
+ * Change the size of a file
+ */
+int fs_truncate(fs_node_t *node, uint32_t length) {
+    if (!node) {
+        return FS_ERR_INVALID;
+    }
+    
+    if ((node->flags & 0x07) != FS_FILE) {
+        return FS_ERR_ISDIR;
+    }
+    
+    if (!node->truncate) {
+        return FS_ERR_INVALID;
     }
     
-    return current;
+    return node->truncate(node, length);
 }
@@ -0,0 +1,167 @@
+/**
+ * LZ4 Decompression
+ * Decoder for the LZ4 frame format
+ *
+ * A frame is a header followed by blocks, each a sequence list: a token
+ * with the literal and match lengths, the literals, and a 16-bit offset
+ * back into the output where the match is copied from. Every length and
+ * offset is checked against both buffers, so a corrupt frame fails with
+ * -1 instead of writing outside dst.
+ */
+
+#include <lz4.h>
+#include <string.h>
+
+/**
+ * Read a length that continues in 255-valued bytes
+ * @param len: Length from the token, extended in place
+ * @return 0 on success, -1 if the input ends
+ */
+static int lz4_read_length(const uint8_t **ip, const uint8_t *end, uint32_t *len) {
+    uint8_t byte;
+
+    do {
+        if (*ip >= end) {
+            return -1;
+        }
+        byte = *(*ip)++;
+        *len += byte;
+    } while (byte == 255);
+
+    return 0;
+}
+
+/**
+ * Decode one compressed block
+ * @param pos: Output position, advanced past the decoded bytes; matches
+ *             may reach back into earlier blocks
+ * @return 0 on success, -1 on error
+ */
+static int lz4_decompress_block(const uint8_t *src, uint32_t src_size, uint8_t *dst,
+                                uint32_t dst_size, uint32_t *pos) {
+    const uint8_t *ip = src;
+    const uint8_t *end = src + src_size;
+    uint32_t op = *pos;
+
+    while (ip < end) {
+        uint8_t token = *ip++;
+
+        /* Literals */
+        uint32_t len = token >> 4;
+        if (len == 15 && lz4_read_length(&ip, end, &len) < 0) {
+            return -1;
+        }
+        if (len > (uint32_t)(end - ip) || len > dst_size - op) {
+            return -1;
+        }
+        memcpy(dst + op, ip, len);
+        ip += len;
+        op += len;
+
+        /* The last sequence has no match */
+        if (ip == end) {
+            break;
+        }
+
+        /* Match */
+        if (end - ip < 2) {
+            return -1;
+        }
+        uint32_t offset = ip[0] | ((uint32_t)ip[1] << 8);
+        ip += 2;
+
+        len = token & 15;
+        if (len == 15 && lz4_read_length(&ip, end, &len) < 0) {
+            return -1;
+        }
+        len += LZ4_MIN_MATCH;
+
+        if (offset == 0 || offset > op || len > dst_size - op) {
+            return -1;
+        }
+
+        uint8_t *from = dst + op - offset;
+        if (offset >= len) {
+            memcpy(dst + op, from, len);
+        } else {
+            /* Overlapping copy repeats the last offset bytes */
+            for (uint32_t i = 0; i < len; i++) {
+                dst[op + i] = from[i];
+            }
+        }
+        op += len;
+    }
+
+    *pos = op;
+    return 0;
+}
+
+/**
+ * Decode an LZ4 frame
+ */
+int lz4_decompress_frame(const uint8_t *src, uint32_t src_size, uint8_t *dst, uint32_t dst_size) {
+    const uint8_t *ip = src;
+    const uint8_t *end = src + src_size;
+    uint32_t pos = 0;
+
+    /* Magic, FLG, BD and the header checksum at least */
+    if (src_size < 7 || (src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t)src[3] << 24)) !=
+        LZ4_FRAME_MAGIC) {
+        return -1;
+    }
+
+    uint8_t flg = src[4];
+    if ((flg & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION) {
+        return -1;
+    }
+
+    uint32_t header = 7;
+    if (flg & LZ4_FLG_CONTENT_SIZE) {
+        header += 8;
+    }
+    if (flg & LZ4_FLG_DICT_ID) {
+        header += 4;
+    }
+    if (src_size < header) {
+        return -1;
+    }
+    ip += header;
+
+    while (1) {
+        if (end - ip < 4) {
+            return -1;
+        }
+        uint32_t size = ip[0] | (ip[1] << 8) | (ip[2] << 16) | ((uint32_t)ip[3] << 24);
+        ip += 4;
+
+        /* End mark */
+        if (size == 0) {
+            break;
+        }
+
+        uint32_t bytes = size & ~LZ4_BLOCK_UNCOMPRESSED;
+        if (bytes > (uint32_t)(end - ip)) {
+            return -1;
+        }
+
+        if (size & LZ4_BLOCK_UNCOMPRESSED) {
+            if (bytes > dst_size - pos) {
+                return -1;
+            }
+            memcpy(dst + pos, ip, bytes);
+            pos += bytes;
+        } else if (lz4_decompress_block(ip, bytes, dst, dst_size, &pos) < 0) {
+            return -1;
+        }
+        ip += bytes;
+
+        if (flg & LZ4_FLG_BLOCK_CHECKSUM) {
+            ip += 4;
+            if (ip > end) {
+                return -1;
+            }
+        }
+    }
+
+    return (int)pos;
+}
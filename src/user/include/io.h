@@ -19,12 +19,92 @@
 #define SYS_SETCOLOR 11
 #define SYS_FREAD   12
 #define SYS_FSIZE   13
+#define SYS_STAT    28
+#define SYS_FSTAT   29
+#define SYS_FSSTATS 31
+#define SYS_REALPATH 32
+#define SYS_MMAP    33
+#define SYS_MUNMAP  34
+#define SYS_LSEEK   35
+#define SYS_PREAD   36
+#define SYS_FWRITE  37
+#define SYS_MKDIR   38
+#define SYS_UNLINK  39
+#define SYS_FTRUNCATE 40
+#define SYS_GETMOUNT 41
+#define SYS_SENDFILE 42
+#define SYS_AREAD   43
+#define SYS_POLL_COMPLETION 44
+#define SYS_WAIT_COMPLETION 45
 
 /* File descriptors */
 #define STDIN   0
 #define STDOUT  1
 #define STDERR  2
 
+/* File open flags (open) */
+#define O_READ      0x01    /* Allow reading */
+#define O_WRITE     0x02    /* Allow writing (writable filesystems such as /tmp) */
+#define O_APPEND    0x04    /* Every write goes to the end of the file */
+#define O_CREATE    0x08    /* Create the file if it does not exist */
+#define O_TRUNC     0x10    /* Truncate to zero length (with O_WRITE) */
+
+/* sendfile offset: copy from the current file position and advance it */
+#define SENDFILE_CUR    0xFFFFFFFF
+
+/* Seek origins (lseek whence) */
+#define SEEK_SET    0
+#define SEEK_CUR    1
+#define SEEK_END    2
+
+/* File types (stat_t.type) */
+#define FILE_TYPE_FILE      0x01
+#define FILE_TYPE_DIR       0x02
+
+/* File status structure (matches kernel layout) */
+typedef struct {
+    unsigned int size;          /* File size in bytes */
+    unsigned int type;          /* FILE_TYPE_FILE or FILE_TYPE_DIR */
+    unsigned int inode;         /* Inode number (extent LBA on ISO9660) */
+    unsigned int generation;    /* Mount generation of the filesystem */
+} stat_t;
+
+/* Filesystem I/O statistics (matches kernel layout) */
+typedef struct {
+    unsigned int sectors_read;  /* Device sectors read by filesystem drivers */
+    unsigned int namei_calls;   /* Path resolutions */
+    unsigned int finddir_calls; /* Directory lookups */
+    unsigned int readdir_calls; /* Directory entry reads */
+    unsigned int dcache_hits;   /* Path components resolved from the path cache */
+    unsigned int dcache_misses; /* Path components resolved by the driver */
+    unsigned int page_hits;     /* File pages served from the page cache */
+    unsigned int page_misses;   /* File pages read through the driver */
+} fs_stats_t;
+
+/* Mount flags (mount_info_t.flags) */
+#define MOUNT_LAZY          0x01    /* Mounted on first access */
+
+/* Mount table entry (matches kernel layout) */
+typedef struct {
+    char path[256];             /* Mount point ("/" for the root) */
+    char fstype[32];            /* Filesystem type name */
+    unsigned int drive;         /* Drive number */
+    unsigned int flags;         /* MOUNT_* flags */
+    unsigned int active;        /* 1 if mounted, 0 while a lazy mount is pending */
+    unsigned int block_size;    /* Bytes per allocation block (0 if not reported) */
+    unsigned int blocks;        /* Blocks for file data */
+    unsigned int blocks_free;   /* Blocks not in use */
+} mount_info_t;
+
+/* Background read completion (matches kernel layout) */
+typedef struct {
+    unsigned int token;         /* Token given to aread */
+    int result;                 /* Bytes read, or -1 on error */
+} completion_t;
+
+/* Maximum background reads outstanding (queued or not yet reaped) */
+#define AREAD_MAX           16
+
 /* VGA color palette */
 #define COLOR_BLACK         0
 #define COLOR_BLUE          1
@@ -297,6 +377,16 @@ static inline int fopen(const char *path) {
     return _io_syscall(SYS_FOPEN, (int)path, 0, 0);
 }
 
+/**
+ * Open a file with flags
+ * @param path: Path to the file
+ * @param flags: O_* flags (e.g. O_WRITE | O_CREATE | O_TRUNC)
+ * @return: File descriptor (>= 3) on success, -1 on error
+ */
+static inline int open(const char *path, int flags) {
+    return _io_syscall(SYS_FOPEN, (int)path, flags, 0);
+}
+
 /**
  * Close a file
  * @param fd: File descriptor
@@ -317,6 +407,45 @@ static inline int fread(int fd, char *buf, int size) {
     return _io_syscall(SYS_FREAD, fd, (int)buf, size);
 }
 
+/**
+ * Write to a file opened with O_WRITE
+ * @param fd: File descriptor
+ * @param buf: Data to write
+ * @param size: Number of bytes to write
+ * @return: Number of bytes written, or -1 on error (e.g. filesystem full)
+ */
+static inline int fwrite(int fd, const char *buf, int size) {
+    return _io_syscall(SYS_FWRITE, fd, (int)buf, size);
+}
+
+/**
+ * Change the size of a file opened with O_WRITE
+ * @param fd: File descriptor
+ * @param length: New size in bytes (growing fills with zeros)
+ * @return: 0 on success, -1 on error
+ */
+static inline int ftruncate(int fd, unsigned int length) {
+    return _io_syscall(SYS_FTRUNCATE, fd, (int)length, 0);
+}
+
+/**
+ * Create a directory
+ * @param path: Path of the new directory
+ * @return: 0 on success, -1 on error
+ */
+static inline int mkdir(const char *path) {
+    return _io_syscall(SYS_MKDIR, (int)path, 0, 0);
+}
+
+/**
+ * Remove a file or empty directory (fails while the file is open)
+ * @param path: Path of the entry
+ * @return: 0 on success, -1 on error
+ */
+static inline int unlink(const char *path) {
+    return _io_syscall(SYS_UNLINK, (int)path, 0, 0);
+}
+
 /**
  * Get file size
  * @param fd: File descriptor
@@ -326,6 +455,170 @@ static inline int fsize(int fd) {
     return _io_syscall(SYS_FSIZE, fd, 0, 0);
 }
 
+/**
+ * Set file position
+ * @param fd: File descriptor
+ * @param offset: Offset relative to whence (may be negative)
+ * @param whence: SEEK_SET, SEEK_CUR or SEEK_END
+ * @return: New position, or -1 on error
+ */
+static inline int lseek(int fd, int offset, int whence) {
+    return _io_syscall(SYS_LSEEK, fd, offset, whence);
+}
+
+/**
+ * Read from a file at an offset without moving the file position
+ * @param fd: File descriptor
+ * @param buf: Buffer to read into
+ * @param size: Number of bytes to read
+ * @param offset: File offset to read from
+ * @return: Number of bytes read, or -1 on error
+ */
+static inline int pread(int fd, char *buf, int size, unsigned int offset) {
+    /* Only three arguments fit in registers; pass the rest by pointer */
+    struct {
+        unsigned int buf;
+        unsigned int size;
+        unsigned int offset;
+    } args = { (unsigned int)buf, (unsigned int)size, offset };
+    return _io_syscall(SYS_PREAD, fd, (int)&args, 0);
+}
+
+/**
+ * Copy file data to another descriptor inside the kernel
+ * Avoids bouncing the data through a user buffer; cached file pages are
+ * written out directly.
+ * @param out_fd: STDOUT, or a file descriptor opened with O_WRITE
+ * @param in_fd: File descriptor to copy from
+ * @param offset: Offset in in_fd, or SENDFILE_CUR to copy from (and
+ *                advance) the file position
+ * @param count: Maximum number of bytes to copy
+ * @return: Number of bytes copied (0 at end of file), or -1 on error
+ */
+static inline int sendfile(int out_fd, int in_fd, unsigned int offset, unsigned int count) {
+    /* Only three arguments fit in registers; pass the rest by pointer */
+    struct {
+        unsigned int in_fd;
+        unsigned int offset;
+        unsigned int count;
+    } args = { (unsigned int)in_fd, offset, count };
+    return _io_syscall(SYS_SENDFILE, out_fd, (int)&args, 0);
+}
+
+/**
+ * Queue a read that completes in the background
+ * Returns at once; the data is in buf once poll_completion() or
+ * wait_completion() reports token. Leave buf alone until then.
+ * @param fd: File descriptor (may be closed before the read completes)
+ * @param buf: Buffer to read into
+ * @param len: Number of bytes to read
+ * @param off: File offset to read from
+ * @param token: Value reported back with the completion
+ * @return: 0 if queued, -1 on error or if AREAD_MAX reads are outstanding
+ */
+static inline int aread(int fd, char *buf, int len, unsigned int off, unsigned int token) {
+    /* Only three arguments fit in registers; pass the rest by pointer */
+    struct {
+        unsigned int buf;
+        unsigned int size;
+        unsigned int offset;
+        unsigned int token;
+    } args = { (unsigned int)buf, (unsigned int)len, off, token };
+    return _io_syscall(SYS_AREAD, fd, (int)&args, 0);
+}
+
+/**
+ * Take a finished background read without blocking
+ * @param c: Completion record to fill
+ * @return: 1 if a read finished, 0 if none is ready
+ */
+static inline int poll_completion(completion_t *c) {
+    return _io_syscall(SYS_POLL_COMPLETION, (int)c, 0, 0);
+}
+
+/**
+ * Wait for a background read to finish
+ * @param c: Completion record to fill
+ * @return: 1 if a read finished, 0 if no read is outstanding
+ */
+static inline int wait_completion(completion_t *c) {
+    return _io_syscall(SYS_WAIT_COMPLETION, (int)c, 0, 0);
+}
+
+/**
+ * Get file status by path (does not open the file)
+ * @param path: Path to the file or directory
+ * @param st: Pointer to stat_t structure to fill
+ * @return: 0 on success, -1 if not found
+ */
+static inline int stat(const char *path, stat_t *st) {
+    return _io_syscall(SYS_STAT, (int)path, (int)st, 0);
+}
+
+/**
+ * Get file status of an open file
+ * @param fd: File descriptor
+ * @param st: Pointer to stat_t structure to fill
+ * @return: 0 on success, -1 on error
+ */
+static inline int fstat(int fd, stat_t *st) {
+    return _io_syscall(SYS_FSTAT, fd, (int)st, 0);
+}
+
+/**
+ * Map an open file into memory (read-only)
+ * Pages are read on first access, straight from the kernel page cache.
+ * The mapping stays valid after fclose, until munmap or program exit.
+ * @param fd: File descriptor
+ * @param offset: File offset (multiple of 4096)
+ * @param length: Bytes to map (0 maps up to end of file)
+ * @return: Pointer to the file data, or 0 on error
+ */
+static inline const void *mmap(int fd, unsigned int offset, unsigned int length) {
+    return (const void *)_io_syscall(SYS_MMAP, fd, (int)offset, (int)length);
+}
+
+/**
+ * Remove a file mapping
+ * @param addr: Pointer returned by mmap
+ * @return: 0 on success, -1 on error
+ */
+static inline int munmap(const void *addr) {
+    return _io_syscall(SYS_MUNMAP, (int)addr, 0, 0);
+}
+
+/**
+ * Resolve a path to its normalized absolute form
+ * Handles ".", ".." and repeated slashes
+ * @param path: Path to resolve
+ * @param buf: Buffer to store the resolved path
+ * @param size: Buffer size
+ * @return: 0 on success, -1 if not found or the buffer is too small
+ */
+static inline int realpath(const char *path, char *buf, int size) {
+    return _io_syscall(SYS_REALPATH, (int)path, (int)buf, size);
+}
+
+/**
+ * Get filesystem I/O statistics
+ * @param st: Pointer to fs_stats_t structure to fill (may be NULL)
+ * @param reset: Non-zero to reset the counters after reading them
+ * @return: 0 on success
+ */
+static inline int fs_stats(fs_stats_t *st, int reset) {
+    return _io_syscall(SYS_FSSTATS, (int)st, reset, 0);
+}
+
+/**
+ * Get an entry of the mount table
+ * @param index: Entry index (the root filesystem comes first)
+ * @param info: Pointer to mount_info_t structure to fill
+ * @return: 0 on success, -1 past the last entry
+ */
+static inline int getmount(int index, mount_info_t *info) {
+    return _io_syscall(SYS_GETMOUNT, index, (int)info, 0);
+}
+
 /**
  * Read entire file into buffer (convenience function)
  * Opens, reads, and closes the file
@@ -356,4 +649,24 @@ static inline int read_file(const char *path, char *buf, int max_size) {
     return bytes_read;
 }
 
+#ifdef USER_RUNTIME
+/* Built against the shared runtime (see runtime.h): these calls go
+ * through its jump table and the definitions above stay unused */
+#include <runtime.h>
+
+#define print                (RUNTIME->print)
+#define print_color          (RUNTIME->print_color)
+#define print_int            (RUNTIME->print_int)
+#define print_hex            (RUNTIME->print_hex)
+#define print_hex_nibble     (RUNTIME->print_hex_nibble)
+#define print_hex16          (RUNTIME->print_hex16)
+#define print_hex8           (RUNTIME->print_hex8)
+#define println              (RUNTIME->println)
+#define print_error          (RUNTIME->print_error)
+#define print_success        (RUNTIME->print_success)
+#define print_warning        (RUNTIME->print_warning)
+#define print_info           (RUNTIME->print_info)
+#define read_file            (RUNTIME->read_file)
+#endif /* USER_RUNTIME */
+
 #endif /* USER_O_H */
@@ -101,12 +101,66 @@ static inline const char *pci_class_name(unsigned char class_code) {
  * ============================================ */
 
 #define PCI_IDS_PATH "/media/pci.ids"
-#define PCI_IDS_BUF_SIZE 8192
-#define PCI_LINE_BUF_SIZE 256
+#define PCI_IDS_PATH_CDROM "/cdrom/media/pci.ids"   /* When booted from initramfs */
 
-/* Static buffers for PCI IDs parsing */
-static char _pci_ids_buf[PCI_IDS_BUF_SIZE];
-static char _pci_line_buf[PCI_LINE_BUF_SIZE];
+/* pci.ids mapped into memory (once per program) */
+static const char *_pci_ids_map = 0;
+static int _pci_ids_size = 0;
+
+/**
+ * Map the pci.ids database into memory
+ * The file is read in place through the page cache, without a private copy.
+ * @return: 1 if the database is available, 0 otherwise
+ */
+static inline int _pci_ids_open(void) {
+    if (_pci_ids_map) {
+        return 1;
+    }
+    
+    int fd = fopen(PCI_IDS_PATH);
+    if (fd < 0) {
+        fd = fopen(PCI_IDS_PATH_CDROM);
+    }
+    if (fd < 0) {
+        return 0;
+    }
+    
+    _pci_ids_size = fsize(fd);
+    _pci_ids_map = (const char *)mmap(fd, 0, _pci_ids_size);
+    fclose(fd);     /* The mapping stays valid after close */
+    
+    return _pci_ids_map != 0;
+}
+
+/**
+ * Get the line starting at pos
+ * @param pos: Offset of the line start; advanced to the next line
+ * @param len: Set to the line length (without line terminator)
+ * @return: Pointer to the line
+ */
+static inline const char *_pci_ids_line(int *pos, int *len) {
+    const char *line = _pci_ids_map + *pos;
+    int n = 0;
+    
+    while (*pos + n < _pci_ids_size && line[n] != '\n' && line[n] != '\r') {
+        n++;
+    }
+    
+    *len = n;
+    *pos += n + 1;
+    return line;
+}
+
+/**
+ * Copy a name from a pci.ids line
+ */
+static inline void _pci_ids_copy_name(const char *line, int start, int len, char *name_buf) {
+    int name_idx = 0;
+    for (int j = start; j < len && name_idx < 63; j++) {
+        name_buf[name_idx++] = line[j];
+    }
+    name_buf[name_idx] = '\0';
+}
 
 /**
  * Look up a vendor name from pci.ids database
@@ -115,52 +169,25 @@ static char _pci_line_buf[PCI_LINE_BUF_SIZE];
  * @return: 1 if found, 0 if not found
  */
 static inline int pci_lookup_vendor(unsigned short vendor_id, char *name_buf) {
-    int fd = fopen(PCI_IDS_PATH);
-    if (fd < 0) {
+    if (!_pci_ids_open()) {
         return 0;
     }
     
-    int found = 0;
-    int line_pos = 0;
-    int bytes_read;
+    int pos = 0;
+    int len;
     
-    while ((bytes_read = fread(fd, _pci_ids_buf, PCI_IDS_BUF_SIZE - 1)) > 0) {
-        _pci_ids_buf[bytes_read] = '\0';
+    while (pos < _pci_ids_size) {
+        const char *line = _pci_ids_line(&pos, &len);
         
-        for (int i = 0; i < bytes_read; i++) {
-            char c = _pci_ids_buf[i];
-            
-            if (c == '\n' || c == '\r') {
-                /* End of line - check if this is our vendor */
-                _pci_line_buf[line_pos] = '\0';
-                
-                /* Vendor lines start with 4 hex digits followed by 2 spaces */
-                if (line_pos >= 6 && 
-                    match_hex4(_pci_line_buf, vendor_id) &&
-                    _pci_line_buf[4] == ' ' && _pci_line_buf[5] == ' ') {
-                    
-                    /* Found! Copy the name */
-                    int name_idx = 0;
-                    int j = 6;
-                    while (_pci_line_buf[j] && name_idx < 63) {
-                        name_buf[name_idx++] = _pci_line_buf[j++];
-                    }
-                    name_buf[name_idx] = '\0';
-                    found = 1;
-                    break;
-                }
-                
-                line_pos = 0;
-            } else if (line_pos < PCI_LINE_BUF_SIZE - 1) {
-                _pci_line_buf[line_pos++] = c;
-            }
+        /* Vendor lines start with 4 hex digits followed by 2 spaces */
+        if (len >= 6 && match_hex4(line, vendor_id) &&
+            line[4] == ' ' && line[5] == ' ') {
+            _pci_ids_copy_name(line, 6, len, name_buf);
+            return 1;
         }
-        
-        if (found) break;
     }
     
-    fclose(fd);
-    return found;
+    return 0;
 }
 
 /**
@@ -171,78 +198,41 @@ static inline int pci_lookup_vendor(unsigned short vendor_id, char *name_buf) {
  * @return: 1 if found, 0 if not found
  */
 static inline int pci_lookup_device(unsigned short vendor_id, unsigned short device_id, char *name_buf) {
-    int fd = fopen(PCI_IDS_PATH);
-    if (fd < 0) {
+    if (!_pci_ids_open()) {
         return 0;
     }
     
-    int found = 0;
     int in_vendor_section = 0;
-    int found_vendor = 0;
-    int line_pos = 0;
-    int bytes_read;
+    int pos = 0;
+    int len;
     
-    while ((bytes_read = fread(fd, _pci_ids_buf, PCI_IDS_BUF_SIZE - 1)) > 0) {
-        _pci_ids_buf[bytes_read] = '\0';
+    while (pos < _pci_ids_size) {
+        const char *line = _pci_ids_line(&pos, &len);
         
-        for (int i = 0; i < bytes_read; i++) {
-            char c = _pci_ids_buf[i];
-            
-            if (c == '\n' || c == '\r') {
-                /* End of line - process it */
-                _pci_line_buf[line_pos] = '\0';
-                
-                if (line_pos > 0) {
-                    /* Check if this is our vendor line (starts with vendor ID) */
-                    if (_pci_line_buf[0] != '\t' && _pci_line_buf[0] != '#' &&
-                        line_pos >= 6 &&
-                        match_hex4(_pci_line_buf, vendor_id) &&
-                        _pci_line_buf[4] == ' ' && _pci_line_buf[5] == ' ') {
-                        in_vendor_section = 1;
-                        found_vendor = 1;
-                    }
-                    /* Check if we've hit another vendor (line starts with hex, not tab) */
-                    else if (in_vendor_section && 
-                             _pci_line_buf[0] != '\t' && 
-                             _pci_line_buf[0] != '#' &&
-                             isxdigit(_pci_line_buf[0])) {
-                        /* New vendor section started, stop searching */
-                        in_vendor_section = 0;
-                        break;
-                    }
-                    /* Check for device line (starts with single tab + hex) */
-                    else if (in_vendor_section && 
-                             _pci_line_buf[0] == '\t' && 
-                             _pci_line_buf[1] != '\t' &&  /* Not subsystem (double tab) */
-                             line_pos >= 7 &&
-                             match_hex4(_pci_line_buf + 1, device_id) &&
-                             _pci_line_buf[5] == ' ' && _pci_line_buf[6] == ' ') {
-                        
-                        /* Found! Copy the name */
-                        int name_idx = 0;
-                        int j = 7;
-                        while (_pci_line_buf[j] && name_idx < 63) {
-                            name_buf[name_idx++] = _pci_line_buf[j++];
-                        }
-                        name_buf[name_idx] = '\0';
-                        found = 1;
-                        break;
-                    }
-                }
-                
-                line_pos = 0;
-            } else if (line_pos < PCI_LINE_BUF_SIZE - 1) {
-                _pci_line_buf[line_pos++] = c;
-            }
+        if (len == 0 || line[0] == '#') {
+            continue;
         }
         
-        /* Stop if found, or if we were in vendor section and left it */
-        if (found) break;
-        if (found_vendor && !in_vendor_section) break;
+        if (line[0] != '\t') {
+            /* A vendor line: ours starts the section, any other ends it */
+            if (in_vendor_section) {
+                break;
+            }
+            if (len >= 6 && match_hex4(line, vendor_id) &&
+                line[4] == ' ' && line[5] == ' ') {
+                in_vendor_section = 1;
+            }
+        }
+        /* Device line (single tab + hex, not a double-tab subsystem line) */
+        else if (in_vendor_section && len >= 7 && line[1] != '\t' &&
+                 match_hex4(line + 1, device_id) &&
+                 line[5] == ' ' && line[6] == ' ') {
+            _pci_ids_copy_name(line, 7, len, name_buf);
+            return 1;
+        }
     }
     
-    fclose(fd);
-    return found;
+    return 0;
 }
 
 #endif /* USER_PCI_H */
@@ -0,0 +1,91 @@
+/**
+ * Shared Runtime Header
+ * Jump table of the runtime library shared by all user programs
+ *
+ * The kernel loads the runtime image (built from src/user/runtime.c) once
+ * at boot to RUNTIME_BASE. It starts with this table; programs compiled
+ * with USER_RUNTIME defined call the library functions through it instead
+ * of carrying their own copies. Entries are only ever appended, so a
+ * program keeps working with a newer runtime.
+ */
+
+#ifndef USER_RUNTIME_H
+#define USER_RUNTIME_H
+
+#include <string.h>
+
+/* Load address of the runtime image (matches kernel layout) */
+#define RUNTIME_BASE        0x02400000
+
+/* First word of the table */
+#define RUNTIME_MAGIC       0x544E5552  /* "RUNT" in little endian */
+
+/* Jump table (the kernel checks magic and that count entries fit the image) */
+typedef struct {
+    unsigned int magic;         /* RUNTIME_MAGIC */
+    unsigned int count;         /* Function entries following */
+
+    /* string.h */
+    size_t (*strlen)(const char *str);
+    int (*strcmp)(const char *s1, const char *s2);
+    int (*strncmp)(const char *s1, const char *s2, size_t n);
+    char *(*strcpy)(char *dest, const char *src);
+    char *(*strncpy)(char *dest, const char *src, size_t n);
+    char *(*strcat)(char *dest, const char *src);
+    char *(*strncat)(char *dest, const char *src, size_t n);
+    char *(*strchr)(const char *s, int c);
+    char *(*strrchr)(const char *s, int c);
+    void *(*memset)(void *s, int c, size_t n);
+    void *(*memcpy)(void *dest, const void *src, size_t n);
+    void *(*memmove)(void *dest, const void *src, size_t n);
+    int (*memcmp)(const void *s1, const void *s2, size_t n);
+    char *(*strstr)(const char *haystack, const char *needle);
+    size_t (*strspn)(const char *s, const char *accept);
+    size_t (*strcspn)(const char *s, const char *reject);
+
+    /* io.h */
+    int (*print)(const char *str);
+    int (*print_color)(const char *str, int fg, int bg);
+    void (*print_int)(int n);
+    void (*print_hex)(unsigned int n);
+    void (*print_hex_nibble)(unsigned char val);
+    void (*print_hex16)(unsigned short val);
+    void (*print_hex8)(unsigned char val);
+    int (*println)(const char *str);
+    void (*print_error)(const char *str);
+    void (*print_success)(const char *str);
+    void (*print_warning)(const char *str);
+    void (*print_info)(const char *str);
+    int (*read_file)(const char *path, char *buf, int max_size);
+
+    /* utils.h */
+    int (*hex_char_value)(int c);
+    int (*match_hex4)(const char *str, unsigned short val);
+    const char *(*skip_whitespace)(const char *s);
+    void (*str_tolower)(char *s);
+    void (*str_toupper)(char *s);
+    int (*atoi)(const char *s);
+    const char *(*get_word)(const char *s, char *word, int max_len);
+    char *(*itoa)(int n, char *buf, int base);
+    char *(*utoa)(unsigned int n, char *buf, int base);
+    int (*parse_int)(const char *s);
+} runtime_table_t;
+
+/* Function entries in this version of the table */
+#define RUNTIME_ENTRIES \
+    ((sizeof(runtime_table_t) - 2 * sizeof(unsigned int)) / sizeof(void (*)(void)))
+
+/* The table in the loaded runtime */
+#define RUNTIME ((const runtime_table_t *)RUNTIME_BASE)
+
+/**
+ * Check that the loaded runtime has every entry this program calls
+ * A runtime built from an older table ends earlier; call this at startup
+ * before any library function.
+ * @return 1 if the runtime is new enough, 0 otherwise
+ */
+static inline int runtime_check(void) {
+    return RUNTIME->count >= RUNTIME_ENTRIES;
+}
+
+#endif /* USER_RUNTIME_H */
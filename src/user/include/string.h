@@ -233,4 +233,27 @@ static inline size_t strcspn(const char *s, const char *reject) {
     return count;
 }
 
+#ifdef USER_RUNTIME
+/* Built against the shared runtime (see runtime.h): these calls go
+ * through its jump table and the definitions above stay unused */
+#include <runtime.h>
+
+#define strlen      (RUNTIME->strlen)
+#define strcmp      (RUNTIME->strcmp)
+#define strncmp     (RUNTIME->strncmp)
+#define strcpy      (RUNTIME->strcpy)
+#define strncpy     (RUNTIME->strncpy)
+#define strcat      (RUNTIME->strcat)
+#define strncat     (RUNTIME->strncat)
+#define strchr      (RUNTIME->strchr)
+#define strrchr     (RUNTIME->strrchr)
+#define memset      (RUNTIME->memset)
+#define memcpy      (RUNTIME->memcpy)
+#define memmove     (RUNTIME->memmove)
+#define memcmp      (RUNTIME->memcmp)
+#define strstr      (RUNTIME->strstr)
+#define strspn      (RUNTIME->strspn)
+#define strcspn     (RUNTIME->strcspn)
+#endif /* USER_RUNTIME */
+
 #endif /* USER_STRING_H */
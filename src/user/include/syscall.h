@@ -12,14 +12,81 @@
 #define SYS_BEEP    6
 #define SYS_EXEC    8
 #define SYS_MEMINFO 27
+#define SYS_UPTIME  30
+#define SYS_IMGCACHE 46
+#define SYS_EXECPROF 47
+#define SYS_KMEMSTAT 48
 
 /* Memory information structure */
 typedef struct {
     unsigned int mem_lower;     /* Lower memory in KB (below 1MB) */
     unsigned int mem_upper;     /* Upper memory in KB (above 1MB) */
     unsigned int total_kb;      /* Total usable memory in KB */
+    unsigned int frames_free;   /* 4KB frames free in the frame allocator */
+    unsigned int frames_used;   /* Frames it has handed out */
 } mem_info_t;
 
+/* Program image cache status */
+typedef struct {
+    unsigned int images;        /* Programs cached */
+    unsigned int bytes_used;    /* Cache bytes in use */
+    unsigned int bytes_total;   /* Cache size (0 if memory is too small) */
+    unsigned int hits;          /* Program loads served from the cache */
+    unsigned int misses;        /* Program loads that read the file */
+} imgcache_info_t;
+
+/* Cached program image */
+typedef struct {
+    char path[64];              /* Path it was loaded from */
+    unsigned int bytes;         /* Cache bytes used */
+    unsigned int hits;          /* Loads served from the cache */
+} imgcache_image_t;
+
+/* Startup phases in exec_profile_t (match the kernel loader) */
+#define EXEC_PHASE_LOOKUP       0   /* Image cache and path lookup */
+#define EXEC_PHASE_HEADERS      1   /* Reading and checking the headers */
+#define EXEC_PHASE_PLACE        2   /* Choosing addresses, saving programs in the way */
+#define EXEC_PHASE_SEGMENTS     3   /* Copying or decoding segment contents */
+#define EXEC_PHASE_PAGER        4   /* Mapping the pages, zeroing BSS */
+#define EXEC_PHASE_RELOCATE     5   /* Applying relocations */
+#define EXEC_PHASE_EXEC         6   /* From exec to the entry point */
+#define EXEC_PHASES             7
+
+/* exec_profile_t flags */
+#define EXEC_PROFILE_CACHED     0x01    /* Image came from the image cache */
+#define EXEC_PROFILE_COMPRESSED 0x02    /* Decoded from a compressed executable */
+#define EXEC_PROFILE_PIE        0x04    /* Position-independent, relocated */
+#define EXEC_PROFILE_RAN        0x08    /* Loaded and started */
+
+/* Startup profile of a program (times in microseconds) */
+typedef struct {
+    char name[64];              /* Path the program was loaded from */
+    unsigned int flags;         /* EXEC_PROFILE_* */
+    int result;                 /* Exit code, or the load error */
+    unsigned int phase_us[EXEC_PHASES];
+    unsigned int run_us;        /* From the entry point to the exit */
+    unsigned int load_addr;     /* Lowest segment address */
+    unsigned int mem_size;      /* Bytes from load_addr to the end of the image */
+    unsigned int bytes_read;    /* File bytes read while loading */
+    unsigned int bytes_zeroed;  /* BSS bytes zeroed while loading */
+    unsigned int run_pages;     /* Pages filled on first access while running */
+    unsigned int run_bytes_read; /* File bytes read for them */
+} exec_profile_t;
+
+/* Kernel object cache statistics */
+typedef struct {
+    char name[16];              /* Cache name ("kmalloc-large" for frame blocks) */
+    unsigned int object_size;   /* Bytes per object (0 for frame blocks) */
+    unsigned int slab_size;     /* Bytes per slab */
+    unsigned int slabs;         /* Slabs (frame blocks) held */
+    unsigned int objects;       /* Objects the slabs hold */
+    unsigned int in_use;        /* Objects allocated */
+    unsigned int peak;          /* Most objects allocated at once */
+    unsigned int allocs;        /* Allocations */
+    unsigned int frees;         /* Frees */
+    unsigned int failures;      /* Allocations that found no memory */
+} kmem_cache_info_t;
+
 /**
  * Make a system call with up to 3 arguments
  */
@@ -63,8 +130,9 @@ static inline void beep(int freq, int duration) {
 
 /**
  * Execute a program
+ * The caller is suspended while the program runs and continues when it exits.
  * @param path: Path to program
- * @return: -1 on error, does not return on success
+ * @return: Exit code of the program, -1 if it could not be loaded
  */
 static inline int exec(const char *path) {
     return syscall(SYS_EXEC, (int)path, 0, 0);
@@ -79,4 +147,58 @@ static inline int get_mem_info(mem_info_t *info) {
     return syscall(SYS_MEMINFO, (int)info, 0, 0);
 }
 
+/**
+ * Get program image cache status
+ * @param info: Pointer to imgcache_info_t structure to fill
+ * @return: 0 on success, -1 on error
+ */
+static inline int get_imgcache_info(imgcache_info_t *info) {
+    return syscall(SYS_IMGCACHE, -1, (int)info, 0);
+}
+
+/**
+ * Get a cached program image
+ * @param index: Image index (0 to images - 1)
+ * @param image: Pointer to imgcache_image_t structure to fill
+ * @return: 0 on success, -1 past the last image
+ */
+static inline int get_imgcache_image(int index, imgcache_image_t *image) {
+    return syscall(SYS_IMGCACHE, index, (int)image, 0);
+}
+
+/**
+ * Get a recent program startup profile
+ * A profile is recorded when its program exits or fails to load, so the
+ * profile of a program that ran others comes after theirs.
+ * @param index: 0 for the most recent, up to 7
+ * @param profile: Pointer to exec_profile_t structure to fill
+ * @return: 0 on success, -1 past the last recorded profile
+ */
+static inline int get_exec_profile(int index, exec_profile_t *profile) {
+    return syscall(SYS_EXECPROF, index, (int)profile, 0);
+}
+
+/**
+ * Get the statistics of a kernel object cache
+ * The caches come in creation order (kmalloc size classes, then the
+ * ones for specific objects), followed by one entry for kernel
+ * allocations too large for a size class.
+ * @param index: Cache index, from 0
+ * @param info: Pointer to kmem_cache_info_t structure to fill
+ * @return: 0 on success, -1 past the last entry
+ */
+static inline int get_kmem_cache_info(int index, kmem_cache_info_t *info) {
+    return syscall(SYS_KMEMSTAT, index, (int)info, 0);
+}
+
+/**
+ * Get time since boot in microseconds
+ * Useful for timing code; wraps after about 71 minutes, so use
+ * unsigned subtraction for intervals.
+ * @return: Microseconds since the timer was initialized
+ */
+static inline unsigned int uptime_us(void) {
+    return (unsigned int)syscall(SYS_UPTIME, 0, 0, 0);
+}
+
 #endif /* USER_SYSCALL_H */
@@ -350,4 +350,21 @@ static inline int clamp(int value, int min_val, int max_val) {
     return value;
 }
 
+#ifdef USER_RUNTIME
+/* Built against the shared runtime (see runtime.h): these calls go
+ * through its jump table and the definitions above stay unused */
+#include <runtime.h>
+
+#define hex_char_value      (RUNTIME->hex_char_value)
+#define match_hex4          (RUNTIME->match_hex4)
+#define skip_whitespace     (RUNTIME->skip_whitespace)
+#define str_tolower         (RUNTIME->str_tolower)
+#define str_toupper         (RUNTIME->str_toupper)
+#define atoi                (RUNTIME->atoi)
+#define get_word            (RUNTIME->get_word)
+#define itoa                (RUNTIME->itoa)
+#define utoa                (RUNTIME->utoa)
+#define parse_int           (RUNTIME->parse_int)
+#endif /* USER_RUNTIME */
+
 #endif /* USER_UTILS_H */
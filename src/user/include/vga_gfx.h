@@ -36,6 +36,8 @@
 #define SYS_VGA_INIT_X    22
 #define SYS_VGA_PALETTE   23
 #define SYS_VGA_INIT_Y    24
+#define SYS_VGA_BLIT      49
+#define SYS_VGA_WC        50
 
 /* VGA 16-color palette */
 #define GFX_BLACK           0
@@ -222,4 +224,31 @@ static inline int gfx_rgb(int r, int g, int b) {
     return (r & 0x3F) | ((g & 0x3F) << 8) | ((b & 0x3F) << 16);
 }
 
+/**
+ * Copy a block of pixels to the screen (modes 13h, X and Y)
+ * Much faster than drawing pixel by pixel; the block is clipped to the
+ * screen.
+ * @param x: Left edge (may be negative)
+ * @param y: Top edge (may be negative)
+ * @param w: Block width
+ * @param h: Block height
+ * @param pixels: w * h color indices, row by row
+ * @return 0 on success, -1 if not in a 256-color mode or the block is empty
+ */
+static inline int gfx_blit(int x, int y, int w, int h, const unsigned char *pixels) {
+    int xy = (x & 0xFFFF) | ((y & 0xFFFF) << 16);
+    int wh = (w & 0xFFFF) | ((h & 0xFFFF) << 16);
+    return _gfx_syscall(SYS_VGA_BLIT, xy, wh, (int)pixels);
+}
+
+/**
+ * Choose whether the 256-color modes map video memory write-combining
+ * Enabled by default where the CPU supports it.
+ * @param enable: Nonzero for write-combining, 0 for the default memory type
+ * @return 0 on success, -1 if the CPU cannot write-combine
+ */
+static inline int gfx_set_write_combining(int enable) {
+    return _gfx_syscall(SYS_VGA_WC, enable, 0, 0);
+}
+
 #endif /* USER_VGA_GFX_H */
@@ -0,0 +1,437 @@
+/**
+ * Filesystem Benchmark
+ * Times directory listings and path lookups on the boot filesystem
+ *
+ * Build a benchmark image with "make bench-iso" to get a /bench tree
+ * with configurable shapes (wide, long names, deep nesting). Without
+ * it, the standard /user and /media directories are measured instead
+ * (/cdrom/media when the root is the initramfs).
+ *
+ * For every directory the program reports:
+ *   - full listing time and sectors read
+ *   - microseconds and sectors per lookup for the first, middle and
+ *     last entry (hits) and for a name that does not exist (miss)
+ *
+ * A large file is also read twice to show the effect of the page cache,
+ * then copied to /tmp once through a user buffer and once with sendfile.
+ * Finally a scratch file is written to and read back from /tmp (RAM).
+ */
+
+#include <io.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Lookups per measured name (averaged) */
+#define LOOKUP_REPEAT   8
+
+/* Deepest path walked in /bench/deep */
+#define MAX_DEPTH       64
+
+/* Path buffer size */
+#define PATH_MAX_LEN    1024
+
+/* Read chunk size for file benchmarks */
+#define READ_CHUNK      4096
+
+/* Scratch file written to tmpfs */
+#define TMP_FILE        "/tmp/fsbench.tmp"
+#define TMP_SIZE        (256 * 1024)
+
+/* Copy target for the sendfile comparison */
+#define COPY_FILE       "/tmp/fsbench.copy"
+
+static char path_buf[PATH_MAX_LEN];
+static char name_buf[256];
+static char read_buf[READ_CHUNK];
+
+/**
+ * Join a directory and a name into dst
+ */
+static void join_path(char *dst, const char *dir, const char *name) {
+    strcpy(dst, dir);
+    int len = strlen(dst);
+    if (len == 0 || dst[len - 1] != '/') {
+        strcat(dst, "/");
+    }
+    strcat(dst, name);
+}
+
+/**
+ * Print a right-aligned unsigned number
+ */
+static void print_uint_pad(unsigned int n, int width) {
+    char buf[12];
+    int len = 0;
+
+    do {
+        buf[len++] = '0' + (n % 10);
+        n /= 10;
+    } while (n && len < 11);
+
+    while (width-- > len) {
+        putchar(' ');
+    }
+    while (len--) {
+        putchar(buf[len]);
+    }
+}
+
+/**
+ * Print one result line: label, microseconds and sectors
+ */
+static void print_result(const char *label, unsigned int us, unsigned int sectors) {
+    print("  ");
+    print(label);
+    int pad = 14 - (int)strlen(label);
+    while (pad-- > 0) {
+        putchar(' ');
+    }
+    print_uint_pad(us, 9);
+    print(" us ");
+    print_uint_pad(sectors, 7);
+    print(" sectors\n");
+}
+
+/**
+ * Check whether a path names a directory
+ */
+static int is_dir(const char *path) {
+    stat_t st;
+    return stat(path, &st) == 0 && st.type == FILE_TYPE_DIR;
+}
+
+/**
+ * List a whole directory, optionally remembering the entry at one index
+ * @param dir: Directory path
+ * @param want: Entry index (excluding . and ..) to copy into out, or -1
+ * @param out: Buffer for the wanted name (may be NULL)
+ * @return: Number of entries excluding . and ..
+ */
+static int list_dir(const char *dir, int want, char *out) {
+    char entry[256];
+    int index = 0;
+    int count = 0;
+
+    while (readdir(dir, index, entry) > 0) {
+        if (strcmp(entry, ".") != 0 && strcmp(entry, "..") != 0) {
+            if (count == want && out) {
+                strcpy(out, entry);
+            }
+            count++;
+        }
+        index++;
+    }
+
+    return count;
+}
+
+/**
+ * Time LOOKUP_REPEAT lookups of one path and print the per-lookup cost
+ */
+static void bench_lookup(const char *label, const char *path) {
+    fs_stats_t fst;
+    stat_t st;
+
+    fs_stats(0, 1);
+    unsigned int start = uptime_us();
+    for (int i = 0; i < LOOKUP_REPEAT; i++) {
+        stat(path, &st);
+    }
+    unsigned int elapsed = uptime_us() - start;
+    fs_stats(&fst, 0);
+
+    print_result(label, elapsed / LOOKUP_REPEAT, fst.sectors_read / LOOKUP_REPEAT);
+}
+
+/**
+ * Benchmark a single directory: full listing plus hit/miss lookups
+ */
+static void bench_dir(const char *dir) {
+    fs_stats_t fst;
+
+    if (!is_dir(dir)) {
+        return;
+    }
+
+    setcolor(COLOR_WHITE, COLOR_BLACK);
+    print(dir);
+    setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+
+    /* Full listing */
+    fs_stats(0, 1);
+    unsigned int start = uptime_us();
+    int count = list_dir(dir, -1, 0);
+    unsigned int elapsed = uptime_us() - start;
+    fs_stats(&fst, 0);
+
+    print(" (");
+    print_int(count);
+    print(" entries)\n");
+    print_result("listing", elapsed, fst.sectors_read);
+
+    if (count > 0) {
+        int picks[3] = { 0, count / 2, count - 1 };
+        const char *labels[3] = { "lookup first", "lookup middle", "lookup last" };
+
+        for (int i = 0; i < 3; i++) {
+            list_dir(dir, picks[i], name_buf);
+            join_path(path_buf, dir, name_buf);
+            bench_lookup(labels[i], path_buf);
+        }
+    }
+
+    join_path(path_buf, dir, "zz_no_such_entry");
+    bench_lookup("lookup miss", path_buf);
+}
+
+/**
+ * Benchmark path resolution down a nested directory chain
+ */
+static void bench_deep(const char *root) {
+    char entry[256];
+    int depth = 0;
+
+    if (!is_dir(root)) {
+        return;
+    }
+
+    /* Follow the first subdirectory at each level */
+    strcpy(path_buf, root);
+    while (depth < MAX_DEPTH) {
+        int index = 0;
+        int found = 0;
+        int len = strlen(path_buf);
+
+        while (readdir(path_buf, index++, entry) > 0) {
+            if (strcmp(entry, ".") == 0 || strcmp(entry, "..") == 0) {
+                continue;
+            }
+            if (len + 1 + (int)strlen(entry) >= PATH_MAX_LEN) {
+                break;
+            }
+            strcat(path_buf, "/");
+            strcat(path_buf, entry);
+            if (is_dir(path_buf)) {
+                found = 1;
+                break;
+            }
+            path_buf[len] = '\0';
+        }
+
+        if (!found) {
+            break;
+        }
+        depth++;
+    }
+
+    setcolor(COLOR_WHITE, COLOR_BLACK);
+    print(root);
+    setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+    print(" (depth ");
+    print_int(depth);
+    print(")\n");
+    bench_lookup("lookup path", path_buf);
+}
+
+/**
+ * Read a whole file in chunks and print the time and sectors it took
+ */
+static void bench_read(const char *label, const char *path) {
+    fs_stats_t fst;
+
+    fs_stats(0, 1);
+    unsigned int start = uptime_us();
+    int fd = fopen(path);
+    if (fd < 0) {
+        return;
+    }
+    while (fread(fd, read_buf, READ_CHUNK) > 0) {
+    }
+    fclose(fd);
+    unsigned int elapsed = uptime_us() - start;
+    fs_stats(&fst, 0);
+
+    print_result(label, elapsed, fst.sectors_read);
+}
+
+/**
+ * Scan a whole file through a memory mapping
+ */
+static void bench_mmap(const char *label, const char *path) {
+    fs_stats_t fst;
+    volatile unsigned int sum = 0;
+
+    fs_stats(0, 1);
+    unsigned int start = uptime_us();
+    int fd = fopen(path);
+    if (fd < 0) {
+        return;
+    }
+    int size = fsize(fd);
+    const unsigned char *data = (const unsigned char *)mmap(fd, 0, size);
+    fclose(fd);
+    if (!data) {
+        return;
+    }
+    for (int i = 0; i < size; i++) {
+        sum += data[i];
+    }
+    munmap(data);
+    unsigned int elapsed = uptime_us() - start;
+    fs_stats(&fst, 0);
+
+    print_result(label, elapsed, fst.sectors_read);
+}
+
+/**
+ * Benchmark cold and warm sequential reads of a file
+ */
+static void bench_file(const char *path) {
+    stat_t st;
+
+    if (stat(path, &st) != 0 || st.type != FILE_TYPE_FILE) {
+        return;
+    }
+
+    setcolor(COLOR_WHITE, COLOR_BLACK);
+    print(path);
+    setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+    print(" (");
+    print_int(st.size);
+    print(" bytes)\n");
+
+    bench_read("first read", path);
+    bench_read("second read", path);
+    bench_mmap("mapped scan", path);
+}
+
+/**
+ * Copy a file to COPY_FILE and print the time it took
+ * @param kernel: Non-zero to copy with sendfile, zero for a read/write loop
+ */
+static void bench_copy_pass(const char *label, const char *path, int kernel) {
+    fs_stats_t fst;
+    
+    fs_stats(0, 1);
+    unsigned int start = uptime_us();
+    int in = fopen(path);
+    if (in < 0) {
+        return;
+    }
+    int out = open(COPY_FILE, O_WRITE | O_CREATE | O_TRUNC);
+    if (out < 0) {
+        print_error("  cannot open " COPY_FILE "\n");
+        fclose(in);
+        return;
+    }
+    if (kernel) {
+        sendfile(out, in, SENDFILE_CUR, fsize(in));
+    } else {
+        int n;
+        while ((n = fread(in, read_buf, READ_CHUNK)) > 0) {
+            fwrite(out, read_buf, n);
+        }
+    }
+    fclose(out);
+    fclose(in);
+    unsigned int elapsed = uptime_us() - start;
+    fs_stats(&fst, 0);
+    
+    print_result(label, elapsed, fst.sectors_read);
+}
+
+/**
+ * Benchmark copying a file to /tmp through user space and in the kernel
+ */
+static void bench_copy(const char *path) {
+    stat_t st;
+    
+    if (stat(path, &st) != 0 || st.type != FILE_TYPE_FILE || !is_dir("/tmp")) {
+        return;
+    }
+    
+    setcolor(COLOR_WHITE, COLOR_BLACK);
+    print(path);
+    setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+    print(" -> " COPY_FILE "\n");
+    
+    bench_copy_pass("read loop", path, 0);
+    bench_copy_pass("sendfile", path, 1);
+    unlink(COPY_FILE);
+}
+
+/**
+ * Time one pass over the scratch file (write or read back)
+ */
+static void bench_tmp_pass(const char *label, int writing) {
+    fs_stats_t fst;
+    int done = 0;
+
+    fs_stats(0, 1);
+    unsigned int start = uptime_us();
+    int fd = writing ? open(TMP_FILE, O_WRITE | O_CREATE | O_TRUNC) : fopen(TMP_FILE);
+    if (fd < 0) {
+        print_error("  cannot open " TMP_FILE "\n");
+        return;
+    }
+    while (done < TMP_SIZE) {
+        int n = writing ? fwrite(fd, read_buf, READ_CHUNK) : fread(fd, read_buf, READ_CHUNK);
+        if (n <= 0) {
+            break;
+        }
+        done += n;
+    }
+    fclose(fd);
+    unsigned int elapsed = uptime_us() - start;
+    fs_stats(&fst, 0);
+
+    print_result(label, elapsed, fst.sectors_read);
+}
+
+/**
+ * Benchmark writing and reading a scratch file on /tmp
+ */
+static void bench_tmp(void) {
+    if (!is_dir("/tmp")) {
+        return;
+    }
+
+    setcolor(COLOR_WHITE, COLOR_BLACK);
+    print(TMP_FILE);
+    setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+    print(" (");
+    print_int(TMP_SIZE);
+    print(" bytes)\n");
+
+    memset(read_buf, 'x', READ_CHUNK);
+    bench_tmp_pass("write", 1);
+    bench_tmp_pass("read", 0);
+    unlink(TMP_FILE);
+}
+
+/* Program entry point */
+void _start(void) {
+    println("Filesystem benchmark (per-lookup averages over 8 runs)");
+    newline();
+
+    if (is_dir("/bench")) {
+        bench_dir("/bench/wide");
+        bench_dir("/bench/long");
+        bench_deep("/bench/deep");
+    } else if (is_dir("/cdrom/bench")) {
+        bench_dir("/cdrom/bench/wide");
+        bench_dir("/cdrom/bench/long");
+        bench_deep("/cdrom/bench/deep");
+    } else {
+        print_warning("No /bench tree; build the image with 'make bench-iso'\n");
+        bench_dir("/user");
+        bench_dir(is_dir("/media") ? "/media" : "/cdrom/media");
+    }
+
+    const char *big_file = is_dir("/media") ? "/media/pci.ids" : "/cdrom/media/pci.ids";
+    bench_file(big_file);
+    bench_copy(big_file);
+    bench_tmp();
+
+    exit(0);
+}
@@ -0,0 +1,181 @@
+/**
+ * Graphics Benchmark
+ * Times full-screen clears and blits with and without write-combining
+ *
+ * For every graphics mode the screen is cleared FRAMES times, and in the
+ * 256-color modes a full-screen image is blitted FRAMES times, once with
+ * video memory mapped uncached (the default memory type) and once mapped
+ * write-combining. The program then returns to text mode and prints the
+ * microseconds per frame and the speedup.
+ *
+ * Mode 12h always keeps the default type (its drawing reads video memory
+ * to load the VGA latches), so it is timed once as a reference. On CPUs
+ * without PAT only the default type is measured. Emulators usually ignore
+ * memory types, so the difference only shows on real hardware.
+ */
+
+#include <io.h>
+#include <string.h>
+#include <syscall.h>
+#include <vga_gfx.h>
+
+/* Frames timed per measurement */
+#define FRAMES          32
+
+/* Largest screen of the 256-color modes (mode X) */
+#define IMAGE_SIZE      (GFX_WIDTH_X * GFX_HEIGHT_X)
+
+/* Result of one mode */
+typedef struct {
+    const char *name;
+    int width;
+    int height;
+    unsigned int clear_us[2];   /* Per frame: default type, write-combining */
+    unsigned int blit_us[2];
+} mode_result_t;
+
+static unsigned char image[IMAGE_SIZE];
+
+/**
+ * Time FRAMES clears
+ * @return Microseconds per frame
+ */
+static unsigned int time_clear(void) {
+    unsigned int start = uptime_us();
+    for (int i = 0; i < FRAMES; i++) {
+        gfx_clear(i & 0x0F);
+    }
+    return (uptime_us() - start) / FRAMES;
+}
+
+/**
+ * Time FRAMES full-screen blits
+ * @return Microseconds per frame
+ */
+static unsigned int time_blit(int width, int height) {
+    unsigned int start = uptime_us();
+    for (int i = 0; i < FRAMES; i++) {
+        gfx_blit(0, 0, width, height, image);
+    }
+    return (uptime_us() - start) / FRAMES;
+}
+
+/**
+ * Time the clears and blits of the current 256-color mode
+ * @param wc: Write-combining can be switched
+ */
+static void bench_mode(mode_result_t *res, int wc) {
+    for (int pass = 0; pass < 2; pass++) {
+        if (wc) {
+            gfx_set_write_combining(pass);
+        } else if (pass == 1) {
+            res->clear_us[1] = res->clear_us[0];
+            res->blit_us[1] = res->blit_us[0];
+            break;
+        }
+        res->clear_us[pass] = time_clear();
+        res->blit_us[pass] = time_blit(res->width, res->height);
+    }
+}
+
+/**
+ * Print a right-aligned unsigned number
+ */
+static void print_uint_pad(unsigned int n, int width) {
+    char buf[12];
+    int len = 0;
+
+    do {
+        buf[len++] = '0' + (n % 10);
+        n /= 10;
+    } while (n && len < 11);
+
+    while (width-- > len) {
+        putchar(' ');
+    }
+    while (len--) {
+        putchar(buf[len]);
+    }
+}
+
+/**
+ * Print one result line: label, both times and the speedup (x.yy)
+ */
+static void print_result(const char *mode, const char *label, const unsigned int us[2],
+                         int wc) {
+    print("  ");
+    print(mode);
+    putchar(' ');
+    print(label);
+    int pad = 12 - (int)strlen(mode) - (int)strlen(label);
+    while (pad-- > 0) {
+        putchar(' ');
+    }
+    print_uint_pad(us[0], 9);
+    print(" us ");
+
+    if (!wc) {
+        print("           -\n");
+        return;
+    }
+
+    print_uint_pad(us[1], 9);
+    print(" us   ");
+    unsigned int ratio = us[1] ? (us[0] * 100 + us[1] / 2) / us[1] : 0;
+    print_uint_pad(ratio / 100, 2);
+    putchar('.');
+    putchar('0' + (ratio / 10) % 10);
+    putchar('0' + ratio % 10);
+    print("x\n");
+}
+
+/* Program entry point */
+void _start(void) {
+    mode_result_t results[3] = {
+        { "13h", GFX_WIDTH_13H, GFX_HEIGHT_13H, { 0, 0 }, { 0, 0 } },
+        { "X",   GFX_WIDTH_X,   GFX_HEIGHT_X,   { 0, 0 }, { 0, 0 } },
+        { "Y",   GFX_WIDTH_Y,   GFX_HEIGHT_Y,   { 0, 0 }, { 0, 0 } },
+    };
+    unsigned int clear_12h[2];
+
+    /* Diagonal color bands */
+    for (int y = 0; y < GFX_HEIGHT_X; y++) {
+        for (int x = 0; x < GFX_WIDTH_X; x++) {
+            image[y * GFX_WIDTH_X + x] = (unsigned char)(x + y);
+        }
+    }
+
+    /* Probe by restoring the default; fails only without write-combining */
+    int wc = gfx_set_write_combining(1) == 0;
+
+    gfx_init();
+    clear_12h[0] = time_clear();
+    clear_12h[1] = clear_12h[0];
+
+    gfx_init_13h();
+    bench_mode(&results[0], wc);
+    gfx_init_x();
+    bench_mode(&results[1], wc);
+    gfx_init_y();
+    bench_mode(&results[2], wc);
+
+    gfx_set_write_combining(1);
+    gfx_exit();
+
+    print("Graphics benchmark (per-frame averages over ");
+    print_int(FRAMES);
+    println(" frames)");
+    if (!wc) {
+        print_warning("CPU has no PAT; write-combining unavailable\n");
+    }
+    newline();
+    println("  Operation         Default           WC  Speedup");
+
+    print_result("12h", "clear", clear_12h, 0);
+    for (int i = 0; i < 3; i++) {
+        print_result(results[i].name, "clear", results[i].clear_us, wc);
+        print_result(results[i].name, "blit", results[i].blit_us, wc);
+    }
+
+    exit(0);
+}
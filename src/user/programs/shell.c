@@ -8,7 +8,7 @@
  *   clear   - Clear the screen
  *   echo    - Print text
  *   beep    - Play a beep sound
- *   run     - Run a program
+ *   run     - Run a program (-v: show its startup profile)
  *   exit    - Exit shell (halt system)
  */
 
@@ -90,13 +90,21 @@ static void cmd_help(void) {
     setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
     print("- Show memory information\n");
     setcolor(COLOR_YELLOW, COLOR_BLACK);
+    print("  mount         ");
+    setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+    print("- Show mounted filesystems\n");
+    setcolor(COLOR_YELLOW, COLOR_BLACK);
     print("  pcidevs       ");
     setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
     print("- Show PCI devices\n");
     setcolor(COLOR_YELLOW, COLOR_BLACK);
+    print("  type <file>   ");
+    setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+    print("- Print the contents of a file\n");
+    setcolor(COLOR_YELLOW, COLOR_BLACK);
     print("  run <program> ");
     setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
-    print("- Run a program from /user/\n");
+    print("- Run a program from /user/ (-v: show startup profile)\n");
     setcolor(COLOR_YELLOW, COLOR_BLACK);
     print("  version       ");
     setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
@@ -104,11 +112,25 @@ static void cmd_help(void) {
     print("\n");
 }
 
+/**
+ * Join a directory path and an entry name
+ */
+static void join_path(char *dst, const char *dir, const char *name) {
+    strcpy(dst, dir);
+    int len = strlen(dst);
+    if (len == 0 || dst[len - 1] != '/') {
+        strcat(dst, "/");
+    }
+    strcat(dst, name);
+}
+
 /**
  * Built-in: ls
  */
 static void cmd_dir(const char *path) {
     char entry[256];
+    char full_path[CMD_MAX_LEN + 256];
+    stat_t st;
     int index = 0;
     int count = 0;
     
@@ -130,9 +152,24 @@ static void cmd_dir(const char *path) {
         
         /* Skip . and .. */
         if (strcmp(entry, ".") != 0 && strcmp(entry, "..") != 0) {
+            join_path(full_path, path, entry);
+            int has_stat = (stat(full_path, &st) == 0);
+            
             print("  ");
-            setcolor(COLOR_LIGHT_GREEN, COLOR_BLACK);
-            print(entry);
+            if (has_stat && st.type == FILE_TYPE_DIR) {
+                setcolor(COLOR_LIGHT_BLUE, COLOR_BLACK);
+                print(entry);
+                print("/");
+            } else {
+                setcolor(COLOR_LIGHT_GREEN, COLOR_BLACK);
+                print(entry);
+                if (has_stat) {
+                    setcolor(COLOR_DARK_GREY, COLOR_BLACK);
+                    print(" (");
+                    print_int(st.size);
+                    print(" bytes)");
+                }
+            }
             setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
             print("\n");
             count++;
@@ -164,8 +201,9 @@ static void cmd_curdir(void) {
  * Built-in: cd
  */
 static void cmd_cd(const char *path) {
-    char entry[256];
     char new_path[CMD_MAX_LEN];
+    char resolved[CMD_MAX_LEN];
+    stat_t st;
     
     if (!path || !*path) {
         /* cd with no args goes to root */
@@ -173,50 +211,67 @@ static void cmd_cd(const char *path) {
         return;
     }
     
-    /* Handle absolute vs relative paths */
+    /* Handle absolute vs relative paths ("." and ".." are resolved by the kernel) */
     if (path[0] == '/') {
-        /* Absolute path */
         strcpy(new_path, path);
-    } else if (strcmp(path, "..") == 0) {
-        /* Go up one directory */
-        strcpy(new_path, cwd);
-        /* Find last slash */
-        int len = strlen(new_path);
-        if (len > 1) {
-            /* Remove trailing slash if present */
-            if (new_path[len-1] == '/') {
-                new_path[len-1] = '\0';
-                len--;
-            }
-            /* Find previous slash */
-            while (len > 0 && new_path[len-1] != '/') {
-                len--;
-            }
-            if (len == 0) {
-                new_path[0] = '/';
-                len = 1;
-            }
-            new_path[len] = '\0';
-        }
     } else {
-        /* Relative path */
-        strcpy(new_path, cwd);
-        int len = strlen(new_path);
-        if (len > 1 || new_path[0] != '/') {
-            strcat(new_path, "/");
-        }
-        strcat(new_path, path);
+        join_path(new_path, cwd, path);
     }
     
-    /* Verify directory exists by trying to read it */
-    if (readdir(new_path, 0, entry) >= 0) {
-        strcpy(cwd, new_path);
+    /* Verify the directory exists */
+    if (realpath(new_path, resolved, CMD_MAX_LEN) == 0 &&
+        stat(resolved, &st) == 0 && st.type == FILE_TYPE_DIR) {
+        strcpy(cwd, resolved);
     } else {
         print_error("Directory not found: ");
         println(path);
     }
 }
 
+/**
+ * Built-in: type
+ * The kernel copies the file to the screen (sendfile), so no data
+ * passes through the shell.
+ */
+static void cmd_type(const char *path) {
+    char full_path[CMD_MAX_LEN];
+    
+    if (!path || !*path) {
+        print_error("Usage: type <file>\n");
+        return;
+    }
+    
+    if (path[0] == '/') {
+        strcpy(full_path, path);
+    } else {
+        join_path(full_path, cwd, path);
+    }
+    
+    int fd = fopen(full_path);
+    if (fd < 0) {
+        print_error("File not found: ");
+        println(path);
+        return;
+    }
+    
+    int size = fsize(fd);
+    int sent = sendfile(STDOUT, fd, SENDFILE_CUR, size);
+    
+    /* Keep the prompt on its own line */
+    char last = '\n';
+    if (sent > 0) {
+        pread(fd, &last, 1, sent - 1);
+    }
+    fclose(fd);
+    
+    if (sent < 0) {
+        print_error("Cannot read: ");
+        println(path);
+    } else if (last != '\n') {
+        newline();
+    }
+}
+
 /**
  * Built-in: clear
  */
@@ -567,17 +622,258 @@ static void cmd_mem(void) {
         print(" KB");
     }
     setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
-    print("\n\n");
+    print("\n");
+    
+    /* Memory left over by the fixed kernel areas, in 4KB frames */
+    print("  Free frames:   ");
+    setcolor(COLOR_WHITE, COLOR_BLACK);
+    print_int(info.frames_free);
+    print(" (");
+    print_int(info.frames_free * 4 / 1024);
+    print(" MB), ");
+    print_int(info.frames_used);
+    print(" in use\n\n");
+    setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+    
+    /* Kernel objects, by cache (only caches that were used) */
+    kmem_cache_info_t kmem;
+    setcolor(COLOR_LIGHT_CYAN, COLOR_BLACK);
+    print("Kernel Object Caches:\n");
+    print("---------------------\n");
+    for (int i = 0; get_kmem_cache_info(i, &kmem) == 0; i++) {
+        if (kmem.allocs == 0) {
+            continue;
+        }
+        
+        setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+        print("  ");
+        print(kmem.name);
+        int pad = 14 - (int)strlen(kmem.name);
+        while (pad-- > 0) {
+            putchar(' ');
+        }
+        
+        setcolor(COLOR_WHITE, COLOR_BLACK);
+        print_int(kmem.in_use);
+        print(" in use");
+        setcolor(COLOR_DARK_GREY, COLOR_BLACK);
+        print(" (peak ");
+        print_int(kmem.peak);
+        print("), ");
+        print_int(kmem.slabs * kmem.slab_size / 1024);
+        print(" KB");
+        if (kmem.failures > 0) {
+            print(", ");
+            print_int(kmem.failures);
+            print(" failed");
+        }
+        print("\n");
+    }
+    setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+    print("\n");
+    
+    /* Program images kept in memory for repeated runs */
+    imgcache_info_t cache;
+    if (get_imgcache_info(&cache) < 0) {
+        return;
+    }
+    
+    setcolor(COLOR_LIGHT_CYAN, COLOR_BLACK);
+    print("Program Image Cache:\n");
+    print("--------------------\n");
+    setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+    if (cache.bytes_total == 0) {
+        print("  Disabled (not enough memory)\n\n");
+        return;
+    }
+    
+    print("  Images:        ");
+    setcolor(COLOR_WHITE, COLOR_BLACK);
+    print_int(cache.images);
+    print(" (");
+    print_int(cache.bytes_used / 1024);
+    print(" of ");
+    print_int(cache.bytes_total / 1024);
+    print(" KB)\n");
+    setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+    print("  Loads:         ");
+    setcolor(COLOR_WHITE, COLOR_BLACK);
+    print_int(cache.hits);
+    print(" from cache, ");
+    print_int(cache.misses);
+    print(" from file\n");
+    
+    imgcache_image_t image;
+    for (int i = 0; get_imgcache_image(i, &image) == 0; i++) {
+        setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+        print("    ");
+        print(image.path);
+        setcolor(COLOR_DARK_GREY, COLOR_BLACK);
+        print("  ");
+        print_int(image.bytes / 1024);
+        print(" KB, ");
+        print_int(image.hits);
+        print(" hits\n");
+    }
+    setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+    print("\n");
+}
+
+/**
+ * Convert a block count to KB without overflowing
+ */
+static int blocks_to_kb(unsigned int blocks, unsigned int block_size) {
+    return (int)((blocks / 1024) * block_size + (blocks % 1024) * block_size / 1024);
+}
+
+/**
+ * Built-in: mount
+ */
+static void cmd_mount(void) {
+    mount_info_t info;
+    
+    print("\n");
+    setcolor(COLOR_LIGHT_CYAN, COLOR_BLACK);
+    print("Mounted Filesystems:\n");
+    print("--------------------\n");
+    
+    for (int i = 0; getmount(i, &info) == 0; i++) {
+        setcolor(COLOR_WHITE, COLOR_BLACK);
+        print("  ");
+        print(info.path);
+        int pad = 12 - (int)strlen(info.path);
+        while (pad-- > 0) {
+            putchar(' ');
+        }
+        
+        setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+        print(" ");
+        print(info.fstype);
+        pad = 10 - (int)strlen(info.fstype);
+        while (pad-- > 0) {
+            putchar(' ');
+        }
+        print(" drive ");
+        print_int(info.drive);
+        
+        if (!info.active) {
+            setcolor(COLOR_DARK_GREY, COLOR_BLACK);
+            print("  (mounted on first use)");
+        } else if (info.block_size) {
+            print("  ");
+            print_int(blocks_to_kb(info.blocks_free, info.block_size));
+            print(" KB free of ");
+            print_int(blocks_to_kb(info.blocks, info.block_size));
+            print(" KB");
+        }
+        print("\n");
+    }
+    
+    setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+    print("\n");
+}
+
+/**
+ * Print the startup profile of the program that finished last
+ */
+static void print_exec_profile(void) {
+    static const char *phase_names[EXEC_PHASES] = {
+        "Lookup", "Headers", "Placement", "Segments", "Pager", "Relocation", "Start"
+    };
+    exec_profile_t profile;
+    unsigned int total = 0;
+    
+    if (get_exec_profile(0, &profile) < 0) {
+        return;
+    }
+    
+    print("\n");
+    setcolor(COLOR_LIGHT_CYAN, COLOR_BLACK);
+    print("Startup profile of ");
+    println(profile.name);
+    setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+    
+    for (int i = 0; i < EXEC_PHASES; i++) {
+        print("  ");
+        print(phase_names[i]);
+        int pad = 12 - (int)strlen(phase_names[i]);
+        while (pad-- > 0) {
+            putchar(' ');
+        }
+        setcolor(COLOR_WHITE, COLOR_BLACK);
+        print_int(profile.phase_us[i]);
+        setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+        print(" us\n");
+        total += profile.phase_us[i];
+    }
+    
+    print("  Total       ");
+    setcolor(COLOR_WHITE, COLOR_BLACK);
+    print_int(total);
+    setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+    print(" us to the entry point\n");
+    
+    if (!(profile.flags & EXEC_PROFILE_RAN)) {
+        print("  Not started, error ");
+        print_int(profile.result);
+        print("\n\n");
+        return;
+    }
+    
+    print("  Run         ");
+    setcolor(COLOR_WHITE, COLOR_BLACK);
+    print_int(profile.run_us);
+    setcolor(COLOR_LIGHT_GREY, COLOR_BLACK);
+    print(" us, exit code ");
+    print_int(profile.result);
+    print("\n");
+    
+    print("  Image       0x");
+    print_hex(profile.load_addr);
+    print(", ");
+    print_int(profile.mem_size);
+    print(" bytes");
+    if (profile.flags & EXEC_PROFILE_CACHED) {
+        print(", cached");
+    }
+    if (profile.flags & EXEC_PROFILE_COMPRESSED) {
+        print(", compressed");
+    }
+    if (profile.flags & EXEC_PROFILE_PIE) {
+        print(", relocated");
+    }
+    print("\n");
+    
+    print("  Read        ");
+    print_int(profile.bytes_read);
+    print(" bytes loading, ");
+    print_int(profile.run_bytes_read);
+    print(" running (");
+    print_int(profile.run_pages);
+    print(" pages filled)\n");
+    
+    print("  Zeroed      ");
+    print_int(profile.bytes_zeroed);
+    print(" bytes of BSS loading\n\n");
 }
 
 /**
  * Built-in: run
  */
-static void cmd_run(const char *name) {
+static void cmd_run(const char *args) {
+    char name[CMD_MAX_LEN];
     char path[CMD_MAX_LEN];
+    stat_t st;
+    int verbose = 0;
     
-    if (!name || !*name) {
-        print_error("Usage: run <program>\n");
+    const char *rest = get_word(args, name, sizeof(name));
+    if (strcmp(name, "-v") == 0) {
+        verbose = 1;
+        get_word(rest, name, sizeof(name));
+    }
+    
+    if (!*name) {
+        print_error("Usage: run [-v] <program>\n");
         return;
     }
     
@@ -585,10 +881,19 @@ static void cmd_run(const char *name) {
     strcpy(path, "/user/");
     strcat(path, name);
     
-    /* Try to execute */
-    if (exec(path) < 0) {
+    /* Check the program exists before handing it to the loader */
+    if (stat(path, &st) < 0 || st.type != FILE_TYPE_FILE) {
         print_error("Program not found: ");
         println(name);
+        return;
+    }
+    
+    /* Runs the program and returns here; the loader reports errors and
+     * the exit code */
+    exec(path);
+    
+    if (verbose) {
+        print_exec_profile();
     }
 }
 
@@ -646,6 +951,12 @@ static void process_command(char *line) {
     else if (strcmp(cmd, "mem") == 0 || strcmp(cmd, "memory") == 0) {
         cmd_mem();
     }
+    else if (strcmp(cmd, "type") == 0) {
+        cmd_type(rest);
+    }
+    else if (strcmp(cmd, "mount") == 0) {
+        cmd_mount();
+    }
     else if (strcmp(cmd, "run") == 0) {
         cmd_run(rest);
     }
@@ -664,6 +975,13 @@ static void process_command(char *line) {
  * Shell entry point
  */
 void _start(void) {
+#ifdef USER_RUNTIME
+    /* Every library call below goes through the runtime's jump table */
+    if (!runtime_check()) {
+        exit(1);
+    }
+#endif
+    
     /* Print welcome shell banner */
     clear();
     print("\n");
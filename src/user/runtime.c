@@ -0,0 +1,62 @@
+/**
+ * Shared Runtime
+ * Library functions shared by all user programs
+ *
+ * Built as its own image (linked with runtime.ld) from the same header
+ * definitions the programs would otherwise inline. The kernel loads it
+ * once at boot; the jump table at its start is all programs see of it.
+ * The runtime has no data of its own: a suspended program and its child
+ * call into the same copy.
+ */
+
+#include <io.h>
+#include <runtime.h>
+#include <string.h>
+#include <utils.h>
+
+const runtime_table_t runtime_table __attribute__((section(".runtime_table"), used)) = {
+    .magic = RUNTIME_MAGIC,
+    .count = RUNTIME_ENTRIES,
+
+    .strlen = strlen,
+    .strcmp = strcmp,
+    .strncmp = strncmp,
+    .strcpy = strcpy,
+    .strncpy = strncpy,
+    .strcat = strcat,
+    .strncat = strncat,
+    .strchr = strchr,
+    .strrchr = strrchr,
+    .memset = memset,
+    .memcpy = memcpy,
+    .memmove = memmove,
+    .memcmp = memcmp,
+    .strstr = strstr,
+    .strspn = strspn,
+    .strcspn = strcspn,
+
+    .print = print,
+    .print_color = print_color,
+    .print_int = print_int,
+    .print_hex = print_hex,
+    .print_hex_nibble = print_hex_nibble,
+    .print_hex16 = print_hex16,
+    .print_hex8 = print_hex8,
+    .println = println,
+    .print_error = print_error,
+    .print_success = print_success,
+    .print_warning = print_warning,
+    .print_info = print_info,
+    .read_file = read_file,
+
+    .hex_char_value = hex_char_value,
+    .match_hex4 = match_hex4,
+    .skip_whitespace = skip_whitespace,
+    .str_tolower = str_tolower,
+    .str_toupper = str_toupper,
+    .atoi = atoi,
+    .get_word = get_word,
+    .itoa = itoa,
+    .utoa = utoa,
+    .parse_int = parse_int,
+};
@@ -0,0 +1,57 @@
+#!/bin/sh
+# Generate a directory tree for filesystem benchmark images
+#
+# Usage: mkbenchtree.sh <dir> <files> <depth> <namelen>
+#
+# Creates under <dir>/bench:
+#   wide/  - <files> small files with short names (f00000.txt ...)
+#   long/  - <files> files whose names are padded to <namelen> characters
+#            (only visible as long names with Rock Ridge or Joliet)
+#   deep/  - a chain of <depth> nested directories ending in leaf.txt
+#
+# The tree is read by the fsbench user program.
+
+set -e
+
+if [ $# -ne 4 ]; then
+    echo "Usage: $0 <dir> <files> <depth> <namelen>" >&2
+    exit 1
+fi
+
+DIR=$1
+FILES=$2
+DEPTH=$3
+NAMELEN=$4
+
+BENCH=$DIR/bench
+rm -rf "$BENCH"
+mkdir -p "$BENCH/wide" "$BENCH/long" "$BENCH/deep"
+
+# Many files per directory
+i=0
+while [ $i -lt "$FILES" ]; do
+    name=$(printf 'f%05d.txt' $i)
+    echo "$name" > "$BENCH/wide/$name"
+    i=$((i + 1))
+done
+
+# Long names (Joliet allows at most 64 characters, Rock Ridge 255)
+pad=$(printf '%*s' "$NAMELEN" '' | tr ' ' 'x')
+i=0
+while [ $i -lt "$FILES" ]; do
+    name=$(printf 'long%05d_%s' $i "$pad" | cut -c1-"$NAMELEN")
+    echo "$name" > "$BENCH/long/$name"
+    i=$((i + 1))
+done
+
+# Deep nesting
+path=$BENCH/deep
+i=1
+while [ $i -le "$DEPTH" ]; do
+    path=$path/$(printf 'd%02d' $i)
+    i=$((i + 1))
+done
+mkdir -p "$path"
+echo "leaf" > "$path/leaf.txt"
+
+echo "Benchmark tree: $FILES files, depth $DEPTH, name length $NAMELEN"
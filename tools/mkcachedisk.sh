@@ -0,0 +1,47 @@
+#!/bin/sh
+# Create a disk image with a cachefs partition
+#
+# Usage: mkcachedisk.sh <image> <size-mb>
+#
+# Writes an MBR with a single partition of type 0xDA starting at sector
+# 2048 and covering the rest of the image. The kernel formats the
+# partition on first boot and keeps CD-ROM file pages in it (see
+# src/drivers/cachefs.c). Attach the image as an ATA disk, e.g. with
+# "qemu-system-i386 -hda <image>".
+
+set -e
+
+if [ $# -ne 2 ]; then
+    echo "Usage: $0 <image> <size-mb>" >&2
+    exit 1
+fi
+
+IMAGE=$1
+SIZE_MB=$2
+
+START=2048
+TOTAL=$((SIZE_MB * 2048))
+if [ "$TOTAL" -le "$START" ]; then
+    echo "Image must be larger than 1 MB" >&2
+    exit 1
+fi
+COUNT=$((TOTAL - START))
+
+# Print a 32-bit value as little-endian octal escapes for printf
+le32() {
+    printf '\\%03o\\%03o\\%03o\\%03o' \
+        $(($1 & 255)) $((($1 >> 8) & 255)) $((($1 >> 16) & 255)) $((($1 >> 24) & 255))
+}
+
+rm -f "$IMAGE"
+dd if=/dev/zero of="$IMAGE" bs=1M count=0 seek="$SIZE_MB" 2>/dev/null
+
+# Partition entry 1: status, CHS first (unused), type, CHS last (unused),
+# first LBA, sector count
+printf "\\000\\377\\377\\377\\332\\377\\377\\377$(le32 $START)$(le32 $COUNT)" |
+    dd of="$IMAGE" bs=1 seek=446 conv=notrunc 2>/dev/null
+
+# Boot signature
+printf '\125\252' | dd of="$IMAGE" bs=1 seek=510 conv=notrunc 2>/dev/null
+
+echo "Cache disk created: $IMAGE ($SIZE_MB MB)"
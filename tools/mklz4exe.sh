@@ -0,0 +1,88 @@
+#!/bin/sh
+# Pack a linked user program into a compressed executable
+#
+# Usage: mklz4exe.sh <elf> <output>
+#
+# The output holds a 16-byte header (magic "E93Z", entry point, segment
+# count, dynamic section address or 0), one 24-byte entry per PT_LOAD segment (address, file
+# bytes, memory bytes, flags, frame offset, frame bytes) and then one LZ4
+# frame per segment with its file bytes. The kernel loader decodes each
+# frame straight to the segment address (see src/kernel/loader.c); for a
+# position-independent program it then applies the relocations listed in
+# the dynamic section.
+# Needs readelf (binutils) and the lz4 command line tool.
+
+set -e
+
+if [ $# -ne 2 ]; then
+    echo "Usage: $0 <elf> <output>" >&2
+    exit 1
+fi
+
+ELF=$1
+OUT=$2
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+HEADER_SIZE=16
+ENTRY_SIZE=24
+
+# Print a 32-bit value as little-endian octal escapes for printf
+le32() {
+    printf '\\%03o\\%03o\\%03o\\%03o' \
+        $(($1 & 255)) $((($1 >> 8) & 255)) $((($1 >> 16) & 255)) $((($1 >> 24) & 255))
+}
+
+ENTRY=$(readelf -hW "$ELF" | awk '/Entry point address:/ { print $4 }')
+DYNAMIC=$(readelf -lW "$ELF" | awk '$1 == "DYNAMIC" { print $3 }')
+
+# Offset, address, file bytes, memory bytes and PF_* flags of each PT_LOAD
+readelf -lW "$ELF" | awk '$1 == "LOAD" {
+    flags = 0
+    for (i = 7; i < NF; i++) {
+        if ($i ~ /R/) flags += 4
+        if ($i ~ /W/) flags += 2
+        if ($i ~ /E/) flags += 1
+    }
+    print $2, $3, $5, $6, flags
+}' > "$TMP/segments"
+
+COUNT=$(wc -l < "$TMP/segments")
+if [ "$COUNT" -eq 0 ]; then
+    echo "$ELF: no loadable segments" >&2
+    exit 1
+fi
+
+# Compress the file bytes of every segment; content checksums are left
+# out, the loader does not verify them
+n=0
+while read -r offset vaddr filesz memsz flags; do
+    : > "$TMP/frame$n"
+    if [ $((filesz)) -gt 0 ]; then
+        dd if="$ELF" bs=4096 iflag=skip_bytes,count_bytes skip=$((offset)) count=$((filesz)) \
+            2>/dev/null > "$TMP/data$n"
+        lz4 -q -9 -f --no-frame-crc "$TMP/data$n" "$TMP/frame$n"
+    fi
+    n=$((n + 1))
+done < "$TMP/segments"
+
+printf "$(le32 0x5A333945)$(le32 $((ENTRY)))$(le32 $COUNT)$(le32 $((${DYNAMIC:-0})))" > "$TMP/out"
+
+n=0
+pos=$((HEADER_SIZE + COUNT * ENTRY_SIZE))
+while read -r offset vaddr filesz memsz flags; do
+    size=$(wc -c < "$TMP/frame$n")
+    printf "$(le32 $((vaddr)))$(le32 $((filesz)))$(le32 $((memsz)))$(le32 $flags)" >> "$TMP/out"
+    printf "$(le32 $pos)$(le32 $size)" >> "$TMP/out"
+    pos=$((pos + size))
+    n=$((n + 1))
+done < "$TMP/segments"
+
+n=0
+while [ $n -lt "$COUNT" ]; do
+    cat "$TMP/frame$n" >> "$TMP/out"
+    n=$((n + 1))
+done
+
+mv "$TMP/out" "$OUT"
+echo "Compressed program built: $OUT ($(wc -c < "$ELF") -> $(wc -c < "$OUT") bytes)"